@@ -0,0 +1,1290 @@
+// MiniGit micro-benchmarks.
+// Build: cmake -S . -B build && cmake --build build --target minigit-bench
+// Run:   ./build/minigit-bench [hash|pack|graph|parse|checkout|merge|diff|log|fsync|fast-import|io|chunk|bitmap|fsck|transfer|fsmonitor|sparse]
+#include "bench_common.h"
+#include "fast_import.h"
+#include "fsck.h"
+#include "fsmonitor.h"
+#include "transfer.h"
+
+#include <random>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Global allocation counter, so benchmarks can report allocations per operation.
+// GCC cannot see that new and delete below are a matched malloc/free pair.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static std::atomic<size_t> allocation_count{0};
+
+void* operator new(size_t size) {
+    allocation_count++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Measure SHA-256 throughput of every backend supported by this CPU
+void bench_hash() {
+    const size_t size = size_t(256) << 20;
+    std::vector<uint8_t> data(size);
+    uint32_t x = 2463534242u;
+    for (auto& b : data) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        b = uint8_t(x);
+    }
+    const std::pair<HashBackend, const char*> backends[] = {
+        {HashBackend::Scalar, "scalar"},
+        {HashBackend::ShaNi, "sha-ni"},
+    };
+    std::string reference;
+    for (const auto& backend : backends) {
+        if (!sha256_backend(backend.first)) {
+            std::cout << std::left << std::setw(8) << backend.second << " unsupported on this CPU\n";
+            continue;
+        }
+        double best = 0;
+        std::string digest;
+        for (int run = 0; run < 3; run++) {
+            auto start = bench_clock::now();
+            Sha256 hasher(backend.first);
+            for (size_t off = 0; off < size; off += IO_BUFFER_SIZE) {
+                hasher.update(data.data() + off, std::min(IO_BUFFER_SIZE, size - off));
+            }
+            digest = hash_to_string(hasher.finish());
+            std::chrono::duration<double> elapsed = bench_clock::now() - start;
+            best = std::max(best, size / elapsed.count() / 1e9);
+        }
+        if (reference.empty()) reference = digest;
+        std::cout << std::left << std::setw(8) << backend.second << std::fixed << std::setprecision(2)
+                  << best << " GB/s" << (digest == reference ? "" : "  DIGEST MISMATCH") << "\n";
+    }
+}
+
+// Pack a synthetic history of small edits to text files, then read every object back
+void bench_pack() {
+    in_scratch_repo("pack", [] {
+        const int files = 40, lines = 400, commits = 120, edits = 3;
+        std::mt19937 rng(42);
+        std::vector<std::vector<std::string>> contents(files);
+        auto write_file = [&](int f) {
+            std::ofstream out("file" + std::to_string(f) + ".txt");
+            for (const auto& line : contents[f]) out << line << "\n";
+        };
+        for (int f = 0; f < files; f++) {
+            for (int l = 0; l < lines; l++) {
+                contents[f].push_back("line " + std::to_string(l) + " of file " + std::to_string(f) +
+                                      " value " + std::to_string(rng()));
+            }
+            write_file(f);
+        }
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("initial");
+            for (int c = 0; c < commits; c++) {
+                std::vector<std::string> changed;
+                for (int e = 0; e < edits; e++) {
+                    int f = rng() % files;
+                    contents[f][rng() % lines] = "edited in commit " + std::to_string(c) + " " + std::to_string(rng());
+                    write_file(f);
+                    changed.push_back("file" + std::to_string(f) + ".txt");
+                }
+                add(changed);
+                commit("commit " + std::to_string(c));
+            }
+        }
+        uint64_t loose_bytes = 0;
+        std::vector<std::string> ids;
+        for (const auto& entry : fs::directory_iterator(".minigit/objects")) {
+            if (!entry.is_regular_file()) continue;
+            loose_bytes += entry.file_size();
+            ids.push_back(entry.path().filename().string());
+        }
+        auto start = bench_clock::now();
+        {
+            QuietStdout quiet;
+            gc();
+        }
+        std::chrono::duration<double> pack_time = bench_clock::now() - start;
+        uint64_t pack_bytes = 0;
+        for (const auto& entry : fs::directory_iterator(PACK_DIR)) pack_bytes += entry.file_size();
+
+        start = bench_clock::now();
+        uint64_t read_bytes = 0;
+        size_t corrupt = 0;
+        std::string content;
+        for (const std::string& id : ids) {
+            if (!read_object(id, content)) corrupt++;
+            read_bytes += content.size();
+        }
+        std::chrono::duration<double> unpack_time = bench_clock::now() - start;
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "pack     " << ids.size() << " objects, " << loose_bytes << " -> " << pack_bytes
+                  << " bytes (ratio " << double(loose_bytes) / pack_bytes << "x)\n";
+        std::cout << "pack     " << loose_bytes / pack_time.count() / 1e6 << " MB/s\n";
+        std::cout << "unpack   " << read_bytes / unpack_time.count() / 1e6 << " MB/s\n";
+        for (const std::string& id : ids) {
+            if (read_object(id, content) && hash_content(content) != id) corrupt++;
+        }
+        if (corrupt) std::cout << "pack     " << corrupt << " objects failed to round-trip\n";
+    });
+}
+
+// Old-style ancestry check: breadth-first search with a set, no generation pruning
+bool naive_is_ancestor(const CommitGraph& graph, uint32_t a, uint32_t d) {
+    std::unordered_set<uint32_t> visited;
+    std::queue<uint32_t> queue;
+    queue.push(d);
+    std::vector<uint32_t> parents;
+    while (!queue.empty()) {
+        uint32_t pos = queue.front();
+        queue.pop();
+        if (pos == a) return true;
+        if (!visited.insert(pos).second) continue;
+        graph.parents(pos, parents);
+        for (uint32_t p : parents) queue.push(p);
+    }
+    return false;
+}
+
+// Ancestry and merge-base queries on a synthetic 1M-commit DAG: eight lines of development
+// that regularly merge each other
+void bench_graph() {
+    in_scratch_repo("graph", [] {
+        const uint32_t commits = 1000000, lines = 8;
+        std::mt19937 rng(7);
+        std::vector<GraphEntry> entries(commits);
+        std::vector<uint32_t> generation(commits);
+        auto id_of = [](uint32_t i) {
+            Sha256 hasher;
+            hasher.update(&i, sizeof(i));
+            return hasher.finish();
+        };
+        for (uint32_t i = 0; i < commits; i++) {
+            GraphEntry& e = entries[i];
+            e.id = id_of(i);
+            e.date = 1700000000 + i;
+            std::vector<uint32_t> parents;
+            if (i >= lines) parents.push_back(i - lines);
+            if (i >= 64 && rng() % 16 == 0) parents.push_back(i - 1 - rng() % 64);
+            uint32_t gen = 1;
+            for (uint32_t p : parents) {
+                e.parents.push_back(entries[p].id);
+                gen = std::max(gen, generation[p] + 1);
+            }
+            generation[i] = e.generation = gen;
+        }
+        std::vector<ObjectId> ids(commits);
+        for (uint32_t i = 0; i < commits; i++) ids[i] = entries[i].id;
+
+        auto start = bench_clock::now();
+        append_commit_graph(std::move(entries));
+        std::chrono::duration<double> write_time = bench_clock::now() - start;
+        // The first open right after writing also pays for the freshly written pages
+        start = bench_clock::now();
+        CommitGraph graph;
+        graph.load();
+        std::chrono::duration<double> first_load_time = bench_clock::now() - start;
+        start = bench_clock::now();
+        graph.load();
+        std::chrono::duration<double> load_time = bench_clock::now() - start;
+        auto pos_of = [&](uint32_t i) {
+            uint32_t pos = 0;
+            graph.find(ids[i].data(), pos);
+            return pos;
+        };
+
+        const int queries = 200;
+        auto time_queries = [&](const char* label, uint32_t depth, auto query) {
+            std::mt19937 qrng(11);
+            size_t hits = 0;
+            auto begin = bench_clock::now();
+            for (int q = 0; q < queries; q++) {
+                uint32_t d = commits - 1 - qrng() % 1000;
+                uint32_t a = d - 1 - qrng() % depth;
+                hits += query(pos_of(a), pos_of(d));
+            }
+            std::chrono::duration<double> elapsed = bench_clock::now() - begin;
+            std::cout << std::left << std::setw(38) << label << std::fixed << std::setprecision(1)
+                      << elapsed.count() / queries * 1e6 << " us/query (" << hits << "/" << queries << " true)\n";
+        };
+        std::cout << "graph    " << commits << " commits written in " << std::fixed << std::setprecision(2)
+                  << write_time.count() << " s, loaded in " << std::setprecision(3) << load_time.count() * 1e3
+                  << " ms (first open after write " << first_load_time.count() * 1e3 << " ms)\n";
+        for (uint32_t depth : {1000u, 100000u}) {
+            std::string suffix = " depth<=" + std::to_string(depth);
+            time_queries(("is_ancestor generation" + suffix).c_str(), depth,
+                         [&](uint32_t a, uint32_t d) { return graph_is_ancestor(graph, a, d); });
+            time_queries(("is_ancestor naive BFS" + suffix).c_str(), depth,
+                         [&](uint32_t a, uint32_t d) { return naive_is_ancestor(graph, a, d); });
+            time_queries(("merge_base" + suffix).c_str(), depth,
+                         [&](uint32_t a, uint32_t d) { return !graph_merge_bases(graph, a, d).empty(); });
+        }
+    });
+}
+
+// The commit parser as it was before zero-copy parsing: ifstream, getline, substr and a map
+struct LegacyCommit {
+    std::vector<std::string> parents;
+    std::string timestamp;
+    std::string message;
+    std::map<std::string, std::string> files;
+};
+
+LegacyCommit legacy_load_commit(const std::string& commit_hash) {
+    std::ifstream commit_file(loose_object_path(commit_hash));
+    LegacyCommit commit;
+    std::string line;
+    while (std::getline(commit_file, line)) {
+        if (line.substr(0, 7) == "parent ") {
+            commit.parents.push_back(line.substr(7));
+        } else if (line.substr(0, 10) == "timestamp ") {
+            commit.timestamp = line.substr(10);
+        } else if (line.substr(0, 8) == "message ") {
+            commit.message = line.substr(8);
+        } else {
+            size_t pos = line.find(':');
+            if (pos != std::string::npos) {
+                commit.files[line.substr(0, pos)] = line.substr(pos + 1);
+            }
+        }
+    }
+    return commit;
+}
+
+// Commit parse time and allocations: legacy parser vs zero-copy parser, cold and cached
+void bench_parse() {
+    in_scratch_repo("parse", [] {
+        CommandScope scope;
+        const int files = 10000, runs = 50;
+        Commit commit;
+        commit.parents.push_back(intern(NULL_COMMIT));
+        commit.timestamp = intern(get_current_timestamp());
+        commit.message = intern("synthetic");
+        std::map<std::string, std::string> file_map;
+        for (int i = 0; i < files; i++) {
+            file_map["src/module" + std::to_string(i % 97) + "/file" + std::to_string(i) + ".cpp"] =
+                hash_content(std::to_string(i));
+        }
+        commit.files = make_file_list(file_map);
+        std::string content = serialize_commit(commit);
+        std::string hash = hash_content(content);
+        std::ofstream(loose_object_path(hash), std::ios::binary) << content;
+
+        auto measure = [&](const char* label, auto body) {
+            size_t allocations = allocation_count.load();
+            auto start = bench_clock::now();
+            for (int r = 0; r < runs; r++) body();
+            std::chrono::duration<double> elapsed = bench_clock::now() - start;
+            size_t count = allocation_count.load() - allocations;
+            std::cout << std::left << std::setw(28) << label << std::fixed << std::setprecision(1)
+                      << elapsed.count() / runs * 1e6 << " us/parse, " << count / runs << " allocations/parse\n";
+        };
+        std::cout << "parse    commit with " << files << " files, " << content.size() << " bytes\n";
+        measure("parse legacy (map)", [&] { legacy_load_commit(hash); });
+        load_commit(hash); // first parse interns every path and hash once
+        measure("parse zero-copy (cold)", [&] {
+            commit_cache().clear();
+            load_commit(hash);
+        });
+        measure("parse zero-copy (cached)", [&] { load_commit(hash); });
+    });
+}
+
+// Switch between two branches of a large tree that differ in one file, against the old
+// strategy of deleting the working tree and rewriting every file from the object store
+void bench_checkout() {
+    in_scratch_repo("checkout", [] {
+        const int dirs = 100, files_per_dir = 200, runs = 5;
+        std::string body(4096, 'x');
+        for (int d = 0; d < dirs; d++) {
+            fs::create_directories("src/d" + std::to_string(d));
+            for (int f = 0; f < files_per_dir; f++) {
+                std::ofstream("src/d" + std::to_string(d) + "/f" + std::to_string(f) + ".txt") << d << " " << f << body;
+            }
+        }
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("initial");
+            branch("dev");
+            checkout("dev", "");
+            std::ofstream("src/d0/f0.txt") << "changed";
+            add({"src/d0/f0.txt"});
+            commit("one change");
+        }
+        auto files = commit_files(load_commit(ref_tips()[0]));
+        std::cout << "checkout " << files->size() << " files of " << body.size() << " bytes\n";
+
+        auto start = bench_clock::now();
+        for (int r = 0; r < runs; r++) {
+            QuietStdout quiet;
+            checkout(r % 2 ? "dev" : "master", "");
+        }
+        std::chrono::duration<double> incremental = bench_clock::now() - start;
+
+        start = bench_clock::now();
+        for (int r = 0; r < runs; r++) {
+            fs::remove_all("src");
+            for (const FileEntry& entry : *files) {
+                std::string content;
+                read_object(std::string(entry.hash), content);
+                fs::path path(std::string(entry.path));
+                fs::create_directories(path.parent_path());
+                std::ofstream(path, std::ios::binary) << content;
+            }
+        }
+        std::chrono::duration<double> rewrite = bench_clock::now() - start;
+
+        start = bench_clock::now();
+        {
+            QuietStdout quiet;
+            fs::remove_all("src");
+            checkout("master", "");
+        }
+        std::chrono::duration<double> full = bench_clock::now() - start;
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "checkout branch switch (1 file differs)  " << incremental.count() / runs * 1e3 << " ms\n"
+                  << "checkout full rewrite (old strategy)     " << rewrite.count() / runs * 1e3 << " ms\n"
+                  << "checkout into empty working tree         " << full.count() * 1e3 << " ms\n";
+    });
+}
+
+// Build base/ours/theirs versions of a text with edits on both sides at disjoint lines
+void make_merge_inputs(size_t lines, size_t edits, uint32_t seed, std::string& base, std::string& ours,
+                       std::string& theirs) {
+    std::mt19937 rng(seed);
+    std::vector<std::string> text(lines);
+    for (size_t i = 0; i < lines; i++) text[i] = "    value_" + std::to_string(i) + " = compute(" + std::to_string(rng()) + ");\n";
+    auto ours_text = text, theirs_text = text;
+    for (size_t e = 0; e < edits; e++) {
+        size_t region = lines / edits;
+        ours_text[e * region] = "    // ours " + std::to_string(rng()) + "\n";
+        theirs_text[e * region + region / 2] = "    // theirs " + std::to_string(rng()) + "\n";
+    }
+    base.clear();
+    ours.clear();
+    theirs.clear();
+    for (size_t i = 0; i < lines; i++) {
+        base += text[i];
+        ours += ours_text[i];
+        theirs += theirs_text[i];
+    }
+}
+
+// Line tokenizing, diff and three-way merge on large files with many hunks, and many
+// files merged serially vs on the thread pool
+void bench_merge() {
+    const size_t lines = 200000, edits = 2000;
+    std::string base, ours, theirs, out;
+    make_merge_inputs(lines, edits, 7, base, ours, theirs);
+    std::cout << "merge    " << lines << " lines, " << edits << " edits per side, " << base.size() / 1e6 << " MB\n";
+
+    const int runs = 10;
+    std::vector<std::string_view> lines_out;
+    std::vector<uint64_t> hashes;
+    auto start = bench_clock::now();
+    for (int r = 0; r < runs; r++) {
+        lines_out.clear();
+        hashes.clear();
+        split_lines(base, lines_out, hashes);
+    }
+    std::chrono::duration<double> split = bench_clock::now() - start;
+    start = bench_clock::now();
+    for (int r = 0; r < runs; r++) {
+        lines_out.clear();
+        hashes.clear();
+        size_t begin = 0;
+        for (size_t pos = 0; pos < base.size(); pos++) {
+            if (base[pos] == '\n') {
+                lines_out.emplace_back(base.data() + begin, pos + 1 - begin);
+                hashes.push_back(std::hash<std::string_view>()(lines_out.back()));
+                begin = pos + 1;
+            }
+        }
+    }
+    std::chrono::duration<double> naive = bench_clock::now() - start;
+    std::cout << std::fixed << std::setprecision(2)
+              << "merge split+hash lines        " << base.size() * runs / split.count() / 1e9 << " GB/s\n"
+              << "merge bytewise split+std::hash " << base.size() * runs / naive.count() / 1e9 << " GB/s\n";
+
+    LineTable table;
+    std::vector<std::string_view> base_lines, ours_lines;
+    auto base_tokens = table.tokenize(base, base_lines);
+    auto ours_tokens = table.tokenize(ours, ours_lines);
+    start = bench_clock::now();
+    size_t hunks = 0;
+    for (int r = 0; r < runs; r++) hunks = diff_tokens(base_tokens, ours_tokens).size();
+    std::chrono::duration<double> diff = bench_clock::now() - start;
+    start = bench_clock::now();
+    size_t conflicts = 0;
+    for (int r = 0; r < runs; r++) conflicts = merge_texts(base, ours, theirs, "HEAD", "dev", out);
+    std::chrono::duration<double> merge3 = bench_clock::now() - start;
+    std::cout << "merge diff (" << hunks << " hunks)         " << diff.count() / runs * 1e3 << " ms\n"
+              << "merge three-way (" << conflicts << " conflicts)  " << merge3.count() / runs * 1e3 << " ms\n";
+
+    const size_t files = 64;
+    std::vector<std::array<std::string, 3>> inputs(files);
+    for (size_t f = 0; f < files; f++) make_merge_inputs(20000, 200, 100 + f, inputs[f][0], inputs[f][1], inputs[f][2]);
+    start = bench_clock::now();
+    for (auto& input : inputs) merge_texts(input[0], input[1], input[2], "HEAD", "dev", out);
+    std::chrono::duration<double> serial = bench_clock::now() - start;
+    start = bench_clock::now();
+    {
+        ThreadPool pool;
+        for (auto& input : inputs) {
+            pool.submit([&input] {
+                std::string merged;
+                merge_texts(input[0], input[1], input[2], "HEAD", "dev", merged);
+            });
+        }
+        pool.wait();
+    }
+    std::chrono::duration<double> parallel = bench_clock::now() - start;
+    std::cout << "merge " << files << " files serial          " << serial.count() * 1e3 << " ms\n"
+              << "merge " << files << " files thread pool     " << parallel.count() * 1e3 << " ms\n";
+}
+
+// diff between commits of a 10,000-file tree, with a varying number of edited files
+void bench_diff() {
+    in_scratch_repo("diff", [] {
+        const int dirs = 100, files_per_dir = 100, lines = 200;
+        auto file_name = [](int n) { return "src/d" + std::to_string(n / 100) + "/f" + std::to_string(n % 100) + ".c"; };
+        std::mt19937 rng(5);
+        for (int d = 0; d < dirs; d++) fs::create_directories("src/d" + std::to_string(d));
+        for (int n = 0; n < dirs * files_per_dir; n++) {
+            std::ofstream out(file_name(n));
+            for (int l = 0; l < lines; l++) out << "line " << l << " of file " << n << "\n";
+        }
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("base");
+        }
+        std::cout << "diff     " << dirs * files_per_dir << " files of " << lines << " lines\n";
+        int edited_so_far = 0;
+        for (int changed : {10, 100, 1000}) {
+            std::vector<std::string> paths;
+            for (int k = 0; k < changed; k++) {
+                int n = (edited_so_far + k) * 7 % (dirs * files_per_dir);
+                std::ofstream out(file_name(n));
+                for (int l = 0; l < lines; l++) out << (l % 50 == 0 ? "edited " : "line ") << l << " of file " << n << "\n";
+                paths.push_back(file_name(n));
+            }
+            edited_so_far += changed;
+            std::string before = resolve_revision("HEAD");
+            {
+                QuietStdout quiet;
+                add(paths);
+                commit("edit " + std::to_string(changed));
+            }
+            std::string after = resolve_revision("HEAD");
+            const int runs = 5;
+            size_t bytes = 0;
+            auto start = bench_clock::now();
+            for (int r = 0; r < runs; r++) {
+                QuietStdout quiet;
+                CommandScope scope;
+                diff({before, after});
+                bytes = quiet.sink.str().size();
+            }
+            std::chrono::duration<double> elapsed = bench_clock::now() - start;
+            std::cout << std::fixed << std::setprecision(1) << "diff " << std::setw(5) << changed << " changed files  "
+                      << elapsed.count() / runs * 1e3 << " ms, " << elapsed.count() / runs / changed * 1e6
+                      << " us per changed file, " << bytes << " bytes of output\n";
+        }
+    });
+}
+
+// Path-limited log over a long history, with and without changed-path Bloom filters
+void bench_log() {
+    in_scratch_repo("log", [] {
+        const int dirs = 20, files_per_dir = 50, commits = 2000, runs = 5;
+        auto file_name = [](int n) { return "d" + std::to_string(n / 50) + "/f" + std::to_string(n % 50) + ".txt"; };
+        std::mt19937 rng(11);
+        for (int d = 0; d < dirs; d++) fs::create_directories("d" + std::to_string(d));
+        for (int n = 0; n < dirs * files_per_dir; n++) std::ofstream(file_name(n)) << "file " << n << "\n";
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("base");
+            for (int c = 0; c < commits; c++) {
+                int n = int(rng() % (dirs * files_per_dir));
+                std::ofstream(file_name(n), std::ios::app) << "edit " << c << "\n";
+                add({file_name(n)});
+                commit("edit " + std::to_string(c));
+            }
+        }
+        std::cout << "log      " << commits + 1 << " commits over " << dirs * files_per_dir << " files\n";
+        LogOptions options;
+        options.paths = {file_name(123)};
+        std::string expected;
+        for (bool bloom : {false, true}) {
+            options.use_bloom = bloom;
+            std::string output;
+            auto start = bench_clock::now();
+            for (int r = 0; r < runs; r++) {
+                QuietStdout quiet;
+                CommandScope scope;
+                log(options);
+                output = quiet.sink.str();
+            }
+            std::chrono::duration<double> elapsed = bench_clock::now() - start;
+            if (!bloom) expected = output;
+            size_t shown = 0;
+            for (size_t at = output.find("Commit "); at != std::string::npos; at = output.find("Commit ", at + 1)) shown++;
+            std::cout << std::fixed << std::setprecision(1) << "log -- <path>  " << (bloom ? "bloom    " : "no bloom ")
+                      << elapsed.count() / runs * 1e3 << " ms, " << shown << " commits shown"
+                      << (output == expected ? "" : "  MISMATCH") << "\n";
+        }
+    });
+}
+
+// Cost of durability: adding a tree of new files and making small commits with each fsync
+// mode, against MINIGIT_FSYNC=off (atomic renames only, nothing forced to disk)
+void bench_fsync() {
+    const std::pair<FsyncMode, const char*> modes[] = {
+        {FsyncMode::Off, "off"},
+        {FsyncMode::Batch, "batch"},
+        {FsyncMode::Full, "full"},
+    };
+    FsyncMode saved = fsync_mode();
+    double off_add = 0, off_commit = 0;
+    for (const auto& [mode, name] : modes) {
+        in_scratch_repo(std::string("fsync-") + name, [&, mode = mode, name = name] {
+            const int dirs = 10, files_per_dir = 100, commits = 50, edits = 3;
+            auto file_name = [](int n) { return "d" + std::to_string(n / 100) + "/f" + std::to_string(n % 100) + ".txt"; };
+            std::mt19937 rng(3);
+            for (int d = 0; d < dirs; d++) fs::create_directories("d" + std::to_string(d));
+            for (int n = 0; n < dirs * files_per_dir; n++) std::ofstream(file_name(n)) << "file " << n << "\n";
+            set_fsync_mode(mode);
+            std::chrono::duration<double> add_time, commit_time;
+            {
+                QuietStdout quiet;
+                auto start = bench_clock::now();
+                add({"."});
+                commit("base");
+                add_time = bench_clock::now() - start;
+                start = bench_clock::now();
+                for (int c = 0; c < commits; c++) {
+                    std::vector<std::string> changed;
+                    for (int e = 0; e < edits; e++) {
+                        changed.push_back(file_name(int(rng() % (dirs * files_per_dir))));
+                        std::ofstream(changed.back(), std::ios::app) << "edit " << c << "\n";
+                    }
+                    add(changed);
+                    commit("edit " + std::to_string(c));
+                }
+                commit_time = bench_clock::now() - start;
+            }
+            double add_ms = add_time.count() * 1e3, commit_ms = commit_time.count() / commits * 1e3;
+            if (mode == FsyncMode::Off) {
+                off_add = add_ms;
+                off_commit = commit_ms;
+            }
+            std::cout << std::fixed << std::setprecision(2) << "fsync " << std::left << std::setw(6) << name
+                      << std::right << " add+commit " << dirs * files_per_dir << " files " << std::setw(9) << add_ms
+                      << " ms (" << add_ms / off_add << "x)   add+commit " << edits << " edits " << std::setw(7)
+                      << commit_ms << " ms (" << commit_ms / off_commit << "x)\n";
+        });
+    }
+    set_fsync_mode(saved);
+}
+
+// Import a generated history from a fast-import stream, then check the result against what
+// the regular commands compute: the tip's tree and every commit's changed-path filter
+void bench_fast_import() {
+    in_scratch_repo("fast-import", [] {
+        const int files = 5000, commits = 50000, edits = 3, merge_every = 100;
+        auto file_name = [](int n) { return "d" + std::to_string(n / 100) + "/s" + std::to_string(n / 10 % 10) + "/f" + std::to_string(n) + ".txt"; };
+        std::mt19937 rng(5);
+        std::ostringstream stream;
+        int mark = 0;
+        auto blob = [&](const std::string& content) {
+            stream << "blob\nmark :" << ++mark << "\ndata " << content.size() << "\n" << content << "\n";
+            return mark;
+        };
+        std::vector<int> file_marks(files);
+        for (int n = 0; n < files; n++) file_marks[n] = blob("file " + std::to_string(n) + "\n");
+        stream << "commit refs/heads/master\nmark :" << ++mark << "\ncommitter A <a@example.com> 1700000000 +0000\n"
+               << "data 4\nbase\n";
+        for (int n = 0; n < files; n++) stream << "M 100644 :" << file_marks[n] << " " << file_name(n) << "\n";
+        stream << "\n";
+        int master = mark, side = 0;
+        for (int c = 1; c < commits; c++) {
+            bool on_side = merge_every && c % merge_every >= merge_every - 3;
+            bool merge = merge_every && c % merge_every == 0 && side;
+            std::vector<std::pair<int, int>> changes;
+            for (int e = 0; e < edits; e++) {
+                int n = int(rng() % files);
+                changes.emplace_back(n, blob("file " + std::to_string(n) + " edit " + std::to_string(c) + "\n"));
+            }
+            std::string message = "edit " + std::to_string(c);
+            stream << "commit refs/heads/" << (on_side ? "side" : "master") << "\nmark :" << ++mark
+                   << "\ncommitter A <a@example.com> " << 1700000000 + c * 60 << " +0000\ndata " << message.size()
+                   << "\n" << message << "\n";
+            if (on_side && !side) stream << "from :" << master << "\n";
+            if (merge) stream << "merge :" << side << "\n";
+            for (const auto& [n, m] : changes) stream << "M 100644 :" << m << " " << file_name(n) << "\n";
+            stream << "\n";
+            if (on_side) {
+                side = mark;
+            } else {
+                master = mark;
+                if (merge) {
+                    // The next side branch starts again from master
+                    stream << "reset refs/heads/side\nfrom :" << master << "\n\n";
+                    side = 0;
+                }
+            }
+        }
+        std::string text = stream.str();
+        std::istringstream in(text);
+        std::string summary;
+        auto start = bench_clock::now();
+        {
+            QuietStdout quiet;
+            fast_import(in);
+            summary = quiet.sink.str();
+        }
+        std::chrono::duration<double> elapsed = bench_clock::now() - start;
+        std::cout << std::fixed << std::setprecision(1) << "fast-import  " << commits << " commits over " << files
+                  << " files (" << text.size() / 1e6 << " MB stream): " << elapsed.count() * 1e3 << " ms, "
+                  << commits / elapsed.count() << " commits/s\n";
+
+        // The tip's tree must be what commit would write for the same files, and each filter
+        // what the commit-graph writer would compute
+        bool ok = summary.find("Imported " + std::to_string(commits) + " commits") != std::string::npos;
+        CommandScope scope;
+        auto tip = load_commit(resolve_revision("master"));
+        ok = ok && write_tree(*commit_files(tip)) == tip->tree;
+        CommitGraph graph;
+        graph.load();
+        size_t checked = 0;
+        for (uint32_t pos = 0; pos < graph.size(); pos++) {
+            size_t size;
+            const uint8_t* filter = graph.bloom(pos, size);
+            std::string expected = changed_path_bloom(*load_commit(graph.id(pos)));
+            if (std::string(reinterpret_cast<const char*>(filter), size) != expected) ok = false;
+            checked++;
+        }
+        std::cout << "fast-import  checked the tip's tree and " << checked << " changed-path filters"
+                  << (ok ? "" : "  MISMATCH") << "\n";
+    });
+}
+
+// Files per second for bulk object reads and for checkout of a 100k-file tree into an empty
+// working tree, with each I/O backend, from loose objects and again after gc packs them
+void bench_io() {
+    in_scratch_repo("io", [] {
+        const int dirs = 100, files_per_dir = 1000, runs = 2;
+        for (int d = 0; d < dirs; d++) {
+            std::string dir = "d" + std::to_string(d);
+            fs::create_directories(dir);
+            for (int f = 0; f < files_per_dir; f++) {
+                std::ofstream(dir + "/f" + std::to_string(f) + ".txt") << "file " << d << "/" << f << "\n";
+            }
+        }
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("initial");
+        }
+        CommandScope scope;
+        auto files = commit_files(load_commit(ref_tips()[0]));
+        std::vector<std::string> hashes;
+        for (const FileEntry& entry : *files) hashes.emplace_back(entry.hash);
+        IoBackend saved = io_backend();
+        set_io_backend(IoBackend::Auto);
+        bool uring = effective_io_backend() == IoBackend::Uring;
+        std::cout << "io       " << files->size() << " files" << (uring ? "" : " (io_uring unavailable)") << "\n";
+
+        auto report = [&](const char* what, const char* name, double seconds) {
+            std::cout << "io       " << std::left << std::setw(28) << what << std::setw(9) << name << std::right
+                      << std::fixed << std::setprecision(0) << std::setw(9) << files->size() / seconds << " files/s ("
+                      << std::setprecision(1) << seconds * 1e3 << " ms)\n";
+        };
+        for (const char* storage : {"loose", "packed"}) {
+            if (std::string(storage) == "packed") {
+                QuietStdout quiet;
+                gc();
+            }
+            for (IoBackend backend : {IoBackend::Threads, IoBackend::Uring}) {
+                const char* name = io_backend_name(backend);
+                set_io_backend(backend);
+                if (backend == IoBackend::Uring && !uring) continue;
+                double read_best = 1e9, checkout_best = 1e9;
+                for (int r = 0; r < runs; r++) {
+                    std::vector<std::string> contents;
+                    auto start = bench_clock::now();
+                    read_objects(hashes, contents);
+                    read_best = std::min(read_best, std::chrono::duration<double>(bench_clock::now() - start).count());
+
+                    for (int d = 0; d < dirs; d++) fs::remove_all("d" + std::to_string(d));
+                    {
+                        Transaction tx;
+                        tx.lock(INDEX_PATH);
+                        save_index({}, tx);
+                        tx.commit();
+                    }
+                    start = bench_clock::now();
+                    Transaction tx;
+                    tx.lock(INDEX_PATH);
+                    update_working_tree(*files, "", tx);
+                    tx.commit();
+                    checkout_best = std::min(checkout_best, std::chrono::duration<double>(bench_clock::now() - start).count());
+                }
+                report((std::string("read objects, ") + storage).c_str(), name, read_best);
+                report((std::string("checkout, ") + storage).c_str(), name, checkout_best);
+            }
+        }
+        set_io_backend(saved);
+    });
+}
+
+// Peak resident set size since the last reset_peak_rss, in MiB
+double peak_rss_mib() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1048576.0;
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+void reset_peak_rss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+// Bytes under a directory
+uint64_t directory_bytes(const std::string& dir) {
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::recursive_directory_iterator(dir, ec)) {
+        if (entry.is_regular_file()) total += entry.file_size();
+    }
+    return total;
+}
+
+// Versioning a 1 GiB binary: add, a second version with 100 bytes inserted in the middle,
+// and checkout, with peak memory and object store growth for each step
+void bench_chunk() {
+    in_scratch_repo("chunk", [] {
+        const uint64_t size = uint64_t(1) << 30;
+        const uint64_t insert_at = size / 2;
+        // The same pseudo-random stream every time, optionally with bytes inserted
+        auto generate = [&](bool insert) {
+            std::ofstream out("model.bin", std::ios::binary | std::ios::trunc);
+            std::vector<uint64_t> block(size_t(1) << 17);
+            uint64_t x = 88172645463325252ull;
+            for (uint64_t written = 0; written < size; written += block.size() * 8) {
+                for (uint64_t& word : block) {
+                    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                    word = x;
+                }
+                const char* bytes = reinterpret_cast<const char*>(block.data());
+                if (insert && written <= insert_at && insert_at < written + block.size() * 8) {
+                    size_t split = static_cast<size_t>(insert_at - written);
+                    out.write(bytes, static_cast<std::streamsize>(split));
+                    out << std::string(100, 'X');
+                    out.write(bytes + split, static_cast<std::streamsize>(block.size() * 8 - split));
+                } else {
+                    out.write(bytes, static_cast<std::streamsize>(block.size() * 8));
+                }
+            }
+        };
+        auto timed = [](auto step) {
+            reset_peak_rss();
+            auto start = bench_clock::now();
+            {
+                QuietStdout quiet;
+                step();
+            }
+            return std::chrono::duration<double>(bench_clock::now() - start).count();
+        };
+        auto report = [&](const char* what, double seconds, uint64_t bytes) {
+            std::cout << "chunk    " << std::left << std::setw(26) << what << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(7) << seconds << " s " << std::setw(8)
+                      << bytes / seconds / 1e6 << " MB/s   peak RSS " << std::setprecision(0) << std::setw(5)
+                      << peak_rss_mib() << " MiB\n";
+        };
+
+        generate(false);
+        std::string first_hash = hash_file("model.bin");
+        double seconds = timed([] {
+            add({"model.bin"});
+            commit("v1");
+            branch("v1");
+        });
+        report("add+commit 1 GiB", seconds, size);
+        uint64_t stored_v1 = directory_bytes(".minigit/objects");
+
+        generate(true);
+        seconds = timed([] {
+            add({"model.bin"});
+            commit("v2");
+        });
+        report("add+commit edited copy", seconds, size);
+        uint64_t stored_v2 = directory_bytes(".minigit/objects");
+
+        seconds = timed([] {
+            fs::remove("model.bin");
+            checkout("v1", "");
+        });
+        report("checkout into empty tree", seconds, size);
+        bool ok = hash_file("model.bin") == first_hash;
+        std::cout << std::fixed << std::setprecision(1) << "chunk    object store " << stored_v1 / 1048576.0
+                  << " MiB after v1, " << stored_v2 / 1048576.0 << " MiB after v2 (+"
+                  << (stored_v2 - stored_v1) / 1048576.0 << " MiB for a 100-byte insert)"
+                  << (ok ? "" : "  CHECKOUT MISMATCH") << "\n";
+    });
+}
+
+// Import a history of commits editing a few files each of a files-file tree onto master, plus
+// a branch of dead_commits commits forking halfway that is deleted afterwards, leaving its
+// objects unreachable
+static void import_edit_history(int files, int commits, int edits, int dead_commits) {
+    std::mt19937 rng(13);
+    std::ostringstream stream;
+    int mark = 0;
+    auto commit_header = [&](const std::string& branch, int c) {
+        std::string message = "edit " + std::to_string(c);
+        stream << "commit refs/heads/" << branch << "\nmark :" << ++mark << "\ncommitter A <a@example.com> "
+               << 1700000000 + c * 60 << " +0000\ndata " << message.size() << "\n" << message << "\n";
+    };
+    auto edit = [&](int c) {
+        for (int e = 0; e < edits; e++) {
+            int n = int(rng() % files);
+            std::string content = "file " + std::to_string(n) + " edit " + std::to_string(c) + "\n";
+            stream << "M 100644 inline d" << n / 100 << "/f" << n << ".txt\ndata " << content.size() << "\n" << content;
+        }
+        stream << "\n";
+    };
+    commit_header("master", 0);
+    for (int n = 0; n < files; n++) {
+        std::string content = "file " + std::to_string(n) + "\n";
+        stream << "M 100644 inline d" << n / 100 << "/f" << n << ".txt\ndata " << content.size() << "\n" << content;
+    }
+    stream << "\n";
+    int fork = 0;
+    for (int c = 1; c < commits; c++) {
+        commit_header("master", c);
+        edit(c);
+        if (c == commits / 2) fork = mark;
+    }
+    // A branch that is deleted afterwards, leaving its objects unreachable
+    for (int c = 0; c < dead_commits; c++) {
+        commit_header("dead", commits + c);
+        if (c == 0) stream << "from :" << fork << "\n";
+        edit(commits + c);
+    }
+    std::istringstream in(stream.str());
+    {
+        QuietStdout quiet;
+        fast_import(in);
+    }
+    fs::remove(".minigit/refs/heads/dead");
+}
+
+// Reachability bitmaps over an imported 20,000-commit history: building them from scratch and
+// for the last 100 commits, then "reachable from master but not master~1000" and the count of
+// unreachable objects, against walking every commit and tree
+void bench_bitmap() {
+    in_scratch_repo("bitmap", [] {
+        const int files = 5000, commits = 20000, edits = 3, dead_commits = 200, behind = 1000;
+        import_edit_history(files, commits, edits, dead_commits);
+
+        CommandScope scope;
+        std::string tip = resolve_revision("master");
+        std::vector<std::string> ancestors{tip};
+        for (int i = 0; i < behind; i++) ancestors.push_back(std::string(load_commit(ancestors.back())->parents[0]));
+        auto time_ms = [](auto step) {
+            auto start = bench_clock::now();
+            step();
+            return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        };
+        double build_ms = time_ms([&] { update_bitmaps({ancestors[100]}); });
+        double update_ms = time_ms([&] { update_bitmaps({tip}); });
+        std::cout << std::fixed << std::setprecision(1) << "bitmap   built for " << commits - 100 << " commits in "
+                  << build_ms << " ms, last 100 commits added in " << update_ms << " ms, "
+                  << fs::file_size(BITMAP_PATH) / 1024.0 << " KiB\n";
+
+        ReachabilityBitmaps bitmaps;
+        double load_ms = time_ms([&] { bitmaps.load(); });
+        const int queries = 100;
+        size_t bitmap_count = 0;
+        double bitmap_ms = time_ms([&] {
+            for (int q = 0; q < queries; q++) {
+                Bitset a, b;
+                reachable_objects(bitmaps, {tip}, a);
+                reachable_objects(bitmaps, {ancestors[behind]}, b);
+                a.subtract(b);
+                bitmap_count = a.count();
+            }
+        }) / queries;
+        // The same question answered by walking every commit and tree from both ends
+        auto walk = [](const std::string& start, std::unordered_set<std::string>& seen) {
+            std::function<void(std::string_view)> walk_tree = [&](std::string_view tree_hash) {
+                if (!seen.insert(std::string(tree_hash)).second) return;
+                for (const TreeEntry& entry : load_tree(tree_hash)->entries) {
+                    if (entry.is_tree) walk_tree(entry.hash); else seen.insert(std::string(entry.hash));
+                }
+            };
+            std::vector<std::string> stack{start};
+            while (!stack.empty()) {
+                std::string hash = std::move(stack.back());
+                stack.pop_back();
+                if (!seen.insert(hash).second) continue;
+                auto commit = load_commit(hash);
+                walk_tree(commit->tree);
+                for (std::string_view parent : commit->parents) stack.emplace_back(parent);
+            }
+        };
+        size_t walk_count = 0;
+        double walk_ms = time_ms([&] {
+            std::unordered_set<std::string> a, b;
+            walk(tip, a);
+            walk(ancestors[behind], b);
+            for (const std::string& hash : a) walk_count += !b.count(hash);
+        });
+        std::cout << "bitmap   reachable from master but not master~" << behind << ": " << bitmap_count << " objects in "
+                  << std::setprecision(3) << bitmap_ms << " ms after a " << load_ms << " ms load (walking history: "
+                  << std::setprecision(1) << walk_ms << " ms)" << (bitmap_count == walk_count ? "" : "  MISMATCH") << "\n";
+
+        std::string report;
+        double unreachable_ms = time_ms([&] {
+            QuietStdout quiet;
+            count_objects(true);
+            report = quiet.sink.str();
+        });
+        size_t at = report.find("unreachable: ");
+        std::string unreachable = at == std::string::npos ? "?" : report.substr(at + 13, report.find('\n', at) - at - 13);
+        std::cout << "bitmap   count-objects -v found " << unreachable << " unreachable objects in " << unreachable_ms
+                  << " ms (the deleted branch left at most " << dead_commits * (2 + 2 * edits) << ")\n";
+    });
+}
+
+// fsck of an imported 20,000-commit history as fast-import packed it and after gc (delta
+// chains), then with a loose copy of an object damaged and a branch whose parent is missing
+void bench_fsck() {
+    in_scratch_repo("fsck", [] {
+        import_edit_history(5000, 20000, 3, 200);
+        auto run = [](const char* label) {
+            FsckReport report;
+            auto start = bench_clock::now();
+            {
+                QuietStdout quiet;
+                report = fsck();
+            }
+            std::chrono::duration<double> elapsed = bench_clock::now() - start;
+            size_t objects = report.loose + report.packed;
+            std::cout << "fsck     " << std::left << std::setw(18) << label << std::right << objects << " objects in "
+                      << std::fixed << std::setprecision(0) << elapsed.count() * 1e3 << " ms, " << objects / elapsed.count()
+                      << " objects/s on " << std::thread::hardware_concurrency() << " threads (" << report.corrupt
+                      << " corrupt, " << report.missing << " missing, " << report.dangling << " dangling)\n";
+            return report;
+        };
+        run("fast-import packs");
+        {
+            QuietStdout quiet;
+            gc();
+        }
+        run("after gc");
+
+        CommandScope scope;
+        auto tip = load_commit(resolve_revision("master"));
+        std::string blob(tree_lookup(tip->tree, "d0/f0.txt"));
+        std::ofstream(loose_object_path(blob), std::ios::binary) << "damaged";
+        std::string orphan = write_object("tree " + std::string(tip->tree) + "\nparent " + std::string(OBJECT_ID_HEX_LEN, 'a') +
+                                          "\ntimestamp 2024-01-01T00:00:00\nmessage orphan\n");
+        std::ofstream(".minigit/refs/heads/orphan") << orphan << "\n";
+        FsckReport report = run("damaged");
+        std::cout << "fsck     " << (report.corrupt == 1 && report.missing == 1 ? "damage detected" : "DAMAGE NOT DETECTED") << "\n";
+    });
+}
+
+// Import commits first.. onto master, each rewriting edits files of a files-file tree with
+// a few lines of text
+static void import_edits(int files, int first, int commits, int edits) {
+    std::mt19937 rng(first);
+    std::ostringstream stream;
+    for (int c = first; c < first + commits; c++) {
+        std::string message = "edit " + std::to_string(c);
+        stream << "commit refs/heads/master\ncommitter A <a@example.com> " << 1700000000 + c * 60 << " +0000\ndata "
+               << message.size() << "\n" << message << "\n";
+        for (int e = 0; e < edits; e++) {
+            int n = int(rng() % files);
+            std::string content = "file " + std::to_string(n) + " edit " + std::to_string(c) + "\n";
+            stream << "M 100644 inline d" << n / 100 << "/f" << n << ".txt\ndata " << content.size() << "\n" << content;
+        }
+        stream << "\n";
+    }
+    std::istringstream in(stream.str());
+    QuietStdout quiet;
+    fast_import(in);
+}
+
+// push and fetch between two repositories of an imported 20,000-commit history after gc: the
+// first push into an empty repository, then 100 new commits pushed, and 100 more fetched
+// back the other way, against copying the whole .minigit directory
+void bench_transfer() {
+    in_scratch_repo("transfer", [] {
+        const int files = 5000, commits = 20000, edits = 3, batch = 100;
+        import_edit_history(files, commits, edits, 0);
+        {
+            QuietStdout quiet;
+            gc();
+        }
+        fs::path source = fs::current_path();
+        fs::path clone = fs::temp_directory_path() / "minigit-bench-transfer-clone";
+        fs::remove_all(clone);
+        fs::create_directories(clone);
+        fs::current_path(clone);
+        {
+            QuietStdout quiet;
+            init();
+        }
+        // HEAD names a branch no transfer touches, so master can move in the clone without
+        // a checkout
+        std::ofstream(clone / ".minigit" / "HEAD") << "ref: refs/heads/work\n";
+        fs::current_path(source);
+        std::cout << "transfer copying .minigit: " << std::fixed << std::setprecision(1)
+                  << directory_bytes((source / ".minigit").string()) / 1048576.0 << " MiB\n";
+
+        // Runs one transfer from the current repository and reports the size of the stream
+        auto run = [](const char* label, auto step) {
+            CommandScope scope;
+            std::string output;
+            bool ok;
+            auto start = bench_clock::now();
+            {
+                QuietStdout quiet;
+                ok = step();
+                output = quiet.sink.str();
+            }
+            double ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+            size_t at = output.rfind(" commits as ");
+            std::string summary = at == std::string::npos ? "?" : output.substr(at + 12, output.find(" (", at) - at - 12);
+            std::cout << "transfer " << std::left << std::setw(26) << label << std::right << summary << " in "
+                      << std::setprecision(1) << ms << " ms" << (ok ? "" : "  FAILED") << "\n";
+        };
+        run("first push (empty clone)", [&] { return push(clone.string(), {"master"}); });
+        import_edits(files, commits, batch, edits);
+        run("push of 100 new commits", [&] { return push(clone.string(), {"master"}); });
+        import_edits(files, commits + batch, batch, edits);
+        fs::current_path(clone);
+        run("fetch of 100 new commits", [&] { return fetch(source.string(), {"master"}); });
+        std::string fetched = resolve_revision(source.filename().string() + "/master");
+        fs::current_path(source);
+        std::cout << "transfer " << (fetched == resolve_revision("master") ? "clone matches" : "CLONE DIFFERS") << "\n";
+        fs::remove_all(clone);
+    });
+}
+
+// status, add . and a branch switch on a 50,000-file working tree with 10 files modified,
+// scanning the whole tree and then asking the fsmonitor daemon, and a burst of 20,000 new
+// files written as fast as possible while the daemon watches
+void bench_fsmonitor() {
+    in_scratch_repo("fsmonitor", [] {
+        const int dirs = 200, files_per_dir = 250, modified = 10, runs = 5, burst = 20000;
+        for (int d = 0; d < dirs; d++) {
+            fs::create_directories("src/d" + std::to_string(d));
+            for (int f = 0; f < files_per_dir; f++) {
+                std::ofstream("src/d" + std::to_string(d) + "/f" + std::to_string(f) + ".txt") << d << " " << f << "\n";
+            }
+        }
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("initial");
+            branch("dev");
+            checkout("dev", "");
+            std::ofstream("src/d0/f0.txt") << "changed";
+            add({"src/d0/f0.txt"});
+            commit("one change");
+            checkout("master", "");
+        }
+        std::cout << "fsmonitor " << dirs * files_per_dir << " files, " << modified << " modified before each run\n";
+
+        int generation = 0;
+        auto modify = [&] {
+            generation++;
+            for (int m = 0; m < modified; m++) {
+                std::ofstream("src/d" + std::to_string(m * 7 % dirs) + "/f" + std::to_string(m) + ".txt") << generation << "\n";
+            }
+        };
+        // Average milliseconds of a command, with files modified before each run
+        auto time_ms = [&](auto command) {
+            double total = 0;
+            for (int r = 0; r < runs; r++) {
+                modify();
+                auto start = bench_clock::now();
+                {
+                    QuietStdout quiet;
+                    CommandScope scope;
+                    command(r);
+                }
+                total += std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+            }
+            return total / runs;
+        };
+        auto measure = [&](double results[3]) {
+            results[0] = time_ms([](int) { status(); });
+            results[1] = time_ms([](int) { add({"."}); });
+            results[2] = time_ms([](int r) { checkout(r % 2 ? "master" : "dev", ""); });
+            QuietStdout quiet;
+            checkout("master", "");
+        };
+        double scan[3], daemon[3];
+        measure(scan);
+        bool started;
+        {
+            QuietStdout quiet;
+            started = fsmonitor_start();
+            status();
+        }
+        if (!started) {
+            std::cout << "fsmonitor daemon did not start\n";
+            return;
+        }
+        measure(daemon);
+        const char* labels[3] = {"status", "add .", "checkout branch switch"};
+        for (int i = 0; i < 3; i++) {
+            std::cout << std::fixed << std::setprecision(2) << "fsmonitor " << std::left << std::setw(24) << labels[i]
+                      << std::right << "full scan " << std::setw(8) << scan[i] << " ms   with daemon " << std::setw(7)
+                      << daemon[i] << " ms\n";
+        }
+
+        // Every new file must be reported, without the daemon falling back to a full rescan
+        auto start = bench_clock::now();
+        for (int b = 0; b < burst; b++) {
+            std::ofstream("src/d" + std::to_string(b % dirs) + "/burst" + std::to_string(b) + ".txt") << b << "\n";
+        }
+        double write_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        FsmonitorChanges changes = fsmonitor_changes();
+        size_t reported = 0;
+        for (const std::string& path : changes.paths) reported += path.find("/burst") != std::string::npos;
+        std::string output;
+        start = bench_clock::now();
+        {
+            QuietStdout quiet;
+            status();
+            output = quiet.sink.str();
+        }
+        double status_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        size_t listed = 0;
+        for (size_t at = output.find("/burst"); at != std::string::npos; at = output.find("/burst", at + 1)) listed++;
+        std::cout << std::setprecision(1) << "fsmonitor burst of " << burst << " new files in " << write_ms << " ms: "
+                  << (changes.full ? "daemon asked for a full rescan" : std::to_string(reported) + " reported")
+                  << ", status lists " << listed << " in " << status_ms << " ms\n";
+        QuietStdout quiet;
+        fsmonitor_stop();
+    });
+}
+
+// Checkout of a 20,000-file tree into an empty working tree, a branch switch and status, with
+// the whole tree checked out and with a sparse checkout of 5 of its 100 directories
+void bench_sparse() {
+    in_scratch_repo("sparse", [] {
+        const int dirs = 100, files_per_dir = 200, cone = 5, runs = 5;
+        std::string body(4096, 'x');
+        for (int d = 0; d < dirs; d++) {
+            fs::create_directories("src/d" + std::to_string(d));
+            for (int f = 0; f < files_per_dir; f++) {
+                std::ofstream("src/d" + std::to_string(d) + "/f" + std::to_string(f) + ".txt") << d << " " << f << body;
+            }
+        }
+        {
+            QuietStdout quiet;
+            add({"."});
+            commit("initial");
+            branch("dev");
+            checkout("dev", "");
+            std::ofstream("src/d0/f0.txt") << "changed";
+            add({"src/d0/f0.txt"});
+            commit("one change");
+            checkout("master", "");
+        }
+        std::cout << "sparse " << dirs * files_per_dir << " files of " << body.size() << " bytes in " << dirs
+                  << " directories, cone of " << cone << "\n";
+
+        auto elapsed_ms = [](bench_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        };
+        auto run = [&](const char* label) {
+            double empty_ms, switch_ms = 0, status_ms = 0;
+            uint64_t bytes;
+            {
+                QuietStdout quiet;
+                CommandScope scope;
+                fs::remove_all("src");
+                auto start = bench_clock::now();
+                checkout("master", "");
+                empty_ms = elapsed_ms(start);
+                bytes = directory_bytes("src");
+                for (int r = 0; r < runs; r++) {
+                    start = bench_clock::now();
+                    checkout(r % 2 ? "master" : "dev", "");
+                    switch_ms += elapsed_ms(start);
+                    start = bench_clock::now();
+                    status();
+                    status_ms += elapsed_ms(start);
+                }
+                checkout("master", "");
+            }
+            std::cout << std::fixed << std::setprecision(2) << "sparse " << std::left << std::setw(6) << label
+                      << std::right << " checkout into empty tree " << std::setw(8) << empty_ms << " ms  "
+                      << std::setprecision(1) << std::setw(6) << bytes / 1048576.0 << " MiB   switch "
+                      << std::setprecision(2) << std::setw(6) << switch_ms / runs << " ms   status " << std::setw(6)
+                      << status_ms / runs << " ms\n";
+        };
+        run("full");
+        std::vector<std::string> patterns;
+        for (int d = 0; d < cone; d++) patterns.push_back("src/d" + std::to_string(d * (dirs / cone)));
+        auto start = bench_clock::now();
+        {
+            QuietStdout quiet;
+            sparse_checkout_set(patterns);
+        }
+        double narrow_ms = elapsed_ms(start);
+        run("sparse");
+        std::cout << std::setprecision(2) << "sparse narrowing the full tree to the cone " << narrow_ms << " ms\n";
+    });
+}
+
+int main(int argc, char* argv[]) {
+    std::string which = argc > 1 ? argv[1] : "all";
+    if (which == "all" || which == "hash") bench_hash();
+    if (which == "all" || which == "pack") bench_pack();
+    if (which == "all" || which == "graph") bench_graph();
+    if (which == "all" || which == "parse") bench_parse();
+    if (which == "all" || which == "checkout") bench_checkout();
+    if (which == "all" || which == "merge") bench_merge();
+    if (which == "all" || which == "diff") bench_diff();
+    if (which == "all" || which == "log") bench_log();
+    if (which == "all" || which == "fsync") bench_fsync();
+    if (which == "all" || which == "fast-import") bench_fast_import();
+    if (which == "all" || which == "io") bench_io();
+    if (which == "all" || which == "chunk") bench_chunk();
+    if (which == "all" || which == "bitmap") bench_bitmap();
+    if (which == "all" || which == "fsck") bench_fsck();
+    if (which == "all" || which == "transfer") bench_transfer();
+    if (which == "all" || which == "fsmonitor") bench_fsmonitor();
+    if (which == "all" || which == "sparse") bench_sparse();
+    return 0;
+}
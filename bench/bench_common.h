@@ -0,0 +1,30 @@
+// Helpers shared by the MiniGit benchmark programs
+#pragma once
+
+#include "commands.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+// Silence command output while a benchmark drives MiniGit commands
+struct QuietStdout {
+    std::ostringstream sink;
+    std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+};
+
+// Run a benchmark inside a fresh scratch repository and remove it afterwards
+template <typename F>
+void in_scratch_repo(const std::string& name, F body) {
+    fs::path previous = fs::current_path();
+    fs::path dir = fs::temp_directory_path() / ("minigit-bench-" + name);
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::current_path(dir);
+    {
+        QuietStdout quiet;
+        init();
+    }
+    body();
+    fs::current_path(previous);
+    fs::remove_all(dir);
+}
@@ -0,0 +1,234 @@
+// MiniGit benchmark suite: times whole commands on synthetic repositories of several sizes
+// and prints p50/p99 latencies as JSON, so runs can be compared to spot regressions.
+// Build: cmake -S . -B build && cmake --build build --target minigit-suite
+// Run:   ./build/minigit-suite [--scale small|medium|large]... [--samples <n>] [--seed <n>] [--out <file>]
+#include "bench_common.h"
+#include "synth_repo.h"
+
+#include <cmath>
+#include <random>
+
+// A named repository shape
+struct SuiteScale {
+    std::string name;
+    SynthOptions options;
+};
+
+// Latency samples of one operation, in milliseconds
+struct SuiteResult {
+    std::string operation;
+    std::vector<double> samples;
+};
+
+std::vector<SuiteScale> suite_scales() {
+    std::vector<SuiteScale> scales(3);
+    scales[0].name = "small";
+    scales[0].options.files = 1000;
+    scales[0].options.commits = 200;
+    scales[0].options.merge_every = 10;
+    scales[1].name = "medium";
+    scales[1].options.files = 10000;
+    scales[1].options.file_size = 2048;
+    scales[1].options.commits = 2000;
+    scales[1].options.merge_every = 20;
+    scales[2].name = "large";
+    scales[2].options.files = 50000;
+    scales[2].options.file_size = 4096;
+    scales[2].options.commits = 10000;
+    scales[2].options.merge_every = 50;
+    return scales;
+}
+
+// Time one call, in milliseconds
+template <typename F>
+double time_ms(F body) {
+    auto start = bench_clock::now();
+    body();
+    std::chrono::duration<double, std::milli> elapsed = bench_clock::now() - start;
+    return elapsed.count();
+}
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// Run every operation against a freshly generated repository of one scale
+std::deque<SuiteResult> run_scale(const SuiteScale& scale, size_t samples, uint32_t seed, double& generate_ms) {
+    std::deque<SuiteResult> results;
+    fs::path previous = fs::current_path();
+    fs::path dir = fs::temp_directory_path() / ("minigit-suite-" + scale.name);
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::current_path(dir);
+    SynthOptions options = scale.options;
+    options.seed = seed;
+    SynthRepo repo;
+    {
+        QuietStdout quiet;
+        generate_ms = time_ms([&] { repo = generate_synthetic_repo(options); });
+    }
+    std::mt19937 rng(seed);
+    auto sample = [&](const std::string& operation) -> std::vector<double>& {
+        results.push_back({operation, {}});
+        return results.back().samples;
+    };
+
+    // add and commit: edit a few files, stage them, commit them
+    std::vector<double>& add_ms = sample("add");
+    std::vector<double>& commit_ms = sample("commit");
+    for (size_t s = 0; s < samples; s++) {
+        std::vector<std::string> paths;
+        for (int k = 0; k < 10; k++) {
+            paths.push_back(repo.paths[rng() % repo.paths.size()]);
+            std::ofstream(paths.back(), std::ios::app) << "    edited = " << s << ";\n";
+        }
+        QuietStdout quiet;
+        add_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            add(paths);
+        }));
+        commit_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            commit("Benchmark commit " + std::to_string(s));
+        }));
+    }
+
+    // log: the latest page of history, and the full history of one path
+    std::vector<double>& log_ms = sample("log");
+    std::vector<double>& log_path_ms = sample("log_path");
+    for (size_t s = 0; s < samples; s++) {
+        QuietStdout quiet;
+        LogOptions page;
+        page.max_count = 100;
+        log_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            log(page);
+        }));
+        LogOptions path;
+        path.paths = {repo.paths[rng() % repo.paths.size()]};
+        log_path_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            log(path);
+        }));
+    }
+
+    // checkout: switch between master and a topic branch
+    std::vector<double>& checkout_ms = sample("checkout");
+    for (size_t s = 0; s < samples && !repo.branches.empty(); s++) {
+        QuietStdout quiet;
+        const std::string& target = s % 2 == 0 ? repo.branches[0] : "master";
+        checkout_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            checkout(target, "");
+        }));
+    }
+
+    // merge: a topic branch into a fresh branch at master, which has moved on since the fork
+    std::vector<double>& merge_ms = sample("merge");
+    for (size_t s = 0; s < samples && !repo.branches.empty(); s++) {
+        QuietStdout quiet;
+        std::string scratch = "merge-" + std::to_string(s);
+        {
+            CommandScope scope;
+            checkout("master", "");
+            branch(scratch);
+            checkout(scratch, "");
+        }
+        merge_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            merge(repo.branches[s % repo.branches.size()]);
+        }));
+        fs::remove(MERGE_HEAD);
+    }
+    {
+        QuietStdout quiet;
+        CommandScope scope;
+        checkout("master", "");
+    }
+
+    // is_ancestor and find_lca: random pairs of generated commits
+    std::vector<double>& ancestor_ms = sample("is_ancestor");
+    std::vector<double>& lca_ms = sample("find_lca");
+    for (size_t s = 0; s < samples * 10; s++) {
+        const std::string& a = repo.commits[rng() % repo.commits.size()];
+        const std::string& b = repo.commits[rng() % repo.commits.size()];
+        ancestor_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            is_ancestor(a, b);
+        }));
+        lca_ms.push_back(time_ms([&] {
+            CommandScope scope;
+            find_lca(a, b);
+        }));
+    }
+
+    fs::current_path(previous);
+    fs::remove_all(dir);
+    return results;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<SuiteScale> all = suite_scales(), chosen;
+    size_t samples = 20;
+    uint32_t seed = 1;
+    std::string out_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scale" && i + 1 < argc) {
+            std::string name = argv[++i];
+            auto it = std::find_if(all.begin(), all.end(), [&](const SuiteScale& s) { return s.name == name; });
+            if (it == all.end()) {
+                std::cerr << "Error: unknown scale " << name << ".\n";
+                return 1;
+            }
+            chosen.push_back(*it);
+        } else if (arg == "--samples" && i + 1 < argc) {
+            samples = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            std::cerr << "Usage: minigit-suite [--scale small|medium|large]... [--samples <n>] [--seed <n>] [--out <file>]\n";
+            return 1;
+        }
+    }
+    if (chosen.empty()) chosen.assign(all.begin(), all.begin() + 2);
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\n  \"suite\": \"minigit\",\n  \"samples\": " << samples << ",\n  \"seed\": " << seed << ",\n  \"scales\": [";
+    for (size_t k = 0; k < chosen.size(); k++) {
+        const SuiteScale& scale = chosen[k];
+        std::cerr << "Running " << scale.name << " scale...\n";
+        double generate_ms = 0;
+        std::deque<SuiteResult> results = run_scale(scale, samples, seed, generate_ms);
+        const SynthOptions& o = scale.options;
+        json << (k ? "," : "") << "\n    {\n      \"name\": \"" << scale.name << "\",\n"
+             << "      \"files\": " << o.files << ", \"file_size\": " << o.file_size << ", \"commits\": " << o.commits
+             << ", \"merge_every\": " << o.merge_every << ",\n"
+             << "      \"generate_ms\": " << generate_ms << ",\n      \"operations\": {";
+        for (size_t r = 0; r < results.size(); r++) {
+            std::vector<double> sorted = results[r].samples;
+            std::sort(sorted.begin(), sorted.end());
+            double mean = 0;
+            for (double v : sorted) mean += v;
+            mean = sorted.empty() ? 0 : mean / sorted.size();
+            json << (r ? "," : "") << "\n        \"" << results[r].operation << "\": {\"samples\": " << sorted.size()
+                 << ", \"p50_ms\": " << percentile(sorted, 50) << ", \"p99_ms\": " << percentile(sorted, 99)
+                 << ", \"mean_ms\": " << mean << ", \"min_ms\": " << (sorted.empty() ? 0 : sorted.front())
+                 << ", \"max_ms\": " << (sorted.empty() ? 0 : sorted.back()) << "}";
+        }
+        json << "\n      }\n    }";
+    }
+    json << "\n  ]\n}\n";
+    if (out_path.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream(out_path) << json.str();
+    }
+    return 0;
+}
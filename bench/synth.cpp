@@ -0,0 +1,61 @@
+// Create a synthetic MiniGit repository for benchmarking and profiling.
+// Build: cmake -S . -B build && cmake --build build --target minigit-synth
+// Run:   ./build/minigit-synth <directory> [--files <n>] [--files-per-dir <n>] [--file-size <bytes>]
+//            [--commits <n>] [--edits <n>] [--merge-every <n>] [--side-commits <n>] [--branches <n>] [--seed <n>]
+#include "bench_common.h"
+#include "synth_repo.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        std::cerr << "Usage: minigit-synth <directory> [--files <n>] [--files-per-dir <n>] [--file-size <bytes>] "
+                     "[--commits <n>] [--edits <n>] [--merge-every <n>] [--side-commits <n>] [--branches <n>] [--seed <n>]\n";
+        return 1;
+    }
+    SynthOptions options;
+    const std::pair<const char*, size_t*> flags[] = {
+        {"--files", &options.files},
+        {"--files-per-dir", &options.files_per_dir},
+        {"--file-size", &options.file_size},
+        {"--commits", &options.commits},
+        {"--edits", &options.edits_per_commit},
+        {"--merge-every", &options.merge_every},
+        {"--side-commits", &options.side_commits},
+        {"--branches", &options.branches},
+    };
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " needs a value.\n";
+            return 1;
+        }
+        size_t value = std::stoul(argv[++i]);
+        if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(value);
+            continue;
+        }
+        auto it = std::find_if(std::begin(flags), std::end(flags), [&](const auto& flag) { return arg == flag.first; });
+        if (it == std::end(flags)) {
+            std::cerr << "Error: unknown option " << arg << ".\n";
+            return 1;
+        }
+        *it->second = value;
+    }
+    fs::path dir = argv[1];
+    if (fs::exists(dir / ".minigit")) {
+        std::cerr << "Error: " << dir.string() << " already contains a repository.\n";
+        return 1;
+    }
+    fs::create_directories(dir);
+    fs::current_path(dir);
+    auto start = bench_clock::now();
+    SynthRepo repo;
+    {
+        QuietStdout quiet;
+        repo = generate_synthetic_repo(options);
+    }
+    std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    std::cout << "Generated " << repo.paths.size() << " files, " << repo.commits.size() << " commits and "
+              << repo.branches.size() << " topic branches in " << std::fixed << std::setprecision(1)
+              << elapsed.count() << " s\n";
+    return 0;
+}
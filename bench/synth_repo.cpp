@@ -0,0 +1,117 @@
+#include "synth_repo.h"
+
+#include <random>
+
+// Files of one line of history: content and blob hash by path
+struct SynthState {
+    std::map<std::string, std::string> contents;
+    std::map<std::string, std::string> blobs;
+};
+
+// A line of source-like text, about 40 bytes
+static std::string synth_line(std::mt19937& rng) {
+    char line[64];
+    std::snprintf(line, sizeof(line), "    value_%08x = combine(%u, %u);\n", unsigned(rng()), unsigned(rng() % 1000),
+                  unsigned(rng() % 1000));
+    return line;
+}
+
+// Replace one random line of a file and store the new blob
+static void synth_edit(SynthState& state, const std::string& path, std::mt19937& rng) {
+    std::string& content = state.contents[path];
+    size_t lines = std::max<size_t>(1, std::count(content.begin(), content.end(), '\n'));
+    size_t target = rng() % lines, start = 0;
+    for (size_t k = 0; k < target; k++) start = content.find('\n', start) + 1;
+    size_t end = content.find('\n', start);
+    end = end == std::string::npos ? content.size() : end + 1;
+    content.replace(start, end - start, synth_line(rng));
+    state.blobs[path] = write_object(content);
+}
+
+// Timestamps one minute apart from a fixed start, so commit hashes are reproducible
+static std::string synth_timestamp(size_t n) {
+    std::time_t t = std::time_t(1704067200) + std::time_t(n) * 60;
+    std::stringstream ss;
+    ss << std::put_time(std::gmtime(&t), "%Y-%m-%dT%H:%M:%S");
+    return ss.str();
+}
+
+std::string synth_path(const SynthOptions& options, size_t n) {
+    size_t leaf = n / std::max<size_t>(1, options.files_per_dir);
+    return "dir" + std::to_string(leaf / 10) + "/sub" + std::to_string(leaf % 10) + "/file" + std::to_string(n) + ".txt";
+}
+
+SynthRepo generate_synthetic_repo(const SynthOptions& options) {
+    init();
+    SynthRepo repo;
+    std::mt19937 rng(options.seed);
+    SynthState master;
+    size_t lines = std::max<size_t>(1, options.file_size / 40);
+    for (size_t n = 0; n < options.files; n++) {
+        std::string path = synth_path(options, n);
+        std::string content;
+        for (size_t l = 0; l < lines; l++) content += synth_line(rng);
+        master.blobs[path] = write_object(content);
+        master.contents[path] = std::move(content);
+        repo.paths.push_back(path);
+    }
+    std::sort(repo.paths.begin(), repo.paths.end());
+
+    // Write a commit of state's files; edits change random files first
+    auto make_commit = [&](SynthState& state, std::vector<std::string> parents, size_t edits, const std::string& message) {
+        for (size_t e = 0; e < edits && !repo.paths.empty(); e++) {
+            synth_edit(state, repo.paths[rng() % repo.paths.size()], rng);
+        }
+        CommandScope scope;
+        Commit commit;
+        commit.tree = intern(write_tree(make_file_list(state.blobs)));
+        for (const std::string& parent : parents) commit.parents.push_back(intern(parent));
+        commit.timestamp = intern(synth_timestamp(repo.commits.size()));
+        commit.message = intern(message);
+        repo.commits.push_back(write_object(serialize_commit(commit)));
+        return repo.commits.back();
+    };
+
+    std::string tip = make_commit(master, {}, 0, "Initial commit");
+    for (size_t i = 1; i < options.commits; i++) {
+        if (options.merge_every > 0 && i % options.merge_every == 0) {
+            // Fork a side branch, advance master past the fork point, then merge the side
+            // branch back with its files taking precedence
+            SynthState side = master;
+            std::string side_tip = tip;
+            for (size_t s = 0; s < options.side_commits; s++) {
+                side_tip = make_commit(side, {side_tip}, options.edits_per_commit, "Side commit " + std::to_string(i) + "." + std::to_string(s));
+            }
+            tip = make_commit(master, {tip}, options.edits_per_commit, "Commit " + std::to_string(i));
+            for (const auto& [path, blob] : side.blobs) {
+                if (blob != master.blobs[path]) {
+                    master.blobs[path] = blob;
+                    master.contents[path] = side.contents[path];
+                }
+            }
+            tip = make_commit(master, {tip, side_tip}, 0, "Merge side branch " + std::to_string(i));
+        } else {
+            tip = make_commit(master, {tip}, options.edits_per_commit, "Commit " + std::to_string(i));
+        }
+    }
+    std::ofstream(".minigit/refs/heads/master") << tip;
+    std::vector<std::string> tips = {tip};
+    for (size_t b = 0; b < options.branches; b++) {
+        SynthState topic = master;
+        std::string topic_tip = tip;
+        for (size_t s = 0; s < options.side_commits; s++) {
+            topic_tip = make_commit(topic, {topic_tip}, options.edits_per_commit, "Topic " + std::to_string(b) + " commit " + std::to_string(s));
+        }
+        std::string name = "topic-" + std::to_string(b);
+        std::ofstream(".minigit/refs/heads/" + name) << topic_tip;
+        repo.branches.push_back(name);
+        tips.push_back(topic_tip);
+    }
+    update_commit_graph(tips);
+    CommandScope scope;
+    Transaction tx;
+    tx.lock(INDEX_PATH);
+    update_working_tree(*commit_files(load_commit(tip)), "", tx);
+    tx.commit();
+    return repo;
+}
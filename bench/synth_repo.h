@@ -0,0 +1,33 @@
+// Synthetic repository generator for benchmarks
+#pragma once
+
+#include "commands.h"
+
+// Shape of a synthetic repository. The same options and seed always produce the same
+// objects and commit hashes.
+struct SynthOptions {
+    size_t files = 1000;            // Files in the first commit
+    size_t files_per_dir = 100;     // Files per leaf directory; ten leaves share a parent
+    size_t file_size = 1024;        // Approximate bytes per file
+    size_t commits = 100;           // Steps of master's history; merge steps add a commit and the merge
+    size_t edits_per_commit = 4;    // Files changed by each commit (one line each)
+    size_t merge_every = 10;        // Every this many commits master merges a side branch (0: linear)
+    size_t side_commits = 3;        // Commits on each side branch and each topic branch
+    size_t branches = 2;            // Unmerged topic-<n> branches forked from the tip of master
+    uint32_t seed = 1;
+};
+
+// What the generator created
+struct SynthRepo {
+    std::vector<std::string> commits;    // Every commit, oldest first
+    std::vector<std::string> paths;      // Every file, sorted
+    std::vector<std::string> branches;   // Topic branch names
+};
+
+// Path of the nth synthetic file
+std::string synth_path(const SynthOptions& options, size_t n);
+
+// Initialize a repository in the current directory and fill it with a synthetic history.
+// Objects and refs are written directly rather than through add and commit, so large
+// histories take seconds; master is checked out at the end.
+SynthRepo generate_synthetic_repo(const SynthOptions& options);
@@ -0,0 +1,595 @@
+#include "async_io.h"
+
+#include <cstdlib>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+// Opening, stat'ing and closing files through the ring needs 5.6 headers and kernel
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_FEAT_CUR_PERSONALITY)
+#define MINIGIT_URING 1
+#endif
+#endif
+#ifndef MINIGIT_URING
+#define MINIGIT_URING 0
+#endif
+
+static IoBackend io_backend_from_env() {
+    const char* env = std::getenv("MINIGIT_IO");
+    if (!env) return IoBackend::Auto;
+    std::string value = env;
+    if (value == "uring" || value == "io_uring") return IoBackend::Uring;
+    if (value == "threads") return IoBackend::Threads;
+    return IoBackend::Auto;
+}
+
+static std::atomic<IoBackend> current_io_backend{io_backend_from_env()};
+
+IoBackend io_backend() {
+    return current_io_backend.load(std::memory_order_relaxed);
+}
+
+void set_io_backend(IoBackend backend) {
+    current_io_backend = backend;
+}
+
+const char* io_backend_name(IoBackend backend) {
+    switch (backend) {
+    case IoBackend::Uring: return "io_uring";
+    case IoBackend::Threads: return "threads";
+    default: return "auto";
+    }
+}
+
+#ifndef _WIN32
+bool copy_fd(int src, int dst, uint64_t size) {
+#ifdef __linux__
+#ifdef FICLONE
+    if (ioctl(dst, FICLONE, src) == 0) return true;
+#endif
+    uint64_t copied = 0;
+    while (copied < size) {
+        ssize_t n = copy_file_range(src, nullptr, dst, nullptr, size - copied, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        copied += static_cast<uint64_t>(n);
+    }
+    if (copied == size) return true;
+    if (copied > 0) return false;
+#endif
+    std::vector<char> buffer(IO_BUFFER_SIZE);
+    while (true) {
+        ssize_t n = ::read(src, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        if (!write_fd(dst, buffer.data(), static_cast<size_t>(n))) return false;
+    }
+}
+
+// Read an open file of the given size
+static bool read_fd(int fd, uint64_t size, std::string& out) {
+    out.resize(static_cast<size_t>(size));
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = ::read(fd, &out[done], out.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) break;
+        done += static_cast<size_t>(n);
+    }
+    out.resize(done);
+    return true;
+}
+#endif
+
+// One request with blocking calls, as the thread pool fallback runs it
+static void run_request_sync(IoRequest& request) {
+#ifndef _WIN32
+    bool ok = false;
+    if (request.kind == IoRequest::Read) {
+        int fd = ::open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        ok = fstat(fd, &st) == 0 && read_fd(fd, static_cast<uint64_t>(st.st_size), request.buffer);
+        ::close(fd);
+        request.ok = ok;
+        return;
+    }
+    int dst = ::open(request.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (dst < 0) return;
+    if (request.kind == IoRequest::Write) {
+        ok = write_fd(dst, request.data.data(), request.data.size());
+    } else {
+        int src = ::open(request.source.c_str(), O_RDONLY | O_CLOEXEC);
+        if (src >= 0) {
+            struct stat st;
+            ok = fstat(src, &st) == 0 && copy_fd(src, dst, static_cast<uint64_t>(st.st_size));
+            ::close(src);
+        }
+    }
+    if (ok && request.flush) flush_file(dst);
+    ok = ::close(dst) == 0 && ok;
+#else
+    bool ok = false;
+    if (request.kind == IoRequest::Read) {
+        std::ifstream in(request.path, std::ios::binary);
+        if (!in) return;
+        request.buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        request.ok = !in.bad();
+        return;
+    }
+    {
+        std::ofstream out(request.path, std::ios::binary | std::ios::trunc);
+        if (request.kind == IoRequest::Write) {
+            out.write(request.data.data(), static_cast<std::streamsize>(request.data.size()));
+        } else {
+            std::ifstream in(request.source, std::ios::binary);
+            if (!in) return;
+            out << in.rdbuf();
+        }
+        out.close();
+        ok = static_cast<bool>(out);
+    }
+    if (ok && request.flush) flush_file(request.path);
+#endif
+    request.ok = ok && stat_file(request.path, request.stat);
+}
+
+// With retry, requests that already succeeded are left alone
+static void run_threads(std::vector<IoRequest>& requests, bool retry = false) {
+    const size_t chunk = 16;
+    size_t jobs = (requests.size() + chunk - 1) / chunk;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), IO_FALLBACK_THREADS);
+    if (jobs < threads) threads = static_cast<unsigned>(jobs);
+    ThreadPool pool(threads);
+    for (size_t start = 0; start < requests.size(); start += chunk) {
+        pool.submit([&requests, start, chunk, retry] {
+            size_t end = std::min(requests.size(), start + chunk);
+            for (size_t i = start; i < end; i++) {
+                if (!retry || !requests[i].ok) run_request_sync(requests[i]);
+            }
+        });
+    }
+    pool.wait();
+}
+
+#if MINIGIT_URING
+// A minimal io_uring driven with raw system calls: the submission and completion rings are
+// mapped once, entries are filled in place and io_uring_enter submits and waits in one call
+class Uring {
+public:
+    Uring() = default;
+    ~Uring() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0 || !(params.features & IORING_FEAT_CUR_PERSONALITY)) return false;
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ptr_ = map(sq_size_, IORING_OFF_SQ_RING);
+        if (!sq_ptr_) return false;
+        cq_ptr_ = single_mmap ? sq_ptr_ : map(cq_size_, IORING_OFF_CQ_RING);
+        if (!cq_ptr_) return false;
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+        if (!sqes_) return false;
+        char* sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        local_tail_ = *sq_tail_;
+        char* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // A cleared submission entry, or nullptr if the queue is full
+    io_uring_sqe* get_sqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (local_tail_ - head >= sq_entries_) return nullptr;
+        unsigned index = local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        local_tail_++;
+        return sqe;
+    }
+
+    // Submit everything queued, then wait until at least wait_for completions are ready
+    bool submit(unsigned wait_for) {
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+        while (true) {
+            unsigned pending = local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            unsigned flags = wait_for ? IORING_ENTER_GETEVENTS : 0;
+            long ret = syscall(__NR_io_uring_enter, fd_, pending, wait_for, flags, nullptr, 0);
+            if (ret >= 0) return true;
+            if (errno == EINTR) continue;
+            // Completions must be reaped before more can be submitted
+            return errno == EAGAIN || errno == EBUSY;
+        }
+    }
+
+    // Hand every ready completion to handle(user_data, result)
+    template <typename Handle>
+    void reap(Handle handle) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            uint64_t user_data = cqe.user_data;
+            int32_t result = cqe.res;
+            head++;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            handle(user_data, result);
+        }
+    }
+
+private:
+    void* map(size_t size, uint64_t offset) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, static_cast<off_t>(offset));
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int fd_ = -1;
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0, sq_entries_ = 0, local_tail_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+
+static bool uring_available() {
+    static const bool available = [] {
+        Uring ring;
+        return ring.init(8);
+    }();
+    return available;
+}
+
+// Drives a batch of requests through the ring. Every file in flight is a small state
+// machine: each completion submits that file's next step, and a round of io_uring_enter
+// carries the steps of all of them.
+class UringBatch {
+public:
+    UringBatch(Uring& ring, std::vector<IoRequest>& requests) : ring_(ring), requests_(requests), files_(IO_MAX_IN_FLIGHT) {
+        for (size_t i = 0; i < files_.size(); i++) free_.push_back(files_.size() - 1 - i);
+    }
+
+    bool run() {
+        size_t next = 0;
+        while (next < requests_.size() || active_ > 0 || closing_ > 0) {
+            while (next < requests_.size() && !free_.empty()) {
+                size_t slot = free_.back();
+                free_.pop_back();
+                active_++;
+                start(slot, requests_[next++]);
+            }
+            if (!ring_.submit(1)) return false;
+            ring_.reap([this](uint64_t user_data, int32_t result) { complete(user_data, result); });
+        }
+        return true;
+    }
+
+    // Copies left to the caller because their source is too large to read whole
+    const std::vector<IoRequest*>& streamed() const { return streamed_; }
+
+private:
+    enum Op : uint8_t { OpOpen, OpStat, OpRead, OpWrite, OpFlush, OpClose };
+    enum Stage : uint8_t { ReadOpen, Reading, WriteOpen, Writing, Flushing, WriteStat };
+
+    struct File {
+        IoRequest* request = nullptr;
+        Stage stage = ReadOpen;
+        int fd = -1;
+        int pending = 0;
+        int open_result = 0, stat_result = 0;
+        bool full_sync = false;
+        uint64_t size = 0, done = 0;
+        std::string_view data;
+        struct statx stx;
+    };
+
+    io_uring_sqe* sqe(size_t slot, Op op, int fd) {
+        io_uring_sqe* entry = ring_.get_sqe();
+        while (!entry) {
+            ring_.submit(0);
+            entry = ring_.get_sqe();
+        }
+        entry->fd = fd;
+        entry->user_data = (uint64_t(slot) << 3) | op;
+        return entry;
+    }
+
+    void open(size_t slot, const std::string& path, int flags) {
+        io_uring_sqe* entry = sqe(slot, OpOpen, AT_FDCWD);
+        entry->opcode = IORING_OP_OPENAT;
+        entry->addr = reinterpret_cast<uint64_t>(path.c_str());
+        entry->len = 0666;
+        entry->open_flags = static_cast<uint32_t>(flags | O_CLOEXEC);
+        files_[slot].pending++;
+    }
+
+    // statx of a path, or of the open file when path is empty
+    void stat(size_t slot, int fd, const char* path, int flags, unsigned mask) {
+        io_uring_sqe* entry = sqe(slot, OpStat, fd);
+        entry->opcode = IORING_OP_STATX;
+        entry->addr = reinterpret_cast<uint64_t>(path);
+        entry->len = mask;
+        entry->off = reinterpret_cast<uint64_t>(&files_[slot].stx);
+        entry->statx_flags = static_cast<uint32_t>(flags);
+        files_[slot].pending++;
+    }
+
+    void transfer(size_t slot, Op op) {
+        File& file = files_[slot];
+        io_uring_sqe* entry = sqe(slot, op, file.fd);
+        entry->opcode = op == OpRead ? IORING_OP_READ : IORING_OP_WRITE;
+        const char* base = op == OpRead ? file.request->buffer.data() : file.data.data();
+        entry->addr = reinterpret_cast<uint64_t>(base + file.done);
+        entry->len = static_cast<uint32_t>(std::min<uint64_t>(file.size - file.done, uint64_t(1) << 30));
+        entry->off = file.done;
+        file.pending++;
+    }
+
+    // Closes are not waited for by their file; the batch drains them before returning
+    void close_file(size_t slot) {
+        File& file = files_[slot];
+        if (file.fd < 0) return;
+        io_uring_sqe* entry = sqe(slot, OpClose, file.fd);
+        entry->opcode = IORING_OP_CLOSE;
+        file.fd = -1;
+        closing_++;
+    }
+
+    void start(size_t slot, IoRequest& request) {
+        File& file = files_[slot];
+        file = File();
+        file.request = &request;
+        request.ok = false;
+        if (request.kind == IoRequest::Write) {
+            file.data = request.data;
+            begin_write(slot);
+            return;
+        }
+        // The open and the size lookup go out together
+        const std::string& path = request.kind == IoRequest::Copy ? request.source : request.path;
+        file.stage = ReadOpen;
+        open(slot, path, O_RDONLY);
+        stat(slot, AT_FDCWD, path.c_str(), 0, STATX_SIZE);
+    }
+
+    void begin_write(size_t slot) {
+        File& file = files_[slot];
+        file.stage = WriteOpen;
+        file.size = file.data.size();
+        file.done = 0;
+        open(slot, file.request->path, O_WRONLY | O_CREAT | O_TRUNC);
+    }
+
+    void finish(size_t slot, bool ok) {
+        File& file = files_[slot];
+        close_file(slot);
+        file.request->ok = ok;
+        // A copy's content is only needed until it is written
+        if (file.request->kind == IoRequest::Copy) std::string().swap(file.request->buffer);
+        file.request = nullptr;
+        free_.push_back(slot);
+        active_--;
+    }
+
+    void read_done(size_t slot) {
+        File& file = files_[slot];
+        file.request->buffer.resize(static_cast<size_t>(file.done));
+        if (file.request->kind == IoRequest::Read) {
+            finish(slot, true);
+            return;
+        }
+        close_file(slot);
+        file.data = file.request->buffer;
+        begin_write(slot);
+    }
+
+    void write_done(size_t slot) {
+        File& file = files_[slot];
+        FsyncMode mode = fsync_mode();
+        if (file.request->flush && mode != FsyncMode::Off) {
+            file.stage = Flushing;
+            io_uring_sqe* entry = sqe(slot, OpFlush, file.fd);
+            file.full_sync = mode == FsyncMode::Full;
+            if (file.full_sync) {
+                TRACE_COUNT(TraceCounter::Fsyncs);
+                entry->opcode = IORING_OP_FSYNC;
+            } else {
+                // Write-out only, as flush_file does in batch mode
+                entry->opcode = IORING_OP_SYNC_FILE_RANGE;
+                entry->sync_range_flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+                note_written_out();
+            }
+            file.pending++;
+            return;
+        }
+        static const char empty_path[] = "";
+        file.stage = WriteStat;
+        stat(slot, file.fd, empty_path, AT_EMPTY_PATH, STATX_BASIC_STATS);
+    }
+
+    void complete(uint64_t user_data, int32_t result) {
+        size_t slot = static_cast<size_t>(user_data >> 3);
+        Op op = static_cast<Op>(user_data & 7);
+        if (op == OpClose) {
+            closing_--;
+            return;
+        }
+        File& file = files_[slot];
+        file.pending--;
+        switch (file.stage) {
+        case ReadOpen:
+            if (op == OpOpen) file.open_result = result; else file.stat_result = result;
+            if (file.pending > 0) return;
+            if (file.open_result >= 0) file.fd = file.open_result;
+            if (file.open_result < 0 || file.stat_result < 0) {
+                finish(slot, false);
+                return;
+            }
+            file.size = file.stx.stx_size;
+            if (file.request->kind == IoRequest::Copy && file.size > IO_WHOLE_FILE_MAX) {
+                // Too large to pass through memory; copied with copy_fd after the batch
+                streamed_.push_back(file.request);
+                finish(slot, false);
+                return;
+            }
+            file.done = 0;
+            file.request->buffer.resize(static_cast<size_t>(file.size));
+            if (file.size == 0) {
+                read_done(slot);
+                return;
+            }
+            file.stage = Reading;
+            transfer(slot, OpRead);
+            return;
+        case Reading:
+            if (result < 0) {
+                finish(slot, false);
+                return;
+            }
+            file.done += static_cast<uint64_t>(result);
+            // A file that shrank since its size was taken ends early
+            if (result == 0 || file.done == file.size) {
+                read_done(slot);
+            } else {
+                transfer(slot, OpRead);
+            }
+            return;
+        case WriteOpen:
+            if (result < 0) {
+                finish(slot, false);
+                return;
+            }
+            file.fd = result;
+            file.stage = Writing;
+            if (file.size == 0) {
+                write_done(slot);
+            } else {
+                transfer(slot, OpWrite);
+            }
+            return;
+        case Writing:
+            if (result <= 0) {
+                finish(slot, false);
+                return;
+            }
+            file.done += static_cast<uint64_t>(result);
+            if (file.done == file.size) {
+                write_done(slot);
+            } else {
+                transfer(slot, OpWrite);
+            }
+            return;
+        case Flushing:
+            if (result < 0 && !file.full_sync) {
+                // Filesystems without sync_file_range get a full fsync instead
+                file.full_sync = true;
+                TRACE_COUNT(TraceCounter::Fsyncs);
+                io_uring_sqe* entry = sqe(slot, OpFlush, file.fd);
+                entry->opcode = IORING_OP_FSYNC;
+                file.pending++;
+                return;
+            }
+            if (result < 0) {
+                finish(slot, false);
+                return;
+            }
+            {
+                static const char empty_path[] = "";
+                file.stage = WriteStat;
+                stat(slot, file.fd, empty_path, AT_EMPTY_PATH, STATX_BASIC_STATS);
+            }
+            return;
+        case WriteStat:
+            if (result < 0) {
+                finish(slot, false);
+                return;
+            }
+            {
+                FileStat& st = file.request->stat;
+                st.mtime_ns = int64_t(file.stx.stx_mtime.tv_sec) * 1000000000 + file.stx.stx_mtime.tv_nsec;
+                st.ctime_ns = int64_t(file.stx.stx_ctime.tv_sec) * 1000000000 + file.stx.stx_ctime.tv_nsec;
+                st.size = file.stx.stx_size;
+                st.ino = file.stx.stx_ino;
+                st.mode = file.stx.stx_mode;
+            }
+            finish(slot, true);
+            return;
+        }
+    }
+
+    Uring& ring_;
+    std::vector<IoRequest>& requests_;
+    std::vector<File> files_;
+    std::vector<size_t> free_;
+    std::vector<IoRequest*> streamed_;
+    size_t active_ = 0;
+    size_t closing_ = 0;
+};
+#endif
+
+IoBackend effective_io_backend() {
+    if (io_backend() == IoBackend::Threads) return IoBackend::Threads;
+#if MINIGIT_URING
+    if (uring_available()) return IoBackend::Uring;
+#endif
+    return IoBackend::Threads;
+}
+
+void run_io(std::vector<IoRequest>& requests) {
+    if (requests.empty()) return;
+    TRACE_SCOPE("io: run batch");
+#if MINIGIT_URING
+    if (effective_io_backend() == IoBackend::Uring) {
+        bool failed = false;
+        {
+            Uring ring;
+            if (ring.init(IO_URING_ENTRIES)) {
+                UringBatch batch(ring, requests);
+                if (batch.run()) {
+                    for (IoRequest* request : batch.streamed()) run_request_sync(*request);
+                    return;
+                }
+                std::cerr << "Warning: io_uring failed (" << std::strerror(errno) << "), using threads\n";
+                failed = true;
+            }
+        }
+        // With the ring torn down, whatever it left unfinished (streamed copies included) is
+        // done again from the start
+        if (failed) {
+            run_threads(requests, true);
+            return;
+        }
+    }
+#endif
+    run_threads(requests);
+}
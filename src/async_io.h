@@ -0,0 +1,60 @@
+// Batched whole-file I/O: io_uring on Linux, a thread pool elsewhere
+#pragma once
+
+#include "transaction.h"
+
+// How run_io performs a batch. Auto picks io_uring when the kernel accepts it; MINIGIT_IO=uring
+// or MINIGIT_IO=threads overrides the choice.
+enum class IoBackend { Auto, Uring, Threads };
+
+IoBackend io_backend();
+
+// Override MINIGIT_IO (benchmarks compare the backends in one process)
+void set_io_backend(IoBackend backend);
+
+// The backend a batch would actually run on
+IoBackend effective_io_backend();
+
+const char* io_backend_name(IoBackend backend);
+
+// io_uring submission queue size, and how many files a batch keeps in flight at once; each
+// file needs at most two operations in flight plus a trailing close
+const unsigned IO_URING_ENTRIES = 256;
+const size_t IO_MAX_IN_FLIGHT = 64;
+
+// The fallback runs blocking calls, so it uses more threads than there are cores
+const unsigned IO_FALLBACK_THREADS = 16;
+
+// Callers split work into batches of at most this many files or bytes held in memory, and
+// files larger than IO_WHOLE_FILE_MAX are streamed instead of read whole
+const size_t IO_BATCH_FILES = 4096;
+const size_t IO_BATCH_BYTES = size_t(64) << 20;
+const uint64_t IO_WHOLE_FILE_MAX = uint64_t(64) << 20;
+
+// One whole-file operation
+struct IoRequest {
+    enum Kind : uint8_t { Read, Write, Copy };
+
+    Kind kind = Read;
+    std::string path;        // Read: the file read; Write, Copy: the file created or truncated
+    std::string source;      // Copy: the file whose content is copied
+    std::string_view data;   // Write: the content, which must stay valid until run_io returns
+    std::string buffer;      // Read: the content read
+    bool flush = false;      // Write, Copy: flush the new file as MINIGIT_FSYNC asks
+    FileStat stat;           // Write, Copy: stat data of the file written
+    bool ok = false;
+};
+
+// Run every request, keeping up to IO_MAX_IN_FLIGHT files in flight, and return once all are
+// done. With io_uring each step (open, read, write, flush, stat, close) of every file in
+// flight goes into one submission, so a batch costs a few system calls per round instead of
+// several per file. Copies are a read followed by a write through memory on io_uring, except
+// for sources over IO_WHOLE_FILE_MAX, and copy_fd (reflink or copy_file_range) otherwise.
+// If the ring fails part way, the requests it did not finish are redone on the thread pool.
+void run_io(std::vector<IoRequest>& requests);
+
+#ifndef _WIN32
+// Copy an open file into another: a reflink where the filesystem shares extents, otherwise
+// copy_file_range inside the kernel, otherwise a streamed read/write loop
+bool copy_fd(int src, int dst, uint64_t size);
+#endif
@@ -0,0 +1,325 @@
+#include "bitmap.h"
+
+const uint64_t EWAH_MAX_RUN = 0xffffffffull;
+const uint64_t EWAH_MAX_LITERALS = 0x7fffffffull;
+
+std::vector<uint64_t> ewah_encode(const std::vector<uint64_t>& words) {
+    std::vector<uint64_t> out;
+    size_t i = 0;
+    while (i < words.size()) {
+        uint64_t run_bit = words[i] == ~uint64_t(0) ? 1 : 0;
+        uint64_t clean = run_bit ? ~uint64_t(0) : 0;
+        uint64_t run = 0;
+        while (i < words.size() && words[i] == clean && run < EWAH_MAX_RUN) {
+            run++;
+            i++;
+        }
+        size_t literals_start = i;
+        while (i < words.size() && words[i] != 0 && words[i] != ~uint64_t(0) && i - literals_start < EWAH_MAX_LITERALS) i++;
+        uint64_t literals = i - literals_start;
+        out.push_back(run_bit | (run << 1) | (literals << 33));
+        out.insert(out.end(), words.begin() + static_cast<std::ptrdiff_t>(literals_start),
+                   words.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+    return out;
+}
+
+bool ewah_decode(const uint8_t* data, size_t count, std::vector<uint64_t>& words) {
+    words.clear();
+    size_t i = 0;
+    while (i < count) {
+        uint64_t marker = read_raw<uint64_t>(data + i * 8);
+        i++;
+        uint64_t run = (marker >> 1) & EWAH_MAX_RUN;
+        uint64_t literals = marker >> 33;
+        if (literals > count - i) return false;
+        words.insert(words.end(), static_cast<size_t>(run), (marker & 1) ? ~uint64_t(0) : 0);
+        for (uint64_t l = 0; l < literals; l++, i++) words.push_back(read_raw<uint64_t>(data + i * 8));
+    }
+    return true;
+}
+
+bool ReachabilityBitmaps::load() {
+    objects_ = commits_ = 0;
+    if (!file_.open(BITMAP_PATH)) return false;
+    const uint8_t* p = file_.data();
+    size_t size = file_.size();
+    if (size < BITMAP_HEADER_SIZE + OBJECT_ID_SIZE || std::memcmp(p, BITMAP_MAGIC, 4) != 0 ||
+        read_raw<uint32_t>(p + 4) != BITMAP_VERSION) {
+        return false;
+    }
+    uint32_t objects = read_raw<uint32_t>(p + 8), commits = read_raw<uint32_t>(p + 12);
+    size_t tables = BITMAP_HEADER_SIZE + size_t(objects) * (OBJECT_ID_SIZE + 4) + size_t(commits) * (OBJECT_ID_SIZE + 8);
+    if (size < tables + OBJECT_ID_SIZE) return false;
+    sorted_ = p + BITMAP_HEADER_SIZE + size_t(objects) * OBJECT_ID_SIZE;
+    commit_ids_ = sorted_ + size_t(objects) * 4;
+    offsets_ = commit_ids_ + size_t(commits) * OBJECT_ID_SIZE;
+    objects_ = objects;
+    commits_ = commits;
+    return true;
+}
+
+bool ReachabilityBitmaps::position(const uint8_t* id, uint32_t& pos) const {
+    size_t lo = 0, hi = objects_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t candidate = read_raw<uint32_t>(sorted_ + mid * 4);
+        if (candidate >= objects_) return false;
+        int cmp = std::memcmp(object_id(candidate), id, OBJECT_ID_SIZE);
+        if (cmp == 0) {
+            pos = candidate;
+            return true;
+        }
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return false;
+}
+
+const uint8_t* ReachabilityBitmaps::commit_ewah(uint32_t i, size_t& count) const {
+    uint64_t offset = read_raw<uint64_t>(offsets_ + size_t(i) * 8);
+    size_t end = file_.size() - OBJECT_ID_SIZE;
+    if (offset + 4 > end) return nullptr;
+    count = read_raw<uint32_t>(file_.data() + offset);
+    if (count > (end - offset - 4) / 8) return nullptr;
+    return file_.data() + offset + 4;
+}
+
+bool ReachabilityBitmaps::commit_bitmap(uint32_t i, Bitset& out) const {
+    size_t count;
+    const uint8_t* data = commit_ewah(i, count);
+    return data && ewah_decode(data, count, out.words());
+}
+
+bool ReachabilityBitmaps::find_commit(const uint8_t* id, Bitset& out) const {
+    size_t lo = 0, hi = commits_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(commit_id(static_cast<uint32_t>(mid)), id, OBJECT_ID_SIZE);
+        if (cmp == 0) return commit_bitmap(static_cast<uint32_t>(mid), out);
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return false;
+}
+
+static ObjectId to_object_id(std::string_view hex) {
+    ObjectId id{};
+    std::string raw = hex_to_bytes(std::string(hex));
+    std::memcpy(id.data(), raw.data(), std::min(raw.size(), id.size()));
+    return id;
+}
+
+bool update_bitmaps(const std::vector<std::string>& tips) {
+    TRACE_SCOPE("bitmaps: update");
+    std::vector<ObjectId> order;
+    std::unordered_map<ObjectId, uint32_t, ObjectIdHash> positions;
+    std::unordered_map<ObjectId, std::vector<uint64_t>, ObjectIdHash> encoded;
+    {
+        TRACE_SCOPE("bitmaps: load");
+        ReachabilityBitmaps existing;
+        bool loaded = existing.load();
+        Bitset scratch;
+        if (loaded && std::all_of(tips.begin(), tips.end(), [&](const std::string& tip) {
+                return existing.find_commit(to_object_id(tip).data(), scratch);
+            })) {
+            return true;
+        }
+        if (loaded) {
+            order.resize(existing.object_count());
+            positions.reserve(existing.object_count());
+            for (uint32_t pos = 0; pos < existing.object_count(); pos++) {
+                std::memcpy(order[pos].data(), existing.object_id(pos), OBJECT_ID_SIZE);
+                positions.emplace(order[pos], pos);
+            }
+            for (uint32_t i = 0; i < existing.commit_count(); i++) {
+                size_t count;
+                const uint8_t* data = existing.commit_ewah(i, count);
+                if (!data) continue;
+                ObjectId id;
+                std::memcpy(id.data(), existing.commit_id(i), OBJECT_ID_SIZE);
+                std::vector<uint64_t>& words = encoded[id];
+                words.resize(count);
+                std::memcpy(words.data(), data, count * 8);
+            }
+        }
+    }
+
+    // Commits without bitmaps, parents before children
+    std::vector<std::string> pending;
+    {
+        std::unordered_set<ObjectId, ObjectIdHash> visited;
+        std::vector<std::pair<std::string, bool>> stack;
+        for (const std::string& tip : tips) stack.emplace_back(tip, false);
+        while (!stack.empty()) {
+            if (stack.back().second) {
+                pending.push_back(std::move(stack.back().first));
+                stack.pop_back();
+                continue;
+            }
+            ObjectId id = to_object_id(stack.back().first);
+            if (encoded.count(id) || !visited.insert(id).second) {
+                stack.pop_back();
+                continue;
+            }
+            stack.back().second = true;
+            auto commit = load_commit(stack.back().first);
+            if (commit->buffer.empty()) {
+                std::cerr << "Error: Cannot read commit " << stack.back().first << "\n";
+                return false;
+            }
+            for (std::string_view parent : commit->parents) {
+                if (!encoded.count(to_object_id(parent))) stack.emplace_back(std::string(parent), false);
+            }
+        }
+    }
+
+    // Each new commit's set is its parents' plus what it introduced; a subtree already in
+    // the set is skipped whole
+    const std::string empty_tree = hash_content("");
+    Bitset set, last;
+    std::string last_hash;
+    bool ok = true;
+    auto position_of = [&](std::string_view hex) {
+        ObjectId id = to_object_id(hex);
+        auto it = positions.find(id);
+        if (it != positions.end()) return it->second;
+        uint32_t pos = static_cast<uint32_t>(order.size());
+        order.push_back(id);
+        positions.emplace(id, pos);
+        return pos;
+    };
+    // Hashes in parsed commits and trees are interned, so their positions are also cached by
+    // address, which saves decoding and hashing the ID of every entry of every new tree
+    std::unordered_map<const char*, uint32_t> interned;
+    auto interned_position = [&](std::string_view hash) {
+        auto it = interned.find(hash.data());
+        if (it != interned.end()) return it->second;
+        uint32_t pos = position_of(hash);
+        interned.emplace(hash.data(), pos);
+        return pos;
+    };
+    auto mark_blob = [&](std::string_view hash) {
+        uint32_t pos = interned_position(hash);
+        if (set.test(pos)) return;
+        set.set(pos);
+        std::string list;
+        uint64_t size;
+        std::vector<std::string> chunks;
+        if (read_chunk_list(std::string(hash), list, size) && chunk_list_hashes(list, chunks)) {
+            for (const std::string& chunk : chunks) set.set(position_of(chunk));
+        }
+    };
+    std::function<void(std::string_view)> mark_tree = [&](std::string_view tree_hash) {
+        uint32_t pos = interned_position(tree_hash);
+        if (set.test(pos)) return;
+        set.set(pos);
+        auto tree = load_tree(tree_hash);
+        if (tree->buffer.empty() && tree_hash != empty_tree) {
+            ok = false;
+            return;
+        }
+        for (const TreeEntry& entry : tree->entries) {
+            if (entry.is_tree) mark_tree(entry.hash); else mark_blob(entry.hash);
+        }
+    };
+    auto decode = [&](std::string_view hash, Bitset& out) {
+        auto it = encoded.find(to_object_id(hash));
+        out.words().clear();
+        if (it != encoded.end()) {
+            ewah_decode(reinterpret_cast<const uint8_t*>(it->second.data()), it->second.size(), out.words());
+        }
+    };
+    {
+        TRACE_SCOPE("bitmaps: walk new commits");
+        Bitset parent;
+        for (const std::string& hash : pending) {
+            auto commit = load_commit(hash);
+            if (!commit->parents.empty() && commit->parents[0] == last_hash) {
+                set = std::move(last);
+            } else if (!commit->parents.empty()) {
+                decode(commit->parents[0], set);
+            } else {
+                set = Bitset();
+            }
+            for (size_t p = 1; p < commit->parents.size(); p++) {
+                decode(commit->parents[p], parent);
+                set |= parent;
+            }
+            set.set(position_of(hash));
+            if (!commit->tree.empty()) mark_tree(commit->tree);
+            for (const FileEntry& file : commit->files) mark_blob(file.hash);
+            if (!ok) return false;
+            encoded[to_object_id(hash)] = ewah_encode(set.words());
+            last = std::move(set);
+            last_hash = hash;
+        }
+    }
+
+    // Commits outside everything the tips reach lose their bitmaps
+    Bitset live;
+    for (const std::string& tip : tips) {
+        decode(tip, set);
+        live |= set;
+    }
+    for (auto it = encoded.begin(); it != encoded.end();) {
+        auto pos = positions.find(it->first);
+        if (pos == positions.end() || !live.test(pos->second)) {
+            it = encoded.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    TRACE_SCOPE("bitmaps: write");
+    std::vector<uint32_t> by_id(order.size());
+    for (uint32_t pos = 0; pos < by_id.size(); pos++) by_id[pos] = pos;
+    std::sort(by_id.begin(), by_id.end(), [&](uint32_t a, uint32_t b) { return order[a] < order[b]; });
+    std::vector<const std::pair<const ObjectId, std::vector<uint64_t>>*> commits;
+    for (const auto& entry : encoded) commits.push_back(&entry);
+    std::sort(commits.begin(), commits.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    std::string out(BITMAP_MAGIC, 4);
+    append_raw<uint32_t>(out, BITMAP_VERSION);
+    append_raw<uint32_t>(out, static_cast<uint32_t>(order.size()));
+    append_raw<uint32_t>(out, static_cast<uint32_t>(commits.size()));
+    for (const ObjectId& id : order) out.append(reinterpret_cast<const char*>(id.data()), OBJECT_ID_SIZE);
+    for (uint32_t pos : by_id) append_raw<uint32_t>(out, pos);
+    for (const auto* commit : commits) out.append(reinterpret_cast<const char*>(commit->first.data()), OBJECT_ID_SIZE);
+    uint64_t offset = out.size() + commits.size() * 8;
+    for (const auto* commit : commits) {
+        append_raw<uint64_t>(out, offset);
+        offset += 4 + commit->second.size() * 8;
+    }
+    for (const auto* commit : commits) {
+        append_raw<uint32_t>(out, static_cast<uint32_t>(commit->second.size()));
+        out.append(reinterpret_cast<const char*>(commit->second.data()), commit->second.size() * 8);
+    }
+    Sha256 hasher;
+    hasher.update(out);
+    ObjectId checksum = hasher.finish();
+    out.append(reinterpret_cast<const char*>(checksum.data()), checksum.size());
+    std::error_code ec;
+    fs::create_directories(fs::path(BITMAP_PATH).parent_path(), ec);
+    if (!write_file_atomic(BITMAP_PATH, out)) {
+        std::cerr << "Error: Cannot write " << BITMAP_PATH << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool reachable_objects(const ReachabilityBitmaps& bitmaps, const std::vector<std::string>& commits, Bitset& out) {
+    out = Bitset();
+    Bitset set;
+    for (const std::string& commit : commits) {
+        ObjectId id = to_object_id(commit);
+        if (!bitmaps.find_commit(id.data(), set)) return false;
+        out |= set;
+    }
+    return true;
+}
+
+std::vector<std::string> bitmap_objects(const ReachabilityBitmaps& bitmaps, const Bitset& set) {
+    std::vector<std::string> hashes;
+    set.for_each([&](size_t pos) {
+        if (pos < bitmaps.object_count()) hashes.push_back(bytes_to_hex(bitmaps.object_id(static_cast<uint32_t>(pos)), OBJECT_ID_SIZE));
+    });
+    return hashes;
+}
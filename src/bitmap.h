@@ -0,0 +1,74 @@
+// Reachability bitmaps: per-commit sets of reachable objects over a stable object order
+#pragma once
+
+#include "commit_graph.h"
+
+// Word-aligned hybrid (EWAH) compression of a bitmap's 64-bit words. The stream is a marker
+// word followed by that many literal words, repeated. A marker holds a run of identical
+// all-0 or all-1 words: its bit (bit 0) and length in words (bits 1-32), then the number of
+// literal words that follow it (bits 33-63).
+std::vector<uint64_t> ewah_encode(const std::vector<uint64_t>& words);
+
+// Expand an EWAH stream (count words at data) into words; false if it is malformed
+bool ewah_decode(const uint8_t* data, size_t count, std::vector<uint64_t>& words);
+
+// .minigit/objects/info/bitmaps gives every object reachable from a ref a position, in the
+// order objects were first found walking history oldest first; new objects are appended, so
+// positions never change. Each commit has a bitmap of the positions reachable from it. A
+// commit's set is its parents' plus the few objects it introduced, so with this order each
+// bitmap is mostly long runs and compresses to a handful of words.
+//   "MGBM", u32 version, u32 object count, u32 commit count,
+//   32-byte object IDs in position order, u32 positions sorted by object ID,
+//   sorted 32-byte commit IDs, u64 file offset of each commit's bitmap in the same order,
+//   bitmaps (u32 word count, EWAH words), SHA-256 of everything before it
+const char BITMAP_MAGIC[4] = {'M', 'G', 'B', 'M'};
+const uint32_t BITMAP_VERSION = 1;
+const size_t BITMAP_HEADER_SIZE = 16;
+const std::string BITMAP_PATH = ".minigit/objects/info/bitmaps";
+
+// Read-only view of the bitmap file
+class ReachabilityBitmaps {
+public:
+    bool load();
+
+    uint32_t object_count() const { return objects_; }
+    uint32_t commit_count() const { return commits_; }
+
+    const uint8_t* object_id(uint32_t pos) const { return file_.data() + BITMAP_HEADER_SIZE + size_t(pos) * OBJECT_ID_SIZE; }
+
+    // Position of an object; false if it has none
+    bool position(const uint8_t* id, uint32_t& pos) const;
+
+    const uint8_t* commit_id(uint32_t i) const { return commit_ids_ + size_t(i) * OBJECT_ID_SIZE; }
+
+    // Commit i's bitmap (in commit ID order) as count EWAH words; nullptr if it is truncated
+    const uint8_t* commit_ewah(uint32_t i, size_t& count) const;
+
+    // Decode commit i's bitmap
+    bool commit_bitmap(uint32_t i, Bitset& out) const;
+
+    // Decode a commit's bitmap by ID; false if the commit has none
+    bool find_commit(const uint8_t* id, Bitset& out) const;
+
+private:
+    MappedFile file_;
+    uint32_t objects_ = 0;
+    uint32_t commits_ = 0;
+    const uint8_t* sorted_ = nullptr;
+    const uint8_t* commit_ids_ = nullptr;
+    const uint8_t* offsets_ = nullptr;
+};
+
+// Give bitmaps to every commit reachable from tips that lacks one, walking only those
+// commits and the trees and blobs (with the chunks of chunked blobs) they introduced. When
+// every tip already has one nothing is read beyond the tips' entries; otherwise the file is
+// rewritten, without the bitmaps of commits no longer reachable. False, with the error
+// printed, if a commit or tree cannot be read.
+bool update_bitmaps(const std::vector<std::string>& tips);
+
+// Objects reachable from any of the commits, as positions in bitmaps; false if one of them
+// has no bitmap
+bool reachable_objects(const ReachabilityBitmaps& bitmaps, const std::vector<std::string>& commits, Bitset& out);
+
+// IDs of the objects set in a bitmap
+std::vector<std::string> bitmap_objects(const ReachabilityBitmaps& bitmaps, const Bitset& set);
@@ -0,0 +1,1722 @@
+#include "commands.h"
+
+void init() {
+    if (fs::exists(".minigit")) {
+        std::cerr << "Error: .minigit already exists.\n";
+        return;
+    }
+    fs::create_directory(".minigit");
+    fs::create_directory(".minigit/objects");
+    fs::create_directory(".minigit/refs");
+    fs::create_directory(".minigit/refs/heads");
+    write_file_atomic(".minigit/HEAD", "ref: refs/heads/master");
+    write_file_atomic(".minigit/refs/heads/master", NULL_COMMIT); // Initial null commit
+    write_file_atomic(INDEX_PATH, "");
+    fsync_barrier();
+    std::cout << "Initialized empty MiniGit repository in .minigit/\n";
+}
+
+void add(const std::vector<std::string>& paths) {
+    TRACE_SCOPE("add");
+    IgnoreRules ignore;
+    ignore.load(".minigitignore");
+    std::vector<std::string> roots;
+    for (const std::string& path : paths) {
+        if (!fs::exists(path)) {
+            std::cerr << "Error: File does not exist: " << path << "\n";
+            return;
+        }
+        std::string rel = normalize_path(path);
+        if (rel == ".." || rel.compare(0, 3, "../") == 0 || fs::path(rel).is_absolute()) {
+            std::cerr << "Error: Path is outside the repository: " << path << "\n";
+            return;
+        }
+        roots.push_back(rel);
+    }
+    Transaction tx;
+    if (!tx.lock(INDEX_PATH)) return;
+
+    // Files whose stat data still matches their index entry are not re-hashed
+    IndexView current_index;
+    bool have_index = current_index.open();
+
+    std::mutex results_mutex;
+    std::vector<IndexEntry> staged, unread;
+    std::vector<std::string> errors;
+    ThreadPool pool;
+
+    std::function<void(const std::string&)> stage_file = [&](const std::string& rel) {
+        try {
+            IndexEntry entry;
+            if (!stat_file(rel, entry.stat)) throw std::runtime_error("Cannot stat file");
+            IndexEntry cached;
+            if (have_index && current_index.find(rel, cached) &&
+                index_entry_clean(cached, entry.stat, current_index.mtime_ns()) &&
+                object_exists(cached.hash)) {
+                entry.hash = cached.hash;
+            } else if (entry.stat.size >= chunk_threshold()) {
+                entry.hash = write_chunked_file(rel);
+                if (entry.hash.empty()) throw std::runtime_error("Cannot read or store file");
+            } else if (entry.stat.size <= IO_WHOLE_FILE_MAX) {
+                // Read, hashed and stored below in batches
+                entry.path = rel;
+                std::lock_guard<std::mutex> lock(results_mutex);
+                unread.push_back(std::move(entry));
+                return;
+            } else {
+                entry.hash = hash_file(rel);
+                if (entry.hash.empty()) throw std::runtime_error("Cannot read file");
+                if (!write_blob_from_file(rel, entry.hash)) throw std::runtime_error("Cannot store file");
+            }
+            entry.path = rel;
+            std::lock_guard<std::mutex> lock(results_mutex);
+            staged.push_back(std::move(entry));
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(results_mutex);
+            errors.push_back(rel + ": " + e.what());
+        }
+    };
+    std::function<void(const std::string&)> walk_dir = [&](const std::string& rel) {
+        try {
+            for (const auto& entry : fs::directory_iterator(rel.empty() ? "." : rel)) {
+                std::string name = entry.path().filename().string();
+                if (name == ".minigit") continue;
+                std::string child = rel.empty() ? name : rel + "/" + name;
+                bool is_dir = entry.is_directory() && !entry.is_symlink();
+                if (ignore.matches(child, is_dir)) continue;
+                if (is_dir) {
+                    pool.submit([&, child] { walk_dir(child); });
+                } else if (entry.is_regular_file()) {
+                    pool.submit([&, child] { stage_file(child); });
+                }
+            }
+        } catch (const fs::filesystem_error& e) {
+            std::lock_guard<std::mutex> lock(results_mutex);
+            errors.push_back(rel + ": " + e.what());
+        }
+    };
+
+    // With fsmonitor, a directory is not walked: only the paths beneath it that changed since
+    // the last status, or that it found dirty, can need staging
+    FsmonitorChanges changes;
+    auto is_directory = [](const std::string& rel) { return fs::is_directory(rel.empty() ? "." : rel); };
+    if (std::any_of(roots.begin(), roots.end(), is_directory)) {
+        changes = fsmonitor_changes();
+    }
+    auto add_changed = [&](const std::string& root, const std::string& listed) {
+        std::string child = listed.back() == '/' ? listed.substr(0, listed.size() - 1) : listed;
+        if (child == root) {
+            walk_dir(root);
+            return;
+        }
+        for (size_t pos = child.find('/', root.size() + 1); pos != std::string::npos; pos = child.find('/', pos + 1)) {
+            if (ignore.matches(child.substr(0, pos), true)) return;
+        }
+        std::error_code ec;
+        fs::file_status st = fs::symlink_status(child, ec);
+        bool is_dir = fs::is_directory(st);
+        if (ec || ignore.matches(child, is_dir)) return;
+        if (is_dir) {
+            walk_dir(child);
+        } else if (fs::is_regular_file(st)) {
+            stage_file(child);
+        }
+    };
+
+    {
+        TRACE_SCOPE("add: hash files");
+        for (const std::string& rel : roots) {
+            if (!rel.empty() && (rel == ".minigit" || rel.compare(0, 9, ".minigit/") == 0)) continue;
+            if (fs::is_directory(rel.empty() ? "." : rel)) {
+                if (!rel.empty() && ignore.is_ignored(rel, true)) continue;
+                if (changes.full) {
+                    pool.submit([&, rel] { walk_dir(rel); });
+                    continue;
+                }
+                std::string prefix = rel.empty() ? "" : rel + "/";
+                for (const std::string& path : changes.paths) {
+                    if (path.compare(0, prefix.size(), prefix) == 0) {
+                        pool.submit([&, rel] { add_changed(rel, path); });
+                    }
+                }
+            } else {
+                // Files named explicitly are staged even if an ignore pattern matches them
+                pool.submit([&, rel] { stage_file(rel); });
+            }
+        }
+        pool.wait();
+    }
+
+    // New and modified files: one run_io batch reads them, the pool hashes them and another
+    // batch stores the new objects
+    {
+        TRACE_SCOPE("add: store files");
+        const size_t chunk = 64;
+        size_t next = 0;
+        while (next < unread.size()) {
+            size_t first = next;
+            uint64_t bytes = 0;
+            while (next < unread.size() && next - first < IO_BATCH_FILES &&
+                   (next == first || bytes + unread[next].stat.size <= IO_BATCH_BYTES)) {
+                bytes += unread[next++].stat.size;
+            }
+            std::vector<IoRequest> requests(next - first);
+            for (size_t r = 0; r < requests.size(); r++) requests[r].path = unread[first + r].path;
+            run_io(requests);
+            std::vector<std::string> hashes(requests.size());
+            for (size_t start = 0; start < requests.size(); start += chunk) {
+                pool.submit([&, start] {
+                    size_t end = std::min(requests.size(), start + chunk);
+                    for (size_t r = start; r < end; r++) {
+                        if (requests[r].ok) hashes[r] = hash_content(requests[r].buffer);
+                    }
+                });
+            }
+            pool.wait();
+            std::vector<std::string> stored;
+            std::vector<std::string_view> contents;
+            std::vector<size_t> read;
+            for (size_t r = 0; r < requests.size(); r++) {
+                if (!requests[r].ok) {
+                    errors.push_back(requests[r].path + ": Cannot read file");
+                    continue;
+                }
+                stored.push_back(hashes[r]);
+                contents.push_back(requests[r].buffer);
+                read.push_back(r);
+            }
+            if (!write_objects(stored, contents)) {
+                for (size_t r : read) errors.push_back(requests[r].path + ": Cannot store file");
+                continue;
+            }
+            for (size_t r : read) {
+                unread[first + r].hash = std::move(hashes[r]);
+                staged.push_back(std::move(unread[first + r]));
+            }
+        }
+    }
+
+    for (const std::string& error : errors) {
+        std::cerr << "Error: " << error << "\n";
+    }
+    // Merge the sorted staged entries into the sorted index in one pass
+    TRACE_SCOPE("add: update index");
+    std::vector<IndexEntry> index = load_index();
+    current_index.close();
+    auto by_path = [](const IndexEntry& a, const IndexEntry& b) { return a.path < b.path; };
+    std::sort(staged.begin(), staged.end(), by_path);
+    // Overlapping roots, or fsmonitor paths, can stage a file twice
+    staged.erase(std::unique(staged.begin(), staged.end(),
+                             [](const IndexEntry& a, const IndexEntry& b) { return a.path == b.path; }),
+                 staged.end());
+    size_t added = staged.size();
+    std::string single = added == 1 ? staged[0].path : "";
+    std::vector<IndexEntry> merged;
+    merged.reserve(index.size() + staged.size());
+    size_t i = 0, j = 0;
+    while (i < index.size() || j < staged.size()) {
+        if (j == staged.size() || (i < index.size() && index[i].path < staged[j].path)) {
+            merged.push_back(std::move(index[i++]));
+        } else {
+            if (i < index.size() && index[i].path == staged[j].path) i++;
+            merged.push_back(std::move(staged[j++]));
+        }
+    }
+    save_index(std::move(merged), tx);
+    if (!tx.commit()) return;
+    if (added == 1 && roots.size() == 1 && roots[0] == single) {
+        std::cout << "Added " << single << " to staging area.\n";
+    } else {
+        std::cout << "Added " << added << " files to staging area.\n";
+    }
+}
+
+void commit(const std::string& message) {
+    TRACE_SCOPE("commit");
+    std::ifstream head_file(".minigit/HEAD");
+    std::string head_content;
+    std::getline(head_file, head_content);
+    head_file.close();
+    std::string current_branch;
+    if (head_content.substr(0, 5) == "ref: ") {
+        current_branch = head_content.substr(5);
+    } else {
+        std::cerr << "Error: Detached HEAD not supported.\n";
+        return;
+    }
+    std::string branch_path = ".minigit/" + current_branch;
+    Transaction tx;
+    if (!tx.lock(INDEX_PATH) || !tx.lock(branch_path) || !tx.lock(MERGE_HEAD)) return;
+    std::ifstream branch_file(branch_path);
+    std::string last_commit_hash;
+    std::getline(branch_file, last_commit_hash);
+    branch_file.close();
+    Commit new_commit;
+    new_commit.timestamp = intern(get_current_timestamp());
+    new_commit.message = intern(message);
+    std::string tree = write_tree(make_file_list(read_index()));
+    if (tree.empty()) return;
+    new_commit.tree = intern(tree);
+    std::ifstream merge_head_file(MERGE_HEAD);
+    std::string merge_head;
+    std::getline(merge_head_file, merge_head);
+    merge_head_file.close();
+    if (!is_null_commit(last_commit_hash)) {
+        auto last_commit = load_commit(last_commit_hash);
+        if (merge_head.empty() && commit_tree(*last_commit) == new_commit.tree) {
+            std::cout << "No changes to commit.\n";
+            return;
+        }
+        new_commit.parents.push_back(intern(last_commit_hash));
+    }
+    if (!merge_head.empty()) new_commit.parents.push_back(intern(merge_head));
+    std::string commit_hash_str = write_object(serialize_commit(new_commit));
+    if (commit_hash_str.empty()) return;
+    if (!merge_head.empty()) tx.remove(MERGE_HEAD);
+    tx.write(branch_path, commit_hash_str);
+    update_commit_graph({commit_hash_str});
+    if (!tx.commit()) return;
+    std::cout << "Committed as " << commit_hash_str << "\n";
+}
+
+std::string read_head(std::string& branch) {
+    std::ifstream head_file(".minigit/HEAD");
+    std::string head_content;
+    std::getline(head_file, head_content);
+    head_file.close();
+    if (head_content.substr(0, 5) != "ref: ") {
+        branch.clear();
+        return head_content;
+    }
+    branch = head_content.substr(5);
+    std::ifstream branch_file(".minigit/" + branch);
+    std::string commit_hash;
+    std::getline(branch_file, commit_hash);
+    branch_file.close();
+    return commit_hash;
+}
+
+void status() {
+    TRACE_SCOPE("status");
+    std::string branch;
+    std::string head_hash = read_head(branch);
+    std::shared_ptr<const FileList> head;
+    if (!is_null_commit(head_hash) && !head_hash.empty()) {
+        head = commit_files(load_commit(head_hash));
+    }
+    static const FileList no_files;
+    const FileList& head_files = head ? *head : no_files;
+
+    // Refreshing stale stat data is opportunistic: skipped if another command holds the index
+    Transaction tx;
+    bool can_refresh = tx.lock(INDEX_PATH, true);
+    IndexView view;
+    int64_t index_mtime_ns = 0;
+    std::vector<IndexEntry> entries;
+    if (view.open()) {
+        index_mtime_ns = view.mtime_ns();
+        entries = load_index();
+        view.close();
+    } else {
+        entries = load_index();
+    }
+    // Asked before anything is looked at, so changes made during the scan come after the token
+    FsmonitorChanges changes = fsmonitor_changes();
+    bool save_state = changes.daemon && can_refresh && tx.lock(FSMONITOR_STATE, true);
+
+    // Index vs HEAD
+    std::vector<std::pair<std::string, std::string>> staged_changes;
+    {
+        TRACE_SCOPE("status: index vs HEAD");
+        size_t h = 0, i = 0;
+        while (h < head_files.size() || i < entries.size()) {
+            if (i == entries.size() || (h < head_files.size() && head_files[h].path < entries[i].path)) {
+                staged_changes.emplace_back("deleted:    ", head_files[h].path);
+                h++;
+            } else if (h == head_files.size() || entries[i].path < head_files[h].path) {
+                staged_changes.emplace_back("new file:   ", entries[i].path);
+                i++;
+            } else {
+                if (head_files[h].hash != entries[i].hash) staged_changes.emplace_back("modified:   ", entries[i].path);
+                h++;
+                i++;
+            }
+        }
+    }
+
+    // Working tree vs index, checked in parallel chunks; with fsmonitor, only the entries it
+    // reported or status last found dirty. Entries outside the sparse checkout are skipped,
+    // except during a merge, which writes conflicted files there: those on disk are checked,
+    // so an unresolved conflict is listed.
+    const size_t chunk = 512;
+    std::vector<char> state(entries.size(), 0); // 0 clean, 1 modified, 2 deleted, 3 clean but stat refreshed
+    std::vector<FileStat> fresh(entries.size());
+    SparseCheckout sparse;
+    sparse.load();
+    bool merging = fs::exists(MERGE_HEAD);
+    auto checked = [&](size_t i) {
+        if (sparse.includes(entries[i].path)) return true;
+        std::error_code ec;
+        return merging && fs::exists(entries[i].path, ec);
+    };
+    std::vector<size_t> selected;
+    if (changes.full) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (checked(i)) selected.push_back(i);
+        }
+    } else {
+        selected = changes.select(entries);
+        selected.erase(std::remove_if(selected.begin(), selected.end(), [&](size_t i) { return !checked(i); }),
+                       selected.end());
+    }
+    std::mutex results_mutex;
+    std::vector<std::string> untracked;
+    IgnoreRules ignore;
+    ignore.load(".minigitignore");
+    {
+        TRACE_SCOPE("status: scan working tree");
+        ThreadPool pool;
+        for (size_t start = 0; start < selected.size(); start += chunk) {
+            pool.submit([&, start] {
+                size_t end = std::min(selected.size(), start + chunk);
+                for (size_t s = start; s < end; s++) {
+                    size_t i = selected[s];
+                    if (!stat_file(entries[i].path, fresh[i])) {
+                        state[i] = 2;
+                    } else if (!index_entry_clean(entries[i], fresh[i], index_mtime_ns)) {
+                        state[i] = hash_file(entries[i].path) == entries[i].hash ? 3 : 1;
+                    }
+                }
+            });
+        }
+
+        // Untracked files; a directory with nothing tracked beneath it is reported once
+        std::function<void(const std::string&)> walk_dir = [&](const std::string& rel) {
+            std::error_code ec;
+            for (const auto& entry : fs::directory_iterator(rel.empty() ? "." : rel, ec)) {
+                std::string name = entry.path().filename().string();
+                if (name == ".minigit") continue;
+                std::string child = rel.empty() ? name : rel + "/" + name;
+                bool is_dir = entry.is_directory(ec) && !entry.is_symlink(ec);
+                if (ignore.matches(child, is_dir)) continue;
+                if (is_dir) {
+                    std::string prefix = child + "/";
+                    auto it = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                               [](const IndexEntry& e, const std::string& p) { return e.path < p; });
+                    if (it == entries.end() || it->path.compare(0, prefix.size(), prefix) != 0) {
+                        std::lock_guard<std::mutex> lock(results_mutex);
+                        untracked.push_back(prefix);
+                    } else {
+                        pool.submit([&, child] { walk_dir(child); });
+                    }
+                } else {
+                    auto it = std::lower_bound(entries.begin(), entries.end(), child,
+                                               [](const IndexEntry& e, const std::string& p) { return e.path < p; });
+                    if (it == entries.end() || it->path != child) {
+                        std::lock_guard<std::mutex> lock(results_mutex);
+                        untracked.push_back(child);
+                    }
+                }
+            }
+        };
+        auto tracked_under = [&](const std::string& prefix, bool exact) {
+            auto it = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                       [](const IndexEntry& e, const std::string& p) { return e.path < p; });
+            if (it == entries.end()) return false;
+            return exact ? it->path == prefix : it->path.compare(0, prefix.size(), prefix) == 0;
+        };
+        // One path fsmonitor reported, reported as the full walk would: under the topmost
+        // directory with nothing tracked beneath it, and not at all if it or a directory
+        // above it is ignored
+        auto check_path = [&](const std::string& listed) {
+            std::string rel = listed.back() == '/' ? listed.substr(0, listed.size() - 1) : listed;
+            std::error_code ec;
+            for (size_t pos = rel.find('/'); pos != std::string::npos; pos = rel.find('/', pos + 1)) {
+                std::string dir = rel.substr(0, pos);
+                if (ignore.matches(dir, true)) return;
+                if (!tracked_under(dir + "/", false)) {
+                    if (fs::is_directory(fs::symlink_status(dir, ec))) {
+                        std::lock_guard<std::mutex> lock(results_mutex);
+                        untracked.push_back(dir + "/");
+                    }
+                    return;
+                }
+            }
+            fs::file_status st = fs::symlink_status(rel, ec);
+            if (ec || !fs::exists(st)) return;
+            bool is_dir = fs::is_directory(st);
+            if (ignore.matches(rel, is_dir)) return;
+            if (is_dir && tracked_under(rel + "/", false)) {
+                walk_dir(rel);
+                return;
+            }
+            if (!is_dir && tracked_under(rel, true)) return;
+            std::lock_guard<std::mutex> lock(results_mutex);
+            untracked.push_back(is_dir ? rel + "/" : rel);
+        };
+        if (changes.full) {
+            pool.submit([&] { walk_dir(""); });
+        } else {
+            for (const std::string& path : changes.paths) pool.submit([&] { check_path(path); });
+        }
+        pool.wait();
+    }
+    std::sort(untracked.begin(), untracked.end());
+    untracked.erase(std::unique(untracked.begin(), untracked.end()), untracked.end());
+
+    if (branch.empty()) {
+        std::cout << "HEAD detached at " << head_hash << "\n";
+    } else {
+        std::cout << "On branch " << branch.substr(branch.rfind('/') + 1) << "\n";
+    }
+    if (merging) {
+        std::cout << "Merge in progress: fix conflicts, add the files and commit to conclude it.\n";
+    }
+    if (!staged_changes.empty()) {
+        std::cout << "Changes to be committed:\n";
+        for (const auto& change : staged_changes) {
+            std::cout << "  " << change.first << change.second << "\n";
+        }
+    }
+    bool header = false;
+    bool refreshed = false;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (state[i] == 1 || state[i] == 2) {
+            if (!header) {
+                std::cout << "Changes not staged for commit:\n";
+                header = true;
+            }
+            std::cout << "  " << (state[i] == 1 ? "modified:   " : "deleted:    ") << entries[i].path << "\n";
+        } else if (state[i] == 3) {
+            entries[i].stat = fresh[i];
+            refreshed = true;
+        }
+    }
+    if (!untracked.empty()) {
+        std::cout << "Untracked files:\n";
+        for (const std::string& path : untracked) {
+            std::cout << "  " << path << "\n";
+        }
+    }
+    if (staged_changes.empty() && !header && untracked.empty()) {
+        std::cout << "nothing to commit, working tree clean\n";
+    }
+    if (save_state) {
+        std::vector<std::string> dirty = untracked;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (state[i] == 1 || state[i] == 2) dirty.push_back(entries[i].path);
+        }
+        save_fsmonitor_state(changes.token, dirty, tx);
+    }
+    // Remember stat data for files that turned out unchanged so the next run skips them
+    if (refreshed && can_refresh) save_index(std::move(entries), tx);
+    if ((refreshed && can_refresh) || save_state) tx.commit();
+}
+
+std::string resolve_revision(const std::string& name) {
+    std::string hash;
+    if (name == "HEAD") {
+        std::string branch;
+        hash = read_head(branch);
+    } else if (fs::exists(".minigit/refs/heads/" + name)) {
+        std::ifstream branch_file(".minigit/refs/heads/" + name);
+        std::getline(branch_file, hash);
+    } else if (fs::exists(REMOTES_DIR + "/" + name)) {
+        std::ifstream branch_file(REMOTES_DIR + "/" + name);
+        std::getline(branch_file, hash);
+    } else if (is_object_id(name) && object_exists(name)) {
+        hash = name;
+    }
+    return is_null_commit(hash) ? "" : hash;
+}
+
+FileList index_files(bool worktree) {
+    IndexView view;
+    int64_t index_mtime_ns = view.open() ? view.mtime_ns() : 0;
+    view.close();
+    std::vector<IndexEntry> entries = load_index();
+    if (worktree) {
+        // Files outside the sparse checkout are taken as they are in the index
+        SparseCheckout sparse;
+        sparse.load();
+        std::vector<char> missing(entries.size(), 0);
+        ThreadPool pool;
+        const size_t chunk = 512;
+        for (size_t start = 0; start < entries.size(); start += chunk) {
+            pool.submit([&, start] {
+                size_t end = std::min(entries.size(), start + chunk);
+                for (size_t i = start; i < end; i++) {
+                    if (!sparse.includes(entries[i].path)) continue;
+                    FileStat fresh;
+                    if (!stat_file(entries[i].path, fresh)) {
+                        missing[i] = 1;
+                    } else if (!index_entry_clean(entries[i], fresh, index_mtime_ns)) {
+                        entries[i].hash = hash_file(entries[i].path);
+                    }
+                }
+            });
+        }
+        pool.wait();
+        size_t kept = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (missing[i]) continue;
+            if (kept != i) entries[kept] = std::move(entries[i]);
+            kept++;
+        }
+        entries.resize(kept);
+    }
+    FileList files(&command_arena());
+    files.reserve(entries.size());
+    StringInterner& interner = StringInterner::instance();
+    auto lock = interner.lock();
+    for (const IndexEntry& entry : entries) {
+        files.push_back({interner.intern_locked(entry.path), interner.intern_locked(entry.hash)});
+    }
+    return files;
+}
+
+bool read_diff_content(std::string_view path, std::string_view hash, bool worktree, std::string& out) {
+    if (!worktree) return read_object(std::string(hash), out);
+    std::ifstream file(std::string(path), std::ios::binary | std::ios::ate);
+    // A file outside the sparse checkout is not on disk, and its index blob stands in
+    if (!file) return read_object(std::string(hash), out);
+    out.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(&out[0], static_cast<std::streamsize>(out.size()));
+    return true;
+}
+
+std::vector<std::pair<uint64_t, uint32_t>> line_fingerprint(const std::string& content) {
+    std::vector<std::string_view> lines;
+    std::vector<uint64_t> hashes;
+    split_lines(content, lines, hashes);
+    std::vector<std::pair<uint64_t, uint32_t>> print(lines.size());
+    for (size_t i = 0; i < lines.size(); i++) print[i] = {hashes[i], static_cast<uint32_t>(lines[i].size())};
+    std::sort(print.begin(), print.end());
+    return print;
+}
+
+void detect_renames(std::vector<FileChange>& changes, bool new_worktree) {
+    TRACE_SCOPE("diff: detect renames");
+    std::vector<size_t> deleted, added;
+    for (size_t i = 0; i < changes.size(); i++) {
+        if (changes[i].new_path.empty()) deleted.push_back(i);
+        if (changes[i].old_path.empty()) added.push_back(i);
+    }
+    if (deleted.empty() || added.empty()) return;
+    std::vector<char> paired(changes.size(), 0);
+    auto pair_up = [&](size_t d, size_t a, int similarity) {
+        changes[a].old_path = changes[d].old_path;
+        changes[a].old_hash = changes[d].old_hash;
+        changes[a].similarity = similarity;
+        paired[d] = 1;
+        paired[a] = 1;
+    };
+    std::unordered_map<std::string_view, std::vector<size_t>> by_hash;
+    for (size_t d : deleted) by_hash[changes[d].old_hash].push_back(d);
+    for (size_t a : added) {
+        auto it = by_hash.find(changes[a].new_hash);
+        if (it == by_hash.end() || it->second.empty()) continue;
+        pair_up(it->second.back(), a, 100);
+        it->second.pop_back();
+    }
+
+    deleted.erase(std::remove_if(deleted.begin(), deleted.end(), [&](size_t i) { return paired[i]; }), deleted.end());
+    added.erase(std::remove_if(added.begin(), added.end(), [&](size_t i) { return paired[i]; }), added.end());
+    if (!deleted.empty() && !added.empty() && deleted.size() <= RENAME_LIMIT && added.size() <= RENAME_LIMIT) {
+        using Print = std::vector<std::pair<uint64_t, uint32_t>>;
+        std::vector<Print> deleted_prints(deleted.size()), added_prints(added.size());
+        std::vector<uint64_t> deleted_sizes(deleted.size()), added_sizes(added.size());
+        ThreadPool pool;
+        for (size_t k = 0; k < deleted.size() + added.size(); k++) {
+            pool.submit([&, k] {
+                bool is_added = k >= deleted.size();
+                size_t idx = is_added ? k - deleted.size() : k;
+                const FileChange& change = changes[is_added ? added[idx] : deleted[idx]];
+                std::string content;
+                if (is_added) {
+                    read_diff_content(change.new_path, change.new_hash, new_worktree, content);
+                } else {
+                    read_diff_content(change.old_path, change.old_hash, false, content);
+                }
+                if (is_binary(content)) return;
+                (is_added ? added_prints : deleted_prints)[idx] = line_fingerprint(content);
+                (is_added ? added_sizes : deleted_sizes)[idx] = content.size();
+            });
+        }
+        pool.wait();
+        std::vector<std::tuple<int, size_t, size_t>> candidates;   // similarity, deleted, added
+        for (size_t d = 0; d < deleted.size(); d++) {
+            for (size_t a = 0; a < added.size(); a++) {
+                uint64_t larger = std::max(deleted_sizes[d], added_sizes[a]);
+                uint64_t smaller = std::min(deleted_sizes[d], added_sizes[a]);
+                if (larger == 0 || smaller * 100 < larger * RENAME_THRESHOLD) continue;
+                const Print& x = deleted_prints[d];
+                const Print& y = added_prints[a];
+                uint64_t shared = 0;
+                for (size_t i = 0, j = 0; i < x.size() && j < y.size();) {
+                    if (x[i] < y[j]) i++;
+                    else if (y[j] < x[i]) j++;
+                    else shared += x[i++].second, j++;
+                }
+                int similarity = static_cast<int>(shared * 100 / larger);
+                if (similarity >= RENAME_THRESHOLD) candidates.emplace_back(similarity, d, a);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& x, const auto& y) {
+            return std::get<0>(x) != std::get<0>(y) ? std::get<0>(x) > std::get<0>(y) : x < y;
+        });
+        for (const auto& [similarity, d, a] : candidates) {
+            if (paired[deleted[d]] || paired[added[a]]) continue;
+            pair_up(deleted[d], added[a], similarity);
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < changes.size(); i++) {
+        if (!(paired[i] && changes[i].new_path.empty())) changes[kept++] = changes[i];
+    }
+    changes.resize(kept);
+}
+
+void format_file_change(const FileChange& change, bool new_worktree, std::string& out) {
+    std::string_view old_name = change.old_path.empty() ? change.new_path : change.old_path;
+    std::string_view new_name = change.new_path.empty() ? change.old_path : change.new_path;
+    out.append("diff --git a/").append(old_name).append(" b/").append(new_name).append("\n");
+    if (change.old_path.empty()) out.append("new file\n");
+    if (change.new_path.empty()) out.append("deleted file\n");
+    if (!change.old_path.empty() && !change.new_path.empty() && change.old_path != change.new_path) {
+        out.append("similarity index ").append(std::to_string(change.similarity)).append("%\n");
+        out.append("rename from ").append(change.old_path).append("\n");
+        out.append("rename to ").append(change.new_path).append("\n");
+    }
+    if (change.old_hash == change.new_hash) return;
+    auto short_id = [](std::string_view hash) { return hash.empty() ? std::string(7, '0') : std::string(hash.substr(0, 7)); };
+    out.append("index ").append(short_id(change.old_hash)).append("..").append(short_id(change.new_hash)).append("\n");
+    std::string a, b;
+    if (!change.old_path.empty()) read_diff_content(change.old_path, change.old_hash, false, a);
+    if (!change.new_path.empty()) read_diff_content(change.new_path, change.new_hash, new_worktree, b);
+    if (is_binary(a) || is_binary(b)) {
+        out.append("Binary files a/").append(old_name).append(" and b/").append(new_name).append(" differ\n");
+        return;
+    }
+    out.append(change.old_path.empty() ? "--- /dev/null\n" : "--- a/" + std::string(old_name) + "\n");
+    out.append(change.new_path.empty() ? "+++ /dev/null\n" : "+++ b/" + std::string(new_name) + "\n");
+    write_unified_diff(a, b, out);
+}
+
+void diff(const std::vector<std::string>& args) {
+    TRACE_SCOPE("diff");
+    bool cached = false;
+    std::vector<std::string> revisions;
+    for (const std::string& arg : args) {
+        if (arg == "--cached" || arg == "--staged") cached = true;
+        else revisions.push_back(arg);
+    }
+    if (revisions.size() > 2 || (cached && revisions.size() > 1)) {
+        std::cerr << "Usage: minigit diff [--cached] [<commit> [<commit>]]\n";
+        return;
+    }
+    if (cached && revisions.empty()) revisions.push_back("HEAD");
+    std::vector<DiffSide> sides(2);
+    for (size_t i = 0; i < revisions.size(); i++) {
+        std::string hash = resolve_revision(revisions[i]);
+        if (hash.empty()) {
+            if (revisions[i] == "HEAD") continue;   // No commits yet: an empty tree
+            std::cerr << "Error: Unknown revision " << revisions[i] << "\n";
+            return;
+        }
+        sides[i].tree = commit_tree(*load_commit(hash));
+    }
+    if (revisions.empty()) {
+        sides[0].files = index_files(false);
+        sides[1].files = index_files(true);
+        sides[1].worktree = true;
+    } else if (revisions.size() == 1) {
+        sides[1].files = index_files(!cached);
+        sides[1].worktree = !cached;
+    }
+
+    std::vector<FileChange> changes;
+    if (revisions.size() == 2) {
+        std::string prefix;
+        diff_trees(sides[0].tree, sides[1].tree, prefix,
+                   [&](std::string_view path, std::string_view old_hash, std::string_view new_hash) {
+                       changes.push_back({old_hash.empty() ? "" : path, new_hash.empty() ? "" : path, old_hash, new_hash});
+                   });
+    } else {
+        if (revisions.size() == 1 && !sides[0].tree.empty()) {
+            std::string prefix;
+            flatten_tree(sides[0].tree, prefix, sides[0].files);
+        }
+        const FileList& a = sides[0].files;
+        const FileList& b = sides[1].files;
+        size_t i = 0, j = 0;
+        while (i < a.size() || j < b.size()) {
+            if (j == b.size() || (i < a.size() && a[i].path < b[j].path)) {
+                changes.push_back({a[i].path, "", a[i].hash, ""});
+                i++;
+            } else if (i == a.size() || b[j].path < a[i].path) {
+                changes.push_back({"", b[j].path, "", b[j].hash});
+                j++;
+            } else {
+                if (a[i].hash != b[j].hash) changes.push_back({a[i].path, b[j].path, a[i].hash, b[j].hash});
+                i++;
+                j++;
+            }
+        }
+    }
+    bool worktree = sides[1].worktree;
+    detect_renames(changes, worktree);
+    std::sort(changes.begin(), changes.end(), [](const FileChange& x, const FileChange& y) {
+        return (x.new_path.empty() ? x.old_path : x.new_path) < (y.new_path.empty() ? y.old_path : y.new_path);
+    });
+
+    ThreadPool pool;
+    const size_t batch = 64 * pool.size();
+    for (size_t start = 0; start < changes.size(); start += batch) {
+        size_t end = std::min(changes.size(), start + batch);
+        std::vector<std::string> outputs(end - start);
+        for (size_t k = start; k < end; k++) {
+            pool.submit([&, k] { format_file_change(changes[k], worktree, outputs[k - start]); });
+        }
+        pool.wait();
+        for (const std::string& out : outputs) std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+    }
+    std::cout.flush();
+}
+
+void branch(const std::string& branch_name) {
+    std::ifstream head_file(".minigit/HEAD");
+    std::string head_content;
+    std::getline(head_file, head_content);
+    head_file.close();
+    std::string current_branch;
+    if (head_content.substr(0, 5) == "ref: ") {
+        current_branch = head_content.substr(5);
+    } else {
+        std::cerr << "Error: Detached HEAD not supported.\n";
+        return;
+    }
+    std::string branch_path = ".minigit/" + current_branch;
+    std::ifstream branch_file(branch_path);
+    std::string commit_hash;
+    std::getline(branch_file, commit_hash);
+    branch_file.close();
+    if (is_null_commit(commit_hash)) {
+        std::cerr << "Error: No commits yet. Cannot create branch.\n";
+        return;
+    }
+    if (is_lock_file(branch_name)) {
+        std::cerr << "Error: Branch names cannot end in " << LOCK_SUFFIX << "\n";
+        return;
+    }
+    std::string new_branch_path = ".minigit/refs/heads/" + branch_name;
+    Transaction tx;
+    if (!tx.lock(new_branch_path)) return;
+    if (fs::exists(new_branch_path)) {
+        std::cerr << "Error: Branch already exists.\n";
+        return;
+    }
+    tx.write(new_branch_path, commit_hash);
+    if (!tx.commit()) return;
+    std::cout << "Created branch " << branch_name << "\n";
+}
+
+void checkout(const std::string& target, const std::string& executable_name) {
+    TRACE_SCOPE("checkout");
+    std::string commit_hash;
+    std::string branch_path = ".minigit/refs/heads/" + target;
+    Transaction tx;
+    if (!tx.lock(".minigit/HEAD") || !tx.lock(INDEX_PATH)) return;
+    // Switching away would overwrite the conflict files and carry MERGE_HEAD to another branch
+    if (fs::exists(MERGE_HEAD)) {
+        std::cerr << "Error: A merge is in progress. Resolve the conflicts and commit first.\n";
+        return;
+    }
+    if (fs::exists(branch_path)) {
+        std::ifstream branch_file(branch_path);
+        std::getline(branch_file, commit_hash);
+        branch_file.close();
+        tx.write(".minigit/HEAD", "ref: refs/heads/" + target);
+    } else {
+        commit_hash = target;
+        if (!object_exists(commit_hash)) {
+            std::cerr << "Error: Commit hash does not exist.\n";
+            return;
+        }
+        tx.write(".minigit/HEAD", commit_hash);
+    }
+    auto files = commit_files(load_commit(commit_hash));
+    // The executable is never deleted, even if a commit happens to track it
+    update_working_tree(*files, fs::path(executable_name).filename().string(), tx);
+    if (!tx.commit()) return;
+    std::cout << "Checked out to " << target << "\n";
+}
+
+// Print how many tracked files a sparse checkout includes
+static void print_sparse_summary(const SparseCheckout& sparse) {
+    std::vector<IndexEntry> entries = load_index();
+    size_t included = 0;
+    for (const IndexEntry& entry : entries) included += sparse.includes(entry.path);
+    std::cout << included << " of " << entries.size() << " tracked files in the working tree\n";
+}
+
+void sparse_checkout_set(const std::vector<std::string>& patterns) {
+    TRACE_SCOPE("sparse-checkout");
+    for (const std::string& pattern : patterns) {
+        std::string rel = normalize_path(pattern);
+        if (rel.empty() || rel == ".." || rel.compare(0, 3, "../") == 0 || fs::path(rel).is_absolute()) {
+            std::cerr << "Error: Pattern is not inside the repository: " << pattern << "\n";
+            return;
+        }
+    }
+    Transaction tx;
+    if (!tx.lock(INDEX_PATH) || !tx.lock(SPARSE_CHECKOUT_PATH)) return;
+    SparseCheckout before, after;
+    before.load();
+    after.set(patterns);
+    std::string content;
+    for (const std::string& pattern : after.patterns()) content += pattern + "\n";
+    apply_sparse_checkout(before, after, tx);
+    tx.write(SPARSE_CHECKOUT_PATH, content);
+    if (!tx.commit()) return;
+    print_sparse_summary(after);
+}
+
+void sparse_checkout_list() {
+    SparseCheckout sparse;
+    sparse.load();
+    if (!sparse.enabled()) {
+        std::cout << "Sparse checkout is not enabled.\n";
+        return;
+    }
+    for (const std::string& pattern : sparse.patterns()) std::cout << pattern << "\n";
+}
+
+void sparse_checkout_disable() {
+    TRACE_SCOPE("sparse-checkout");
+    Transaction tx;
+    if (!tx.lock(INDEX_PATH) || !tx.lock(SPARSE_CHECKOUT_PATH)) return;
+    SparseCheckout before;
+    before.load();
+    if (!before.enabled()) {
+        std::cout << "Sparse checkout is not enabled.\n";
+        return;
+    }
+    SparseCheckout after;
+    apply_sparse_checkout(before, after, tx);
+    tx.remove(SPARSE_CHECKOUT_PATH);
+    if (!tx.commit()) return;
+    print_sparse_summary(after);
+}
+
+bool merge(const std::string& branch_name) {
+    TRACE_SCOPE("merge");
+    // A local branch, or a remote-tracking one that fetch wrote
+    std::string target_branch_path = ".minigit/refs/heads/" + branch_name;
+    if (!fs::exists(target_branch_path)) target_branch_path = REMOTES_DIR + "/" + branch_name;
+    if (!fs::exists(target_branch_path)) {
+        std::cerr << "Error: Branch does not exist: " << branch_name << "\n";
+        return false;
+    }
+    Transaction tx;
+    if (!tx.lock(INDEX_PATH) || !tx.lock(MERGE_HEAD)) return false;
+    if (fs::exists(MERGE_HEAD)) {
+        std::cerr << "Error: A merge is in progress. Resolve the conflicts and commit first.\n";
+        return false;
+    }
+    std::ifstream head_file(".minigit/HEAD");
+    std::string head_content;
+    std::getline(head_file, head_content);
+    head_file.close();
+    std::string current_branch;
+    if (head_content.substr(0, 5) == "ref: ") {
+        current_branch = head_content.substr(5);
+    } else {
+        std::cerr << "Error: Detached HEAD not supported.\n";
+        return false;
+    }
+    std::string current_branch_path = ".minigit/" + current_branch;
+    if (!tx.lock(current_branch_path)) return false;
+    std::ifstream current_branch_file(current_branch_path);
+    std::string current_commit_hash;
+    std::getline(current_branch_file, current_commit_hash);
+    current_branch_file.close();
+    std::ifstream target_branch_file(target_branch_path);
+    std::string target_commit_hash;
+    std::getline(target_branch_file, target_commit_hash);
+    target_branch_file.close();
+
+    // Check for fast-forward or already up-to-date cases
+    if (current_commit_hash == target_commit_hash) {
+        std::cout << "Already up-to-date.\n";
+        return true;
+    }
+    // An unborn branch (a fresh repository merging what it fetched) fast-forwards too
+    bool unborn = current_commit_hash.empty() || is_null_commit(current_commit_hash);
+    if (unborn || is_ancestor(current_commit_hash, target_commit_hash)) {
+        tx.write(current_branch_path, target_commit_hash);
+        update_working_tree(*commit_files(load_commit(target_commit_hash)), "", tx);
+        if (!tx.commit()) return false;
+        std::cout << "Fast-forward merge.\n";
+        return true;
+    }
+    if (is_ancestor(target_commit_hash, current_commit_hash)) {
+        std::cout << "Already up-to-date.\n";
+        return true;
+    }
+
+    // Perform three-way merge
+    std::string lca_hash = find_lca(current_commit_hash, target_commit_hash);
+    if (lca_hash.empty()) {
+        std::cerr << "Error: No common ancestor found.\n";
+        return false;
+    }
+    std::string lca_tree = commit_tree(*load_commit(lca_hash));
+    std::string current_tree = commit_tree(*load_commit(current_commit_hash));
+    std::string target_tree = commit_tree(*load_commit(target_commit_hash));
+
+    // Changes on each side relative to the merge base; directories that a side did not
+    // touch are skipped without being read. A path changed on both sides merges cleanly if
+    // both made the same change; if both edited a text file, its lines are merged.
+    struct Change {
+        std::string_view path, base_hash, hash;   // hash is "" if deleted
+    };
+    std::vector<Change> current_changes, target_changes;
+    {
+        TRACE_SCOPE("merge: diff trees");
+        std::string prefix;
+        diff_trees(lca_tree, current_tree, prefix, [&](std::string_view path, std::string_view base, std::string_view hash) {
+            current_changes.push_back({path, base, hash});
+        });
+        diff_trees(lca_tree, target_tree, prefix, [&](std::string_view path, std::string_view base, std::string_view hash) {
+            target_changes.push_back({path, base, hash});
+        });
+    }
+    std::vector<Change> incoming;
+    std::vector<std::string_view> conflicts;
+    struct ContentMerge {
+        std::string_view path, base_hash, current_hash, target_hash;
+        std::string text, hash;
+        size_t conflicts = 0;
+        bool binary = false;
+    };
+    std::vector<ContentMerge> content_merges;
+    {
+        size_t c = 0;
+        for (const Change& change : target_changes) {
+            while (c < current_changes.size() && current_changes[c].path < change.path) c++;
+            if (c < current_changes.size() && current_changes[c].path == change.path) {
+                const Change& ours = current_changes[c];
+                if (ours.hash == change.hash) continue;
+                if (!change.base_hash.empty() && !ours.hash.empty() && !change.hash.empty()) {
+                    content_merges.push_back({change.path, change.base_hash, ours.hash, change.hash, "", "", 0, false});
+                } else {
+                    conflicts.push_back(change.path);
+                }
+            } else {
+                incoming.push_back(change);
+            }
+        }
+    }
+
+    // Line-level merges of files edited on both sides: every version is read in one batch,
+    // the merges run in parallel, and clean results are stored in another batch
+    {
+        TRACE_SCOPE("merge: merge file contents");
+        std::vector<std::string> hashes, versions;
+        for (const ContentMerge& job : content_merges) {
+            hashes.emplace_back(job.base_hash);
+            hashes.emplace_back(job.current_hash);
+            hashes.emplace_back(job.target_hash);
+        }
+        std::vector<bool> found = read_objects(hashes, versions);
+        ThreadPool pool;
+        for (size_t j = 0; j < content_merges.size(); j++) {
+            pool.submit([&, j] {
+                ContentMerge& job = content_merges[j];
+                const std::string &base = versions[j * 3], &ours = versions[j * 3 + 1], &theirs = versions[j * 3 + 2];
+                if (!found[j * 3] || !found[j * 3 + 1] || !found[j * 3 + 2] || is_binary(base) || is_binary(ours) ||
+                    is_binary(theirs)) {
+                    job.binary = true;
+                    return;
+                }
+                job.conflicts = merge_texts(base, ours, theirs, "HEAD", branch_name, job.text);
+                if (!job.conflicts) job.hash = hash_content(job.text);
+            });
+        }
+        pool.wait();
+    }
+    std::vector<const ContentMerge*> conflicted;
+    std::vector<std::string> merged_hashes;
+    std::vector<std::string_view> merged_texts;
+    for (const ContentMerge& job : content_merges) {
+        if (job.binary) {
+            conflicts.push_back(job.path);
+        } else if (job.conflicts) {
+            conflicted.push_back(&job);
+        } else {
+            merged_hashes.push_back(job.hash);
+            merged_texts.push_back(job.text);
+            incoming.push_back({job.path, job.base_hash, intern(job.hash)});
+        }
+    }
+    if (!write_objects(merged_hashes, merged_texts)) return false;
+    std::sort(conflicts.begin(), conflicts.end());
+    std::sort(incoming.begin(), incoming.end(), [](const Change& a, const Change& b) { return a.path < b.path; });
+
+    // Apply the target's changes to the current files; filled in path order, so the
+    // result is already a sorted file list
+    auto current_files = commit_files(load_commit(current_commit_hash));
+    FileList merged_files(&command_arena());
+    merged_files.reserve(current_files->size() + incoming.size());
+    {
+        size_t f = 0;
+        for (const Change& change : incoming) {
+            while (f < current_files->size() && (*current_files)[f].path < change.path) {
+                merged_files.push_back((*current_files)[f++]);
+            }
+            if (f < current_files->size() && (*current_files)[f].path == change.path) f++;
+            if (!change.hash.empty()) merged_files.push_back({change.path, change.hash});
+        }
+        while (f < current_files->size()) merged_files.push_back((*current_files)[f++]);
+    }
+
+    if (!conflicts.empty()) {
+        for (std::string_view file : conflicts) {
+            std::cout << "CONFLICT: both modified " << file << "\n";
+        }
+        std::cout << "Merge aborted.\n";
+        return false;
+    }
+
+    // A clean merge's commit is stored before the working tree is touched, so a failed write
+    // leaves everything as it was
+    std::string commit_hash_str;
+    if (conflicted.empty()) {
+        std::string tree = write_tree(merged_files);
+        if (tree.empty()) return false;
+        Commit new_commit;
+        new_commit.parents = {intern(current_commit_hash), intern(target_commit_hash)};
+        new_commit.timestamp = intern(get_current_timestamp());
+        new_commit.message = intern("Merge branch " + branch_name);
+        new_commit.tree = intern(tree);
+        commit_hash_str = write_object(serialize_commit(new_commit));
+        if (commit_hash_str.empty()) return false;
+    }
+
+    // Update working directory and index
+    update_working_tree(merged_files, "", tx);
+
+    // Overlapping edits: leave the files with conflict markers (the index keeps our side)
+    // and let the next commit record the merge. If one cannot be written the index still
+    // moves with the working tree, but no merge is recorded. Files outside the sparse
+    // checkout are written too, with their directories, so the conflict can be resolved.
+    if (!conflicted.empty()) {
+        bool written = true;
+        for (const ContentMerge* job : conflicted) {
+            std::error_code ec;
+            fs::path parent = fs::path(std::string(job->path)).parent_path();
+            if (!parent.empty()) fs::create_directories(parent, ec);
+            if (!write_file_atomic(std::string(job->path), job->text)) {
+                std::cerr << "Error: Cannot write " << job->path << "\n";
+                written = false;
+                continue;
+            }
+            std::cout << "CONFLICT (content): Merge conflict in " << job->path << "\n";
+        }
+        if (written) tx.write(MERGE_HEAD, target_commit_hash);
+        if (!tx.commit()) return false;
+        if (!written) {
+            std::cerr << "Error: Merge stopped; run 'minigit checkout " << current_branch.substr(11)
+                      << "' to restore the working tree.\n";
+            return false;
+        }
+        std::cout << "Automatic merge failed; fix conflicts, add the files and commit the result.\n";
+        return false;
+    }
+
+    // Update current branch
+    tx.write(current_branch_path, commit_hash_str);
+    update_commit_graph({commit_hash_str});
+    if (!tx.commit()) return false;
+    std::cout << "Merged " << branch_name << " into " << current_branch << "\n";
+    return true;
+}
+
+// Ref files under dir, by their path relative to it
+static std::vector<std::string> list_refs(const std::string& dir) {
+    std::vector<std::string> refs;
+    std::error_code ec;
+    for (const auto& entry : fs::recursive_directory_iterator(dir, ec)) {
+        if (entry.is_regular_file() && !is_lock_file(entry.path().filename().string())) {
+            refs.push_back(fs::relative(entry.path(), dir).generic_string());
+        }
+    }
+    std::sort(refs.begin(), refs.end());
+    return refs;
+}
+
+std::vector<std::string> list_branches() {
+    return list_refs(".minigit/refs/heads");
+}
+
+std::vector<std::string> list_remote_branches() {
+    return list_refs(REMOTES_DIR);
+}
+
+std::vector<std::string> ref_tips() {
+    std::vector<std::string> tips;
+    for (const std::string& branch : list_branches()) {
+        std::ifstream branch_file(".minigit/refs/heads/" + branch);
+        std::string hash;
+        std::getline(branch_file, hash);
+        if (!hash.empty() && !is_null_commit(hash)) tips.push_back(hash);
+    }
+    for (const std::string& branch : list_remote_branches()) {
+        std::ifstream branch_file(REMOTES_DIR + "/" + branch);
+        std::string hash;
+        std::getline(branch_file, hash);
+        if (!hash.empty() && !is_null_commit(hash)) tips.push_back(hash);
+    }
+    std::string head_branch;
+    std::string head = read_head(head_branch);
+    if (head_branch.empty() && !head.empty() && !is_null_commit(head)) tips.push_back(head);
+    return tips;
+}
+
+std::string_view tree_lookup(std::string_view tree_hash, std::string_view path) {
+    while (!tree_hash.empty()) {
+        size_t slash = path.find('/');
+        std::string_view name = path.substr(0, slash);
+        auto tree = load_tree(tree_hash);
+        std::string_view found;
+        for (const TreeEntry& entry : tree->entries) {
+            if (entry.name == name && (slash == std::string_view::npos || entry.is_tree)) {
+                found = entry.hash;
+                break;
+            }
+        }
+        if (slash == std::string_view::npos || found.empty()) return found;
+        tree_hash = found;
+        path = path.substr(slash + 1);
+    }
+    return "";
+}
+
+bool commit_touches_paths(const CommitGraph& graph, uint32_t pos, const LogOptions& options,
+                          const std::vector<uint64_t>& path_hashes) {
+    if (options.use_bloom) {
+        bool maybe = false;
+        for (uint64_t h : path_hashes) maybe = maybe || graph.maybe_changed(pos, h);
+        if (!maybe) return false;
+    }
+    std::string tree = commit_tree(*load_commit(graph.id(pos)));
+    std::vector<uint32_t> parents;
+    graph.parents(pos, parents);
+    if (parents.empty()) {
+        for (const std::string& path : options.paths) {
+            if (!tree_lookup(tree, path).empty()) return true;
+        }
+        return false;
+    }
+    for (uint32_t parent : parents) {
+        std::string parent_tree = commit_tree(*load_commit(graph.id(parent)));
+        bool same = true;
+        for (const std::string& path : options.paths) {
+            if (tree_lookup(tree, path).data() != tree_lookup(parent_tree, path).data()) {
+                same = false;
+                break;
+            }
+        }
+        if (same) return false;
+    }
+    return true;
+}
+
+void log(const LogOptions& options) {
+    TRACE_SCOPE("log");
+    std::vector<std::string> tips;
+    if (options.all) {
+        tips = ref_tips();
+    } else {
+        std::string branch;
+        std::string head = read_head(branch);
+        if (!head.empty() && !is_null_commit(head)) tips.push_back(head);
+    }
+    if (tips.empty()) {
+        std::cout << "No commits yet.\n";
+        return;
+    }
+    update_commit_graph(tips);
+    CommitGraph graph;
+    graph.load();
+    std::vector<uint32_t> starts;
+    for (const std::string& tip : tips) {
+        uint32_t pos;
+        if (graph.find(tip, pos)) {
+            starts.push_back(pos);
+        } else {
+            std::cerr << "Error: Cannot read the history of " << tip << "\n";
+        }
+    }
+    std::vector<uint64_t> path_hashes;
+    for (const std::string& path : options.paths) path_hashes.push_back(bloom_path_hash(path));
+
+    const size_t page_size = 64;
+    std::string page;
+    size_t shown = 0, on_page = 0;
+    auto flush_page = [&] {
+        std::cout.write(page.data(), static_cast<std::streamsize>(page.size()));
+        std::cout.flush();
+        page.clear();
+        on_page = 0;
+    };
+    // Returns false once enough commits were shown
+    auto visit = [&](uint32_t pos) {
+        if (!options.paths.empty() && !commit_touches_paths(graph, pos, options, path_hashes)) return true;
+        std::string hash = graph.id(pos);
+        auto commit = load_commit(hash);
+        page.append("Commit ").append(hash).append("\n");
+        page.append("Date: ").append(commit->timestamp).append("\n");
+        page.append(commit->message).append("\n\n");
+        if (++on_page == page_size) flush_page();
+        return ++shown < options.max_count;
+    };
+
+    Bitset seen(graph.size());
+    std::vector<uint32_t> parents;
+    if (!options.topo_order) {
+        // Newest commit date first; generation breaks ties so parents never precede children
+        std::priority_queue<std::tuple<int64_t, uint32_t, uint32_t>> queue;
+        for (uint32_t pos : starts) {
+            if (seen.test(pos)) continue;
+            seen.set(pos);
+            queue.emplace(graph.date(pos), graph.generation(pos), pos);
+        }
+        while (!queue.empty() && shown < options.max_count) {
+            uint32_t pos = std::get<2>(queue.top());
+            queue.pop();
+            if (!visit(pos)) break;
+            graph.parents(pos, parents);
+            for (uint32_t parent : parents) {
+                if (seen.test(parent)) continue;
+                seen.set(parent);
+                queue.emplace(graph.date(parent), graph.generation(parent), parent);
+            }
+        }
+    } else {
+        // Count each commit's children within the reachable set, then emit a commit once all
+        // of its children are out, following first parents depth-first
+        std::vector<uint32_t> children(graph.size(), 0);
+        std::vector<uint32_t> stack;
+        for (uint32_t pos : starts) {
+            if (seen.test(pos)) continue;
+            seen.set(pos);
+            stack.push_back(pos);
+        }
+        while (!stack.empty()) {
+            uint32_t pos = stack.back();
+            stack.pop_back();
+            graph.parents(pos, parents);
+            for (uint32_t parent : parents) {
+                children[parent]++;
+                if (!seen.test(parent)) {
+                    seen.set(parent);
+                    stack.push_back(parent);
+                }
+            }
+        }
+        std::sort(starts.begin(), starts.end(), [&](uint32_t a, uint32_t b) { return graph.date(a) < graph.date(b); });
+        for (uint32_t pos : starts) {
+            if (children[pos] == 0) stack.push_back(pos);
+        }
+        while (!stack.empty() && shown < options.max_count) {
+            uint32_t pos = stack.back();
+            stack.pop_back();
+            if (!visit(pos)) break;
+            graph.parents(pos, parents);
+            for (auto it = parents.rbegin(); it != parents.rend(); ++it) {
+                if (--children[*it] == 0) stack.push_back(*it);
+            }
+        }
+    }
+    flush_page();
+}
+
+void pack_segment(const std::vector<PackCandidate>& candidates, size_t start, size_t end,
+                  std::vector<std::string>& records, std::vector<std::string>& failed, std::mutex& failed_mutex) {
+    TRACE_SCOPE("gc: delta search");
+    struct WindowEntry {
+        std::string id;
+        std::string content;
+        std::unique_ptr<DeltaIndex> index;
+        int depth = 0;
+    };
+    std::deque<WindowEntry> window;
+    for (size_t i = start; i < end; i++) {
+        if (candidates[i].chunked) {
+            std::string list;
+            uint64_t size;
+            if (!read_chunk_list(candidates[i].hex, list, size)) {
+                std::lock_guard<std::mutex> lock(failed_mutex);
+                failed.push_back(candidates[i].hex);
+                continue;
+            }
+            std::string& record = records[i - start];
+            record.push_back(static_cast<char>(PACK_RECORD_CHUNKS));
+            append_varint(record, size);
+            append_varint(record, list.size());
+            record += list;
+            continue;
+        }
+        WindowEntry current;
+        current.id = hex_to_bytes(candidates[i].hex);
+        if (!read_object(candidates[i].hex, current.content)) {
+            std::lock_guard<std::mutex> lock(failed_mutex);
+            failed.push_back(candidates[i].hex);
+            continue;
+        }
+        const std::string& content = current.content;
+        std::string best = pack_record(content);
+        for (auto it = window.rbegin(); it != window.rend(); ++it) {
+            if (it->depth >= PACK_MAX_DELTA_DEPTH) continue;
+            std::string delta = delta_record(it->id, it->content, it->index, content);
+            if (!delta.empty() && delta.size() < best.size()) {
+                best = std::move(delta);
+                current.depth = it->depth + 1;
+            }
+        }
+        records[i - start] = std::move(best);
+        window.push_back(std::move(current));
+        if (window.size() > PACK_DELTA_WINDOW) window.pop_front();
+    }
+}
+
+// Commits whose objects are in use: the ref tips and a merge in progress
+static std::vector<std::string> bitmap_tips() {
+    std::vector<std::string> tips = ref_tips();
+    std::ifstream merge_head_file(MERGE_HEAD);
+    std::string merge_head;
+    if (std::getline(merge_head_file, merge_head) && !merge_head.empty()) tips.push_back(merge_head);
+    return tips;
+}
+
+void gc() {
+    TRACE_SCOPE("gc");
+    std::map<std::string, PackCandidate> objects;
+    PackStore& store = PackStore::instance();
+    for (const auto& pack : store.packs()) {
+        for (uint32_t i = 0; i < pack->count; i++) {
+            std::string hex = bytes_to_hex(pack->id_at(i), OBJECT_ID_SIZE);
+            objects[hex].hex = hex;
+        }
+    }
+    std::vector<std::string> loose, loose_chunk_lists;
+    for (const auto& entry : fs::directory_iterator(".minigit/objects")) {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file()) continue;
+        if (entry.path().extension() == CHUNK_LIST_SUFFIX && is_object_id(entry.path().stem().string())) {
+            name = entry.path().stem().string();
+            loose_chunk_lists.push_back(name);
+            objects[name].hex = name;
+            objects[name].chunked = true;
+            continue;
+        }
+        if (!is_object_id(name)) continue;
+        loose.push_back(name);
+        objects[name].hex = name;
+    }
+    if (objects.empty()) {
+        std::cout << "Nothing to pack.\n";
+        return;
+    }
+
+    // Walk history from the tips to learn each blob's and tree's path and how recently it
+    // was used. Each tree is walked once, so directories shared between commits cost nothing.
+    std::set<std::string> seen;
+    std::deque<std::string> queue;
+    for (const std::string& tip : ref_tips()) queue.push_back(tip);
+    size_t rank = 0;
+    auto note = [&](std::string_view hash, const std::string& path, const std::string& name, size_t recency) {
+        auto it = objects.find(std::string(hash));
+        if (it == objects.end() || it->second.recency != SIZE_MAX) return false;
+        it->second.path = path;
+        it->second.name = name;
+        it->second.recency = recency;
+        return true;
+    };
+    std::function<void(std::string_view, std::string&, size_t)> walk_tree =
+        [&](std::string_view tree_hash, std::string& prefix, size_t recency) {
+            for (const TreeEntry& entry : load_tree(tree_hash)->entries) {
+                size_t length = prefix.size();
+                prefix.append(entry.name);
+                if (!entry.is_tree) {
+                    note(entry.hash, prefix, std::string(entry.name), recency);
+                } else if (note(entry.hash, prefix + "/", std::string(entry.name) + "/", recency)) {
+                    prefix.push_back('/');
+                    walk_tree(entry.hash, prefix, recency);
+                }
+                prefix.resize(length);
+            }
+        };
+    while (!queue.empty()) {
+        std::string hash = queue.front();
+        queue.pop_front();
+        if (!seen.insert(hash).second || !objects.count(hash)) continue;
+        auto commit = load_commit(hash);
+        PackCandidate& self = objects[hash];
+        self.recency = rank++;
+        if (!commit->tree.empty()) {
+            std::string prefix;
+            if (note(commit->tree, "/", "/", self.recency)) walk_tree(commit->tree, prefix, self.recency);
+        }
+        for (const FileEntry& file : commit->files) {
+            note(file.hash, std::string(file.path), fs::path(std::string(file.path)).filename().string(), self.recency);
+        }
+        for (std::string_view parent : commit->parents) queue.emplace_back(parent);
+    }
+    std::vector<PackCandidate> candidates;
+    candidates.reserve(objects.size());
+    for (auto& pair : objects) {
+        const PackFile* pack;
+        uint64_t offset;
+        uint8_t kind;
+        const uint8_t* data;
+        uint64_t stored;
+        std::error_code ec;
+        if (store.find(pair.first, pack, offset)) {
+            pack_record_at(*pack, offset, kind, pair.second.size, data, stored);
+            pair.second.chunked = kind == PACK_RECORD_CHUNKS;
+        } else if (!pair.second.chunked) {
+            pair.second.size = fs::file_size(loose_object_path(pair.first), ec);
+        }
+        candidates.push_back(std::move(pair.second));
+    }
+    objects.clear();
+    std::sort(candidates.begin(), candidates.end(), [](const PackCandidate& a, const PackCandidate& b) {
+        if (a.name != b.name) return a.name < b.name;
+        if (a.path != b.path) return a.path < b.path;
+        if (a.recency != b.recency) return a.recency < b.recency;
+        if (a.size != b.size) return a.size > b.size;
+        return a.hex < b.hex;
+    });
+
+    PackWriter writer;
+    if (!writer.open("gc")) return;
+
+    // Segments are delta-searched in parallel, one wave at a time, and appended in order
+    std::vector<std::string> failed;
+    std::mutex failed_mutex;
+    uint64_t raw_bytes = 0;
+    size_t deltas = 0;
+    const size_t segment = 256;
+    ThreadPool pool;
+    const size_t wave = segment * pool.size();
+    for (size_t wave_start = 0; wave_start < candidates.size(); wave_start += wave) {
+        size_t wave_end = std::min(candidates.size(), wave_start + wave);
+        std::vector<std::string> records(wave_end - wave_start);
+        for (size_t start = wave_start; start < wave_end; start += segment) {
+            size_t end = std::min(wave_end, start + segment);
+            pool.submit([&, start, end] {
+                std::vector<std::string> out(end - start);
+                pack_segment(candidates, start, end, out, failed, failed_mutex);
+                for (size_t i = start; i < end; i++) records[i - wave_start] = std::move(out[i - start]);
+            });
+        }
+        pool.wait();
+        for (size_t i = wave_start; i < wave_end; i++) {
+            const std::string& record = records[i - wave_start];
+            if (record.empty()) continue;
+            ObjectId id;
+            std::string raw = hex_to_bytes(candidates[i].hex);
+            std::memcpy(id.data(), raw.data(), OBJECT_ID_SIZE);
+            writer.append(id, record);
+            // A chunk list's content is counted in its chunks
+            if (!candidates[i].chunked) raw_bytes += candidates[i].size;
+            if (static_cast<uint8_t>(record[0]) == PACK_RECORD_DELTA) deltas++;
+        }
+    }
+    if (!failed.empty()) {
+        writer.abort();
+        for (const std::string& hex : failed) {
+            std::cerr << "Error: Cannot read object " << hex << "\n";
+        }
+        std::cerr << "Error: gc aborted.\n";
+        return;
+    }
+    std::vector<std::string> old_packs;
+    for (const auto& pack : store.packs()) old_packs.push_back(pack->name);
+    std::string name = writer.finish();
+    if (name.empty()) return;
+    // Nothing is deleted until the pack that replaces it is on disk
+    fsync_barrier();
+
+    old_packs.erase(std::remove(old_packs.begin(), old_packs.end(), name), old_packs.end());
+    for (const std::string& old : old_packs) {
+        fs::remove(PACK_DIR + "/" + old + ".idx");
+        fs::remove(PACK_DIR + "/" + old + ".pack");
+    }
+    uint64_t loose_bytes = 0;
+    for (const std::string& hex : loose) {
+        std::error_code ec;
+        loose_bytes += fs::file_size(loose_object_path(hex), ec);
+        fs::remove(loose_object_path(hex), ec);
+    }
+    for (const std::string& hex : loose_chunk_lists) {
+        std::error_code ec;
+        loose_bytes += fs::file_size(chunk_list_path(hex), ec);
+        fs::remove(chunk_list_path(hex), ec);
+    }
+    // Fold the commit-graph into a single layer while we are at it
+    update_commit_graph(ref_tips());
+    append_commit_graph({}, true);
+    update_bitmaps(bitmap_tips());
+
+    std::cout << "Packed " << writer.count() << " objects (" << deltas << " deltas) into " << name
+              << ".pack (" << raw_bytes << " bytes of content stored in " << writer.bytes() << " bytes)\n";
+    std::cout << "Removed " << loose.size() + loose_chunk_lists.size() << " loose objects (" << loose_bytes << " bytes) and "
+              << old_packs.size() << " old packs\n";
+}
+
+bool reachable_set(ReachabilityBitmaps& bitmaps, Bitset& reachable, std::unordered_set<std::string>& keep) {
+    TRACE_SCOPE("reachable set");
+    std::vector<std::string> tips = bitmap_tips();
+    if (!update_bitmaps(tips)) return false;
+    if (!bitmaps.load() && !tips.empty()) {
+        std::cerr << "Error: Cannot read " << BITMAP_PATH << "\n";
+        return false;
+    }
+    if (!tips.empty() && !reachable_objects(bitmaps, tips, reachable)) {
+        std::cerr << "Error: " << BITMAP_PATH << " is missing a ref's commit\n";
+        return false;
+    }
+    std::string list;
+    uint64_t size;
+    std::vector<std::string> chunks;
+    for (const IndexEntry& entry : load_index()) {
+        keep.insert(entry.hash);
+        if (read_chunk_list(entry.hash, list, size) && chunk_list_hashes(list, chunks)) keep.insert(chunks.begin(), chunks.end());
+    }
+    return true;
+}
+
+// What is stored: loose objects (whole or as chunk lists) and anything else under objects/
+struct LooseObjects {
+    std::vector<std::string> objects;
+    std::vector<std::string> chunk_lists;
+    std::vector<std::string> garbage;
+    uint64_t bytes = 0;
+    uint64_t garbage_bytes = 0;
+};
+
+static LooseObjects scan_loose_objects() {
+    LooseObjects loose;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(".minigit/objects", ec)) {
+        if (!entry.is_regular_file()) continue;
+        std::string name = entry.path().filename().string();
+        uint64_t size = entry.file_size(ec);
+        if (is_object_id(name)) {
+            loose.objects.push_back(name);
+        } else if (entry.path().extension() == CHUNK_LIST_SUFFIX && is_object_id(entry.path().stem().string())) {
+            loose.chunk_lists.push_back(entry.path().stem().string());
+        } else {
+            loose.garbage.push_back(name);
+            loose.garbage_bytes += size;
+            continue;
+        }
+        loose.bytes += size;
+    }
+    return loose;
+}
+
+static bool is_reachable(const ReachabilityBitmaps& bitmaps, const Bitset& reachable,
+                         const std::unordered_set<std::string>& keep, const std::string& hex) {
+    if (keep.count(hex)) return true;
+    std::string id = hex_to_bytes(hex);
+    uint32_t pos;
+    return bitmaps.position(reinterpret_cast<const uint8_t*>(id.data()), pos) && reachable.test(pos);
+}
+
+void count_objects(bool verbose) {
+    TRACE_SCOPE("count-objects");
+    LooseObjects loose = scan_loose_objects();
+    size_t count = loose.objects.size() + loose.chunk_lists.size();
+    if (!verbose) {
+        std::cout << count << " objects, " << loose.bytes / 1024 << " kilobytes\n";
+        return;
+    }
+    ReachabilityBitmaps bitmaps;
+    Bitset reachable;
+    std::unordered_set<std::string> keep;
+    if (!reachable_set(bitmaps, reachable, keep)) return;
+
+    PackStore& store = PackStore::instance();
+    size_t in_pack = 0, packable = 0, reachable_count = 0, unreachable = 0;
+    uint64_t pack_bytes = 0;
+    for (const auto& pack : store.packs()) {
+        in_pack += pack->count;
+        std::error_code ec;
+        pack_bytes += fs::file_size(PACK_DIR + "/" + pack->name + ".pack", ec) + fs::file_size(PACK_DIR + "/" + pack->name + ".idx", ec);
+        for (uint32_t i = 0; i < pack->count; i++) {
+            uint32_t pos;
+            bool live = (bitmaps.position(pack->id_at(i), pos) && reachable.test(pos)) ||
+                        keep.count(bytes_to_hex(pack->id_at(i), OBJECT_ID_SIZE));
+            if (live) reachable_count++; else unreachable++;
+        }
+    }
+    for (const auto* list : {&loose.objects, &loose.chunk_lists}) {
+        for (const std::string& hex : *list) {
+            if (store.contains(hex)) {
+                packable++;
+                continue;
+            }
+            if (is_reachable(bitmaps, reachable, keep, hex)) reachable_count++; else unreachable++;
+        }
+    }
+    std::cout << "count: " << count << "\n";
+    std::cout << "size: " << loose.bytes / 1024 << "\n";
+    std::cout << "in-pack: " << in_pack << "\n";
+    std::cout << "packs: " << store.packs().size() << "\n";
+    std::cout << "size-pack: " << pack_bytes / 1024 << "\n";
+    std::cout << "prune-packable: " << packable << "\n";
+    std::cout << "garbage: " << loose.garbage.size() << "\n";
+    std::cout << "size-garbage: " << loose.garbage_bytes / 1024 << "\n";
+    std::cout << "reachable: " << reachable_count << "\n";
+    std::cout << "unreachable: " << unreachable << "\n";
+}
+
+void prune(bool dry_run) {
+    TRACE_SCOPE("prune");
+    // Holding the index lock keeps add, commit and merge from writing objects meanwhile
+    Transaction tx;
+    if (!tx.lock(INDEX_PATH)) return;
+    ReachabilityBitmaps bitmaps;
+    Bitset reachable;
+    std::unordered_set<std::string> keep;
+    if (!reachable_set(bitmaps, reachable, keep)) {
+        std::cerr << "Error: prune aborted; nothing was removed.\n";
+        return;
+    }
+    LooseObjects loose = scan_loose_objects();
+    size_t pruned = 0;
+    uint64_t pruned_bytes = 0;
+    auto prune_file = [&](const std::string& hex, const std::string& path) {
+        if (is_reachable(bitmaps, reachable, keep, hex)) return;
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        if (dry_run) {
+            std::cout << hex << "\n";
+        } else if (!fs::remove(path, ec) || ec) {
+            std::cerr << "Error: Cannot remove " << path << "\n";
+            return;
+        }
+        pruned++;
+        pruned_bytes += size;
+    };
+    for (const std::string& hex : loose.chunk_lists) prune_file(hex, chunk_list_path(hex));
+    for (const std::string& hex : loose.objects) prune_file(hex, loose_object_path(hex));
+    tx.rollback();
+    std::cout << (dry_run ? "Would prune " : "Pruned ") << pruned << " unreachable objects (" << pruned_bytes << " bytes)\n";
+}
@@ -0,0 +1,165 @@
+// The minigit commands
+#pragma once
+
+#include "bitmap.h"
+#include "diff.h"
+#include "fsmonitor.h"
+#include "ignore.h"
+#include "worktree.h"
+
+// Initialize a new MiniGit repository
+void init();
+
+// Add files and directories (recursively) to the staging area. Directory walking, hashing
+// and blob writes run on a thread pool; the index is loaded once and written once. With
+// fsmonitor running, directories are not walked: only the paths it reports beneath them,
+// and those status last found dirty, are looked at.
+void add(const std::vector<std::string>& paths);
+
+// Commit being merged while a merge waits for conflicts to be resolved
+const std::string MERGE_HEAD = ".minigit/MERGE_HEAD";
+
+// Commit staged changes; concludes a conflicted merge if one is in progress
+void commit(const std::string& message);
+
+// Resolve HEAD to a commit hash; branch receives the branch ref ("" when HEAD is detached)
+std::string read_head(std::string& branch);
+
+// Show staged changes (index vs HEAD), unstaged changes (working tree vs index) and
+// untracked files. Only files whose stat data changed since they were indexed are re-hashed.
+// With fsmonitor running, only the paths it reports and those status last found dirty are
+// looked at, and the new token is saved with the dirty paths found this time.
+void status();
+
+// Resolve HEAD, a branch name, a remote-tracking branch (<remote>/<branch>) or a full commit
+// hash to a commit hash ("" if unknown)
+std::string resolve_revision(const std::string& name);
+
+// One side of a diff: a commit's tree, the index, or the working tree
+struct DiffSide {
+    std::string tree;         // Root tree, for commits
+    FileList files{&command_arena()};
+    bool worktree = false;    // Content comes from files on disk
+};
+
+// A path that differs between the two sides; renames pair an old and a new path
+struct FileChange {
+    std::string_view old_path, new_path;   // "" when added / deleted
+    std::string_view old_hash, new_hash;
+    int similarity = 0;                    // Percent, for renames
+};
+
+// Files of the index, or of the working tree as far as the index tracks it. Tracked files
+// whose stat data changed are re-hashed in parallel; deleted ones are left out.
+FileList index_files(bool worktree);
+
+// Content of one side of a change
+bool read_diff_content(std::string_view path, std::string_view hash, bool worktree, std::string& out);
+
+// Line hashes with lengths, sorted, as a similarity fingerprint of a text
+std::vector<std::pair<uint64_t, uint32_t>> line_fingerprint(const std::string& content);
+
+// Renames are only searched among this many added and deleted files each
+const size_t RENAME_LIMIT = 1000;
+const int RENAME_THRESHOLD = 50;
+
+// Pair deleted with added paths: identical blobs first, then, by descending similarity,
+// pairs sharing at least RENAME_THRESHOLD percent of the larger file's bytes in whole lines
+void detect_renames(std::vector<FileChange>& changes, bool new_worktree);
+
+// Unified diff of one change, with a Git-style header
+void format_file_change(const FileChange& change, bool new_worktree, std::string& out);
+
+// Show changes as unified diffs. With no revisions the working tree is compared with the
+// index, --cached compares a commit (HEAD by default) with the index, one revision is
+// compared with the working tree and two revisions with each other. Renames are detected,
+// and output is produced in batches formatted in parallel and written as they finish.
+void diff(const std::vector<std::string>& args);
+
+// Create a new branch
+void branch(const std::string& branch_name);
+
+// Checkout a branch or commit; refused while a merge is in progress
+void checkout(const std::string& target, const std::string& executable_name);
+
+// Limit the working tree to the paths the patterns include (see SparseCheckout), writing
+// and deleting files to match; the index keeps tracking every path, so commits are complete
+void sparse_checkout_set(const std::vector<std::string>& patterns);
+
+// Print the sparse-checkout patterns
+void sparse_checkout_list();
+
+// Turn sparse checkout off and write every missing file back
+void sparse_checkout_disable();
+
+// Merge a branch, or a remote-tracking branch fetch wrote, into the current branch. False,
+// with the reason printed, if the merge stopped on conflicts or failed.
+bool merge(const std::string& branch_name);
+
+// Names of every branch under refs/heads
+std::vector<std::string> list_branches();
+
+// Where fetch keeps the branches of other repositories, as <remote>/<branch>
+const std::string REMOTES_DIR = ".minigit/refs/remotes";
+
+// Names of every remote-tracking branch, as <remote>/<branch>
+std::vector<std::string> list_remote_branches();
+
+// Commit hashes that refs and HEAD point at
+std::vector<std::string> ref_tips();
+
+// Options of the log command
+struct LogOptions {
+    size_t max_count = SIZE_MAX;      // -n
+    bool all = false;                 // Start from every branch, not just HEAD
+    bool topo_order = false;          // Children before parents, lines of history kept together
+    std::vector<std::string> paths;   // Only commits that changed one of these
+    bool use_bloom = true;            // Skip commits whose changed-path filter rules them out
+};
+
+// Hash of the blob or tree at path within a tree ("" if absent)
+std::string_view tree_lookup(std::string_view tree_hash, std::string_view path);
+
+// Does the commit change any of the paths? A merge counts only if it differs from every
+// parent, since otherwise its content came from a parent that is shown on its own.
+bool commit_touches_paths(const CommitGraph& graph, uint32_t pos, const LogOptions& options,
+                          const std::vector<uint64_t>& path_hashes);
+
+// Display commit history, newest first by commit date (or in topological order). Commits
+// are walked through the commit-graph and output is written a page at a time.
+void log(const LogOptions& options);
+
+// An object to be packed, with the hints used to line up delta candidates: versions of the
+// same path sit next to each other, newest first, so recent checkouts hit full objects
+struct PackCandidate {
+    std::string hex;
+    std::string name;
+    std::string path;
+    size_t recency = SIZE_MAX;
+    uint64_t size = 0;
+    bool chunked = false;   // Stored as a chunk list, which is packed as it is
+};
+
+// Encode a contiguous run of sorted candidates, trying each against a sliding window of the
+// previous objects as a delta base. records/depths are indexed from start.
+void pack_segment(const std::vector<PackCandidate>& candidates, size_t start, size_t end,
+                  std::vector<std::string>& records, std::vector<std::string>& failed, std::mutex& failed_mutex);
+
+// Consolidate loose objects and existing packs into a single pack with a fanout index.
+// Objects are delta-compressed against similar objects (same path, similar size) where that
+// pays off, and LZ-compressed otherwise. Loose copies and old packs are deleted afterwards.
+void gc();
+
+// Every object reachable from a ref or MERGE_HEAD, as positions in bitmaps (brought up to
+// date first), plus the objects only the index refers to, in keep. False, with the error
+// printed, if history cannot be read.
+bool reachable_set(ReachabilityBitmaps& bitmaps, Bitset& reachable, std::unordered_set<std::string>& keep);
+
+// Count loose objects and their size; verbose adds packs, garbage, and how many stored
+// objects are reachable, answered from the reachability bitmaps
+void count_objects(bool verbose);
+
+// Delete loose objects (and chunk lists) that nothing refers to: not reachable from a ref or
+// MERGE_HEAD and not in the index. Packed objects are left for gc to repack. With dry_run,
+// only list what would go.
+void prune(bool dry_run);
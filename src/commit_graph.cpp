@@ -0,0 +1,446 @@
+#include "commit_graph.h"
+
+uint64_t bloom_path_hash(std::string_view path) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : path) h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    return h ^ (h >> 33);
+}
+
+std::string make_bloom_filter(const std::vector<uint64_t>& hashes) {
+    if (hashes.size() > BLOOM_MAX_PATHS) return std::string(1, '\xff');
+    if (hashes.empty()) return std::string(1, '\0');
+    size_t bytes = (hashes.size() * BLOOM_BITS_PER_PATH + 7) / 8;
+    std::string filter(std::max<size_t>(bytes, 8), '\0');
+    uint64_t bits = filter.size() * 8;
+    for (uint64_t h : hashes) {
+        uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+        for (uint32_t i = 0; i < BLOOM_HASHES; i++) {
+            uint64_t bit = (h1 + uint64_t(i) * h2) % bits;
+            filter[bit / 8] = static_cast<char>(filter[bit / 8] | (1 << (bit % 8)));
+        }
+    }
+    return filter;
+}
+
+bool bloom_maybe_contains(const uint8_t* filter, size_t size, uint64_t h) {
+    if (size == 0 || (size == 1 && filter[0] == 0xff)) return true;
+    uint64_t bits = size * 8;
+    uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+    for (uint32_t i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + uint64_t(i) * h2) % bits;
+        if (!(filter[bit / 8] & (1 << (bit % 8)))) return false;
+    }
+    return true;
+}
+
+std::string changed_path_bloom(const Commit& commit) {
+    std::string parent_tree;
+    if (commit.tree.empty()) return "";
+    if (!commit.parents.empty()) {
+        auto parent = load_commit(std::string(commit.parents[0]));
+        if (parent->tree.empty()) return "";
+        parent_tree = std::string(parent->tree);
+    }
+    std::unordered_set<std::string_view> paths;
+    std::string prefix;
+    bool too_many = false;
+    diff_trees(parent_tree, commit.tree, prefix, [&](std::string_view path, std::string_view, std::string_view) {
+        if (too_many) return;
+        // Leading directories go in too, so history can be limited to a directory
+        for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+            paths.insert(path.substr(0, slash));
+        }
+        paths.insert(path);
+        too_many = paths.size() > BLOOM_MAX_PATHS;
+    });
+    if (too_many) return std::string(1, '\xff');
+    std::vector<uint64_t> hashes;
+    hashes.reserve(paths.size());
+    for (std::string_view path : paths) hashes.push_back(bloom_path_hash(path));
+    return make_bloom_filter(hashes);
+}
+
+std::string write_commit_graph_layer(std::vector<GraphEntry>& entries, const CommitGraph& lower) {
+    TRACE_SCOPE("commit-graph: write layer");
+    std::sort(entries.begin(), entries.end(), [](const GraphEntry& a, const GraphEntry& b) { return a.id < b.id; });
+    uint32_t base = static_cast<uint32_t>(lower.size());
+    auto position = [&](const ObjectId& id) -> uint32_t {
+        auto it = std::lower_bound(entries.begin(), entries.end(), id,
+                                   [](const GraphEntry& e, const ObjectId& key) { return e.id < key; });
+        if (it != entries.end() && it->id == id) return base + static_cast<uint32_t>(it - entries.begin());
+        uint32_t pos;
+        return lower.find(id.data(), pos) ? pos : GRAPH_NO_PARENT;
+    };
+    std::string ids, records, extra, bloom_ends, blooms;
+    std::vector<uint32_t> fanout(256, 0);
+    uint32_t extra_count = 0;
+    for (const GraphEntry& e : entries) {
+        blooms += e.bloom;
+        append_raw<uint32_t>(bloom_ends, static_cast<uint32_t>(blooms.size()));
+        fanout[e.id[0]]++;
+        ids.append(reinterpret_cast<const char*>(e.id.data()), OBJECT_ID_SIZE);
+        uint32_t p1 = e.parents.size() > 0 ? position(e.parents[0]) : GRAPH_NO_PARENT;
+        uint32_t p2 = e.parents.size() > 1 ? position(e.parents[1]) : GRAPH_NO_PARENT;
+        if (e.parents.size() > 2) {
+            p2 = GRAPH_EXTRA_EDGES | extra_count;
+            for (size_t i = 1; i < e.parents.size(); i++) {
+                uint32_t edge = position(e.parents[i]);
+                if (i + 1 == e.parents.size()) edge |= GRAPH_LAST_EDGE;
+                append_raw<uint32_t>(extra, edge);
+                extra_count++;
+            }
+        }
+        append_raw<uint32_t>(records, p1);
+        append_raw<uint32_t>(records, p2);
+        append_raw<uint32_t>(records, e.generation);
+        append_raw<int64_t>(records, e.date);
+    }
+    for (int b = 1; b < 256; b++) fanout[b] += fanout[b - 1];
+    std::string out(GRAPH_MAGIC, 4);
+    append_raw<uint32_t>(out, GRAPH_VERSION);
+    append_raw<uint32_t>(out, static_cast<uint32_t>(entries.size()));
+    append_raw<uint32_t>(out, base);
+    append_raw<uint32_t>(out, extra_count);
+    for (uint32_t count : fanout) append_raw<uint32_t>(out, count);
+    out += ids;
+    out += records;
+    out += extra;
+    out += bloom_ends;
+    out += blooms;
+    std::string name = "graph-" + hash_content(out);
+    fs::create_directories(GRAPH_DIR);
+    write_file_atomic(GRAPH_DIR + "/" + name + ".graph", out);
+    return name;
+}
+
+bool lock_commit_graph(Transaction& tx) {
+    for (int attempt = 0;; attempt++) {
+        if (tx.lock(GRAPH_CHAIN, true)) return true;
+        if (attempt == GRAPH_LOCK_ATTEMPTS) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(GRAPH_LOCK_WAIT_MS));
+    }
+}
+
+bool write_commit_graph_chain(const std::vector<std::string>& layers, const std::vector<std::string>& listed,
+                              Transaction& tx) {
+    std::string chain;
+    for (const std::string& name : layers) chain += name + "\n";
+    tx.write(GRAPH_CHAIN, chain);
+    // Layers merged away are only deleted once the chain that drops them is on disk
+    if (!tx.commit()) return false;
+    std::set<std::string> keep(layers.begin(), layers.end());
+    std::error_code ec;
+    for (const std::string& name : listed) {
+        if (!keep.count(name)) fs::remove(GRAPH_DIR + "/" + name + ".graph", ec);
+    }
+    return true;
+}
+
+void append_commit_graph(std::vector<GraphEntry> entries, bool compact) {
+    Transaction tx;
+    if (!lock_commit_graph(tx)) return;
+    CommitGraph graph;
+    graph.load();
+    // Another command may have added some of the entries since the caller looked
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const GraphEntry& entry) {
+        uint32_t pos;
+        return graph.find(entry.id.data(), pos);
+    }), entries.end());
+    std::vector<std::string> names;
+    std::vector<uint32_t> sizes;
+    for (size_t i = 0; i < graph.layer_count(); i++) {
+        names.push_back(graph.layer_name(i));
+        sizes.push_back(graph.layer_size(i));
+    }
+    const std::vector<std::string> listed = names;
+    size_t merge_from = names.size();
+    uint64_t merged_size = entries.size();
+    while (merge_from > 0 && (compact || merged_size * 2 > sizes[merge_from - 1])) {
+        merged_size += sizes[--merge_from];
+    }
+    if (entries.empty() && merge_from == names.size()) return;
+    if (merge_from < names.size()) {
+        uint32_t start = 0;
+        for (size_t i = 0; i < merge_from; i++) start += sizes[i];
+        for (uint32_t pos = start; pos < graph.size(); pos++) {
+            entries.push_back(graph.entry(pos));
+            // Compaction fills in filters that older layers lack
+            if (compact && entries.back().bloom.empty()) {
+                entries.back().bloom = changed_path_bloom(*load_commit(graph.id(pos)));
+            }
+        }
+    }
+    // The layers being replaced are dropped from the view the writer resolves parents against
+    names.resize(merge_from);
+    CommitGraph lower;
+    lower.load_layers(names);
+    names.push_back(write_commit_graph_layer(entries, lower));
+    write_commit_graph_chain(names, listed, tx);
+}
+
+void update_commit_graph(const std::vector<std::string>& tips) {
+    TRACE_SCOPE("commit-graph: update");
+    CommitGraph graph;
+    graph.load();
+    std::map<std::string, GraphEntry> missing;
+    std::map<std::string, std::vector<std::string>> parent_hexes;
+    std::set<std::string> unreadable;
+    std::vector<std::string> stack;
+    for (const std::string& tip : tips) {
+        if (!tip.empty() && !is_null_commit(tip)) stack.push_back(tip);
+    }
+    while (!stack.empty()) {
+        std::string hash = stack.back();
+        stack.pop_back();
+        uint32_t pos;
+        if (missing.count(hash) || unreadable.count(hash) || graph.find(hash, pos)) continue;
+        std::shared_ptr<const Commit> commit;
+        if (is_object_id(hash)) commit = load_commit(hash);
+        if (!commit || commit->buffer.empty()) {
+            unreadable.insert(hash);
+            continue;
+        }
+        GraphEntry& entry = missing[hash];
+        std::string raw = hex_to_bytes(hash);
+        std::memcpy(entry.id.data(), raw.data(), OBJECT_ID_SIZE);
+        entry.date = parse_timestamp(std::string(commit->timestamp));
+        entry.bloom = changed_path_bloom(*commit);
+        for (std::string_view parent_view : commit->parents) {
+            std::string parent(parent_view);
+            parent_hexes[hash].push_back(parent);
+            if (!is_object_id(parent)) continue;
+            ObjectId pid;
+            std::string praw = hex_to_bytes(parent);
+            std::memcpy(pid.data(), praw.data(), OBJECT_ID_SIZE);
+            entry.parents.push_back(pid);
+            stack.push_back(parent);
+        }
+    }
+
+    // A commit with a parent that cannot be read would be recorded with part of its history
+    // cut off, so it is left out, and so is everything descending from it
+    std::map<std::string, std::vector<std::string>> children;
+    std::vector<std::string> dropped;
+    for (const auto& pair : parent_hexes) {
+        for (const std::string& parent : pair.second) {
+            uint32_t pos;
+            if (missing.count(parent)) {
+                children[parent].push_back(pair.first);
+            } else if (!graph.find(parent, pos)) {
+                dropped.push_back(pair.first);
+            }
+        }
+    }
+    while (!dropped.empty()) {
+        std::string hash = std::move(dropped.back());
+        dropped.pop_back();
+        if (!missing.erase(hash)) continue;
+        auto it = children.find(hash);
+        if (it != children.end()) dropped.insert(dropped.end(), it->second.begin(), it->second.end());
+    }
+    if (missing.empty()) return;
+
+    // Generation numbers, computed parents-first with an explicit stack
+    for (auto& pair : missing) {
+        std::vector<std::pair<std::string, bool>> work = {{pair.first, false}};
+        while (!work.empty()) {
+            auto [hash, expanded] = work.back();
+            work.pop_back();
+            GraphEntry& entry = missing[hash];
+            if (entry.generation) continue;
+            if (!expanded) {
+                work.emplace_back(hash, true);
+                for (const std::string& parent : parent_hexes[hash]) {
+                    auto it = missing.find(parent);
+                    if (it != missing.end() && !it->second.generation) work.emplace_back(parent, false);
+                }
+                continue;
+            }
+            uint32_t generation = 1;
+            for (const std::string& parent : parent_hexes[hash]) {
+                uint32_t pos;
+                auto it = missing.find(parent);
+                uint32_t parent_gen = it != missing.end() ? it->second.generation
+                                    : graph.find(parent, pos) ? graph.generation(pos) : 0;
+                generation = std::max(generation, parent_gen + 1);
+            }
+            entry.generation = generation;
+        }
+    }
+    std::vector<GraphEntry> entries;
+    entries.reserve(missing.size());
+    for (auto& pair : missing) entries.push_back(std::move(pair.second));
+    append_commit_graph(std::move(entries));
+}
+
+bool graph_is_ancestor(const CommitGraph& graph, uint32_t a, uint32_t d) {
+    if (a == d) return true;
+    uint32_t min_generation = graph.generation(a);
+    if (graph.generation(d) <= min_generation) return false;
+    Bitset visited(graph.size());
+    std::vector<uint32_t> stack = {d};
+    std::vector<uint32_t> parents;
+    visited.set(d);
+    while (!stack.empty()) {
+        uint32_t pos = stack.back();
+        stack.pop_back();
+        graph.parents(pos, parents);
+        for (uint32_t p : parents) {
+            if (p == a) return true;
+            if (p == GRAPH_NO_PARENT || visited.test(p) || graph.generation(p) <= min_generation) continue;
+            visited.set(p);
+            stack.push_back(p);
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> graph_merge_bases(const CommitGraph& graph, uint32_t c1, uint32_t c2) {
+    if (c1 == c2) return {c1};
+    const uint8_t SIDE1 = 1, SIDE2 = 2, STALE = 4;
+    Bitset side1(graph.size()), side2(graph.size()), stale(graph.size()), result(graph.size());
+    auto flags_of = [&](uint32_t pos) {
+        return uint8_t((side1.test(pos) ? SIDE1 : 0) | (side2.test(pos) ? SIDE2 : 0) | (stale.test(pos) ? STALE : 0));
+    };
+    auto add_flags = [&](uint32_t pos, uint8_t flags) {
+        if (flags & SIDE1) side1.set(pos);
+        if (flags & SIDE2) side2.set(pos);
+        if (flags & STALE) stale.set(pos);
+    };
+    // Queue items are (generation, position, pushed while not stale)
+    using Item = std::tuple<uint32_t, uint32_t, bool>;
+    std::priority_queue<Item> queue;
+    size_t active = 0;
+    auto push = [&](uint32_t pos, uint8_t flags) {
+        bool is_active = !(flags & STALE);
+        queue.emplace(graph.generation(pos), pos, is_active);
+        if (is_active) active++;
+    };
+    add_flags(c1, SIDE1);
+    add_flags(c2, SIDE2);
+    push(c1, SIDE1);
+    push(c2, SIDE2);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> parents;
+    while (active > 0) {
+        auto [generation, pos, was_active] = queue.top();
+        (void)generation;
+        queue.pop();
+        if (was_active) active--;
+        uint8_t flags = flags_of(pos);
+        if (flags == (SIDE1 | SIDE2)) {
+            if (!result.test(pos)) {
+                result.set(pos);
+                candidates.push_back(pos);
+            }
+            flags |= STALE;
+        }
+        graph.parents(pos, parents);
+        for (uint32_t p : parents) {
+            if (p == GRAPH_NO_PARENT || (flags_of(p) & flags) == flags) continue;
+            add_flags(p, flags);
+            push(p, flags);
+        }
+    }
+    std::vector<uint32_t> bases;
+    for (uint32_t candidate : candidates) {
+        bool redundant = false;
+        for (uint32_t other : candidates) {
+            if (other != candidate && graph_is_ancestor(graph, candidate, other)) {
+                redundant = true;
+                break;
+            }
+        }
+        if (!redundant) bases.push_back(candidate);
+    }
+    std::sort(bases.begin(), bases.end(), [&](uint32_t a, uint32_t b) {
+        if (graph.generation(a) != graph.generation(b)) return graph.generation(a) > graph.generation(b);
+        return std::memcmp(graph.raw_id(a), graph.raw_id(b), OBJECT_ID_SIZE) < 0;
+    });
+    return bases;
+}
+
+std::vector<uint32_t> graph_commits_between(const CommitGraph& graph, const std::vector<uint32_t>& wants,
+                                            const std::vector<uint32_t>& haves,
+                                            const std::function<bool(uint32_t)>& also_have,
+                                            std::vector<uint32_t>& boundary) {
+    boundary.clear();
+    Bitset wanted(graph.size()), had(graph.size()), queued(graph.size());
+    // A parent's generation is below its children's, so a commit's flags are final once it
+    // is popped. active counts queued commits not yet known to be had.
+    std::priority_queue<std::pair<uint32_t, uint32_t>> queue;
+    size_t active = 0;
+    auto push = [&](uint32_t pos) {
+        if (queued.test(pos)) return;
+        queued.set(pos);
+        queue.emplace(graph.generation(pos), pos);
+        if (!had.test(pos)) active++;
+    };
+    auto mark_had = [&](uint32_t pos) {
+        if (had.test(pos)) return;
+        had.set(pos);
+        if (queued.test(pos)) active--;
+    };
+    for (uint32_t pos : haves) {
+        mark_had(pos);
+        push(pos);
+    }
+    for (uint32_t pos : wants) {
+        wanted.set(pos);
+        push(pos);
+    }
+    std::vector<uint32_t> result;
+    std::vector<uint32_t> parents;
+    while (active > 0) {
+        uint32_t pos = queue.top().second;
+        queue.pop();
+        if (!had.test(pos)) {
+            active--;
+            if (also_have(pos)) had.set(pos);
+        }
+        graph.parents(pos, parents);
+        if (had.test(pos)) {
+            if (wanted.test(pos)) boundary.push_back(pos);
+            for (uint32_t p : parents) {
+                if (p == GRAPH_NO_PARENT) continue;
+                mark_had(p);
+                push(p);
+            }
+            continue;
+        }
+        result.push_back(pos);
+        for (uint32_t p : parents) {
+            if (p == GRAPH_NO_PARENT) continue;
+            wanted.set(p);
+            push(p);
+        }
+    }
+    // Whatever is still queued is had; the commits among it that were reached from wants
+    // are boundary too
+    for (; !queue.empty(); queue.pop()) {
+        if (wanted.test(queue.top().second)) boundary.push_back(queue.top().second);
+    }
+    return result;
+}
+
+bool is_ancestor(const std::string& ancestor, const std::string& descendant) {
+    TRACE_SCOPE("is_ancestor");
+    if (ancestor == descendant) return true;
+    update_commit_graph({ancestor, descendant});
+    CommitGraph graph;
+    uint32_t a, d;
+    if (!graph.load() || !graph.find(ancestor, a) || !graph.find(descendant, d)) return false;
+    return graph_is_ancestor(graph, a, d);
+}
+
+std::string find_lca(const std::string& commit1, const std::string& commit2) {
+    TRACE_SCOPE("find_lca");
+    update_commit_graph({commit1, commit2});
+    CommitGraph graph;
+    uint32_t c1, c2;
+    if (!graph.load() || !graph.find(commit1, c1) || !graph.find(commit2, c2)) return "";
+    std::vector<uint32_t> bases = graph_merge_bases(graph, c1, c2);
+    return bases.empty() ? "" : graph.id(bases.front());
+}
@@ -0,0 +1,303 @@
+// The layered commit-graph with changed-path Bloom filters, and ancestry queries
+#pragma once
+
+#include "objects.h"
+
+// The commit-graph stores parents, generation numbers and dates for every commit so that
+// ancestry queries never parse commit objects. It is a chain of layers: .minigit/commit-graph
+// lists the layer files in .minigit/commit-graphs, oldest first. New commits go into a small
+// layer on top, and the top two layers are merged whenever the upper one holds more than
+// half as many commits as the one below, so the chain stays O(log n) long.
+//   layer:  "MGCG", u32 version, u32 count, u32 base (commits in lower layers),
+//           u32 extra edge count, u32 fanout[256], sorted 32-byte IDs,
+//           per commit u32 parent1, u32 parent2, u32 generation, i64 date, then u32 extra edges,
+//           then (version 2) per commit u32 end offset of its Bloom filter, then the filters
+// A commit's dense position is the layer's base plus its index within the layer. Parents
+// are positions (always in the same or a lower layer); GRAPH_NO_PARENT marks an absent
+// parent. Octopus merges set GRAPH_EXTRA_EDGES on parent2, whose low bits index the extra
+// edge list holding the second and later parents, the last one tagged GRAPH_LAST_EDGE.
+// Generation numbers are 1 for root commits and 1 + the largest parent generation otherwise.
+// Each commit's Bloom filter holds the paths (and their leading directories) that differ
+// from its first parent; an empty filter means none was computed (version 1 layers, commits
+// without trees), and a single 0xff byte means too many paths changed to be worth one.
+const char GRAPH_MAGIC[4] = {'M', 'G', 'C', 'G'};
+const uint32_t GRAPH_VERSION = 2;
+const size_t GRAPH_HEADER_SIZE = 20 + 256 * 4;
+const size_t GRAPH_RECORD_SIZE = 4 + 4 + 4 + 8;
+const uint32_t GRAPH_NO_PARENT = 0xffffffff;
+const uint32_t GRAPH_EXTRA_EDGES = 0x80000000;
+const uint32_t GRAPH_LAST_EDGE = 0x80000000;
+const std::string GRAPH_CHAIN = ".minigit/commit-graph";
+const std::string GRAPH_DIR = ".minigit/commit-graphs";
+const size_t BLOOM_BITS_PER_PATH = 10;
+const uint32_t BLOOM_HASHES = 7;
+const size_t BLOOM_MAX_PATHS = 512;
+
+// Hash a path for the changed-path Bloom filters (64-bit FNV-1a, finalized)
+uint64_t bloom_path_hash(std::string_view path);
+
+// Build a Bloom filter over path hashes
+std::string make_bloom_filter(const std::vector<uint64_t>& hashes);
+
+// False only if the filter proves the path is not in it
+bool bloom_maybe_contains(const uint8_t* filter, size_t size, uint64_t h);
+
+// A commit as handed to the commit-graph writer
+struct GraphEntry {
+    ObjectId id;
+    std::vector<ObjectId> parents;
+    uint32_t generation = 0;
+    int64_t date = 0;
+    std::string bloom;   // Changed-path filter ("" if not computed)
+};
+
+// Read-only view of the commit-graph chain
+class CommitGraph {
+public:
+    // Load the layers listed in the chain file
+    bool load() {
+        TRACE_SCOPE("commit-graph: load");
+        std::ifstream chain(GRAPH_CHAIN);
+        std::vector<std::string> names;
+        std::string name;
+        while (std::getline(chain, name)) {
+            if (!name.empty()) names.push_back(name);
+        }
+        return load_layers(names);
+    }
+
+    // Load an explicit list of layers, oldest first
+    bool load_layers(const std::vector<std::string>& names) {
+        layers_.clear();
+        uint32_t expected_base = 0;
+        for (const std::string& name : names) {
+            auto layer = std::make_unique<Layer>();
+            layer->name = name;
+            if (!layer->file.open(GRAPH_DIR + "/" + name + ".graph")) return fail();
+            const uint8_t* p = layer->file.data();
+            uint32_t version = layer->file.size() >= GRAPH_HEADER_SIZE ? read_raw<uint32_t>(p + 4) : 0;
+            if (layer->file.size() < GRAPH_HEADER_SIZE || std::memcmp(p, GRAPH_MAGIC, 4) != 0 ||
+                version < 1 || version > GRAPH_VERSION) {
+                return fail();
+            }
+            layer->count = read_raw<uint32_t>(p + 8);
+            layer->base = read_raw<uint32_t>(p + 12);
+            layer->extra_count = read_raw<uint32_t>(p + 16);
+            size_t blooms = GRAPH_HEADER_SIZE + size_t(layer->count) * (OBJECT_ID_SIZE + GRAPH_RECORD_SIZE) +
+                            size_t(layer->extra_count) * 4;
+            if (layer->base != expected_base || layer->file.size() < blooms) return fail();
+            if (version >= 2) {
+                if (layer->file.size() < blooms + size_t(layer->count) * 4) return fail();
+                layer->bloom_ends = layer->file.data() + blooms;
+                layer->bloom_data = layer->bloom_ends + size_t(layer->count) * 4;
+                layer->bloom_size = layer->file.size() - blooms - size_t(layer->count) * 4;
+            }
+            expected_base += layer->count;
+            layers_.push_back(std::move(layer));
+        }
+        size_ = expected_base;
+        return !layers_.empty();
+    }
+
+    size_t size() const { return size_; }
+    size_t layer_count() const { return layers_.size(); }
+    uint32_t layer_size(size_t i) const { return layers_[i]->count; }
+    const std::string& layer_name(size_t i) const { return layers_[i]->name; }
+
+    bool find(const std::string& hex, uint32_t& pos) const {
+        if (hex.size() != OBJECT_ID_HEX_LEN) return false;
+        std::string id = hex_to_bytes(hex);
+        return find(reinterpret_cast<const uint8_t*>(id.data()), pos);
+    }
+
+    bool find(const uint8_t* id, uint32_t& pos) const {
+        for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
+            const Layer& layer = **it;
+            const uint8_t* fanout = layer.file.data() + 20;
+            size_t lo = id[0] == 0 ? 0 : read_raw<uint32_t>(fanout + (id[0] - 1) * 4);
+            size_t hi = read_raw<uint32_t>(fanout + id[0] * 4);
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                int cmp = std::memcmp(layer.id_at(mid), id, OBJECT_ID_SIZE);
+                if (cmp == 0) {
+                    pos = layer.base + static_cast<uint32_t>(mid);
+                    return true;
+                }
+                if (cmp < 0) lo = mid + 1; else hi = mid;
+            }
+        }
+        return false;
+    }
+
+    const uint8_t* raw_id(uint32_t pos) const {
+        const Layer& layer = layer_of(pos);
+        return layer.id_at(pos - layer.base);
+    }
+
+    std::string id(uint32_t pos) const { return bytes_to_hex(raw_id(pos), OBJECT_ID_SIZE); }
+
+    uint32_t generation(uint32_t pos) const {
+        const Layer& layer = layer_of(pos);
+        return read_raw<uint32_t>(layer.record_at(pos - layer.base) + 8);
+    }
+
+    int64_t date(uint32_t pos) const {
+        const Layer& layer = layer_of(pos);
+        return read_raw<int64_t>(layer.record_at(pos - layer.base) + 12);
+    }
+
+    void parents(uint32_t pos, std::vector<uint32_t>& out) const {
+        out.clear();
+        const Layer& layer = layer_of(pos);
+        const uint8_t* record = layer.record_at(pos - layer.base);
+        uint32_t p1 = read_raw<uint32_t>(record);
+        uint32_t p2 = read_raw<uint32_t>(record + 4);
+        if (p1 != GRAPH_NO_PARENT) out.push_back(p1);
+        if (p2 == GRAPH_NO_PARENT) return;
+        if (!(p2 & GRAPH_EXTRA_EDGES)) {
+            out.push_back(p2);
+            return;
+        }
+        for (uint32_t e = p2 & ~GRAPH_EXTRA_EDGES; e < layer.extra_count; e++) {
+            uint32_t edge = layer.extra_at(e);
+            out.push_back(edge & ~GRAPH_LAST_EDGE);
+            if (edge & GRAPH_LAST_EDGE) break;
+        }
+    }
+
+    // A commit's changed-path filter; size 0 if it has none
+    const uint8_t* bloom(uint32_t pos, size_t& size) const {
+        const Layer& layer = layer_of(pos);
+        size = 0;
+        if (!layer.bloom_ends) return nullptr;
+        size_t i = pos - layer.base;
+        uint32_t start = i == 0 ? 0 : read_raw<uint32_t>(layer.bloom_ends + (i - 1) * 4);
+        uint32_t end = read_raw<uint32_t>(layer.bloom_ends + i * 4);
+        if (end < start || end > layer.bloom_size) return nullptr;
+        size = end - start;
+        return layer.bloom_data + start;
+    }
+
+    // False only if the commit's filter proves the path is the same as in its first parent
+    bool maybe_changed(uint32_t pos, uint64_t path_hash) const {
+        size_t size;
+        const uint8_t* filter = bloom(pos, size);
+        return bloom_maybe_contains(filter, size, path_hash);
+    }
+
+    // Decode a commit back into writer form (used when layers are merged)
+    GraphEntry entry(uint32_t pos) const {
+        GraphEntry e;
+        std::memcpy(e.id.data(), raw_id(pos), OBJECT_ID_SIZE);
+        std::vector<uint32_t> parent_pos;
+        parents(pos, parent_pos);
+        for (uint32_t p : parent_pos) {
+            ObjectId parent;
+            std::memcpy(parent.data(), raw_id(p), OBJECT_ID_SIZE);
+            e.parents.push_back(parent);
+        }
+        e.generation = generation(pos);
+        e.date = date(pos);
+        size_t size;
+        const uint8_t* filter = bloom(pos, size);
+        e.bloom.assign(reinterpret_cast<const char*>(filter), size);
+        return e;
+    }
+
+private:
+    struct Layer {
+        std::string name;
+        MappedFile file;
+        uint32_t count = 0;
+        uint32_t base = 0;
+        uint32_t extra_count = 0;
+        const uint8_t* bloom_ends = nullptr;   // Version 2 layers only
+        const uint8_t* bloom_data = nullptr;
+        size_t bloom_size = 0;
+
+        const uint8_t* id_at(size_t i) const { return file.data() + GRAPH_HEADER_SIZE + i * OBJECT_ID_SIZE; }
+        const uint8_t* record_at(size_t i) const {
+            return file.data() + GRAPH_HEADER_SIZE + size_t(count) * OBJECT_ID_SIZE + i * GRAPH_RECORD_SIZE;
+        }
+        uint32_t extra_at(size_t i) const {
+            return read_raw<uint32_t>(file.data() + GRAPH_HEADER_SIZE +
+                                      size_t(count) * (OBJECT_ID_SIZE + GRAPH_RECORD_SIZE) + i * 4);
+        }
+    };
+
+    const Layer& layer_of(uint32_t pos) const {
+        for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
+            if (pos >= (*it)->base) return **it;
+        }
+        return *layers_.front();
+    }
+
+    bool fail() {
+        layers_.clear();
+        size_ = 0;
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Layer>> layers_;
+    size_t size_ = 0;
+};
+
+// Changed-path Bloom filter of a commit against its first parent (or the empty tree);
+// "" for commits that predate trees
+std::string changed_path_bloom(const Commit& commit);
+
+// Write one layer on top of the layers in lower; entries must already carry generation
+// numbers. Returns the new layer's name.
+std::string write_commit_graph_layer(std::vector<GraphEntry>& entries, const CommitGraph& lower);
+
+// Writers of the chain take its lock in a Transaction. One that finds it busy retries for a
+// moment, since the holder is often adding the same commits, then gives up: the graph only
+// caches what the commit objects say, so a later command can fill it in.
+const int GRAPH_LOCK_ATTEMPTS = 20;
+const int GRAPH_LOCK_WAIT_MS = 10;
+
+// Lock the chain file in tx; false if it stayed busy
+bool lock_commit_graph(Transaction& tx);
+
+// Point the chain file, locked in tx, at the given layers and commit tx, then delete the
+// layers of listed (the chain as read under the lock) that it no longer names. Layers no
+// chain listed yet are left alone, as another writer may be about to list them.
+bool write_commit_graph_chain(const std::vector<std::string>& layers, const std::vector<std::string>& listed,
+                              Transaction& tx);
+
+// Add entries as a new top layer, then merge layers while the top one is more than half the
+// size of the one below it (or merge everything when compact is set). Entries the graph
+// gained meanwhile are dropped, and nothing is written if the chain stays locked.
+void append_commit_graph(std::vector<GraphEntry> entries, bool compact = false);
+
+// Make sure the commit-graph covers the given commits and all of their history, walking
+// commit objects only for the part that is not in the graph yet. Commits with a parent that
+// cannot be read, and their descendants, are left out rather than stored with fewer parents.
+void update_commit_graph(const std::vector<std::string>& tips);
+
+// Is a reachable from d? Depth-first walk that never descends below a's generation
+bool graph_is_ancestor(const CommitGraph& graph, uint32_t a, uint32_t d);
+
+// All best common ancestors of two commits. Commits are visited in decreasing generation
+// order, painting each with the sides that reach it; once a commit is reached from both
+// sides it is a candidate and everything below it is marked stale. Candidates that are
+// ancestors of other candidates are dropped, so criss-cross merges yield every merge base.
+std::vector<uint32_t> graph_merge_bases(const CommitGraph& graph, uint32_t c1, uint32_t c2);
+
+// Commits reachable from any of wants but from none of haves, answered for all of them in
+// one walk: commits are visited in decreasing generation order, those reached from haves
+// paint their parents as reached too, and the walk ends once only such commits are queued.
+// Commits for which also_have is true count as reached from haves (another repository's
+// history). boundary receives the commits reached from both sides, which the result builds
+// on. The result is in visiting order, newest generation first.
+std::vector<uint32_t> graph_commits_between(const CommitGraph& graph, const std::vector<uint32_t>& wants,
+                                            const std::vector<uint32_t>& haves,
+                                            const std::function<bool(uint32_t)>& also_have,
+                                            std::vector<uint32_t>& boundary);
+
+// Check if one commit is an ancestor of another
+bool is_ancestor(const std::string& ancestor, const std::string& descendant);
+
+// Find the lowest common ancestor (LCA) of two commits; with several equally good merge
+// bases (criss-cross history) the one with the highest generation is returned
+std::string find_lca(const std::string& commit1, const std::string& commit2);
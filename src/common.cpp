@@ -0,0 +1,195 @@
+#include "common.h"
+
+// SHA-256 round constants
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// Portable SHA-256 block compression
+static void sha256_compress_scalar(uint32_t state[8], const uint8_t* data, size_t nblocks) {
+    uint32_t w[64];
+    while (nblocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t(data[i * 4]) << 24) | (uint32_t(data[i * 4 + 1]) << 16) |
+                   (uint32_t(data[i * 4 + 2]) << 8) | uint32_t(data[i * 4 + 3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#if MINIGIT_X86
+// SHA-256 block compression using the x86 SHA extensions (SHA-NI)
+__attribute__((target("sha,sse4.1")))
+static void sha256_compress_shani(uint32_t state[8], const uint8_t* data, size_t nblocks) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);             // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);       // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);    // CDGH
+    while (nblocks--) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i w[4];
+        for (int i = 0; i < 16; i++) {
+            __m128i& m = w[i & 3];
+            if (i < 4) {
+                m = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)), byteswap);
+            } else {
+                // m holds W[t-16..t-13]; the other slots hold the following twelve words
+                __m128i t = _mm_sha256msg1_epu32(m, w[(i + 1) & 3]);
+                t = _mm_add_epi32(t, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                m = _mm_sha256msg2_epu32(t, w[(i + 3) & 3]);
+            }
+            __m128i msg = _mm_add_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&SHA256_K[i * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        data += 64;
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1B);          // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);       // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);       // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+static bool cpu_has_sha_ni() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    bool sha = (ebx >> 29) & 1;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    bool ssse3 = (ecx >> 9) & 1;
+    bool sse41 = (ecx >> 19) & 1;
+    return sha && ssse3 && sse41;
+}
+#endif
+
+Sha256Compress sha256_backend(HashBackend backend) {
+#if MINIGIT_X86
+    static const bool has_sha_ni = cpu_has_sha_ni();
+    if (backend == HashBackend::ShaNi) return has_sha_ni ? sha256_compress_shani : nullptr;
+    if (backend == HashBackend::Auto && has_sha_ni) return sha256_compress_shani;
+#else
+    if (backend == HashBackend::ShaNi) return nullptr;
+#endif
+    return sha256_compress_scalar;
+}
+
+std::string hash_to_string(const ObjectId& hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(hash.size() * 2, '0');
+    for (size_t i = 0; i < hash.size(); i++) {
+        out[i * 2] = digits[hash[i] >> 4];
+        out[i * 2 + 1] = digits[hash[i] & 0xf];
+    }
+    return out;
+}
+
+std::string hash_content(const std::string& content) {
+    Sha256 hasher;
+    hasher.update(content);
+    return hash_to_string(hasher.finish());
+}
+
+std::string hash_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return "";
+    Sha256 hasher;
+    std::vector<char> buffer(IO_BUFFER_SIZE);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hasher.update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    return hash_to_string(hasher.finish());
+}
+
+bool stat_file(const std::string& path, FileStat& out) {
+#ifdef _WIN32
+    std::error_code ec;
+    auto status = fs::status(path, ec);
+    if (ec || !fs::exists(status)) return false;
+    out = FileStat();
+    out.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        fs::last_write_time(path, ec).time_since_epoch()).count();
+    out.size = fs::is_regular_file(status) ? fs::file_size(path, ec) : 0;
+    out.mode = static_cast<uint32_t>(status.type());
+    return true;
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+#ifdef __APPLE__
+    out.mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    out.ctime_ns = int64_t(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    out.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    out.ctime_ns = int64_t(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.ino = static_cast<uint64_t>(st.st_ino);
+    out.mode = static_cast<uint32_t>(st.st_mode);
+    return true;
+#endif
+}
+
+std::string hex_to_bytes(const std::string& hex) {
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return 0;
+    };
+    std::string out(hex.size() / 2, '\0');
+    for (size_t i = 0; i < out.size(); i++) {
+        out[i] = static_cast<char>((nibble(hex[i * 2]) << 4) | nibble(hex[i * 2 + 1]));
+    }
+    return out;
+}
+
+std::string bytes_to_hex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(len * 2, '0');
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0xf];
+    }
+    return out;
+}
+
+thread_local ThreadPool* ThreadPool::current_pool_ = nullptr;
+thread_local size_t ThreadPool::current_worker_ = 0;
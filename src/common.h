@@ -0,0 +1,477 @@
+// Shared building blocks: SHA-256 object IDs, file mapping and stat helpers, the thread pool and caches
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <queue>
+#include <algorithm>
+#include <filesystem>
+#include <ctime>
+#include <iomanip>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+#include <list>
+#include <tuple>
+#include <string_view>
+#include <memory_resource>
+#include <stdexcept>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+
+#include "trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINIGIT_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define MINIGIT_X86 0
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Available SHA-256 implementations
+enum class HashBackend { Auto, Scalar, ShaNi };
+
+using Sha256Compress = void (*)(uint32_t*, const uint8_t*, size_t);
+
+// Resolve a backend to its compression function (nullptr if unsupported on this CPU)
+Sha256Compress sha256_backend(HashBackend backend);
+
+using ObjectId = std::array<uint8_t, 32>;
+
+// Streaming SHA-256 hasher used for all object IDs
+class Sha256 {
+public:
+    explicit Sha256(HashBackend backend = HashBackend::Auto) : compress_(sha256_backend(backend)) {
+        if (!compress_) compress_ = sha256_backend(HashBackend::Scalar);
+    }
+
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        total_ += len;
+        if (buffered_ > 0) {
+            size_t take = std::min(len, sizeof(buffer_) - buffered_);
+            std::memcpy(buffer_ + buffered_, p, take);
+            buffered_ += take;
+            p += take;
+            len -= take;
+            if (buffered_ < sizeof(buffer_)) return;
+            compress_(state_, buffer_, 1);
+            buffered_ = 0;
+        }
+        if (len >= 64) {
+            compress_(state_, p, len / 64);
+            p += len & ~size_t(63);
+            len &= 63;
+        }
+        std::memcpy(buffer_, p, len);
+        buffered_ = len;
+    }
+
+    void update(const std::string& data) { update(data.data(), data.size()); }
+
+    ObjectId finish() {
+        TRACE_COUNT(TraceCounter::BytesHashed, total_);
+        uint64_t bit_len = total_ * 8;
+        uint8_t pad[72] = {0x80};
+        size_t pad_len = (buffered_ < 56 ? 56 : 120) - buffered_;
+        for (int i = 0; i < 8; i++) {
+            pad[pad_len + i] = uint8_t(bit_len >> (56 - 8 * i));
+        }
+        update(pad, pad_len + 8);
+        ObjectId out;
+        for (int i = 0; i < 8; i++) {
+            out[i * 4] = uint8_t(state_[i] >> 24);
+            out[i * 4 + 1] = uint8_t(state_[i] >> 16);
+            out[i * 4 + 2] = uint8_t(state_[i] >> 8);
+            out[i * 4 + 3] = uint8_t(state_[i]);
+        }
+        return out;
+    }
+
+private:
+    Sha256Compress compress_;
+    uint32_t state_[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buffer_[64];
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+// Size of the read buffer used when hashing or copying files
+const size_t IO_BUFFER_SIZE = 1 << 16;
+
+// Hex length of an object ID and the null commit every branch starts from
+const size_t OBJECT_ID_HEX_LEN = 64;
+const std::string NULL_COMMIT(OBJECT_ID_HEX_LEN, '0');
+
+// Convert hash to a fixed-length string
+std::string hash_to_string(const ObjectId& hash);
+
+// Hash an in-memory object (commit content)
+std::string hash_content(const std::string& content);
+
+// Hash a file by streaming it through fixed-size buffers; returns "" if unreadable
+std::string hash_file(const std::string& path);
+
+// Read-only view of a whole file: mmap on POSIX, a plain buffer elsewhere
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data_ = reinterpret_cast<const uint8_t*>(buffer_.data());
+        size_ = buffer_.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                size_ = 0;
+                return false;
+            }
+            data_ = static_cast<const uint8_t*>(p);
+        }
+        ::close(fd);
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        buffer_.clear();
+#else
+        if (data_ && size_ > 0) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    std::string buffer_;
+#endif
+};
+
+// Stat data cached in the index so unchanged files are not re-hashed
+struct FileStat {
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+    uint64_t size = 0;
+    uint64_t ino = 0;
+    uint32_t mode = 0;
+
+    bool operator==(const FileStat& other) const {
+        return mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns && size == other.size &&
+               ino == other.ino && mode == other.mode;
+    }
+    bool operator!=(const FileStat& other) const { return !(*this == other); }
+};
+
+// Stat a path (following symlinks, like the content hash does); false if it does not exist
+bool stat_file(const std::string& path, FileStat& out);
+
+// Decode a hex string into raw bytes (an odd trailing digit is ignored)
+std::string hex_to_bytes(const std::string& hex);
+
+// Encode raw bytes as lowercase hex
+std::string bytes_to_hex(const uint8_t* data, size_t len);
+
+// Unaligned host-order loads and stores for binary file formats
+template <typename T>
+T read_raw(const uint8_t* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void append_raw(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Work-stealing thread pool: each worker owns a deque, pops its own tasks LIFO
+// and steals FIFO from the others when it runs dry
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+        if (threads == 0) threads = 1;
+        for (unsigned i = 0; i < threads; i++) {
+            queues_.push_back(std::make_unique<TaskQueue>());
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            workers_.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stop_ = true;
+        }
+        wake_cv_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    // Queue a task; tasks submitted from a worker go to that worker's own deque
+    void submit(std::function<void()> task) {
+        size_t target = (current_pool_ == this) ? current_worker_ : next_queue_++ % queues_.size();
+        pending_.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+            queues_[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            queued_++;
+        }
+        wake_cv_.notify_one();
+    }
+
+    // Block until every submitted task (including tasks they submitted) has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(done_mutex_);
+        done_cv_.wait(lock, [this] { return pending_.load() == 0; });
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool try_take(size_t self, std::function<void()>& task) {
+        {
+            std::lock_guard<std::mutex> lock(queues_[self]->mutex);
+            if (!queues_[self]->tasks.empty()) {
+                task = std::move(queues_[self]->tasks.back());
+                queues_[self]->tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); i++) {
+            TaskQueue& victim = *queues_[(self + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(size_t self) {
+        current_pool_ = this;
+        current_worker_ = self;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex_);
+                wake_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+                if (stop_ && queued_ == 0) return;
+                queued_--;
+            }
+            std::function<void()> task;
+            while (!try_take(self, task)) {
+                std::this_thread::yield();
+            }
+            task();
+            if (pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(done_mutex_);
+                done_cv_.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    size_t queued_ = 0;
+    bool stop_ = false;
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+    static thread_local ThreadPool* current_pool_;
+    static thread_local size_t current_worker_;
+};
+
+// Cost-bounded LRU cache shared between threads; values are shared pointers so entries
+// evicted while in use stay valid for their holders
+template <typename Value>
+class LruCache {
+public:
+    explicit LruCache(size_t budget) : budget_(budget) {}
+
+    bool get(const std::string& key, std::shared_ptr<const Value>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(key);
+        if (it == map_.end()) return false;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        out = it->second->value;
+        return true;
+    }
+
+    void put(const std::string& key, std::shared_ptr<const Value> value, size_t cost) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cost > budget_ / 4 || map_.count(key)) return;
+        lru_.push_front(Entry{key, std::move(value), cost});
+        map_[key] = lru_.begin();
+        used_ += cost;
+        while (used_ > budget_) {
+            used_ -= lru_.back().cost;
+            map_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        map_.clear();
+        used_ = 0;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const Value> value;
+        size_t cost;
+    };
+    std::mutex mutex_;
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> map_;
+    size_t budget_;
+    size_t used_ = 0;
+};
+
+// Number of set bits in a word. MSVC has no GCC builtins, and __popcnt64 needs a CPU with
+// POPCNT, so it counts bits in parallel instead.
+inline int popcount64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    word -= (word >> 1) & 0x5555555555555555ull;
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<int>((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Index of the lowest set bit of a non-zero word
+inline int countr_zero64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    int index = 0;
+    for (; !(word & 1); word >>= 1) index++;
+    return index;
+#endif
+}
+
+// Bit array used to mark commits during graph walks and to hold sets of objects
+class Bitset {
+public:
+    explicit Bitset(size_t bits = 0) : words_((bits + 63) / 64, 0) {}
+    bool test(size_t i) const { return (i >> 6) < words_.size() && ((words_[i >> 6] >> (i & 63)) & 1); }
+    void set(size_t i) {
+        if ((i >> 6) >= words_.size()) words_.resize((i >> 6) + 1, 0);
+        words_[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+
+    // Union and difference; the result grows to cover both sides
+    Bitset& operator|=(const Bitset& other) {
+        if (other.words_.size() > words_.size()) words_.resize(other.words_.size(), 0);
+        for (size_t w = 0; w < other.words_.size(); w++) words_[w] |= other.words_[w];
+        return *this;
+    }
+    void subtract(const Bitset& other) {
+        size_t n = std::min(words_.size(), other.words_.size());
+        for (size_t w = 0; w < n; w++) words_[w] &= ~other.words_[w];
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t word : words_) total += static_cast<size_t>(popcount64(word));
+        return total;
+    }
+
+    // Call visit(i) for every set bit, in increasing order
+    template <typename Visit>
+    void for_each(Visit visit) const {
+        for (size_t w = 0; w < words_.size(); w++) {
+            for (uint64_t word = words_[w]; word; word &= word - 1) {
+                visit(w * 64 + static_cast<size_t>(countr_zero64(word)));
+            }
+        }
+    }
+
+    std::vector<uint64_t>& words() { return words_; }
+    const std::vector<uint64_t>& words() const { return words_; }
+
+private:
+    std::vector<uint64_t> words_;
+};
@@ -0,0 +1,199 @@
+#include "diff.h"
+
+// Hash a line a machine word at a time
+static inline uint64_t line_hash(const char* p, size_t n) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ n;
+    while (n >= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+        p += 8;
+        n -= 8;
+    }
+    uint64_t w = 0;
+    std::memcpy(&w, p, n);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 29);
+}
+
+void split_lines(std::string_view text, std::vector<std::string_view>& lines, std::vector<uint64_t>& hashes) {
+    const char* data = text.data();
+    size_t size = text.size();
+    size_t start = 0;
+    auto emit = [&](size_t end) {
+        lines.emplace_back(data + start, end - start);
+        hashes.push_back(line_hash(data + start, end - start));
+        start = end;
+    };
+    size_t pos = 0;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        while (mask) {
+            emit(pos + static_cast<size_t>(__builtin_ctz(mask)) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; pos < size; pos++) {
+        if (data[pos] == '\n') emit(pos + 1);
+    }
+    if (start < size) emit(size);
+}
+
+std::vector<DiffHunk> diff_tokens(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    uint32_t tokens = 0;
+    for (uint32_t token : a) tokens = std::max(tokens, token + 1);
+    for (uint32_t token : b) tokens = std::max(tokens, token + 1);
+    std::vector<uint8_t> seen(tokens, 0);   // bit 0: in a, bit 1: in b
+    for (uint32_t token : a) seen[token] |= 1;
+    for (uint32_t token : b) seen[token] |= 2;
+    std::vector<char> a_changed(a.size(), 1), b_changed(b.size(), 1);
+    std::vector<uint32_t> a_kept, b_kept;
+    std::vector<size_t> a_index, b_index;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (seen[a[i]] != 3) continue;
+        a_kept.push_back(a[i]);
+        a_index.push_back(i);
+    }
+    for (size_t j = 0; j < b.size(); j++) {
+        if (seen[b[j]] != 3) continue;
+        b_kept.push_back(b[j]);
+        b_index.push_back(j);
+    }
+    MyersDiff diff(a_kept.data(), a_kept.size(), b_kept.data(), b_kept.size());
+    for (size_t i = 0; i < a_kept.size(); i++) a_changed[a_index[i]] = diff.a_changed[i];
+    for (size_t j = 0; j < b_kept.size(); j++) b_changed[b_index[j]] = diff.b_changed[j];
+    return MyersDiff::hunks(a_changed, b_changed);
+}
+
+bool is_binary(std::string_view content) {
+    return content.substr(0, 8000).find('\0') != std::string_view::npos;
+}
+
+size_t merge_texts(std::string_view base, std::string_view ours, std::string_view theirs,
+                   const std::string& ours_label, const std::string& theirs_label, std::string& out) {
+    LineTable table;
+    std::vector<std::string_view> base_lines, ours_lines, theirs_lines;
+    std::vector<uint32_t> base_tokens = table.tokenize(base, base_lines);
+    std::vector<uint32_t> ours_tokens = table.tokenize(ours, ours_lines);
+    std::vector<uint32_t> theirs_tokens = table.tokenize(theirs, theirs_lines);
+    std::vector<DiffHunk> ours_hunks = diff_tokens(base_tokens, ours_tokens);
+    std::vector<DiffHunk> theirs_hunks = diff_tokens(base_tokens, theirs_tokens);
+
+    out.clear();
+    out.reserve(std::max(ours.size(), theirs.size()));
+    auto append = [&](const std::vector<std::string_view>& lines, size_t from, size_t to) {
+        for (size_t k = from; k < to; k++) out.append(lines[k]);
+    };
+    auto marker = [&](const std::string& text) {
+        if (!out.empty() && out.back() != '\n') out.push_back('\n');
+        out.append(text).push_back('\n');
+    };
+
+    size_t conflicts = 0;
+    size_t base_pos = 0;              // Base lines before this are already written
+    long ours_shift = 0, theirs_shift = 0;   // Side line number minus base line number
+    size_t o = 0, t = 0;
+    while (o < ours_hunks.size() || t < theirs_hunks.size()) {
+        // Start a region at the earliest hunk and grow it while hunks from either side overlap
+        bool take_ours = t == theirs_hunks.size() ||
+                         (o < ours_hunks.size() && ours_hunks[o].a_start <= theirs_hunks[t].a_start);
+        size_t lo = take_ours ? ours_hunks[o].a_start : theirs_hunks[t].a_start;
+        size_t hi = lo;
+        size_t o_end = o, t_end = t;
+        auto overlaps = [&](const DiffHunk& h) {
+            return h.a_start < hi || (h.a_start == hi && (h.a_start == h.a_end || lo == hi || h.a_start == lo));
+        };
+        bool grew = true;
+        while (grew) {
+            grew = false;
+            while (o_end < ours_hunks.size() && overlaps(ours_hunks[o_end])) {
+                hi = std::max(hi, ours_hunks[o_end++].a_end);
+                grew = true;
+            }
+            while (t_end < theirs_hunks.size() && overlaps(theirs_hunks[t_end])) {
+                hi = std::max(hi, theirs_hunks[t_end++].a_end);
+                grew = true;
+            }
+        }
+        append(base_lines, base_pos, lo);
+
+        // Each side's version of base lines [lo, hi)
+        long ours_delta = 0, theirs_delta = 0;
+        for (size_t k = o; k < o_end; k++) {
+            ours_delta += long(ours_hunks[k].b_end - ours_hunks[k].b_start) - long(ours_hunks[k].a_end - ours_hunks[k].a_start);
+        }
+        for (size_t k = t; k < t_end; k++) {
+            theirs_delta += long(theirs_hunks[k].b_end - theirs_hunks[k].b_start) -
+                            long(theirs_hunks[k].a_end - theirs_hunks[k].a_start);
+        }
+        size_t ours_lo = lo + ours_shift, ours_hi = hi + ours_shift + ours_delta;
+        size_t theirs_lo = lo + theirs_shift, theirs_hi = hi + theirs_shift + theirs_delta;
+        if (o_end == o) {
+            append(theirs_lines, theirs_lo, theirs_hi);
+        } else if (t_end == t) {
+            append(ours_lines, ours_lo, ours_hi);
+        } else if (std::equal(ours_tokens.begin() + ours_lo, ours_tokens.begin() + ours_hi,
+                              theirs_tokens.begin() + theirs_lo, theirs_tokens.begin() + theirs_hi)) {
+            append(ours_lines, ours_lo, ours_hi);
+        } else {
+            conflicts++;
+            marker("<<<<<<< " + ours_label);
+            append(ours_lines, ours_lo, ours_hi);
+            marker("=======");
+            append(theirs_lines, theirs_lo, theirs_hi);
+            marker(">>>>>>> " + theirs_label);
+        }
+        ours_shift += ours_delta;
+        theirs_shift += theirs_delta;
+        base_pos = hi;
+        o = o_end;
+        t = t_end;
+    }
+    append(base_lines, base_pos, base_lines.size());
+    return conflicts;
+}
+
+void write_unified_diff(std::string_view a, std::string_view b, std::string& out) {
+    LineTable table;
+    std::vector<std::string_view> a_lines, b_lines;
+    std::vector<uint32_t> a_tokens = table.tokenize(a, a_lines);
+    std::vector<uint32_t> b_tokens = table.tokenize(b, b_lines);
+    std::vector<DiffHunk> hunks = diff_tokens(a_tokens, b_tokens);
+    auto line = [&](char prefix, std::string_view text) {
+        out.push_back(prefix);
+        out.append(text);
+        if (text.empty() || text.back() != '\n') out.append("\n\\ No newline at end of file\n");
+    };
+    auto range = [&](size_t start, size_t count) {
+        // Git numbers lines from 1; an empty range names the line before it
+        out.append(std::to_string(count ? start + 1 : start));
+        if (count != 1) out.append(",").append(std::to_string(count));
+    };
+    for (size_t h = 0; h < hunks.size();) {
+        size_t last = h;
+        while (last + 1 < hunks.size() && hunks[last + 1].a_start - hunks[last].a_end <= 2 * DIFF_CONTEXT) last++;
+        size_t a_from = hunks[h].a_start - std::min(hunks[h].a_start, DIFF_CONTEXT);
+        size_t b_from = hunks[h].b_start - (hunks[h].a_start - a_from);
+        size_t a_to = std::min(a_lines.size(), hunks[last].a_end + DIFF_CONTEXT);
+        size_t b_to = hunks[last].b_end + (a_to - hunks[last].a_end);
+        out.append("@@ -");
+        range(a_from, a_to - a_from);
+        out.append(" +");
+        range(b_from, b_to - b_from);
+        out.append(" @@\n");
+        size_t i = a_from;
+        for (size_t k = h; k <= last; k++) {
+            for (; i < hunks[k].a_start; i++) line(' ', a_lines[i]);
+            for (size_t j = hunks[k].a_start; j < hunks[k].a_end; j++) line('-', a_lines[j]);
+            for (size_t j = hunks[k].b_start; j < hunks[k].b_end; j++) line('+', b_lines[j]);
+            i = hunks[k].a_end;
+        }
+        for (; i < a_to; i++) line(' ', a_lines[i]);
+        h = last + 1;
+    }
+}
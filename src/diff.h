@@ -0,0 +1,208 @@
+// Line diff (Myers), three-way text merge and unified diff output
+#pragma once
+
+#include "common.h"
+
+// Line diff and three-way merge. Texts are split into lines (each keeping its '\n'), lines
+// are mapped to integer tokens so equal lines compare as equal integers, and token sequences
+// are diffed with Myers' algorithm in linear space.
+
+// Split text into lines and hash each one. Newlines are located 16 bytes at a time with
+// SSE2 where available.
+void split_lines(std::string_view text, std::vector<std::string_view>& lines, std::vector<uint64_t>& hashes);
+
+// Assigns each distinct line a small integer, shared across the texts of one diff or merge
+class LineTable {
+public:
+    LineTable() : slots_(1024, {0, 0}) {}
+
+    uint32_t token(std::string_view line, uint64_t hash) {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            auto& slot = slots_[i];
+            if (slot.second == 0) {
+                lines_.push_back(line);
+                slot = {hash, static_cast<uint32_t>(lines_.size())};
+                if (lines_.size() * 2 > slots_.size()) grow();
+                return static_cast<uint32_t>(lines_.size() - 1);
+            }
+            if (slot.first == hash && lines_[slot.second - 1] == line) return slot.second - 1;
+        }
+    }
+
+    // Tokens for every line of text; lines receives views of the lines themselves
+    std::vector<uint32_t> tokenize(std::string_view text, std::vector<std::string_view>& lines) {
+        std::vector<uint64_t> hashes;
+        lines.clear();
+        split_lines(text, lines, hashes);
+        std::vector<uint32_t> tokens(lines.size());
+        for (size_t i = 0; i < lines.size(); i++) tokens[i] = token(lines[i], hashes[i]);
+        return tokens;
+    }
+
+private:
+    void grow() {
+        std::vector<std::pair<uint64_t, uint32_t>> old(slots_.size() * 2, {0, 0});
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (const auto& slot : old) {
+            if (slot.second == 0) continue;
+            size_t i = slot.first & mask;
+            while (slots_[i].second != 0) i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> slots_;   // hash, token + 1 (0 = empty)
+    std::vector<std::string_view> lines_;
+};
+
+// Lines [a_start, a_end) of the old text are replaced by [b_start, b_end) of the new one
+struct DiffHunk {
+    size_t a_start, a_end, b_start, b_end;
+};
+
+// Myers' O((N+M)D) diff, divided at middle snakes so memory stays linear. Changed lines are
+// flagged in a_changed/b_changed. Past a cost limit the furthest-reaching path is used as
+// the split, trading a minimal diff for bounded time on very different inputs.
+class MyersDiff {
+public:
+    MyersDiff(const uint32_t* a, size_t n, const uint32_t* b, size_t m)
+        : a_changed(n, 0), b_changed(m, 0), a_(a), b_(b), offset_(static_cast<long>(m) + 1),
+          forward_(n + m + 3), backward_(n + m + 3) {
+        max_cost_ = 1;
+        while (max_cost_ * max_cost_ < static_cast<long>(n + m)) max_cost_++;
+        max_cost_ = std::max(max_cost_, 256L);
+        compare(0, static_cast<long>(n), 0, static_cast<long>(m));
+    }
+
+    // Group flagged lines into hunks
+    static std::vector<DiffHunk> hunks(const std::vector<char>& a_changed, const std::vector<char>& b_changed) {
+        std::vector<DiffHunk> result;
+        size_t i = 0, j = 0, n = a_changed.size(), m = b_changed.size();
+        while (i < n || j < m) {
+            if (i < n && j < m && !a_changed[i] && !b_changed[j]) {
+                i++;
+                j++;
+                continue;
+            }
+            DiffHunk hunk{i, i, j, j};
+            while (i < n && a_changed[i]) i++;
+            while (j < m && b_changed[j]) j++;
+            hunk.a_end = i;
+            hunk.b_end = j;
+            result.push_back(hunk);
+        }
+        return result;
+    }
+
+    std::vector<char> a_changed, b_changed;   // Lines of each side not in the common subsequence
+
+private:
+    long& fwd(long d) { return forward_[d + offset_]; }
+    long& bwd(long d) { return backward_[d + offset_]; }
+
+    void compare(long a_lo, long a_hi, long b_lo, long b_hi) {
+        while (a_lo < a_hi && b_lo < b_hi && a_[a_lo] == b_[b_lo]) a_lo++, b_lo++;
+        while (a_lo < a_hi && b_lo < b_hi && a_[a_hi - 1] == b_[b_hi - 1]) a_hi--, b_hi--;
+        if (a_lo == a_hi) {
+            for (long j = b_lo; j < b_hi; j++) b_changed[j] = 1;
+            return;
+        }
+        if (b_lo == b_hi) {
+            for (long i = a_lo; i < a_hi; i++) a_changed[i] = 1;
+            return;
+        }
+        long x = a_lo, y = b_lo;
+        split(a_lo, a_hi, b_lo, b_hi, x, y);
+        if ((x == a_lo && y == b_lo) || (x == a_hi && y == b_hi)) {
+            // No progress possible; treat the whole range as replaced
+            for (long i = a_lo; i < a_hi; i++) a_changed[i] = 1;
+            for (long j = b_lo; j < b_hi; j++) b_changed[j] = 1;
+            return;
+        }
+        compare(a_lo, x, b_lo, y);
+        compare(x, a_hi, y, b_hi);
+    }
+
+    // Find the point where the forward and backward searches meet (diagonal d = x - y)
+    void split(long a_lo, long a_hi, long b_lo, long b_hi, long& x, long& y) {
+        const long dmin = a_lo - b_hi, dmax = a_hi - b_lo;
+        const long fmid = a_lo - b_lo, bmid = a_hi - b_hi;
+        const bool odd = (fmid - bmid) & 1;
+        long fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+        fwd(fmid) = a_lo;
+        bwd(bmid) = a_hi;
+        for (long cost = 1;; cost++) {
+            if (fmin > dmin) fwd(--fmin - 1) = -1; else ++fmin;
+            if (fmax < dmax) fwd(++fmax + 1) = -1; else --fmax;
+            for (long d = fmax; d >= fmin; d -= 2) {
+                long i = fwd(d - 1) >= fwd(d + 1) ? fwd(d - 1) + 1 : fwd(d + 1);
+                long j = i - d;
+                while (i < a_hi && j < b_hi && a_[i] == b_[j]) i++, j++;
+                fwd(d) = i;
+                if (odd && bmin <= d && d <= bmax && bwd(d) <= i) {
+                    x = i;
+                    y = j;
+                    return;
+                }
+            }
+            if (bmin > dmin) bwd(--bmin - 1) = LONG_MAX; else ++bmin;
+            if (bmax < dmax) bwd(++bmax + 1) = LONG_MAX; else --bmax;
+            for (long d = bmax; d >= bmin; d -= 2) {
+                long i = bwd(d - 1) < bwd(d + 1) ? bwd(d - 1) : bwd(d + 1) - 1;
+                long j = i - d;
+                while (i > a_lo && j > b_lo && a_[i - 1] == b_[j - 1]) i--, j--;
+                bwd(d) = i;
+                if (!odd && fmin <= d && d <= fmax && i <= fwd(d)) {
+                    x = i;
+                    y = j;
+                    return;
+                }
+            }
+            if (cost >= max_cost_) {
+                // Give up on minimality: split where the forward search got furthest
+                long best = -1;
+                for (long d = fmax; d >= fmin; d -= 2) {
+                    long i = std::min(fwd(d), a_hi);
+                    long j = i - d;
+                    if (j > b_hi) {
+                        i = b_hi + d;
+                        j = b_hi;
+                    }
+                    if (i + j > best) {
+                        best = i + j;
+                        x = i;
+                        y = j;
+                    }
+                }
+                return;
+            }
+        }
+    }
+
+    const uint32_t* a_;
+    const uint32_t* b_;
+    long offset_;
+    std::vector<long> forward_, backward_;
+    long max_cost_;
+};
+
+// Diff two token sequences into hunks, in order. Lines that occur on only one side can
+// never match, so they are flagged up front and Myers runs on the rest.
+std::vector<DiffHunk> diff_tokens(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b);
+
+// True if content looks binary (a NUL byte near the start), as Git decides
+bool is_binary(std::string_view content);
+
+// Three-way merge of texts. Changes from each side relative to base are combined; regions
+// changed by both sides in different ways become conflicts, written between markers.
+// Returns the number of conflicts.
+size_t merge_texts(std::string_view base, std::string_view ours, std::string_view theirs,
+                   const std::string& ours_label, const std::string& theirs_label, std::string& out);
+
+const size_t DIFF_CONTEXT = 3;
+
+// Append the unified diff of two texts to out: hunks of changes with DIFF_CONTEXT lines of
+// context, merged when their context would overlap
+void write_unified_diff(std::string_view a, std::string_view b, std::string& out);
@@ -0,0 +1,926 @@
+#include "fast_import.h"
+
+struct ImportNode;
+using ImportNodePtr = std::shared_ptr<ImportNode>;
+
+// A directory entry: a blob hash, or a subdirectory
+struct ImportEntry {
+    std::string hash;
+    ImportNodePtr tree;
+};
+
+// A directory of an imported tree. Nodes are shared between commits and branches and copied
+// before they change; nodes of trees that are already stored are read on first use.
+struct ImportNode {
+    std::string hash;                             // Tree hash; "" while there are unwritten changes
+    bool loaded = false;
+    std::map<std::string, ImportEntry> entries;   // Subdirectories end in '/', so they sort as in tree objects
+};
+
+// A blob and the results of its hashing job
+struct ImportBlob {
+    std::string content;    // Dropped once encoded
+    ObjectId id{};
+    bool exists = false;    // Already in the repository
+    std::string record;     // Pack record, for new blobs
+};
+
+// One file change of a commit
+struct ImportFileOp {
+    char op = 'M';          // M, D, R, C, or '*' for deleteall
+    bool is_tree = false;   // M with mode 040000
+    std::string dataref;    // M: ":<mark>" or an object ID; "" for inline data
+    size_t blob = 0;        // M with inline data: index into the batch's blobs
+    std::string path, target;
+};
+
+// A parsed commit, or the ref and from of a reset
+struct ImportCommit {
+    std::string ref;
+    uint64_t mark = 0;
+    int64_t date = 0;
+    std::string message;
+    bool has_from = false;
+    std::string from;
+    std::vector<std::string> merges;
+    std::vector<ImportFileOp> ops;
+};
+
+// A command waiting for its batch's blobs to be hashed
+struct ImportCommand {
+    enum Kind { Blob, Commit, Reset, Progress } kind;
+    uint64_t mark = 0;      // Blob
+    size_t blob = 0;        // Blob: index into the batch's blobs
+    ImportCommit commit;    // Commit, Reset
+    std::string text;       // Progress
+
+    explicit ImportCommand(Kind k) : kind(k) {}
+};
+
+// A branch as the import has left it so far
+struct ImportBranch {
+    std::string tip;        // "" while unborn
+    ImportNodePtr root;     // nullptr for an empty tree
+    std::string base;       // Tip of the existing ref the import continued from
+};
+
+static bool starts_with(const std::string& s, std::string_view prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static ObjectId to_object_id(const std::string& hex) {
+    ObjectId id;
+    std::string raw = hex_to_bytes(hex);
+    std::memcpy(id.data(), raw.data(), OBJECT_ID_SIZE);
+    return id;
+}
+
+// Refs may be given without their refs/heads/ prefix
+static std::string full_ref(const std::string& name) {
+    return starts_with(name, "refs/") ? name : "refs/heads/" + name;
+}
+
+// Commit messages are stored on one line: line breaks become single spaces
+static std::string fold_message(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    bool pending_space = false;
+    for (char ch : text) {
+        if (ch == '\n' || ch == '\r') {
+            pending_space = !out.empty();
+            continue;
+        }
+        if (pending_space) out.push_back(' ');
+        pending_space = false;
+        out.push_back(ch);
+    }
+    return out;
+}
+
+static std::string format_timestamp(int64_t date) {
+    std::time_t t = static_cast<std::time_t>(date);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", std::localtime(&t));
+    return buffer;
+}
+
+// Parse a path at the start of text, C-style quoted or plain. A plain path runs to the first
+// space if stop_at_space, else to the end. end receives the index just past it.
+static bool parse_import_path(const std::string& text, size_t start, bool stop_at_space, std::string& path, size_t& end) {
+    path.clear();
+    if (start >= text.size()) return false;
+    if (text[start] != '"') {
+        end = stop_at_space ? std::min(text.find(' ', start), text.size()) : text.size();
+        path = text.substr(start, end - start);
+        return !path.empty();
+    }
+    for (size_t i = start + 1; i < text.size(); i++) {
+        char ch = text[i];
+        if (ch == '"') {
+            end = i + 1;
+            return !path.empty();
+        }
+        if (ch != '\\') {
+            path.push_back(ch);
+            continue;
+        }
+        if (++i >= text.size()) return false;
+        switch (text[i]) {
+        case 'a': path.push_back('\a'); break;
+        case 'b': path.push_back('\b'); break;
+        case 'f': path.push_back('\f'); break;
+        case 'n': path.push_back('\n'); break;
+        case 'r': path.push_back('\r'); break;
+        case 't': path.push_back('\t'); break;
+        case 'v': path.push_back('\v'); break;
+        default:
+            if (text[i] >= '0' && text[i] <= '7') {
+                int value = 0;
+                for (int digits = 0; digits < 3 && i < text.size() && text[i] >= '0' && text[i] <= '7'; digits++, i++) {
+                    value = value * 8 + (text[i] - '0');
+                }
+                i--;
+                path.push_back(static_cast<char>(value));
+            } else {
+                path.push_back(text[i]);
+            }
+        }
+    }
+    return false;
+}
+
+// Paths must stay inside the working tree and out of .minigit
+static bool valid_import_path(const std::string& path) {
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t slash = std::min(path.find('/', pos), path.size());
+        std::string_view part(path.data() + pos, slash - pos);
+        if (part.empty() || part == "." || part == ".." || (pos == 0 && part == ".minigit")) return false;
+        pos = slash + 1;
+    }
+    return true;
+}
+
+// Reads the stream, queues commands, and applies them once their blobs are hashed
+class FastImporter {
+public:
+    explicit FastImporter(std::istream& in) : in_(in) {}
+
+    ~FastImporter() { pool_.wait(); }
+
+    bool run();
+
+    // Summary of what was imported
+    void report(double seconds) const;
+
+private:
+    bool fail(const std::string& message) {
+        std::cerr << "Error: fast-import: " << message << " (line " << line_number_ << ")\n";
+        return false;
+    }
+
+    // Stream parsing
+    bool read_line();
+    void unread() { have_line_ = true; }
+    bool read_data(std::string& out);
+    bool parse_blob();
+    bool parse_commit();
+    bool parse_file_op(ImportCommit& commit);
+    bool parse_reset();
+    bool skip_tag();
+    size_t add_blob();
+    void hash_blob(size_t index);
+    void submit_blobs();
+
+    // Applying commands
+    bool flush();
+    bool apply_commit(const ImportCommit& commit);
+    bool apply_reset(const ImportCommit& reset);
+    bool apply_file_op(ImportNodePtr& root, const ImportFileOp& op);
+    std::string resolve(std::string name);
+    ImportBranch& load_branch(const std::string& ref);
+    uint32_t generation_of(const ObjectId& id, const std::string& hex);
+    bool finish();
+
+    // Objects and trees
+    bool stored(const ObjectId& id) { return loose_.count(id) || PackStore::instance().contains(id); }
+    std::string store(const std::string& content);
+    bool read_import_object(const std::string& hex, std::string& out);
+    ImportNodePtr commit_root(const std::string& commit_hash);
+    bool load(ImportNode& node);
+    ImportNode& edit(ImportNodePtr& slot);
+    const ImportEntry* find_path(ImportNode* node, std::string_view path);
+    void set_path(ImportNodePtr& root, std::string_view path, const ImportEntry& entry);
+    void remove_path(ImportNodePtr& root, std::string_view path);
+    const std::string& write_node(ImportNode& node);
+    bool changed_paths(ImportNode* a, ImportNode* b, std::string& prefix, std::unordered_set<std::string>& paths);
+
+    static ImportNodePtr empty_node() {
+        auto node = std::make_shared<ImportNode>();
+        node->loaded = true;
+        return node;
+    }
+
+    std::istream& in_;
+    std::string line_;
+    bool have_line_ = false;
+    uint64_t line_number_ = 0;
+
+    PackWriter writer_;
+    CommitGraph graph_;
+    std::vector<GraphEntry> graph_entries_;
+    std::unordered_map<ObjectId, uint32_t, ObjectIdHash> generations_;   // Of commits new to the graph
+    std::unordered_map<uint64_t, ObjectId> marks_;
+    std::unordered_set<ObjectId, ObjectIdHash> loose_;   // Loose objects, listed once up front
+    std::map<std::string, ImportBranch> branches_;
+    std::string empty_tree_;
+
+    std::vector<ImportCommand> commands_;
+    std::deque<ImportBlob> blobs_;   // A deque, so hashing jobs can hold pointers while it grows
+    size_t batch_bytes_ = 0;
+    size_t submitted_ = 0;           // Blobs handed to the pool so far
+    size_t unsubmitted_bytes_ = 0;
+    ThreadPool pool_;                // Declared last: destroyed, and drained, before the blobs
+
+    size_t commit_count_ = 0, blob_count_ = 0, tree_count_ = 0, tags_skipped_ = 0;
+    size_t refs_written_ = 0, refs_skipped_ = 0;
+    std::string pack_name_, head_branch_;
+    std::string checkout_hint_;   // HEAD's branch, if the import moved what HEAD resolves to
+};
+
+bool FastImporter::read_line() {
+    if (have_line_) {
+        have_line_ = false;
+        return true;
+    }
+    if (!std::getline(in_, line_)) return false;
+    line_number_++;
+    return true;
+}
+
+bool FastImporter::read_data(std::string& out) {
+    if (!starts_with(line_, "data ")) return fail("expected data, got '" + line_ + "'");
+    std::string spec = line_.substr(5);
+    if (starts_with(spec, "<<")) {
+        std::string delimiter = spec.substr(2);
+        out.clear();
+        while (true) {
+            if (!read_line()) return fail("unterminated data <<" + delimiter);
+            if (line_ == delimiter) break;
+            out.append(line_).push_back('\n');
+        }
+        return true;
+    }
+    char* end = nullptr;
+    uint64_t size = std::strtoull(spec.c_str(), &end, 10);
+    if (spec.empty() || *end != '\0') return fail("bad data length '" + spec + "'");
+    out.resize(static_cast<size_t>(size));
+    if (size && !in_.read(&out[0], static_cast<std::streamsize>(size))) return fail("truncated data");
+    line_number_ += std::count(out.begin(), out.end(), '\n');
+    if (in_.peek() == '\n') {
+        in_.get();
+        line_number_++;
+    }
+    return true;
+}
+
+size_t FastImporter::add_blob() {
+    blobs_.emplace_back();
+    return blobs_.size() - 1;
+}
+
+void FastImporter::hash_blob(size_t index) {
+    batch_bytes_ += blobs_[index].content.size();
+    unsubmitted_bytes_ += blobs_[index].content.size();
+    if (blobs_.size() - submitted_ >= FAST_IMPORT_JOB_BLOBS || unsubmitted_bytes_ >= FAST_IMPORT_JOB_BYTES) {
+        submit_blobs();
+    }
+}
+
+void FastImporter::submit_blobs() {
+    if (submitted_ == blobs_.size()) return;
+    std::vector<ImportBlob*> job;
+    job.reserve(blobs_.size() - submitted_);
+    for (; submitted_ < blobs_.size(); submitted_++) job.push_back(&blobs_[submitted_]);
+    unsubmitted_bytes_ = 0;
+    pool_.submit([this, job = std::move(job)] {
+        for (ImportBlob* blob : job) {
+            Sha256 hasher;
+            hasher.update(blob->content);
+            blob->id = hasher.finish();
+            blob->exists = stored(blob->id);
+            if (!blob->exists) blob->record = pack_record(blob->content);
+            std::string().swap(blob->content);
+        }
+    });
+}
+
+bool FastImporter::parse_blob() {
+    ImportCommand command(ImportCommand::Blob);
+    if (!read_line()) return fail("unexpected end of stream in blob");
+    if (starts_with(line_, "mark :")) {
+        command.mark = std::strtoull(line_.c_str() + 6, nullptr, 10);
+        if (!read_line()) return fail("unexpected end of stream in blob");
+    }
+    if (starts_with(line_, "original-oid ") && !read_line()) return fail("unexpected end of stream in blob");
+    command.blob = add_blob();
+    if (!read_data(blobs_[command.blob].content)) return false;
+    hash_blob(command.blob);
+    commands_.push_back(std::move(command));
+    return true;
+}
+
+bool FastImporter::parse_commit() {
+    ImportCommand command(ImportCommand::Commit);
+    ImportCommit& commit = command.commit;
+    commit.ref = full_ref(line_.substr(7));
+    commit.date = static_cast<int64_t>(std::time(nullptr));
+    bool have_data = false;
+    while (!have_data) {
+        if (!read_line()) return fail("unexpected end of stream in commit");
+        if (starts_with(line_, "mark :")) {
+            commit.mark = std::strtoull(line_.c_str() + 6, nullptr, 10);
+        } else if (starts_with(line_, "committer ")) {
+            // committer <name> <<email>> <seconds> <zone>; the zone is implied by local time
+            size_t email_end = line_.rfind('>');
+            if (email_end == std::string::npos) return fail("bad committer line");
+            commit.date = std::strtoll(line_.c_str() + email_end + 1, nullptr, 10);
+        } else if (starts_with(line_, "author ") || starts_with(line_, "original-oid ") ||
+                   starts_with(line_, "encoding ")) {
+            continue;
+        } else {
+            std::string message;
+            if (!read_data(message)) return false;
+            commit.message = fold_message(message);
+            have_data = true;
+        }
+    }
+    while (read_line()) {
+        if (line_.empty()) break;
+        if (starts_with(line_, "from ")) {
+            commit.has_from = true;
+            commit.from = line_.substr(5);
+        } else if (starts_with(line_, "merge ")) {
+            commit.merges.push_back(line_.substr(6));
+        } else if (line_ == "deleteall" || (line_.size() > 2 && std::string_view("MDRC").find(line_[0]) != std::string_view::npos &&
+                                             line_[1] == ' ')) {
+            if (!parse_file_op(commit)) return false;
+        } else if (starts_with(line_, "N ")) {
+            return fail("notes are not supported");
+        } else {
+            unread();
+            break;
+        }
+    }
+    commands_.push_back(std::move(command));
+    return true;
+}
+
+bool FastImporter::parse_file_op(ImportCommit& commit) {
+    ImportFileOp op;
+    op.op = line_ == "deleteall" ? '*' : line_[0];
+    size_t end = 0;
+    if (op.op == 'M') {
+        // M <mode> <dataref> <path>
+        size_t mode_end = line_.find(' ', 2);
+        size_t ref_end = mode_end == std::string::npos ? mode_end : line_.find(' ', mode_end + 1);
+        if (ref_end == std::string::npos) return fail("bad file change '" + line_ + "'");
+        std::string mode = line_.substr(2, mode_end - 2);
+        op.dataref = line_.substr(mode_end + 1, ref_end - mode_end - 1);
+        if (!parse_import_path(line_, ref_end + 1, false, op.path, end)) return fail("bad path in '" + line_ + "'");
+        if (op.dataref == "inline") {
+            op.dataref.clear();
+            op.blob = add_blob();
+            if (!read_line() || !read_data(blobs_[op.blob].content)) return fail("missing inline data");
+            hash_blob(op.blob);
+        }
+        if (mode == "160000") {
+            std::cerr << "Warning: skipping submodule " << op.path << "\n";
+            return true;
+        }
+        op.is_tree = mode == "040000" || mode == "40000";
+    } else if (op.op == 'D') {
+        if (!parse_import_path(line_, 2, false, op.path, end)) return fail("bad path in '" + line_ + "'");
+    } else if (op.op == 'R' || op.op == 'C') {
+        if (!parse_import_path(line_, 2, true, op.path, end) || end >= line_.size() || line_[end] != ' ' ||
+            !parse_import_path(line_, end + 1, false, op.target, end)) {
+            return fail("bad paths in '" + line_ + "'");
+        }
+        if (!valid_import_path(op.target)) return fail("invalid path '" + op.target + "'");
+    }
+    if (op.op != '*' && !valid_import_path(op.path)) return fail("invalid path '" + op.path + "'");
+    commit.ops.push_back(std::move(op));
+    return true;
+}
+
+bool FastImporter::parse_reset() {
+    ImportCommand command(ImportCommand::Reset);
+    command.commit.ref = full_ref(line_.substr(6));
+    if (read_line()) {
+        if (starts_with(line_, "from ")) {
+            command.commit.has_from = true;
+            command.commit.from = line_.substr(5);
+        } else {
+            unread();
+        }
+    }
+    commands_.push_back(std::move(command));
+    return true;
+}
+
+bool FastImporter::skip_tag() {
+    tags_skipped_++;
+    while (read_line()) {
+        if (starts_with(line_, "data ")) {
+            std::string message;
+            return read_data(message);
+        }
+        if (!starts_with(line_, "from ") && !starts_with(line_, "mark ") && !starts_with(line_, "tagger ") &&
+            !starts_with(line_, "original-oid ")) {
+            return fail("bad tag command '" + line_ + "'");
+        }
+    }
+    return fail("unexpected end of stream in tag");
+}
+
+bool FastImporter::run() {
+    empty_tree_ = hash_content("");
+    if (!writer_.open("fast-import")) return false;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(".minigit/objects", ec)) {
+        std::string name = entry.path().filename().string();
+        if (is_object_id(name)) loose_.insert(to_object_id(name));
+    }
+    // Parents that predate the import need generation numbers
+    update_commit_graph(ref_tips());
+    graph_.load();
+    while (read_line()) {
+        bool ok = true;
+        if (line_.empty() || starts_with(line_, "feature ") || starts_with(line_, "option ")) {
+            continue;
+        } else if (line_ == "blob") {
+            ok = parse_blob();
+        } else if (starts_with(line_, "commit ")) {
+            ok = parse_commit();
+        } else if (starts_with(line_, "reset ")) {
+            ok = parse_reset();
+        } else if (starts_with(line_, "tag ")) {
+            ok = skip_tag();
+        } else if (line_ == "checkpoint") {
+            ok = flush();
+        } else if (starts_with(line_, "progress ")) {
+            ImportCommand command(ImportCommand::Progress);
+            command.text = line_;
+            commands_.push_back(std::move(command));
+        } else if (line_ == "done") {
+            break;
+        } else {
+            ok = fail("unsupported command '" + line_ + "'");
+        }
+        if (!ok) return false;
+        if (batch_bytes_ >= FAST_IMPORT_BATCH_BYTES || commands_.size() >= FAST_IMPORT_BATCH_COMMANDS) {
+            if (!flush()) return false;
+        }
+    }
+    return flush() && finish();
+}
+
+bool FastImporter::flush() {
+    TRACE_SCOPE("fast-import: apply batch");
+    submit_blobs();
+    pool_.wait();
+    // Blob commands and inline data alike
+    for (const ImportBlob& blob : blobs_) {
+        if (!blob.exists && !writer_.contains(blob.id)) writer_.append(blob.id, blob.record);
+    }
+    blob_count_ += blobs_.size();
+    for (const ImportCommand& command : commands_) {
+        switch (command.kind) {
+        case ImportCommand::Blob:
+            if (command.mark) marks_[command.mark] = blobs_[command.blob].id;
+            break;
+        case ImportCommand::Commit:
+            if (!apply_commit(command.commit)) return false;
+            break;
+        case ImportCommand::Reset:
+            if (!apply_reset(command.commit)) return false;
+            break;
+        case ImportCommand::Progress:
+            std::cout << command.text << "\n";
+            break;
+        }
+    }
+    commands_.clear();
+    blobs_.clear();
+    batch_bytes_ = 0;
+    submitted_ = 0;
+    return true;
+}
+
+std::string FastImporter::resolve(std::string name) {
+    if (name.size() > 2 && name.compare(name.size() - 2, 2, "^0") == 0) name.resize(name.size() - 2);
+    if (name.empty()) return "";
+    if (name[0] == ':') {
+        auto it = marks_.find(std::strtoull(name.c_str() + 1, nullptr, 10));
+        return it == marks_.end() ? "" : hash_to_string(it->second);
+    }
+    if (is_null_commit(name)) return NULL_COMMIT;
+    auto it = branches_.find(full_ref(name));
+    if (it != branches_.end()) return it->second.tip;
+    if (is_object_id(name) && (writer_.contains(to_object_id(name)) || stored(to_object_id(name)))) return name;
+    std::string ref = full_ref(name);
+    return starts_with(ref, "refs/heads/") ? resolve_revision(ref.substr(11)) : "";
+}
+
+bool FastImporter::read_import_object(const std::string& hex, std::string& out) {
+    return writer_.read(to_object_id(hex), out) || read_object(hex, out);
+}
+
+ImportNodePtr FastImporter::commit_root(const std::string& commit_hash) {
+    std::string tree;
+    std::string content;
+    if (writer_.read(to_object_id(commit_hash), content)) {
+        if (starts_with(content, "tree ")) tree = content.substr(5, OBJECT_ID_HEX_LEN);
+    } else {
+        // Commits from before trees existed get one written from their file list
+        tree = commit_tree(*load_commit(commit_hash));
+    }
+    if (tree.empty() || tree == empty_tree_) return nullptr;
+    auto node = std::make_shared<ImportNode>();
+    node->hash = tree;
+    return node;
+}
+
+ImportBranch& FastImporter::load_branch(const std::string& ref) {
+    auto it = branches_.find(ref);
+    if (it != branches_.end()) return it->second;
+    // A branch that already exists continues from its current tip
+    ImportBranch& branch = branches_[ref];
+    if (starts_with(ref, "refs/heads/")) {
+        branch.tip = resolve_revision(ref.substr(11));
+        branch.base = branch.tip;
+        if (!branch.tip.empty()) branch.root = commit_root(branch.tip);
+    }
+    return branch;
+}
+
+bool FastImporter::load(ImportNode& node) {
+    if (node.loaded) return true;
+    std::string content;
+    if (!read_import_object(node.hash, content)) {
+        std::cerr << "Error: Cannot read tree " << node.hash << "\n";
+        return false;
+    }
+    TRACE_COUNT(TraceCounter::TreesParsed);
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t eol = content.find('\n', pos);
+        if (eol == std::string::npos) eol = content.size();
+        if (eol - pos > 6 + OBJECT_ID_HEX_LEN) {
+            bool is_tree = content.compare(pos, 5, "tree ") == 0;
+            std::string name = content.substr(pos + 6 + OBJECT_ID_HEX_LEN, eol - pos - 6 - OBJECT_ID_HEX_LEN);
+            ImportEntry& entry = node.entries[is_tree ? name + "/" : name];
+            if (is_tree) {
+                entry.tree = std::make_shared<ImportNode>();
+                entry.tree->hash = content.substr(pos + 5, OBJECT_ID_HEX_LEN);
+            } else {
+                entry.hash = content.substr(pos + 5, OBJECT_ID_HEX_LEN);
+            }
+        }
+        pos = eol + 1;
+    }
+    node.loaded = true;
+    return true;
+}
+
+ImportNode& FastImporter::edit(ImportNodePtr& slot) {
+    load(*slot);
+    if (slot.use_count() > 1) slot = std::make_shared<ImportNode>(*slot);
+    slot->hash.clear();
+    return *slot;
+}
+
+const ImportEntry* FastImporter::find_path(ImportNode* node, std::string_view path) {
+    while (node && load(*node)) {
+        size_t slash = path.find('/');
+        if (slash == std::string_view::npos) {
+            auto it = node->entries.find(std::string(path));
+            if (it == node->entries.end()) it = node->entries.find(std::string(path) + "/");
+            return it == node->entries.end() ? nullptr : &it->second;
+        }
+        auto it = node->entries.find(std::string(path.substr(0, slash + 1)));
+        if (it == node->entries.end()) return nullptr;
+        node = it->second.tree.get();
+        path.remove_prefix(slash + 1);
+    }
+    return nullptr;
+}
+
+void FastImporter::set_path(ImportNodePtr& root, std::string_view path, const ImportEntry& entry) {
+    ImportNodePtr* slot = &root;
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/')) {
+        ImportNode& node = edit(*slot);
+        node.entries.erase(std::string(path.substr(0, slash)));
+        ImportEntry& dir = node.entries[std::string(path.substr(0, slash + 1))];
+        if (!dir.tree) dir.tree = empty_node();
+        slot = &dir.tree;
+        path.remove_prefix(slash + 1);
+    }
+    ImportNode& node = edit(*slot);
+    std::string name(path);
+    node.entries.erase(name);
+    node.entries.erase(name + "/");
+    node.entries[entry.tree ? name + "/" : name] = entry;
+}
+
+void FastImporter::remove_path(ImportNodePtr& root, std::string_view path) {
+    if (!find_path(root.get(), path)) return;
+    ImportNodePtr* slot = &root;
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/')) {
+        slot = &edit(*slot).entries[std::string(path.substr(0, slash + 1))].tree;
+        path.remove_prefix(slash + 1);
+    }
+    ImportNode& node = edit(*slot);
+    node.entries.erase(std::string(path));
+    node.entries.erase(std::string(path) + "/");
+}
+
+bool FastImporter::apply_file_op(ImportNodePtr& root, const ImportFileOp& op) {
+    switch (op.op) {
+    case '*':
+        root = empty_node();
+        return true;
+    case 'D':
+        remove_path(root, op.path);
+        return true;
+    case 'R':
+    case 'C': {
+        const ImportEntry* source = find_path(root.get(), op.path);
+        if (!source) return fail("no such path " + op.path);
+        ImportEntry copy = *source;
+        if (op.op == 'R') remove_path(root, op.path);
+        set_path(root, op.target, copy);
+        return true;
+    }
+    }
+    ImportEntry entry;
+    if (op.is_tree) {
+        if (!is_object_id(op.dataref) || !(writer_.contains(to_object_id(op.dataref)) || stored(to_object_id(op.dataref)))) {
+            return fail("unknown tree " + op.dataref);
+        }
+        entry.tree = std::make_shared<ImportNode>();
+        entry.tree->hash = op.dataref;
+    } else if (op.dataref.empty()) {
+        entry.hash = hash_to_string(blobs_[op.blob].id);
+    } else if (op.dataref[0] == ':') {
+        auto it = marks_.find(std::strtoull(op.dataref.c_str() + 1, nullptr, 10));
+        if (it == marks_.end()) return fail("unknown mark " + op.dataref);
+        entry.hash = hash_to_string(it->second);
+    } else if (is_object_id(op.dataref) && (writer_.contains(to_object_id(op.dataref)) || stored(to_object_id(op.dataref)))) {
+        entry.hash = op.dataref;
+    } else {
+        return fail("unknown blob " + op.dataref);
+    }
+    set_path(root, op.path, entry);
+    return true;
+}
+
+std::string FastImporter::store(const std::string& content) {
+    Sha256 hasher;
+    hasher.update(content);
+    ObjectId id = hasher.finish();
+    std::string hex = hash_to_string(id);
+    // Trees and commits are mostly hex IDs, which LZ barely shrinks; gc deltas them later
+    if (!writer_.contains(id) && !stored(id)) writer_.append(id, pack_record(content, false));
+    return hex;
+}
+
+const std::string& FastImporter::write_node(ImportNode& node) {
+    if (!node.hash.empty()) return node.hash;
+    // The same lines write_tree produces, so identical trees get identical hashes
+    std::string content;
+    for (const auto& [name, entry] : node.entries) {
+        if (entry.tree) {
+            const std::string& subtree = write_node(*entry.tree);
+            if (subtree == empty_tree_) continue;
+            content.append("tree ").append(subtree).append(" ").append(name, 0, name.size() - 1).append("\n");
+        } else {
+            content.append("blob ").append(entry.hash).append(" ").append(name).append("\n");
+        }
+    }
+    node.hash = store(content);
+    tree_count_++;
+    return node.hash;
+}
+
+bool FastImporter::changed_paths(ImportNode* a, ImportNode* b, std::string& prefix,
+                                 std::unordered_set<std::string>& paths) {
+    static const std::map<std::string, ImportEntry> none;
+    if (a && b && a->hash == b->hash) return true;
+    if ((a && !load(*a)) || (b && !load(*b))) return false;
+    const auto& old_entries = a ? a->entries : none;
+    const auto& new_entries = b ? b->entries : none;
+    auto i = old_entries.begin(), j = new_entries.begin();
+    while (i != old_entries.end() || j != new_entries.end()) {
+        const ImportEntry* old_entry = nullptr;
+        const ImportEntry* new_entry = nullptr;
+        const std::string* name;
+        if (j == new_entries.end() || (i != old_entries.end() && i->first < j->first)) {
+            name = &i->first;
+            old_entry = &(i++)->second;
+        } else if (i == old_entries.end() || j->first < i->first) {
+            name = &j->first;
+            new_entry = &(j++)->second;
+        } else {
+            name = &i->first;
+            old_entry = &(i++)->second;
+            new_entry = &(j++)->second;
+            if (!old_entry->tree && old_entry->hash == new_entry->hash) continue;
+        }
+        size_t length = prefix.size();
+        prefix.append(*name);
+        if ((old_entry ? old_entry : new_entry)->tree) {
+            if (!changed_paths(old_entry ? old_entry->tree.get() : nullptr, new_entry ? new_entry->tree.get() : nullptr,
+                               prefix, paths)) {
+                return false;
+            }
+        } else {
+            // Leading directories go in too, as in changed_path_bloom
+            for (size_t slash = prefix.find('/'); slash != std::string::npos; slash = prefix.find('/', slash + 1)) {
+                paths.insert(prefix.substr(0, slash));
+            }
+            paths.insert(prefix);
+            if (paths.size() > BLOOM_MAX_PATHS) return false;
+        }
+        prefix.resize(length);
+    }
+    return true;
+}
+
+uint32_t FastImporter::generation_of(const ObjectId& id, const std::string& hex) {
+    auto it = generations_.find(id);
+    if (it != generations_.end()) return it->second;
+    uint32_t pos;
+    if (graph_.find(id.data(), pos)) return graph_.generation(pos);
+    // An existing commit no ref reaches
+    update_commit_graph({hex});
+    graph_.load();
+    return graph_.find(id.data(), pos) ? graph_.generation(pos) : 0;
+}
+
+bool FastImporter::apply_commit(const ImportCommit& commit) {
+    ImportBranch& branch = load_branch(commit.ref);
+    ImportNodePtr start = branch.root;
+    std::vector<std::string> parents;
+    if (commit.has_from) {
+        std::string from = resolve(commit.from);
+        if (from.empty()) return fail("unknown commit " + commit.from + " in from");
+        if (is_null_commit(from)) {
+            start = nullptr;
+        } else {
+            if (from != branch.tip) start = commit_root(from);
+            parents.push_back(from);
+        }
+    } else if (!branch.tip.empty()) {
+        parents.push_back(branch.tip);
+    }
+    for (const std::string& merge : commit.merges) {
+        std::string parent = resolve(merge);
+        if (parent.empty() || is_null_commit(parent)) return fail("unknown commit " + merge + " in merge");
+        parents.push_back(parent);
+    }
+    ImportNodePtr root = start ? start : empty_node();
+    for (const ImportFileOp& op : commit.ops) {
+        if (!apply_file_op(root, op)) return false;
+    }
+    std::string tree = write_node(*root);
+    std::string timestamp = format_timestamp(commit.date);
+    Commit object;
+    object.tree = tree;
+    object.parents.assign(parents.begin(), parents.end());
+    object.timestamp = timestamp;
+    object.message = commit.message;
+    std::string hash = store(serialize_commit(object));
+    ObjectId id = to_object_id(hash);
+    uint32_t pos;
+    if (!generations_.count(id) && !graph_.find(id.data(), pos)) {
+        GraphEntry entry;
+        entry.id = id;
+        entry.date = commit.date;
+        entry.generation = 1;
+        for (const std::string& parent : parents) {
+            ObjectId parent_id = to_object_id(parent);
+            entry.parents.push_back(parent_id);
+            entry.generation = std::max(entry.generation, generation_of(parent_id, parent) + 1);
+        }
+        // The filter is against the first parent, whose tree the commit was built from
+        std::unordered_set<std::string> paths;
+        std::string prefix;
+        if (!changed_paths(start.get(), root.get(), prefix, paths)) {
+            entry.bloom = std::string(1, '\xff');
+        } else {
+            std::vector<uint64_t> hashes;
+            hashes.reserve(paths.size());
+            for (const std::string& path : paths) hashes.push_back(bloom_path_hash(path));
+            entry.bloom = make_bloom_filter(hashes);
+        }
+        generations_[id] = entry.generation;
+        graph_entries_.push_back(std::move(entry));
+    }
+    if (commit.mark) marks_[commit.mark] = id;
+    branch.tip = hash;
+    branch.root = tree == empty_tree_ ? nullptr : root;
+    commit_count_++;
+    return true;
+}
+
+bool FastImporter::apply_reset(const ImportCommit& reset) {
+    ImportBranch& branch = branches_[reset.ref];
+    branch.tip.clear();
+    branch.root = nullptr;
+    if (!reset.has_from) return true;
+    std::string from = resolve(reset.from);
+    if (from.empty()) return fail("unknown commit " + reset.from + " in reset");
+    if (!is_null_commit(from)) {
+        branch.tip = from;
+        branch.root = commit_root(from);
+    }
+    return true;
+}
+
+bool FastImporter::finish() {
+    TRACE_SCOPE("fast-import: finish");
+    size_t objects = writer_.count();
+    pack_name_ = writer_.finish();
+    if (objects && pack_name_.empty()) return false;
+    if (!graph_entries_.empty()) append_commit_graph(std::move(graph_entries_));
+
+    // Refs go last, once everything they point at is in place. A branch the import continued
+    // must not have moved since, or that command's commits would be lost.
+    Transaction tx;
+    if (!tx.lock(".minigit/HEAD")) return false;
+    std::string head_ref;
+    std::string head = read_head(head_ref);
+    std::string first_branch;
+    for (const auto& [ref, branch] : branches_) {
+        if (!starts_with(ref, "refs/heads/") || is_lock_file(ref)) {
+            refs_skipped_++;
+            continue;
+        }
+        if (branch.tip.empty()) continue;
+        std::string path = ".minigit/" + ref;
+        if (!tx.lock(path)) return false;
+        if (!branch.base.empty() && resolve_revision(ref.substr(11)) != branch.base) {
+            std::cerr << "Error: fast-import: " << ref.substr(11) << " was updated by another command during the import\n";
+            return false;
+        }
+        tx.write(path, branch.tip);
+        if (first_branch.empty()) first_branch = ref;
+        if (ref == head_ref && branch.tip != head) checkout_hint_ = ref;
+        refs_written_++;
+    }
+    // An unborn HEAD whose branch was not imported moves to one that was: master if possible
+    auto imported = [&](const std::string& ref) {
+        auto it = branches_.find(ref);
+        return it != branches_.end() && !it->second.tip.empty();
+    };
+    if (!head_ref.empty() && (head.empty() || is_null_commit(head)) && !first_branch.empty() && !imported(head_ref)) {
+        head_branch_ = imported("refs/heads/master") ? "refs/heads/master" : first_branch;
+        tx.write(".minigit/HEAD", "ref: " + head_branch_);
+        checkout_hint_ = head_branch_;
+        if (is_null_commit(head) && tx.lock(".minigit/" + head_ref)) tx.remove(".minigit/" + head_ref);
+    }
+    return tx.commit();
+}
+
+void FastImporter::report(double seconds) const {
+    std::cout << "Imported " << commit_count_ << " commits, " << blob_count_ << " blobs and " << tree_count_
+              << " trees";
+    if (!pack_name_.empty()) std::cout << " into " << pack_name_ << ".pack (" << writer_.bytes() << " bytes)";
+    std::cout << " in " << std::fixed << std::setprecision(3) << seconds << " s ("
+              << static_cast<uint64_t>(seconds > 0 ? commit_count_ / seconds : 0) << " commits/s)\n";
+    std::cout << "Updated " << refs_written_ << " branches\n";
+    if (refs_skipped_) std::cout << "Skipped " << refs_skipped_ << " refs outside refs/heads\n";
+    if (tags_skipped_) std::cout << "Skipped " << tags_skipped_ << " annotated tags\n";
+    if (!head_branch_.empty()) std::cout << "HEAD now points at " << head_branch_.substr(11) << "\n";
+    if (!checkout_hint_.empty()) {
+        std::cout << "Run 'minigit checkout " << checkout_hint_.substr(11) << "' to update the working tree\n";
+    }
+}
+
+bool fast_import(std::istream& in) {
+    TRACE_SCOPE("fast-import");
+    if (!fs::exists(".minigit")) {
+        std::cerr << "Error: Not a MiniGit repository.\n";
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    FastImporter importer(in);
+    if (!importer.run()) {
+        std::cerr << "Error: fast-import aborted; no refs were changed.\n";
+        return false;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    importer.report(elapsed.count());
+    return true;
+}
@@ -0,0 +1,23 @@
+// Bulk history import from a fast-import stream
+#pragma once
+
+#include "commands.h"
+
+// Blobs are hashed and compressed on the thread pool; the commands that use them are
+// applied in batches of at most this many blob bytes or commands
+const size_t FAST_IMPORT_BATCH_BYTES = size_t(64) << 20;
+const size_t FAST_IMPORT_BATCH_COMMANDS = 16384;
+
+// Blobs are handed to the pool in jobs of this many blobs or bytes
+const size_t FAST_IMPORT_JOB_BLOBS = 256;
+const size_t FAST_IMPORT_JOB_BYTES = size_t(1) << 20;
+
+// Import history from a git fast-import stream, such as `git fast-export --all` writes.
+// Supported: blob, commit (mark, committer, data, from, merge, and the M, D, R, C and
+// deleteall file changes), reset, checkpoint, progress and done; tags, feature and option
+// commands are skipped. Branch trees are kept in memory and only changed directories are
+// re-hashed, every new object goes into one new pack, and the commit-graph, refs and (for an
+// unborn HEAD) HEAD are written once at the end. The index and working tree are left alone.
+// Multi-line commit messages are folded onto one line, and file modes are not recorded.
+// False, with the error printed, if the stream was aborted.
+bool fast_import(std::istream& in);
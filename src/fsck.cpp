@@ -0,0 +1,394 @@
+#include "fsck.h"
+
+// Rehash a chunked object through its chunks, holding one chunk at a time
+static bool verify_chunk_list(const std::string& hash, std::string_view list, std::string& buffer) {
+    std::vector<std::string> chunks;
+    if (!chunk_list_hashes(list, chunks)) return false;
+    Sha256 hasher;
+    for (const std::string& chunk : chunks) {
+        if (!read_object(chunk, buffer)) return false;
+        hasher.update(buffer);
+    }
+    return hash_to_string(hasher.finish()) == hash;
+}
+
+// A loose object or loose chunk list; "" if it is intact, else what is wrong
+static std::string check_loose(const std::string& hash, bool chunk_list, std::string& buffer) {
+    if (!chunk_list) return hash_file(loose_object_path(hash)) == hash ? "" : "corrupt " + hash + " (loose object)";
+    MappedFile list;
+    bool ok = list.open(chunk_list_path(hash)) &&
+              verify_chunk_list(hash, std::string_view(reinterpret_cast<const char*>(list.data()), list.size()), buffer);
+    return ok ? "" : "corrupt " + hash + " (loose chunk list)";
+}
+
+// Per-job buffers. Pack records are checked in pack order, where delta bases come shortly
+// before the objects built on them, so each job keeps what it decoded last to apply deltas to.
+struct FsckScratch {
+    std::string content;
+    std::string base;
+    std::unordered_map<std::string, std::string> recent;
+    size_t recent_bytes = 0;
+};
+
+// Pack record i decoded from this pack (not whichever pack find() picks); "" if it is intact
+static std::string check_pack_record(const PackFile& pack, uint32_t i, FsckScratch& scratch) {
+    std::string hash = bytes_to_hex(pack.id_at(i), OBJECT_ID_SIZE);
+    uint8_t kind;
+    uint64_t size, stored;
+    const uint8_t* data;
+    std::string& content = scratch.content;
+    bool ok = pack_record_at(pack, pack.offset_at(i), kind, size, data, stored);
+    if (ok && kind == PACK_RECORD_CHUNKS) {
+        ok = verify_chunk_list(hash, std::string_view(reinterpret_cast<const char*>(data), stored), content);
+    } else if (ok) {
+        if (kind == PACK_RECORD_DELTA) {
+            auto base = stored >= OBJECT_ID_SIZE ? scratch.recent.find(bytes_to_hex(data, OBJECT_ID_SIZE)) : scratch.recent.end();
+            const std::string* base_content = &scratch.base;
+            if (base != scratch.recent.end()) {
+                base_content = &base->second;
+            } else {
+                ok = stored >= OBJECT_ID_SIZE && read_object(bytes_to_hex(data, OBJECT_ID_SIZE), scratch.base);
+            }
+            ok = ok && delta_apply(*base_content, data + OBJECT_ID_SIZE, static_cast<size_t>(stored - OBJECT_ID_SIZE), content);
+        } else {
+            ok = decode_pack_record(kind, data, stored, size, content);
+        }
+        ok = ok && content.size() == size && hash_content(content) == hash;
+        if (ok && content.size() <= FSCK_RECENT_BYTES / 16) {
+            if (scratch.recent_bytes + content.size() > FSCK_RECENT_BYTES) {
+                scratch.recent.clear();
+                scratch.recent_bytes = 0;
+            }
+            scratch.recent_bytes += content.size();
+            scratch.recent.emplace(std::move(hash), content);
+            return "";
+        }
+    }
+    return ok ? "" : "corrupt " + hash + " (in " + pack.name + ".pack)";
+}
+
+// The pack's trailing checksum, the copy in its index and its name must all agree
+static bool pack_checksum_ok(const PackFile& pack) {
+    if (pack.pack.size() < PACK_HEADER_SIZE + OBJECT_ID_SIZE || pack.idx.size() < PACK_INDEX_HEADER_SIZE + OBJECT_ID_SIZE) {
+        return false;
+    }
+    size_t body = pack.pack.size() - OBJECT_ID_SIZE;
+    Sha256 hasher;
+    hasher.update(pack.pack.data(), body);
+    ObjectId sum = hasher.finish();
+    return std::memcmp(sum.data(), pack.pack.data() + body, OBJECT_ID_SIZE) == 0 &&
+           std::memcmp(sum.data(), pack.idx.data() + pack.idx.size() - OBJECT_ID_SIZE, OBJECT_ID_SIZE) == 0 &&
+           pack.name == "pack-" + hash_to_string(sum);
+}
+
+// Run check(k) for k in [0, count) on the pool and print the findings in order
+template <typename Check>
+static size_t run_checks(ThreadPool& pool, size_t count, Check check) {
+    std::vector<std::string> findings(count);
+    for (size_t start = 0; start < count; start += FSCK_JOB_OBJECTS) {
+        pool.submit([&, start] {
+            FsckScratch scratch;
+            size_t end = std::min(count, start + FSCK_JOB_OBJECTS);
+            for (size_t k = start; k < end; k++) findings[k] = check(k, scratch);
+        });
+    }
+    pool.wait();
+    size_t problems = 0;
+    for (const std::string& finding : findings) {
+        if (finding.empty()) continue;
+        std::cout << finding << "\n";
+        problems++;
+    }
+    return problems;
+}
+
+enum class FsckType : uint8_t { Commit, Tree, Blob };
+
+static const char* type_name(FsckType type) {
+    return type == FsckType::Commit ? "commit" : type == FsckType::Tree ? "tree" : "blob";
+}
+
+// Decode a lowercase hex object ID; false if it is not one
+static bool decode_id(std::string_view hex, ObjectId& id) {
+    static const std::array<int8_t, 256> values = [] {
+        std::array<int8_t, 256> table;
+        table.fill(-1);
+        for (int c = 0; c < 10; c++) table['0' + c] = static_cast<int8_t>(c);
+        for (int c = 0; c < 6; c++) table['a' + c] = static_cast<int8_t>(10 + c);
+        return table;
+    }();
+    if (hex.size() != OBJECT_ID_HEX_LEN) return false;
+    int bad = 0;
+    for (size_t i = 0; i < id.size(); i++) {
+        int high = values[static_cast<uint8_t>(hex[i * 2])], low = values[static_cast<uint8_t>(hex[i * 2 + 1])];
+        bad |= high | low;
+        id[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return bad >= 0;
+}
+
+// Every stored object's ID, sorted and unique, with a fanout table over the first two bytes
+// so a lookup only searches the handful of IDs that share them
+class StoredIds {
+public:
+    std::vector<ObjectId> ids;
+
+    void index() {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        fanout_.assign(65537, 0);
+        for (const ObjectId& id : ids) fanout_[(id[0] << 8 | id[1]) + 1]++;
+        for (size_t b = 1; b < fanout_.size(); b++) fanout_[b] += fanout_[b - 1];
+    }
+
+    // Position of an ID; false if it is not stored
+    bool find(const ObjectId& id, uint32_t& index) const {
+        size_t bucket = id[0] << 8 | id[1];
+        auto end = ids.begin() + fanout_[bucket + 1];
+        auto it = std::lower_bound(ids.begin() + fanout_[bucket], end, id);
+        index = static_cast<uint32_t>(it - ids.begin());
+        return it != end && *it == id;
+    }
+
+private:
+    std::vector<uint32_t> fanout_;
+};
+
+// What a commit or tree refers to; false if it is malformed
+static bool parse_references(const std::string& content, FsckType type, std::vector<std::pair<FsckType, ObjectId>>& out) {
+    std::string_view data(content);
+    for (size_t pos = 0; pos < data.size();) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string_view::npos) return false;
+        std::string_view line = data.substr(pos, eol - pos);
+        pos = eol + 1;
+        std::pair<FsckType, ObjectId> ref;
+        std::string_view hash;
+        if (type == FsckType::Tree) {
+            size_t space = line.find(' ');
+            if (space == std::string_view::npos || line.size() < space + OBJECT_ID_HEX_LEN + 3 ||
+                line[space + 1 + OBJECT_ID_HEX_LEN] != ' ') {
+                return false;
+            }
+            std::string_view kind = line.substr(0, space);
+            if (kind != "blob" && kind != "tree") return false;
+            ref.first = kind == "tree" ? FsckType::Tree : FsckType::Blob;
+            hash = line.substr(space + 1, OBJECT_ID_HEX_LEN);
+        } else if (line.compare(0, 5, "tree ") == 0) {
+            ref.first = FsckType::Tree;
+            hash = line.substr(5);
+        } else if (line.compare(0, 7, "parent ") == 0) {
+            ref.first = FsckType::Commit;
+            hash = line.substr(7);
+        } else if (line.compare(0, 10, "timestamp ") == 0 || line.compare(0, 8, "message ") == 0) {
+            continue;
+        } else {
+            // An inline file entry, "<path>:<hash>"
+            size_t colon = line.rfind(':');
+            if (colon == std::string_view::npos || colon == 0) return false;
+            ref.first = FsckType::Blob;
+            hash = line.substr(colon + 1);
+        }
+        if (!decode_id(hash, ref.second)) return false;
+        out.push_back(ref);
+    }
+    return true;
+}
+
+FsckReport fsck() {
+    TRACE_SCOPE("fsck");
+    FsckReport report;
+    ThreadPool pool;
+    StoredIds stored;
+    std::vector<ObjectId>& ids = stored.ids;
+    std::vector<ObjectId> loose;
+    std::vector<std::string> chunked;
+    {
+        TRACE_SCOPE("fsck: rehash loose objects");
+        std::vector<std::pair<std::string, bool>> batch;
+        auto flush = [&] {
+            report.corrupt += run_checks(pool, batch.size(), [&](size_t k, FsckScratch& scratch) {
+                return check_loose(batch[k].first, batch[k].second, scratch.content);
+            });
+            report.loose += batch.size();
+            batch.clear();
+        };
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(".minigit/objects", ec)) {
+            if (!entry.is_regular_file()) continue;
+            std::string name = entry.path().filename().string();
+            bool chunk_list = entry.path().extension() == CHUNK_LIST_SUFFIX && is_object_id(entry.path().stem().string());
+            if (chunk_list) {
+                name = entry.path().stem().string();
+                chunked.push_back(name);
+            } else if (!is_object_id(name)) {
+                continue;
+            }
+            ids.emplace_back();
+            decode_id(name, ids.back());
+            if (!chunk_list) loose.push_back(ids.back());
+            batch.emplace_back(name, chunk_list);
+            if (batch.size() == FSCK_BATCH_OBJECTS) flush();
+        }
+        flush();
+    }
+    {
+        TRACE_SCOPE("fsck: rehash packs");
+        for (const auto& pack : PackStore::instance().packs()) {
+            report.packs++;
+            std::atomic<bool> checksum_ok{true};
+            pool.submit([&] { checksum_ok = pack_checksum_ok(*pack); });
+            std::vector<std::pair<uint64_t, uint32_t>> order(pack->count);
+            for (uint32_t i = 0; i < pack->count; i++) order[i] = {pack->offset_at(i), i};
+            std::sort(order.begin(), order.end());
+            for (size_t start = 0; start < order.size(); start += FSCK_BATCH_OBJECTS) {
+                size_t count = std::min(order.size() - start, FSCK_BATCH_OBJECTS);
+                for (size_t k = start; k < start + count; k++) {
+                    uint8_t kind;
+                    uint64_t size, stored_size;
+                    const uint8_t* data;
+                    ids.emplace_back();
+                    std::memcpy(ids.back().data(), pack->id_at(order[k].second), OBJECT_ID_SIZE);
+                    if (pack_record_at(*pack, order[k].first, kind, size, data, stored_size) && kind == PACK_RECORD_CHUNKS) {
+                        chunked.push_back(hash_to_string(ids.back()));
+                    }
+                }
+                report.corrupt += run_checks(pool, count, [&](size_t k, FsckScratch& scratch) {
+                    return check_pack_record(*pack, order[start + k].second, scratch);
+                });
+            }
+            pool.wait();
+            report.packed += pack->count;
+            if (!checksum_ok) {
+                std::cout << "corrupt " << pack->name << ".pack (checksum mismatch)\n";
+                report.corrupt++;
+            }
+        }
+    }
+    stored.index();
+    std::sort(loose.begin(), loose.end());
+
+    // Connectivity: each commit or tree is read and parsed in a task of its own, which claims
+    // the objects it refers to and queues a task for each commit and tree it was first to
+    // claim, so separate lines of history and subtrees are walked in parallel
+    TRACE_SCOPE("fsck: connectivity");
+    std::vector<std::atomic<uint64_t>> reached((ids.size() + 63) / 64);
+    auto claim = [&](uint32_t index) {
+        uint64_t bit = uint64_t(1) << (index & 63);
+        return !(reached[index >> 6].fetch_or(bit) & bit);
+    };
+    auto is_reached = [&](size_t index) { return (reached[index >> 6] >> (index & 63)) & 1; };
+    // Packed objects are read straight from the packs, skipping the loose lookup
+    auto read_stored = [&](const ObjectId& id, std::string& content) {
+        std::string hash = hash_to_string(id);
+        if (!std::binary_search(loose.begin(), loose.end(), id) && PackStore::instance().read(hash, content)) return true;
+        return read_object(hash, content);
+    };
+    // (type, ID, referring object); the referrer is a ref or index path for roots
+    std::vector<std::tuple<FsckType, ObjectId, std::string>> missing;
+    std::vector<std::pair<ObjectId, FsckType>> malformed;
+    std::mutex findings_mutex;
+    std::function<void(FsckType, uint32_t)> visit = [&](FsckType type, uint32_t index) {
+        pool.submit([&, type, index] {
+            std::string content;
+            std::vector<std::pair<FsckType, ObjectId>> refs;
+            if (!read_stored(ids[index], content) || !parse_references(content, type, refs)) {
+                std::lock_guard<std::mutex> lock(findings_mutex);
+                malformed.emplace_back(ids[index], type);
+                return;
+            }
+            for (const auto& ref : refs) {
+                uint32_t child;
+                if (!stored.find(ref.second, child)) {
+                    std::lock_guard<std::mutex> lock(findings_mutex);
+                    missing.emplace_back(ref.first, ref.second, std::string(type_name(type)) + " " + hash_to_string(ids[index]));
+                } else if (claim(child) && ref.first != FsckType::Blob) {
+                    visit(ref.first, child);
+                }
+            }
+        });
+    };
+    auto reach_hash = [&](FsckType type, const std::string& hash, const std::string& from) {
+        ObjectId id{};
+        uint32_t index;
+        if (!decode_id(hash, id) || !stored.find(id, index)) {
+            std::lock_guard<std::mutex> lock(findings_mutex);
+            missing.emplace_back(type, id, from);
+        } else if (claim(index) && type != FsckType::Blob) {
+            visit(type, index);
+        }
+    };
+    auto check_ref = [&](const std::string& name, const std::string& hash) {
+        ObjectId id;
+        uint32_t index;
+        if (!decode_id(hash, id) || !stored.find(id, index)) {
+            std::cout << "broken ref " << name << " (" << (hash.empty() ? "empty" : hash) << ")\n";
+            report.bad_refs++;
+            return;
+        }
+        reach_hash(FsckType::Commit, hash, name);
+    };
+    for (const std::string& branch : list_branches()) {
+        std::ifstream branch_file(".minigit/refs/heads/" + branch);
+        std::string hash;
+        std::getline(branch_file, hash);
+        if (!is_null_commit(hash)) check_ref("refs/heads/" + branch, hash);
+    }
+    for (const std::string& branch : list_remote_branches()) {
+        std::ifstream branch_file(REMOTES_DIR + "/" + branch);
+        std::string hash;
+        std::getline(branch_file, hash);
+        check_ref("refs/remotes/" + branch, hash);
+    }
+    std::string head_branch;
+    std::string head = read_head(head_branch);
+    if (head_branch.empty() && !head.empty() && !is_null_commit(head)) check_ref("HEAD", head);
+    if (fs::exists(MERGE_HEAD)) {
+        std::ifstream merge_head_file(MERGE_HEAD);
+        std::string merge_head;
+        std::getline(merge_head_file, merge_head);
+        check_ref("MERGE_HEAD", merge_head);
+    }
+    for (const IndexEntry& entry : load_index()) reach_hash(FsckType::Blob, entry.hash, "index: " + entry.path);
+    pool.wait();
+
+    // A reachable chunked blob keeps its chunks
+    for (const std::string& hash : chunked) {
+        ObjectId id;
+        uint32_t index;
+        std::string list;
+        uint64_t size;
+        std::vector<std::string> chunks;
+        if (!decode_id(hash, id) || !stored.find(id, index) || !is_reached(index) || !read_chunk_list(hash, list, size) ||
+            !chunk_list_hashes(list, chunks)) {
+            continue;
+        }
+        for (const std::string& chunk : chunks) reach_hash(FsckType::Blob, chunk, "chunk of blob " + hash);
+    }
+
+    std::sort(malformed.begin(), malformed.end());
+    for (const auto& object : malformed) {
+        std::cout << "corrupt " << hash_to_string(object.first) << " (malformed " << type_name(object.second) << ")\n";
+        report.corrupt++;
+    }
+    ObjectId empty_tree;
+    decode_id(hash_content(""), empty_tree);
+    std::sort(missing.begin(), missing.end(), [](const auto& a, const auto& b) {
+        return std::tie(std::get<1>(a), std::get<2>(a)) < std::tie(std::get<1>(b), std::get<2>(b));
+    });
+    for (size_t i = 0; i < missing.size(); i++) {
+        const auto& [type, id, from] = missing[i];
+        if ((i > 0 && std::get<1>(missing[i - 1]) == id) || (type == FsckType::Tree && id == empty_tree)) continue;
+        std::cout << "missing " << type_name(type) << " " << hash_to_string(id) << " (" << from << ")\n";
+        report.missing++;
+    }
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (is_reached(i)) continue;
+        std::cout << "dangling " << hash_to_string(ids[i]) << "\n";
+        report.dangling++;
+    }
+    std::cout << "Checked " << ids.size() << " objects (" << report.loose << " loose, " << report.packed << " in "
+              << report.packs << " packs): " << report.corrupt << " corrupt, " << report.missing << " missing, "
+              << report.bad_refs << " broken refs, " << report.dangling << " dangling\n";
+    return report;
+}
@@ -0,0 +1,33 @@
+// Integrity check of the object store and the history it holds
+#pragma once
+
+#include "commands.h"
+
+// Stored objects are rehashed on the thread pool in jobs of this many objects, with at most
+// this many objects queued at once, so memory stays bounded whatever the repository's size
+const size_t FSCK_JOB_OBJECTS = 64;
+const size_t FSCK_BATCH_OBJECTS = 16384;
+
+// Each job keeps up to this many bytes of objects it decoded as delta bases for the next ones
+const size_t FSCK_RECENT_BYTES = size_t(16) << 20;
+
+// What fsck found
+struct FsckReport {
+    size_t loose = 0;      // Loose objects and chunk lists checked
+    size_t packed = 0;     // Pack records checked
+    size_t packs = 0;
+    size_t corrupt = 0;    // Objects whose content no longer hashes to their name, or unreadable
+    size_t missing = 0;    // Objects referred to but not stored
+    size_t bad_refs = 0;   // Refs that do not name a stored commit
+    size_t dangling = 0;   // Stored objects nothing reachable refers to
+};
+
+// Verify the repository in two streaming passes. First every stored copy of every object is
+// rehashed in parallel: loose objects, chunked objects through their chunks, and every pack
+// record in pack order, plus each pack's checksum. Then the history is walked from the refs,
+// HEAD, MERGE_HEAD and the index, each commit and tree read and parsed on the pool by the
+// task that first reached it, checking that every parent, tree and blob referred to is
+// stored. Memory is one 32-byte ID per stored object, one bit each for the walk, and the
+// current batch. Problems are printed one per line ("corrupt", "missing", "broken ref",
+// "dangling"), then a summary.
+FsckReport fsck();
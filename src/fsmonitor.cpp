@@ -0,0 +1,580 @@
+#include "fsmonitor.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+bool FsmonitorChanges::contains(const std::string& path) const {
+    if (std::binary_search(paths.begin(), paths.end(), path)) return true;
+    for (size_t pos = path.find('/'); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        if (std::binary_search(paths.begin(), paths.end(), path.substr(0, pos + 1))) return true;
+    }
+    return false;
+}
+
+std::vector<size_t> FsmonitorChanges::select(const std::vector<IndexEntry>& entries) const {
+    std::vector<size_t> selected;
+    auto by_path = [](const IndexEntry& e, const std::string& p) { return e.path < p; };
+    for (const std::string& path : paths) {
+        auto it = std::lower_bound(entries.begin(), entries.end(), path, by_path);
+        if (path.back() == '/') {
+            for (; it != entries.end() && it->path.compare(0, path.size(), path) == 0; ++it) {
+                selected.push_back(it - entries.begin());
+            }
+        } else if (it != entries.end() && it->path == path) {
+            selected.push_back(it - entries.begin());
+        }
+    }
+    std::sort(selected.begin(), selected.end());
+    selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+    return selected;
+}
+
+void save_fsmonitor_state(const std::string& token, const std::vector<std::string>& dirty, Transaction& tx) {
+    std::string content = token + "\n";
+    for (const std::string& path : dirty) content += path + "\n";
+    tx.write(FSMONITOR_STATE, content);
+}
+
+#ifdef __linux__
+
+// Send all of data; a peer that went away is an error rather than a SIGPIPE
+static bool send_all(int fd, const std::string& data) {
+    const char* p = data.data();
+    size_t size = data.size();
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static sockaddr_un socket_address() {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, FSMONITOR_SOCKET.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+// Send one request line to the daemon and read its whole answer; false if none is running
+static bool ask_daemon(const std::string& request, std::string& answer) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_un addr = socket_address();
+    bool ok = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && send_all(fd, request + "\n");
+    answer.clear();
+    char buffer[1 << 16];
+    while (ok) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        answer.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return ok;
+}
+
+FsmonitorChanges fsmonitor_changes() {
+    TRACE_SCOPE("fsmonitor: query");
+    FsmonitorChanges changes;
+    std::ifstream state(FSMONITOR_STATE);
+    std::string token;
+    std::vector<std::string> dirty;
+    if (std::getline(state, token)) {
+        for (std::string line; std::getline(state, line);) dirty.push_back(line);
+    }
+    std::string answer, kind;
+    if (!ask_daemon("query " + token, answer)) return changes;
+    std::istringstream in(answer);
+    if (!std::getline(in, changes.token) || !std::getline(in, kind)) return changes;
+    changes.daemon = true;
+    if (kind != "changes" || token.empty()) return changes;
+    for (std::string line; std::getline(in, line);) changes.paths.push_back(line);
+    // New ignore rules can change which files are untracked anywhere in the tree
+    if (std::find(changes.paths.begin(), changes.paths.end(), ".minigitignore") != changes.paths.end()) return changes;
+    changes.paths.insert(changes.paths.end(), dirty.begin(), dirty.end());
+    std::sort(changes.paths.begin(), changes.paths.end());
+    changes.paths.erase(std::unique(changes.paths.begin(), changes.paths.end()), changes.paths.end());
+    changes.full = false;
+    return changes;
+}
+
+// Single-producer single-consumer byte ring: the reader thread appends whole batches of
+// inotify events and the journal thread takes everything queued, with no lock on either side
+class EventRing {
+public:
+    explicit EventRing(size_t capacity) : buffer_(capacity) {}
+
+    // Copy a batch in; false if there is no room for all of it yet
+    bool push(const char* data, size_t size) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if (buffer_.size() - (head - tail) < size) return false;
+        size_t at = head % buffer_.size();
+        size_t first = std::min(size, buffer_.size() - at);
+        std::memcpy(buffer_.data() + at, data, first);
+        std::memcpy(buffer_.data(), data + first, size - first);
+        head_.store(head + size, std::memory_order_release);
+        return true;
+    }
+
+    // Append everything queued to out
+    void pop_all(std::string& out) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t size = head - tail;
+        size_t at = tail % buffer_.size();
+        size_t first = std::min(size, buffer_.size() - at);
+        out.append(buffer_.data() + at, first);
+        out.append(buffer_.data(), size - first);
+        tail_.store(head, std::memory_order_release);
+    }
+
+private:
+    std::vector<char> buffer_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// Events watched on every directory of the working tree
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+// The daemon. One thread only reads the inotify queue into the ring; the thread that calls
+// serve() owns everything else, turning events into the journal and answering clients.
+class FsmonitorDaemon {
+public:
+    FsmonitorDaemon() = default;
+    FsmonitorDaemon(const FsmonitorDaemon&) = delete;
+    FsmonitorDaemon& operator=(const FsmonitorDaemon&) = delete;
+
+    ~FsmonitorDaemon() {
+        if (reader_.joinable()) {
+            uint64_t one = 1;
+            if (::write(stop_fd_, &one, sizeof(one)) < 0) {}
+            reader_.join();
+        }
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+            ::unlink(FSMONITOR_SOCKET.c_str());
+        }
+        for (int fd : {inotify_fd_, wake_fd_, stop_fd_}) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+
+    // Watch the tree and listen on the socket; false, with the error printed, on failure
+    bool open() {
+        std::string answer;
+        if (ask_daemon("status", answer)) {
+            std::cerr << "Error: fsmonitor is already running.\n";
+            return false;
+        }
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (inotify_fd_ < 0 || wake_fd_ < 0 || stop_fd_ < 0) {
+            std::cerr << "Error: Cannot start inotify: " << std::strerror(errno) << "\n";
+            return false;
+        }
+        minigit_wd_ = inotify_add_watch(inotify_fd_, ".minigit", IN_CREATE | IN_ONLYDIR);
+        if (minigit_wd_ < 0) {
+            std::cerr << "Error: Cannot watch .minigit: " << std::strerror(errno) << "\n";
+            return false;
+        }
+        if (!watch_tree("")) return false;
+        root_wd_ = watches_[""];
+
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr = socket_address();
+        ::unlink(FSMONITOR_SOCKET.c_str());
+        if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, 64) != 0) {
+            std::cerr << "Error: Cannot listen on " << FSMONITOR_SOCKET << ": " << std::strerror(errno) << "\n";
+            return false;
+        }
+        instance_ = std::to_string(::getpid()) + "-" +
+                    std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+        reader_ = std::thread([this] { read_events(); });
+        return true;
+    }
+
+    size_t watched() const { return dirs_.size(); }
+
+    // Serve until asked to stop or until the working tree or .minigit goes away
+    void serve() {
+        pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        while (!stopping_ && !gone_) {
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[1].revents) drain();
+            if (fds[0].revents) {
+                int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client < 0) continue;
+                answer(client);
+                ::close(client);
+            }
+        }
+    }
+
+private:
+    // Reader thread: move events from the kernel queue into the ring as fast as they come.
+    // When the journal thread falls behind and the ring is full, the kernel queue absorbs
+    // events while this waits.
+    void read_events() {
+        alignas(inotify_event) char buffer[1 << 16];
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        while (true) {
+            if (::poll(fds, 2, -1) < 0 && errno != EINTR) return;
+            if (fds[1].revents) return;
+            ssize_t n = ::read(inotify_fd_, buffer, sizeof(buffer));
+            if (n <= 0) continue;
+            while (!ring_.push(buffer, static_cast<size_t>(n))) {
+                if (::poll(&fds[1], 1, 1) > 0) return;
+            }
+            uint64_t one = 1;
+            if (::write(wake_fd_, &one, sizeof(one)) < 0) {}
+        }
+    }
+
+    // Watch a directory and every directory beneath it; false, with the error printed, if
+    // one that exists cannot be watched
+    bool watch_tree(const std::string& rel) {
+        std::vector<std::string> pending{rel};
+        while (!pending.empty()) {
+            std::string dir = std::move(pending.back());
+            pending.pop_back();
+            int wd = inotify_add_watch(inotify_fd_, dir.empty() ? "." : dir.c_str(), WATCH_MASK);
+            if (wd < 0) {
+                if (errno == ENOENT || errno == ENOTDIR) continue;
+                std::cerr << "Error: Cannot watch " << (dir.empty() ? "." : dir) << ": " << std::strerror(errno)
+                          << (errno == ENOSPC ? " (see /proc/sys/fs/inotify/max_user_watches)" : "") << "\n";
+                return false;
+            }
+            auto old = dirs_.find(wd);
+            if (old != dirs_.end() && old->second != dir) watches_.erase(old->second);
+            dirs_[wd] = dir;
+            watches_[dir] = wd;
+            std::error_code ec;
+            for (const auto& entry : fs::directory_iterator(dir.empty() ? "." : dir, ec)) {
+                std::string name = entry.path().filename().string();
+                if (dir.empty() && name == ".minigit") continue;
+                if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+                    pending.push_back(dir.empty() ? name : dir + "/" + name);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Stop watching a directory that moved away, and everything beneath it
+    void unwatch_tree(const std::string& rel) {
+        auto drop = [&](std::map<std::string, int>::iterator it) {
+            inotify_rm_watch(inotify_fd_, it->second);
+            dirs_.erase(it->second);
+            return watches_.erase(it);
+        };
+        auto it = watches_.find(rel);
+        if (it != watches_.end()) drop(it);
+        std::string prefix = rel + "/";
+        for (it = watches_.lower_bound(prefix); it != watches_.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+            it = drop(it);
+        }
+    }
+
+    void record(std::string path) {
+        // A repeat of the last change is only needed if a token was handed out in between
+        if (!journal_.empty() && journal_.back().second == path && journal_.back().first >= issued_) return;
+        journal_.emplace_back(next_seq_++, std::move(path));
+        if (journal_.size() > FSMONITOR_JOURNAL_MAX) {
+            journal_.erase(journal_.begin(), journal_.begin() + journal_.size() / 2);
+            valid_from_ = std::max(valid_from_, journal_.front().first);
+        }
+    }
+
+    void handle(const inotify_event& event, const char* name) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            // Events were lost: no earlier token can be answered, and new directories may
+            // have gone unwatched
+            valid_from_ = next_seq_;
+            if (!watch_tree("")) failed_ = true;
+            return;
+        }
+        if (event.wd == minigit_wd_) {
+            if (event.len && cookie_ == name) cookie_seen_ = true;
+            return;
+        }
+        auto dir = dirs_.find(event.wd);
+        if (dir == dirs_.end()) return;
+        if (event.mask & IN_IGNORED) {
+            if (event.wd == root_wd_) gone_ = true;
+            auto it = watches_.find(dir->second);
+            if (it != watches_.end() && it->second == event.wd) watches_.erase(it);
+            dirs_.erase(dir);
+            return;
+        }
+        if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            if (event.wd == root_wd_) gone_ = true;
+            return;
+        }
+        if (!event.len) return;
+        std::string path = dir->second.empty() ? std::string(name) : dir->second + "/" + name;
+        if (path == ".minigit") {
+            if (event.mask & (IN_DELETE | IN_MOVED_FROM)) gone_ = true;
+            return;
+        }
+        if (event.mask & IN_ISDIR) {
+            // Everything beneath a directory that appeared, went away or moved is reported
+            // as one "dir/" change; a new one is watched before it is journaled, so files
+            // created in it meanwhile are covered either way
+            if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (!watch_tree(path)) failed_ = true;
+            } else if (event.mask & IN_MOVED_FROM) {
+                unwatch_tree(path);
+            } else if (!(event.mask & IN_DELETE)) {
+                return;
+            }
+            record(path + "/");
+            return;
+        }
+        record(std::move(path));
+    }
+
+    // Journal everything the reader thread has queued
+    void drain() {
+        uint64_t count;
+        if (::read(wake_fd_, &count, sizeof(count)) < 0) {}
+        ring_.pop_all(batch_);
+        size_t at = 0;
+        while (at + sizeof(inotify_event) <= batch_.size()) {
+            inotify_event event;
+            std::memcpy(&event, batch_.data() + at, sizeof(event));
+            // The name is NUL-padded to the record's length
+            handle(event, batch_.data() + at + sizeof(event));
+            at += sizeof(event) + event.len;
+        }
+        batch_.clear();
+    }
+
+    // Create a cookie file and journal events until its own arrives, so every change made
+    // before the query was read has been journaled too
+    bool sync() {
+        cookie_ = FSMONITOR_COOKIE_PREFIX + std::to_string(++cookies_);
+        cookie_seen_ = false;
+        std::string path = ".minigit/" + cookie_;
+        int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        ::close(fd);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(FSMONITOR_COOKIE_TIMEOUT_MS);
+        while (!cookie_seen_) {
+            drain();
+            int left = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count());
+            if (cookie_seen_ || left <= 0) break;
+            pollfd wake{wake_fd_, POLLIN, 0};
+            ::poll(&wake, 1, left);
+        }
+        ::unlink(path.c_str());
+        cookie_.clear();
+        return cookie_seen_;
+    }
+
+    // Requests are one line: "query <token>", "status" or "stop"
+    void answer(int client) {
+        timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string request;
+        char buffer[4096];
+        while (request.find('\n') == std::string::npos && request.size() < sizeof(buffer)) {
+            ssize_t n = ::recv(client, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            request.append(buffer, static_cast<size_t>(n));
+        }
+        request = request.substr(0, request.find('\n'));
+        if (request == "stop") {
+            stopping_ = true;
+            send_all(client, "stopping\n");
+        } else if (request == "status") {
+            drain();
+            send_all(client, "fsmonitor: pid " + std::to_string(::getpid()) + ", watching " +
+                             std::to_string(dirs_.size()) + " directories, " + std::to_string(journal_.size()) +
+                             " changes journaled" + (failed_ ? ", a watch failed so every query rescans" : "") + "\n");
+        } else if (request.compare(0, 6, "query ") == 0) {
+            send_all(client, query(request.substr(6)));
+        }
+    }
+
+    // Answer a token: a new token, then "full", or "changes" and the changed paths
+    std::string query(const std::string& token) {
+        TRACE_SCOPE("fsmonitor: answer");
+        bool synced = sync();
+        uint64_t since = 0;
+        size_t colon = token.rfind(':');
+        bool known = colon != std::string::npos && token.compare(0, colon, instance_) == 0;
+        if (known) {
+            try {
+                since = std::stoull(token.substr(colon + 1));
+            } catch (const std::exception&) {
+                known = false;
+            }
+        }
+        std::string out = instance_ + ":" + std::to_string(next_seq_) + "\n";
+        issued_ = next_seq_;
+        if (!synced || failed_ || !known || since < valid_from_ || since > next_seq_) return out + "full\n";
+        auto it = std::lower_bound(journal_.begin(), journal_.end(), since,
+                                   [](const std::pair<uint64_t, std::string>& e, uint64_t s) { return e.first < s; });
+        std::vector<std::string_view> paths;
+        for (; it != journal_.end(); ++it) paths.push_back(it->second);
+        std::sort(paths.begin(), paths.end());
+        paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+        out += "changes\n";
+        for (std::string_view path : paths) {
+            out.append(path.data(), path.size());
+            out += '\n';
+        }
+        return out;
+    }
+
+    int inotify_fd_ = -1;
+    int listen_fd_ = -1;
+    int wake_fd_ = -1;   // Reader thread to journal thread: the ring has events
+    int stop_fd_ = -1;   // Journal thread to reader thread: exit
+    int minigit_wd_ = -1;
+    int root_wd_ = -1;
+    std::unordered_map<int, std::string> dirs_;   // Watched directories ("" is the root)
+    std::map<std::string, int> watches_;          // The same, by path
+    EventRing ring_{FSMONITOR_RING_BYTES};
+    std::thread reader_;
+    std::string batch_;
+
+    std::string instance_;   // Tokens of another daemon get a full rescan
+    std::deque<std::pair<uint64_t, std::string>> journal_;
+    uint64_t next_seq_ = 1;
+    uint64_t valid_from_ = 1;   // Oldest token that can still be answered
+    uint64_t issued_ = 0;       // Latest token handed out
+    bool failed_ = false;       // A directory could not be watched
+    bool gone_ = false;         // The working tree or .minigit was removed
+    bool stopping_ = false;
+    std::string cookie_;
+    bool cookie_seen_ = false;
+    uint64_t cookies_ = 0;
+};
+
+bool fsmonitor_run() {
+    FsmonitorDaemon daemon;
+    if (!daemon.open()) return false;
+    std::cout << "Watching " << daemon.watched() << " directories\n" << std::flush;
+    daemon.serve();
+    return true;
+}
+
+bool fsmonitor_start() {
+    // Errors while starting come back through a pipe that the daemon closes once it listens
+    int pipe_fds[2];
+    if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        std::cerr << "Error: Cannot start fsmonitor: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t child = ::fork();
+    if (child == 0) {
+        // Fork twice so the daemon is not left as a zombie of this process
+        ::setsid();
+        if (::fork() != 0) ::_exit(0);
+        ::close(pipe_fds[0]);
+        int null_fd = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+        ::dup2(null_fd, 0);
+        ::dup2(null_fd, 1);
+        ::dup2(pipe_fds[1], 2);
+        int status = 1;
+        {
+            FsmonitorDaemon daemon;
+            if (daemon.open()) {
+                std::cerr.flush();
+                ::dup2(null_fd, 2);
+                ::close(pipe_fds[1]);
+                daemon.serve();
+                status = 0;
+            }
+            std::cerr.flush();
+        }
+        ::_exit(status);
+    }
+    ::close(pipe_fds[1]);
+    std::string errors;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = ::read(pipe_fds[0], buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        errors.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(pipe_fds[0]);
+    if (child > 0) ::waitpid(child, nullptr, 0);
+    std::string answer;
+    if (child < 0 || !errors.empty() || !ask_daemon("status", answer)) {
+        std::cerr << (errors.empty() ? "Error: fsmonitor did not start.\n" : errors);
+        return false;
+    }
+    std::cout << "Started " << answer;
+    return true;
+}
+
+bool fsmonitor_stop() {
+    std::string answer;
+    if (!ask_daemon("stop", answer)) {
+        std::cerr << "Error: fsmonitor is not running.\n";
+        return false;
+    }
+    // The daemon removes its socket last, after which a new one can start
+    for (int i = 0; i < 500 && fs::exists(FSMONITOR_SOCKET); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << "Stopped fsmonitor\n";
+    return true;
+}
+
+bool fsmonitor_status() {
+    std::string answer;
+    if (!ask_daemon("status", answer)) {
+        std::cout << "fsmonitor is not running\n";
+        return false;
+    }
+    std::cout << answer;
+    return true;
+}
+
+#else
+
+FsmonitorChanges fsmonitor_changes() {
+    return FsmonitorChanges();
+}
+
+static bool fsmonitor_unsupported() {
+    std::cerr << "Error: fsmonitor needs inotify, which is only available on Linux.\n";
+    return false;
+}
+
+bool fsmonitor_start() { return fsmonitor_unsupported(); }
+bool fsmonitor_run() { return fsmonitor_unsupported(); }
+bool fsmonitor_stop() { return fsmonitor_unsupported(); }
+bool fsmonitor_status() { return fsmonitor_unsupported(); }
+
+#endif
@@ -0,0 +1,59 @@
+// Watching the working tree with inotify, so commands only look at the paths that changed
+#pragma once
+
+#include "index.h"
+
+// The daemon answers on this socket. Status saves the token of its last answer here, along
+// with the paths it then found modified, deleted or untracked.
+const std::string FSMONITOR_SOCKET = ".minigit/fsmonitor.sock";
+const std::string FSMONITOR_STATE = ".minigit/fsmonitor";
+
+// Before answering, the daemon creates a file with this prefix in .minigit and waits up to
+// FSMONITOR_COOKIE_TIMEOUT_MS for its event, so every change made before the query is in
+// the answer
+const std::string FSMONITOR_COOKIE_PREFIX = "fsmonitor-cookie-";
+const int FSMONITOR_COOKIE_TIMEOUT_MS = 1000;
+
+// Raw inotify events pass from the thread that reads them to the journal thread through a
+// lock-free ring of this many bytes, so a burst is drained from the kernel queue at once
+// however busy the journal thread is
+const size_t FSMONITOR_RING_BYTES = size_t(16) << 20;
+
+// Changes the journal keeps; a token older than the oldest kept change gets a full rescan
+const size_t FSMONITOR_JOURNAL_MAX = size_t(1) << 20;
+
+// Start the daemon in the background for the repository in the current directory, run it
+// in the foreground, ask it to stop, or print what it is doing. The daemon watches every
+// directory outside .minigit and journals each changed path under an increasing sequence
+// number; a query with a token gets the paths changed since that token and a new one.
+// False, with the error printed, when inotify is unavailable, a directory cannot be
+// watched, or the daemon is already running (start, run) or not running (stop, status).
+bool fsmonitor_start();
+bool fsmonitor_run();
+bool fsmonitor_stop();
+bool fsmonitor_status();
+
+// Paths that may differ from the index or from what status last reported
+struct FsmonitorChanges {
+    bool daemon = false;             // A daemon answered, and token is set
+    bool full = true;                // Nothing is known: every path must be checked
+    std::string token;               // For save_fsmonitor_state
+    std::vector<std::string> paths;  // Sorted; "dir/" stands for everything beneath dir
+
+    // Whether path, or a directory above it, is listed
+    bool contains(const std::string& path) const;
+
+    // Positions of the entries (sorted by path) that a listed path covers, in order
+    std::vector<size_t> select(const std::vector<IndexEntry>& entries) const;
+};
+
+// Ask the daemon, if one is running, what changed since the saved token, and add the paths
+// saved with it. full stays set without a daemon or a saved token, when the daemon cannot
+// tell (it restarted, its journal overflowed or a watch failed) and when .minigitignore
+// changed.
+FsmonitorChanges fsmonitor_changes();
+
+// Save the token a scan of the whole working tree started from, or one that checked every
+// path fsmonitor_changes returned, with the paths it found modified, deleted or untracked
+// ("dir/" for an untracked directory); tx must hold the lock on FSMONITOR_STATE
+void save_fsmonitor_state(const std::string& token, const std::vector<std::string>& dirty, Transaction& tx);
@@ -0,0 +1,45 @@
+#include "ignore.h"
+
+bool glob_match(const char* pattern, const char* text) {
+    while (*pattern) {
+        if (pattern[0] == '*' && pattern[1] == '*') {
+            pattern += 2;
+            if (*pattern == '/') pattern++;
+            for (const char* t = text;; t++) {
+                if (glob_match(pattern, t)) return true;
+                if (!*t) return false;
+            }
+        }
+        if (*pattern == '*') {
+            pattern++;
+            for (const char* t = text;; t++) {
+                if (glob_match(pattern, t)) return true;
+                if (!*t || *t == '/') return false;
+            }
+        }
+        if (!*text) return false;
+        if (*pattern == '?') {
+            if (*text == '/') return false;
+        } else if (*pattern == '[') {
+            const char* p = pattern + 1;
+            bool negate = (*p == '!' || *p == '^');
+            if (negate) p++;
+            bool matched = false;
+            for (bool first = true; *p && (first || *p != ']'); first = false, p++) {
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    if (*text >= p[0] && *text <= p[2]) matched = true;
+                    p += 2;
+                } else if (*p == *text) {
+                    matched = true;
+                }
+            }
+            if (*p != ']' || matched == negate) return false;
+            pattern = p;
+        } else if (*pattern != *text) {
+            return false;
+        }
+        pattern++;
+        text++;
+    }
+    return !*text;
+}
@@ -0,0 +1,93 @@
+// .minigitignore pattern matching
+#pragma once
+
+#include "common.h"
+
+// Shell-style glob match: '*' and '?' stop at '/', '**' crosses directories, '[...]' is a class
+bool glob_match(const char* pattern, const char* text);
+
+// Patterns from .minigitignore. Literal names and "*.ext" patterns are kept in hash sets so
+// the common cases cost one lookup per path; everything else falls back to glob matching.
+class IgnoreRules {
+public:
+    void load(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::vector<Rule> parsed;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            while (!line.empty() && line.back() == ' ') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            Rule rule;
+            if (line[0] == '!') {
+                rule.negate = true;
+                line = line.substr(1);
+            }
+            if (!line.empty() && line.back() == '/') {
+                rule.dir_only = true;
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] == '/') {
+                rule.anchored = true;
+                line = line.substr(1);
+            }
+            if (line.find('/') != std::string::npos) rule.anchored = true;
+            if (line.empty()) continue;
+            rule.pattern = line;
+            has_negation_ = has_negation_ || rule.negate;
+            parsed.push_back(rule);
+        }
+        for (const Rule& rule : parsed) {
+            // With negations present, rule order matters, so every rule is evaluated in order
+            if (!has_negation_ && !rule.anchored && rule.pattern.find_first_of("*?[") == std::string::npos) {
+                (rule.dir_only ? dir_names_ : names_).insert(rule.pattern);
+            } else if (!has_negation_ && !rule.anchored && !rule.dir_only && rule.pattern.size() > 1 &&
+                       rule.pattern[0] == '*' && rule.pattern.find_first_of("*?[/", 1) == std::string::npos) {
+                suffixes_.insert(rule.pattern.substr(1));
+            } else {
+                rules_.push_back(rule);
+            }
+        }
+    }
+
+    // Check a single repository-relative path (its parent directories are not consulted)
+    bool matches(const std::string& rel_path, bool is_dir) const {
+        size_t slash = rel_path.rfind('/');
+        std::string name = slash == std::string::npos ? rel_path : rel_path.substr(slash + 1);
+        if (names_.count(name) || (is_dir && dir_names_.count(name))) return true;
+        if (!suffixes_.empty()) {
+            for (size_t pos = name.find('.'); pos != std::string::npos; pos = name.find('.', pos + 1)) {
+                if (suffixes_.count(name.substr(pos))) return true;
+            }
+        }
+        bool ignored = false;
+        for (const Rule& rule : rules_) {
+            if (rule.dir_only && !is_dir) continue;
+            if (ignored != rule.negate) continue;
+            const std::string& subject = rule.anchored ? rel_path : name;
+            if (glob_match(rule.pattern.c_str(), subject.c_str())) ignored = !rule.negate;
+        }
+        return ignored;
+    }
+
+    // Check a path and every directory above it
+    bool is_ignored(const std::string& rel_path, bool is_dir) const {
+        for (size_t pos = rel_path.find('/'); pos != std::string::npos; pos = rel_path.find('/', pos + 1)) {
+            if (matches(rel_path.substr(0, pos), true)) return true;
+        }
+        return matches(rel_path, is_dir);
+    }
+
+private:
+    struct Rule {
+        std::string pattern;
+        bool negate = false;
+        bool dir_only = false;
+        bool anchored = false;
+    };
+    std::unordered_set<std::string> names_;
+    std::unordered_set<std::string> dir_names_;
+    std::unordered_set<std::string> suffixes_;
+    std::vector<Rule> rules_;
+    bool has_negation_ = false;
+};
@@ -0,0 +1,68 @@
+#include "index.h"
+
+std::vector<IndexEntry> load_index() {
+    TRACE_SCOPE("index: load");
+    std::vector<IndexEntry> entries;
+    IndexView view;
+    if (view.open()) {
+        entries.reserve(view.size());
+        for (size_t i = 0; i < view.size(); i++) {
+            entries.push_back(view.entry(i));
+        }
+        return entries;
+    }
+    std::ifstream index_file(INDEX_PATH);
+    std::string line;
+    while (std::getline(index_file, line)) {
+        size_t pos = line.find(':');
+        if (pos != std::string::npos) {
+            IndexEntry e;
+            e.path = line.substr(0, pos);
+            e.hash = line.substr(pos + 1);
+            entries.push_back(e);
+        }
+    }
+    index_file.close();
+    std::sort(entries.begin(), entries.end(),
+              [](const IndexEntry& a, const IndexEntry& b) { return a.path < b.path; });
+    return entries;
+}
+
+void save_index(std::vector<IndexEntry> entries, Transaction& tx) {
+    TRACE_SCOPE("index: save");
+    std::sort(entries.begin(), entries.end(),
+              [](const IndexEntry& a, const IndexEntry& b) { return a.path < b.path; });
+    std::string out;
+    out.append(INDEX_MAGIC, 4);
+    append_raw<uint32_t>(out, INDEX_VERSION);
+    append_raw<uint64_t>(out, entries.size());
+    size_t offset = INDEX_HEADER_SIZE + entries.size() * 8;
+    for (const IndexEntry& e : entries) {
+        append_raw<uint64_t>(out, offset);
+        offset += INDEX_ENTRY_FIXED_SIZE + e.hash.size() / 2 + e.path.size();
+    }
+    for (const IndexEntry& e : entries) {
+        append_raw<int64_t>(out, e.stat.mtime_ns);
+        append_raw<int64_t>(out, e.stat.ctime_ns);
+        append_raw<uint64_t>(out, e.stat.size);
+        append_raw<uint64_t>(out, e.stat.ino);
+        append_raw<uint32_t>(out, e.stat.mode);
+        append_raw<uint32_t>(out, static_cast<uint32_t>(e.path.size()));
+        out.push_back(static_cast<char>(e.hash.size() / 2));
+        out += hex_to_bytes(e.hash);
+        out += e.path;
+    }
+    tx.write(INDEX_PATH, out);
+}
+
+std::map<std::string, std::string> read_index() {
+    std::map<std::string, std::string> index;
+    for (const IndexEntry& e : load_index()) {
+        index[e.path] = e.hash;
+    }
+    return index;
+}
+
+bool index_entry_clean(const IndexEntry& entry, const FileStat& current, int64_t index_mtime_ns) {
+    return entry.stat == current && entry.stat.mtime_ns < index_mtime_ns;
+}
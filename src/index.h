@@ -0,0 +1,113 @@
+// The binary staging index
+#pragma once
+
+#include "objects.h"
+
+// One staged file: path, blob hash and the stat data seen when it was hashed
+struct IndexEntry {
+    std::string path;
+    std::string hash;
+    FileStat stat;
+};
+
+// The index file; commands that rewrite it hold INDEX_PATH.lock while they work
+const std::string INDEX_PATH = ".minigit/index";
+
+// Binary index layout (host byte order):
+//   header   "MGIX", u32 version, u64 entry count
+//   offsets  u64 per entry, pointing at the entries in path order
+//   entries  i64 mtime_ns, i64 ctime_ns, u64 size, u64 ino, u32 mode,
+//            u32 path length, u8 hash length, hash bytes, path bytes
+const char INDEX_MAGIC[4] = {'M', 'G', 'I', 'X'};
+const uint32_t INDEX_VERSION = 1;
+const size_t INDEX_HEADER_SIZE = 16;
+const size_t INDEX_ENTRY_FIXED_SIZE = 8 + 8 + 8 + 8 + 4 + 4 + 1;
+
+// Memory-mapped binary index; entries are decoded on demand and looked up by binary search
+class IndexView {
+public:
+    // Returns false if the index is missing or not in the binary format
+    bool open(const std::string& path = INDEX_PATH) {
+        if (!file_.open(path)) return false;
+        const uint8_t* p = file_.data();
+        if (file_.size() < INDEX_HEADER_SIZE || std::memcmp(p, INDEX_MAGIC, 4) != 0 ||
+            read_raw<uint32_t>(p + 4) != INDEX_VERSION) {
+            return false;
+        }
+        count_ = read_raw<uint64_t>(p + 8);
+        if (file_.size() < INDEX_HEADER_SIZE + count_ * 8) return false;
+        FileStat st;
+        if (stat_file(path, st)) mtime_ns_ = st.mtime_ns;
+        return true;
+    }
+
+    void close() {
+        file_.close();
+        count_ = 0;
+    }
+
+    size_t size() const { return count_; }
+
+    // Modification time of the index file, used to detect racily-clean entries
+    int64_t mtime_ns() const { return mtime_ns_; }
+
+    IndexEntry entry(size_t i) const {
+        const uint8_t* p = entry_ptr(i);
+        IndexEntry e;
+        e.stat.mtime_ns = read_raw<int64_t>(p);
+        e.stat.ctime_ns = read_raw<int64_t>(p + 8);
+        e.stat.size = read_raw<uint64_t>(p + 16);
+        e.stat.ino = read_raw<uint64_t>(p + 24);
+        e.stat.mode = read_raw<uint32_t>(p + 32);
+        uint32_t path_len = read_raw<uint32_t>(p + 36);
+        uint8_t hash_len = p[40];
+        e.hash = bytes_to_hex(p + INDEX_ENTRY_FIXED_SIZE, hash_len);
+        e.path.assign(reinterpret_cast<const char*>(p + INDEX_ENTRY_FIXED_SIZE + hash_len), path_len);
+        return e;
+    }
+
+    bool find(const std::string& path, IndexEntry& out) const {
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int cmp = compare_path(mid, path);
+            if (cmp == 0) {
+                out = entry(mid);
+                return true;
+            }
+            if (cmp < 0) lo = mid + 1; else hi = mid;
+        }
+        return false;
+    }
+
+private:
+    const uint8_t* entry_ptr(size_t i) const {
+        return file_.data() + read_raw<uint64_t>(file_.data() + INDEX_HEADER_SIZE + i * 8);
+    }
+
+    int compare_path(size_t i, const std::string& path) const {
+        const uint8_t* p = entry_ptr(i);
+        uint32_t path_len = read_raw<uint32_t>(p + 36);
+        const char* entry_path = reinterpret_cast<const char*>(p + INDEX_ENTRY_FIXED_SIZE + p[40]);
+        int cmp = std::memcmp(entry_path, path.data(), std::min<size_t>(path_len, path.size()));
+        if (cmp != 0) return cmp;
+        return path_len < path.size() ? -1 : (path_len > path.size() ? 1 : 0);
+    }
+
+    MappedFile file_;
+    size_t count_ = 0;
+    int64_t mtime_ns_ = 0;
+};
+
+// Load every index entry in path order (the pre-binary "filename:hash" text format is still read)
+std::vector<IndexEntry> load_index();
+
+// Stage the index in the binary format, sorted by path; tx must hold the lock on INDEX_PATH
+void save_index(std::vector<IndexEntry> entries, Transaction& tx);
+
+// Read the staging area into a filename to blob hash map
+std::map<std::string, std::string> read_index();
+
+// An entry can be trusted without re-hashing only if its stat data still matches and the
+// file was not modified in the same clock tick the index was written ("racily clean")
+bool index_entry_clean(const IndexEntry& entry, const FileStat& current, int64_t index_mtime_ns);
@@ -0,0 +1,688 @@
+#include "object_store.h"
+
+void append_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool read_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static void lz_put_length(std::string& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    out.push_back(static_cast<char>(len));
+}
+
+std::string lz_compress(const uint8_t* src, size_t size) {
+    std::string out;
+    out.reserve(size / 2 + 16);
+    // A table no larger than the input keeps small objects from paying for a 256 KiB memset
+    int bits = LZ_HASH_BITS;
+    while (bits > 8 && (size_t(1) << (bits - 1)) >= size) bits--;
+    std::vector<uint32_t> table(size_t(1) << bits, UINT32_MAX);
+    auto hash4 = [bits](const uint8_t* p) {
+        return (read_raw<uint32_t>(p) * 2654435761u) >> (32 - bits);
+    };
+    size_t anchor = 0;
+    size_t i = 0;
+    auto emit = [&](size_t literal_end, size_t offset, size_t match_len) {
+        size_t lit = literal_end - anchor;
+        uint8_t token = static_cast<uint8_t>((std::min<size_t>(lit, 15) << 4) |
+                                             (match_len ? std::min<size_t>(match_len - LZ_MIN_MATCH, 15) : 0));
+        out.push_back(static_cast<char>(token));
+        if (lit >= 15) lz_put_length(out, lit - 15);
+        out.append(reinterpret_cast<const char*>(src + anchor), lit);
+        if (match_len) {
+            out.push_back(static_cast<char>(offset & 0xff));
+            out.push_back(static_cast<char>(offset >> 8));
+            if (match_len - LZ_MIN_MATCH >= 15) lz_put_length(out, match_len - LZ_MIN_MATCH - 15);
+        }
+    };
+    while (size >= LZ_MIN_MATCH && i + LZ_MIN_MATCH <= size) {
+        uint32_t h = hash4(src + i);
+        uint32_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i);
+        if (candidate != UINT32_MAX && i - candidate <= LZ_MAX_OFFSET &&
+            read_raw<uint32_t>(src + candidate) == read_raw<uint32_t>(src + i)) {
+            size_t len = LZ_MIN_MATCH;
+            while (i + len < size && src[candidate + len] == src[i + len]) len++;
+            emit(i, i - candidate, len);
+            i += len;
+            anchor = i;
+            continue;
+        }
+        i++;
+    }
+    emit(size, 0, 0);
+    return out;
+}
+
+bool lz_decompress(const uint8_t* src, size_t size, std::string& out, size_t expected_size) {
+    out.resize(expected_size);
+    const uint8_t* p = src;
+    const uint8_t* end = src + size;
+    size_t pos = 0;
+    auto read_length = [&](size_t& len) {
+        uint8_t byte;
+        do {
+            if (p >= end) return false;
+            byte = *p++;
+            len += byte;
+        } while (byte == 255);
+        return true;
+    };
+    while (p < end) {
+        uint8_t token = *p++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !read_length(lit)) return false;
+        if (lit > size_t(end - p) || lit > expected_size - pos) return false;
+        std::memcpy(&out[pos], p, lit);
+        p += lit;
+        pos += lit;
+        if (p == end) break;
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (size_t(p[1]) << 8);
+        p += 2;
+        size_t len = (token & 0xf);
+        if (len == 15 && !read_length(len)) return false;
+        len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > pos || len > expected_size - pos) return false;
+        for (size_t k = 0; k < len; k++, pos++) {
+            out[pos] = out[pos - offset];
+        }
+    }
+    return pos == expected_size;
+}
+
+std::string delta_encode(const DeltaIndex& index, const std::string& target) {
+    const std::string& base = index.base();
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(base.data());
+    const uint8_t* t = reinterpret_cast<const uint8_t*>(target.data());
+    size_t n = target.size();
+    std::string out;
+    append_varint(out, base.size());
+    append_varint(out, n);
+    auto emit_insert = [&](size_t from, size_t to) {
+        if (to <= from) return;
+        out.push_back(static_cast<char>(DELTA_OP_INSERT));
+        append_varint(out, to - from);
+        out.append(target, from, to - from);
+    };
+    uint32_t high = 1;
+    for (size_t i = 1; i < DELTA_BLOCK; i++) high *= DELTA_HASH_MULT;
+    size_t insert_start = 0;
+    size_t i = 0;
+    uint32_t h = n >= DELTA_BLOCK ? delta_block_hash(t) : 0;
+    while (i + DELTA_BLOCK <= n) {
+        int64_t candidate = index.lookup(h);
+        if (candidate >= 0 && std::memcmp(b + candidate, t + i, DELTA_BLOCK) == 0) {
+            size_t bpos = static_cast<size_t>(candidate);
+            size_t tpos = i;
+            while (tpos > insert_start && bpos > 0 && b[bpos - 1] == t[tpos - 1]) {
+                bpos--;
+                tpos--;
+            }
+            size_t len = (i - tpos) + DELTA_BLOCK;
+            while (tpos + len < n && bpos + len < base.size() && b[bpos + len] == t[tpos + len]) len++;
+            emit_insert(insert_start, tpos);
+            out.push_back(static_cast<char>(DELTA_OP_COPY));
+            append_varint(out, bpos);
+            append_varint(out, len);
+            i = tpos + len;
+            insert_start = i;
+            if (i + DELTA_BLOCK <= n) h = delta_block_hash(t + i);
+            continue;
+        }
+        if (i + DELTA_BLOCK < n) {
+            h = (h - t[i] * high) * DELTA_HASH_MULT + t[i + DELTA_BLOCK];
+        }
+        i++;
+    }
+    emit_insert(insert_start, n);
+    return out;
+}
+
+std::string delta_record(const std::string& base_id, const std::string& base,
+                         std::unique_ptr<DeltaIndex>& index, const std::string& target) {
+    // Bases far smaller or larger than the target rarely give a useful delta
+    if (base.size() < target.size() / 4 || target.size() < base.size() / 4) return "";
+    if (!index) index = std::make_unique<DeltaIndex>(base);
+    std::string delta = delta_encode(*index, target);
+    std::string record;
+    record.reserve(delta.size() + OBJECT_ID_SIZE + 21);
+    record.push_back(static_cast<char>(PACK_RECORD_DELTA));
+    append_varint(record, target.size());
+    append_varint(record, OBJECT_ID_SIZE + delta.size());
+    record += base_id;
+    record += delta;
+    return record;
+}
+
+bool delta_apply(const std::string& base, const uint8_t* delta, size_t len, std::string& out) {
+    const uint8_t* p = delta;
+    const uint8_t* end = delta + len;
+    uint64_t base_size, result_size;
+    if (!read_varint(p, end, base_size) || !read_varint(p, end, result_size) || base_size != base.size()) {
+        return false;
+    }
+    out.clear();
+    out.reserve(result_size);
+    while (p < end) {
+        uint8_t op = *p++;
+        uint64_t a, b;
+        if (op == DELTA_OP_INSERT) {
+            if (!read_varint(p, end, a) || a > uint64_t(end - p)) return false;
+            out.append(reinterpret_cast<const char*>(p), a);
+            p += a;
+        } else if (op == DELTA_OP_COPY) {
+            if (!read_varint(p, end, a) || !read_varint(p, end, b) || a > base.size() || b > base.size() - a) {
+                return false;
+            }
+            out.append(base, a, b);
+        } else {
+            return false;
+        }
+    }
+    return out.size() == result_size;
+}
+
+bool pack_record_at(const PackFile& pack, uint64_t offset, uint8_t& kind, uint64_t& size,
+                    const uint8_t*& data, uint64_t& stored) {
+    const uint8_t* end = pack.pack.data() + pack.pack.size();
+    const uint8_t* p = pack.pack.data() + offset;
+    if (offset >= pack.pack.size()) return false;
+    kind = *p++;
+    if (!read_varint(p, end, size) || !read_varint(p, end, stored)) return false;
+    if (stored > uint64_t(end - p)) return false;
+    data = p;
+    return true;
+}
+
+bool decode_pack_record(uint8_t kind, const uint8_t* data, uint64_t stored, uint64_t size, std::string& out) {
+    if (kind == PACK_RECORD_RAW) {
+        if (stored != size) return false;
+        out.assign(reinterpret_cast<const char*>(data), stored);
+        return true;
+    }
+    if (kind == PACK_RECORD_LZ) {
+        return lz_decompress(data, stored, out, size);
+    }
+    return false;
+}
+
+thread_local int PackStore::depth_ = 0;
+
+static uint64_t chunk_threshold_from_env() {
+    const uint64_t fallback = uint64_t(16) << 20;
+    const char* env = std::getenv("MINIGIT_CHUNK_THRESHOLD");
+    if (!env) return fallback;
+    char* end;
+    uint64_t value = std::strtoull(env, &end, 10);
+    if (end == env) return fallback;
+    switch (*end) {
+    case 'k': case 'K': return value << 10;
+    case 'm': case 'M': return value << 20;
+    case 'g': case 'G': return value << 30;
+    default: return value;
+    }
+}
+
+static std::atomic<uint64_t> current_chunk_threshold{chunk_threshold_from_env()};
+
+uint64_t chunk_threshold() {
+    return current_chunk_threshold.load(std::memory_order_relaxed);
+}
+
+void set_chunk_threshold(uint64_t bytes) {
+    current_chunk_threshold = bytes;
+}
+
+// Fixed pseudo-random gear values (splitmix64), so every build cuts the same chunks
+static constexpr std::array<uint64_t, 256> make_gear_table() {
+    std::array<uint64_t, 256> table{};
+    uint64_t x = 0x6d696e6967697400;
+    for (size_t i = 0; i < table.size(); i++) {
+        x += 0x9e3779b97f4a7c15;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        table[i] = z ^ (z >> 31);
+    }
+    return table;
+}
+
+static constexpr std::array<uint64_t, 256> CHUNK_GEAR = make_gear_table();
+
+size_t chunk_boundary(const uint8_t* data, size_t size) {
+    if (size <= CHUNK_MIN_SIZE) return size;
+    size_t normal = std::min(size, CHUNK_AVG_SIZE);
+    size_t limit = std::min(size, CHUNK_MAX_SIZE);
+    uint64_t hash = 0;
+    size_t i = CHUNK_MIN_SIZE;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + CHUNK_GEAR[data[i]];
+        if (!(hash & CHUNK_MASK_SMALL)) return i + 1;
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + CHUNK_GEAR[data[i]];
+        if (!(hash & CHUNK_MASK_LARGE)) return i + 1;
+    }
+    return limit;
+}
+
+// Parse a chunk list's header into size, then call visit(hash, chunk size) for each chunk;
+// false if the list is malformed or visit fails
+template <typename Visit>
+static bool for_each_chunk(std::string_view list, uint64_t& size, Visit visit) {
+    const std::string_view header = "chunks ";
+    size_t eol = list.find('\n');
+    if (list.compare(0, header.size(), header) != 0 || eol == std::string_view::npos) return false;
+    size = std::strtoull(std::string(list.substr(header.size(), eol - header.size())).c_str(), nullptr, 10);
+    uint64_t total = 0;
+    for (size_t pos = eol + 1; pos < list.size(); pos = eol + 1) {
+        eol = list.find('\n', pos);
+        if (eol == std::string_view::npos || eol - pos < OBJECT_ID_HEX_LEN + 2 || list[pos + OBJECT_ID_HEX_LEN] != ' ') {
+            return false;
+        }
+        std::string hash(list.substr(pos, OBJECT_ID_HEX_LEN));
+        uint64_t chunk_size = std::strtoull(std::string(list.substr(pos + OBJECT_ID_HEX_LEN + 1, eol - pos - OBJECT_ID_HEX_LEN - 1)).c_str(), nullptr, 10);
+        total += chunk_size;
+        if (!visit(hash, chunk_size)) return false;
+    }
+    return total == size;
+}
+
+bool expand_chunk_list(std::string_view list, uint64_t size, std::string& out) {
+    out.clear();
+    out.reserve(static_cast<size_t>(size));
+    std::string chunk;
+    uint64_t listed;
+    return for_each_chunk(list, listed, [&](const std::string& hash, uint64_t chunk_size) {
+        if (!read_object(hash, chunk) || chunk.size() != chunk_size) return false;
+        out += chunk;
+        return true;
+    }) && listed == size;
+}
+
+bool chunk_list_hashes(std::string_view list, std::vector<std::string>& hashes) {
+    hashes.clear();
+    uint64_t size;
+    return for_each_chunk(list, size, [&](const std::string& hash, uint64_t) {
+        hashes.push_back(hash);
+        return true;
+    });
+}
+
+std::string pack_record(const std::string& content, bool compress) {
+    std::string compressed;
+    if (compress) compressed = lz_compress(reinterpret_cast<const uint8_t*>(content.data()), content.size());
+    bool use_lz = compress && compressed.size() < content.size();
+    const std::string& stored = use_lz ? compressed : content;
+    std::string record;
+    record.reserve(stored.size() + 21);
+    record.push_back(static_cast<char>(use_lz ? PACK_RECORD_LZ : PACK_RECORD_RAW));
+    append_varint(record, content.size());
+    append_varint(record, stored.size());
+    record += stored;
+    return record;
+}
+
+bool PackWriter::open(const std::string& label) {
+    abort();
+    fs::create_directories(PACK_DIR);
+    tmp_path_ = PACK_DIR + "/tmp-" + label + ".pack";
+    file_.open(tmp_path_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        std::cerr << "Error: Cannot create " << tmp_path_ << "\n";
+        tmp_path_.clear();
+        return false;
+    }
+    // The object count is filled in by finish
+    std::string header(PACK_MAGIC, 4);
+    append_raw<uint32_t>(header, PACK_VERSION);
+    append_raw<uint32_t>(header, 0);
+    file_.write(header.data(), static_cast<std::streamsize>(header.size()));
+    offset_ = header.size();
+    reading_ = false;
+    offsets_.clear();
+    return true;
+}
+
+void PackWriter::append(const ObjectId& id, const std::string& record) {
+    if (reading_) {
+        file_.seekp(static_cast<std::streamoff>(offset_));
+        reading_ = false;
+    }
+    TRACE_COUNT(TraceCounter::ObjectsWritten);
+    offsets_.emplace(id, offset_);
+    file_.write(record.data(), static_cast<std::streamsize>(record.size()));
+    offset_ += record.size();
+}
+
+bool PackWriter::read(const ObjectId& id, std::string& out) {
+    auto it = offsets_.find(id);
+    if (it == offsets_.end()) return false;
+    if (!reading_) {
+        file_.flush();
+        reading_ = true;
+    }
+    // Kind byte and two varints of at most ten bytes each
+    uint8_t header[21];
+    size_t header_size = static_cast<size_t>(std::min<uint64_t>(sizeof(header), offset_ - it->second));
+    file_.seekg(static_cast<std::streamoff>(it->second));
+    if (!file_.read(reinterpret_cast<char*>(header), static_cast<std::streamsize>(header_size))) {
+        file_.clear();
+        return false;
+    }
+    const uint8_t* p = header + 1;
+    uint64_t size, stored;
+    if (!read_varint(p, header + header_size, size) || !read_varint(p, header + header_size, stored)) return false;
+    std::string data(static_cast<size_t>(stored), '\0');
+    file_.seekg(static_cast<std::streamoff>(it->second + (p - header)));
+    if (!file_.read(&data[0], static_cast<std::streamsize>(stored))) {
+        file_.clear();
+        return false;
+    }
+    TRACE_COUNT(TraceCounter::ObjectsRead);
+    if (header[0] == PACK_RECORD_DELTA) {
+        if (stored < OBJECT_ID_SIZE) return false;
+        ObjectId base_id;
+        std::memcpy(base_id.data(), data.data(), OBJECT_ID_SIZE);
+        std::string base;
+        if (!read(base_id, base) && !read_object(hash_to_string(base_id), base)) return false;
+        return delta_apply(base, reinterpret_cast<const uint8_t*>(data.data()) + OBJECT_ID_SIZE,
+                           static_cast<size_t>(stored) - OBJECT_ID_SIZE, out);
+    }
+    return decode_pack_record(header[0], reinterpret_cast<const uint8_t*>(data.data()), stored, size, out);
+}
+
+std::string PackWriter::finish() {
+    if (tmp_path_.empty() || offsets_.empty()) {
+        abort();
+        return "";
+    }
+    std::string count;
+    append_raw<uint32_t>(count, static_cast<uint32_t>(offsets_.size()));
+    file_.seekp(8);
+    file_.write(count.data(), static_cast<std::streamsize>(count.size()));
+    file_.flush();
+
+    // The checksum covers the patched header, so it is computed over the file as written
+    Sha256 checksum;
+    std::vector<char> buffer(IO_BUFFER_SIZE * 16);
+    file_.seekg(0);
+    for (uint64_t done = 0; done < offset_;) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), offset_ - done));
+        if (!file_.read(buffer.data(), static_cast<std::streamsize>(chunk))) break;
+        checksum.update(buffer.data(), chunk);
+        done += chunk;
+    }
+    ObjectId pack_sum = checksum.finish();
+    file_.clear();
+    file_.seekp(static_cast<std::streamoff>(offset_));
+    file_.write(reinterpret_cast<const char*>(pack_sum.data()), pack_sum.size());
+    file_.close();
+    if (file_.fail()) {
+        std::cerr << "Error: Cannot write " << tmp_path_ << "\n";
+        abort();
+        return "";
+    }
+    offset_ += pack_sum.size();
+
+    std::vector<std::pair<ObjectId, uint64_t>> sorted(offsets_.begin(), offsets_.end());
+    std::sort(sorted.begin(), sorted.end());
+    std::string idx;
+    idx.reserve(PACK_INDEX_HEADER_SIZE + sorted.size() * (OBJECT_ID_SIZE + 8) + pack_sum.size());
+    idx.append(PACK_INDEX_MAGIC, 4);
+    append_raw<uint32_t>(idx, PACK_VERSION);
+    std::vector<uint32_t> fanout(256, 0);
+    for (const auto& entry : sorted) fanout[entry.first[0]]++;
+    for (int b = 1; b < 256; b++) fanout[b] += fanout[b - 1];
+    for (uint32_t n : fanout) append_raw<uint32_t>(idx, n);
+    for (const auto& entry : sorted) idx.append(reinterpret_cast<const char*>(entry.first.data()), OBJECT_ID_SIZE);
+    for (const auto& entry : sorted) append_raw<uint64_t>(idx, entry.second);
+    idx.append(reinterpret_cast<const char*>(pack_sum.data()), pack_sum.size());
+
+    std::string name = "pack-" + hash_to_string(pack_sum);
+    // The pack goes in place before its index so readers never see an index without data
+    flush_file(tmp_path_);
+    if (!rename_file(tmp_path_, PACK_DIR + "/" + name + ".pack") ||
+        !write_file_atomic(PACK_DIR + "/" + name + ".idx", idx)) {
+        std::cerr << "Error: Cannot write " << PACK_DIR << "/" << name << "\n";
+        abort();
+        return "";
+    }
+    tmp_path_.clear();
+    PackStore::instance().reload();
+    return name;
+}
+
+void PackWriter::abort() {
+    if (tmp_path_.empty()) return;
+    if (file_.is_open()) file_.close();
+    std::error_code ec;
+    fs::remove(tmp_path_, ec);
+    tmp_path_.clear();
+    offsets_.clear();
+}
+
+std::string loose_object_path(const std::string& hash) {
+    return ".minigit/objects/" + hash;
+}
+
+bool object_exists(const std::string& hash) {
+    return fs::exists(loose_object_path(hash)) || PackStore::instance().contains(hash) ||
+           fs::exists(chunk_list_path(hash));
+}
+
+std::string chunk_list_path(const std::string& hash) {
+    return loose_object_path(hash) + CHUNK_LIST_SUFFIX;
+}
+
+static bool read_loose_chunk_list(const std::string& hash, std::string& list) {
+    std::ifstream file(chunk_list_path(hash), std::ios::binary);
+    if (!file) return false;
+    list.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+bool read_object(const std::string& hash, std::string& out) {
+    TRACE_COUNT(TraceCounter::ObjectsRead);
+    std::ifstream file(loose_object_path(hash), std::ios::binary | std::ios::ate);
+    if (file) {
+        // One bulk read sized from the file length
+        std::streamoff size = file.tellg();
+        out.resize(static_cast<size_t>(size));
+        file.seekg(0);
+        file.read(&out[0], size);
+        return static_cast<std::streamoff>(file.gcount()) == size;
+    }
+    if (PackStore::instance().read(hash, out)) return true;
+    std::string list;
+    uint64_t size;
+    return read_loose_chunk_list(hash, list) && for_each_chunk(list, size, [](const std::string&, uint64_t) { return true; }) &&
+           expand_chunk_list(list, size, out);
+}
+
+bool read_chunk_list(const std::string& hash, std::string& list, uint64_t& size) {
+    const PackFile* pack;
+    uint64_t offset, stored;
+    uint8_t kind;
+    const uint8_t* data;
+    if (PackStore::instance().find(hash, pack, offset)) {
+        if (!pack_record_at(*pack, offset, kind, size, data, stored) || kind != PACK_RECORD_CHUNKS) return false;
+        list.assign(reinterpret_cast<const char*>(data), stored);
+        return true;
+    }
+    if (!read_loose_chunk_list(hash, list)) return false;
+    return for_each_chunk(list, size, [](const std::string&, uint64_t) { return true; });
+}
+
+std::string write_chunked_file(const std::string& path) {
+    TRACE_SCOPE("chunk: store file");
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return "";
+    Sha256 whole;
+    uint64_t total = 0;
+    std::string body;
+    // Chunks are cut from a window of two maximum chunks and stored a few at a time
+    std::vector<char> window(CHUNK_MAX_SIZE * 2);
+    size_t start = 0, end = 0;
+    bool at_end = false;
+    std::vector<std::string> hashes, chunks;
+    size_t batch_bytes = 0;
+    bool stored = true;
+    auto store = [&] {
+        std::vector<std::string_view> contents(chunks.begin(), chunks.end());
+        stored = write_objects(hashes, contents) && stored;
+        hashes.clear();
+        chunks.clear();
+        batch_bytes = 0;
+    };
+    while (true) {
+        if (!at_end && end - start < CHUNK_MAX_SIZE) {
+            std::memmove(window.data(), window.data() + start, end - start);
+            end -= start;
+            start = 0;
+            while (!at_end && end < window.size()) {
+                file.read(window.data() + end, static_cast<std::streamsize>(window.size() - end));
+                end += static_cast<size_t>(file.gcount());
+                if (!file) at_end = true;
+            }
+            if (file.bad()) return "";
+        }
+        if (start == end) break;
+        size_t length = chunk_boundary(reinterpret_cast<const uint8_t*>(window.data() + start), end - start);
+        chunks.emplace_back(window.data() + start, length);
+        start += length;
+        total += length;
+        whole.update(chunks.back());
+        hashes.push_back(hash_content(chunks.back()));
+        body += hashes.back() + " " + std::to_string(length) + "\n";
+        batch_bytes += length;
+        if (batch_bytes >= CHUNK_MAX_SIZE * 4) store();
+    }
+    store();
+    if (!stored) return "";
+    std::string hash = hash_to_string(whole.finish());
+    if (object_exists(hash)) return hash;
+    if (!write_file_atomic(chunk_list_path(hash), "chunks " + std::to_string(total) + "\n" + body)) {
+        std::cerr << "Error: Cannot write object " << hash << "\n";
+        return "";
+    }
+    TRACE_COUNT(TraceCounter::ObjectsWritten);
+    return hash;
+}
+
+bool write_chunked_object(const std::string& hash, const std::string& path) {
+    std::string list;
+    uint64_t size, listed;
+    if (!read_chunk_list(hash, list, size)) return false;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    std::string chunk;
+    bool ok = for_each_chunk(list, listed, [&](const std::string& chunk_hash, uint64_t chunk_size) {
+        if (!read_object(chunk_hash, chunk) || chunk.size() != chunk_size) return false;
+        out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        return static_cast<bool>(out);
+    });
+    out.close();
+    return ok && out && listed == size;
+}
+
+std::string write_object(const std::string& content) {
+    std::string hash = hash_content(content);
+    if (object_exists(hash)) return hash;
+    if (!write_file_atomic(loose_object_path(hash), content)) {
+        std::cerr << "Error: Cannot write object " << hash << "\n";
+        return "";
+    }
+    TRACE_COUNT(TraceCounter::ObjectsWritten);
+    return hash;
+}
+
+std::vector<bool> read_objects(const std::vector<std::string>& hashes, std::vector<std::string>& out) {
+    out.assign(hashes.size(), std::string());
+    std::vector<bool> found(hashes.size(), false);
+    std::vector<IoRequest> requests;
+    std::vector<size_t> owners;
+    PackStore& packs = PackStore::instance();
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (packs.contains(hashes[i])) {
+            TRACE_COUNT(TraceCounter::ObjectsRead);
+            found[i] = packs.read(hashes[i], out[i]);
+            continue;
+        }
+        IoRequest request;
+        request.kind = IoRequest::Read;
+        request.path = loose_object_path(hashes[i]);
+        requests.push_back(std::move(request));
+        owners.push_back(i);
+    }
+    run_io(requests);
+    for (size_t r = 0; r < requests.size(); r++) {
+        if (!requests[r].ok) {
+            // Chunked objects have no whole loose file
+            found[owners[r]] = read_object(hashes[owners[r]], out[owners[r]]);
+            continue;
+        }
+        TRACE_COUNT(TraceCounter::ObjectsRead);
+        out[owners[r]] = std::move(requests[r].buffer);
+        found[owners[r]] = true;
+    }
+    return found;
+}
+
+bool write_objects(const std::vector<std::string>& hashes, const std::vector<std::string_view>& contents) {
+    std::stringstream suffix;
+    suffix << ".tmp" << std::this_thread::get_id();
+    std::vector<IoRequest> requests;
+    std::vector<const std::string*> targets;
+    std::unordered_set<std::string_view> seen;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (!seen.insert(hashes[i]).second || object_exists(hashes[i])) continue;
+        IoRequest request;
+        request.kind = IoRequest::Write;
+        request.path = loose_object_path(hashes[i]) + suffix.str();
+        request.data = contents[i];
+        request.flush = true;
+        requests.push_back(std::move(request));
+        targets.push_back(&hashes[i]);
+    }
+    run_io(requests);
+    std::string failed;
+    for (size_t r = 0; r < requests.size(); r++) {
+        if (requests[r].ok && rename_file(requests[r].path, loose_object_path(*targets[r]))) {
+            TRACE_COUNT(TraceCounter::ObjectsWritten);
+            continue;
+        }
+        std::error_code ec;
+        fs::remove(requests[r].path, ec);
+        if (failed.empty()) failed = *targets[r];
+    }
+    if (failed.empty()) return true;
+    std::cerr << "Error: Cannot write object " << failed << "\n";
+    return false;
+}
+
+bool is_object_id(const std::string& name) {
+    return name.size() == OBJECT_ID_HEX_LEN &&
+           name.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+bool is_null_commit(const std::string& hash) {
+    return !hash.empty() && hash.find_first_not_of('0') == std::string::npos;
+}
@@ -0,0 +1,383 @@
+// Object storage: loose objects, packs, compression and binary deltas
+#pragma once
+
+#include "async_io.h"
+
+// Unsigned LEB128 varints used in pack records
+void append_varint(std::string& out, uint64_t value);
+
+bool read_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value);
+
+// LZ77 block codec (LZ4-style sequences) used to compress packed objects.
+// A sequence is: token (literal length << 4 | match length - 4), extra literal length
+// bytes, literals, u16 little-endian match offset, extra match length bytes. Lengths of 15
+// continue in following bytes of 255. The final sequence carries literals only.
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_MAX_OFFSET = 65535;
+const int LZ_HASH_BITS = 16;       // Match table size for large inputs; small ones use a smaller table
+
+std::string lz_compress(const uint8_t* src, size_t size);
+
+bool lz_decompress(const uint8_t* src, size_t size, std::string& out, size_t expected_size);
+
+// Binary deltas between object versions.
+// Format: varint base size, varint result size, then instructions:
+//   DELTA_OP_INSERT, varint length, literal bytes
+//   DELTA_OP_COPY,   varint base offset, varint length
+const size_t DELTA_BLOCK = 16;
+const uint32_t DELTA_HASH_MULT = 0x01000193;
+const uint8_t DELTA_OP_INSERT = 0;
+const uint8_t DELTA_OP_COPY = 1;
+
+// Polynomial hash of DELTA_BLOCK bytes; can be rolled one byte at a time
+inline uint32_t delta_block_hash(const uint8_t* p) {
+    uint32_t h = 0;
+    for (size_t i = 0; i < DELTA_BLOCK; i++) h = h * DELTA_HASH_MULT + p[i];
+    return h;
+}
+
+// Hash table of the base's DELTA_BLOCK-aligned blocks, built once per delta base
+class DeltaIndex {
+public:
+    explicit DeltaIndex(const std::string& base) : base_(base) {
+        size_t blocks = base.size() / DELTA_BLOCK;
+        size_t slots = 16;
+        while (slots < blocks * 2) slots <<= 1;
+        mask_ = slots - 1;
+        table_.assign(slots, 0);
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(base.data());
+        for (size_t b = 0; b < blocks; b++) {
+            uint32_t& slot = table_[delta_block_hash(p + b * DELTA_BLOCK) & mask_];
+            if (slot == 0) slot = static_cast<uint32_t>(b * DELTA_BLOCK + 1);
+        }
+    }
+
+    const std::string& base() const { return base_; }
+
+    // Offset of a base block with this hash, or -1
+    int64_t lookup(uint32_t hash) const {
+        uint32_t slot = table_[hash & mask_];
+        return slot == 0 ? -1 : int64_t(slot) - 1;
+    }
+
+private:
+    const std::string& base_;
+    std::vector<uint32_t> table_;
+    size_t mask_ = 0;
+};
+
+// Encode target as copy/insert instructions against the indexed base
+std::string delta_encode(const DeltaIndex& index, const std::string& target);
+
+// Encode target as a delta record (see pack_record) against base, whose 32-byte binary ID is
+// base_id, building base's index in index on first use. "" when the sizes are too far apart
+// for a delta to be worth trying.
+std::string delta_record(const std::string& base_id, const std::string& base,
+                         std::unique_ptr<DeltaIndex>& index, const std::string& target);
+
+// Rebuild an object from its base and a delta
+bool delta_apply(const std::string& base, const uint8_t* delta, size_t len, std::string& out);
+
+// Pack files live in .minigit/objects/pack as pack-<checksum>.pack plus a matching .idx.
+//   pack: "MGPK", u32 version, u32 object count, records, SHA-256 of everything before it
+//   record: u8 kind, varint object size, varint stored size, stored bytes; a delta
+//           record stores the 32-byte base ID followed by the delta, and a chunks record
+//           stores a chunk list (see below)
+//   idx:  "MGPI", u32 version, u32 fanout[256] (cumulative counts by first ID byte),
+//         32-byte IDs in sorted order, u64 record offsets in the same order,
+//         checksum of the pack
+const char PACK_MAGIC[4] = {'M', 'G', 'P', 'K'};
+const char PACK_INDEX_MAGIC[4] = {'M', 'G', 'P', 'I'};
+const uint32_t PACK_VERSION = 1;
+const size_t PACK_HEADER_SIZE = 12;
+const size_t PACK_INDEX_HEADER_SIZE = 8 + 256 * 4;
+const size_t OBJECT_ID_SIZE = 32;
+const std::string PACK_DIR = ".minigit/objects/pack";
+
+enum PackRecordKind : uint8_t {
+    PACK_RECORD_RAW = 0,
+    PACK_RECORD_LZ = 1,
+    PACK_RECORD_DELTA = 2,
+    PACK_RECORD_CHUNKS = 3,
+};
+
+// Files of at least MINIGIT_CHUNK_THRESHOLD bytes (16 MiB unless set; K, M and G suffixes
+// allowed) are split into content-defined chunks. Each chunk is stored as an ordinary
+// object, and the file's object, still named by the SHA-256 of its whole content, is a
+// chunk list: "chunks <size>\n" followed by "<chunk hash> <chunk size>\n" per chunk. Loose
+// chunk lists are stored as <hash>.chunks beside the loose objects, and as chunks records in
+// packs. Chunks shared between versions or files are stored once, so a changed file costs
+// the chunks around its edits.
+uint64_t chunk_threshold();
+
+// Override MINIGIT_CHUNK_THRESHOLD (benchmarks)
+void set_chunk_threshold(uint64_t bytes);
+
+// FastCDC parameters: a gear hash rolls over each byte after the minimum size, and a chunk
+// ends where the hash's top bits are all zero. The stricter mask below the average size and
+// the looser one above it keep chunk sizes close to the average.
+const size_t CHUNK_MIN_SIZE = size_t(256) << 10;
+const size_t CHUNK_AVG_SIZE = size_t(1) << 20;
+const size_t CHUNK_MAX_SIZE = size_t(4) << 20;
+const uint64_t CHUNK_MASK_SMALL = ~uint64_t(0) << (64 - 22);
+const uint64_t CHUNK_MASK_LARGE = ~uint64_t(0) << (64 - 18);
+const std::string CHUNK_LIST_SUFFIX = ".chunks";
+
+// Length of the next chunk at data, given the rest of the file or at least CHUNK_MAX_SIZE
+// bytes of it
+size_t chunk_boundary(const uint8_t* data, size_t size);
+
+// Rebuild a chunked object's whole content from its chunk list
+bool expand_chunk_list(std::string_view list, uint64_t size, std::string& out);
+
+// Hashes of the chunks in a chunk list; false if it is malformed
+bool chunk_list_hashes(std::string_view list, std::vector<std::string>& hashes);
+
+// Delta search parameters used by gc
+const size_t PACK_DELTA_WINDOW = 10;
+const int PACK_MAX_DELTA_DEPTH = 50;
+const size_t DELTA_BASE_CACHE_BYTES = size_t(96) << 20;
+
+bool read_object(const std::string& hash, std::string& out);
+
+// One pack and its mmapped index
+struct PackFile {
+    std::string name;
+    MappedFile pack;
+    MappedFile idx;
+    uint32_t count = 0;
+
+    const uint8_t* id_at(size_t i) const { return idx.data() + PACK_INDEX_HEADER_SIZE + i * OBJECT_ID_SIZE; }
+
+    uint64_t offset_at(size_t i) const {
+        return read_raw<uint64_t>(idx.data() + PACK_INDEX_HEADER_SIZE + count * OBJECT_ID_SIZE + i * 8);
+    }
+
+    // Binary search within the fanout bucket for the ID's first byte
+    bool find(const uint8_t* id, uint64_t& offset) const {
+        const uint8_t* fanout = idx.data() + 8;
+        uint8_t first = id[0];
+        size_t lo = first == 0 ? 0 : read_raw<uint32_t>(fanout + (first - 1) * 4);
+        size_t hi = read_raw<uint32_t>(fanout + first * 4);
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int cmp = std::memcmp(id_at(mid), id, OBJECT_ID_SIZE);
+            if (cmp == 0) {
+                offset = offset_at(mid);
+                return true;
+            }
+            if (cmp < 0) lo = mid + 1; else hi = mid;
+        }
+        return false;
+    }
+};
+
+// Parse the record header at offset; data/stored point into the mmapped pack
+bool pack_record_at(const PackFile& pack, uint64_t offset, uint8_t& kind, uint64_t& size,
+                    const uint8_t*& data, uint64_t& stored);
+
+// Inflate a record into its object content
+bool decode_pack_record(uint8_t kind, const uint8_t* data, uint64_t stored, uint64_t size, std::string& out);
+
+// All packs in the repository, opened lazily on first use and shared by every command
+class PackStore {
+public:
+    static PackStore& instance() {
+        static PackStore store;
+        return store;
+    }
+
+    // Re-scan the pack directory (after gc writes or removes packs)
+    void reload() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        packs_.clear();
+        loaded_ = false;
+    }
+
+    bool find(const std::string& hex, const PackFile*& pack, uint64_t& offset) {
+        if (hex.size() != OBJECT_ID_SIZE * 2) return false;
+        ensure_loaded();
+        std::string id = hex_to_bytes(hex);
+        for (const auto& candidate : packs_) {
+            if (candidate->find(reinterpret_cast<const uint8_t*>(id.data()), offset)) {
+                pack = candidate.get();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool contains(const std::string& hex) {
+        const PackFile* pack;
+        uint64_t offset;
+        return find(hex, pack, offset);
+    }
+
+    // Lookup by binary ID, for callers that already hold one
+    bool contains(const ObjectId& id) {
+        ensure_loaded();
+        uint64_t offset;
+        for (const auto& candidate : packs_) {
+            if (candidate->find(id.data(), offset)) return true;
+        }
+        return false;
+    }
+
+    bool read(const std::string& hex, std::string& out) {
+        const PackFile* pack;
+        uint64_t offset;
+        if (!find(hex, pack, offset)) return false;
+        uint8_t kind;
+        uint64_t size, stored;
+        const uint8_t* data;
+        if (!pack_record_at(*pack, offset, kind, size, data, stored)) return false;
+        if (kind == PACK_RECORD_CHUNKS) {
+            return expand_chunk_list(std::string_view(reinterpret_cast<const char*>(data), stored), size, out);
+        }
+        if (kind != PACK_RECORD_DELTA) return decode_pack_record(kind, data, stored, size, out);
+        if (stored < OBJECT_ID_SIZE || depth_ > PACK_MAX_DELTA_DEPTH * 4) return false;
+        std::string base_hex = bytes_to_hex(data, OBJECT_ID_SIZE);
+        std::shared_ptr<const std::string> base;
+        if (!base_cache_.get(base_hex, base)) {
+            auto content = std::make_shared<std::string>();
+            depth_++;
+            bool ok = read_object(base_hex, *content);
+            depth_--;
+            if (!ok) return false;
+            base = content;
+            base_cache_.put(base_hex, base, base->size());
+        }
+        return delta_apply(*base, data + OBJECT_ID_SIZE, stored - OBJECT_ID_SIZE, out);
+    }
+
+    const std::vector<std::unique_ptr<PackFile>>& packs() {
+        ensure_loaded();
+        return packs_;
+    }
+
+private:
+    void ensure_loaded() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (loaded_) return;
+        loaded_ = true;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(PACK_DIR, ec)) {
+            if (entry.path().extension() != ".idx") continue;
+            auto pack = std::make_unique<PackFile>();
+            pack->name = entry.path().stem().string();
+            fs::path pack_path = entry.path();
+            pack_path.replace_extension(".pack");
+            if (!pack->idx.open(entry.path().string()) || !pack->pack.open(pack_path.string())) continue;
+            if (pack->idx.size() < PACK_INDEX_HEADER_SIZE ||
+                std::memcmp(pack->idx.data(), PACK_INDEX_MAGIC, 4) != 0 ||
+                read_raw<uint32_t>(pack->idx.data() + 4) != PACK_VERSION) {
+                continue;
+            }
+            pack->count = read_raw<uint32_t>(pack->idx.data() + 8 + 255 * 4);
+            if (pack->idx.size() < PACK_INDEX_HEADER_SIZE + size_t(pack->count) * (OBJECT_ID_SIZE + 8)) continue;
+            packs_.push_back(std::move(pack));
+        }
+    }
+
+    std::mutex mutex_;
+    bool loaded_ = false;
+    std::vector<std::unique_ptr<PackFile>> packs_;
+    LruCache<std::string> base_cache_{DELTA_BASE_CACHE_BYTES};
+    static thread_local int depth_;
+};
+
+// Encode content as a standalone record: LZ-compressed when that is smaller, raw otherwise
+// (or always raw without compress)
+std::string pack_record(const std::string& content, bool compress = true);
+
+// Hashes an ObjectId by its leading bytes, which are already uniformly distributed
+struct ObjectIdHash {
+    size_t operator()(const ObjectId& id) const {
+        size_t h;
+        std::memcpy(&h, id.data(), sizeof(h));
+        return h;
+    }
+};
+
+// Writes a new pack one record at a time, then its index. Records can be read back before
+// the pack is finished, so a writer may build on objects it has only just written.
+class PackWriter {
+public:
+    PackWriter() = default;
+    ~PackWriter() { abort(); }
+    PackWriter(const PackWriter&) = delete;
+    PackWriter& operator=(const PackWriter&) = delete;
+
+    // Start a temporary pack named after label in the pack directory
+    bool open(const std::string& label);
+
+    // Append an encoded record (see pack_record) for an object not yet in this pack
+    void append(const ObjectId& id, const std::string& record);
+
+    bool contains(const ObjectId& id) const { return offsets_.count(id) != 0; }
+
+    // Decode an object appended earlier; a delta's base may be in this pack or already stored
+    bool read(const ObjectId& id, std::string& out);
+
+    size_t count() const { return offsets_.size(); }
+
+    // Bytes written so far, including the header (and the checksum once finished)
+    uint64_t bytes() const { return offset_; }
+
+    // Write the header count, checksum and index, move both files into place and reload the
+    // PackStore. Returns the pack name, or "" if nothing was appended or writing failed.
+    std::string finish();
+
+    // Delete the temporary pack
+    void abort();
+
+private:
+    std::fstream file_;
+    std::string tmp_path_;
+    uint64_t offset_ = 0;
+    bool reading_ = false;   // The stream was last positioned for a read
+    std::unordered_map<ObjectId, uint64_t, ObjectIdHash> offsets_;
+};
+
+// Path of an object stored loose in the objects directory
+std::string loose_object_path(const std::string& hash);
+
+// True if the object is stored loose (whole or as a chunk list) or in any pack
+bool object_exists(const std::string& hash);
+
+// Read an object's content from the loose store or a pack. Chunked objects are reassembled
+// in memory; write_chunked_object streams them instead.
+bool read_object(const std::string& hash, std::string& out);
+
+// Path of a chunked object's loose chunk list
+std::string chunk_list_path(const std::string& hash);
+
+// The chunk list of a chunked object, loose or packed; false if the object is not chunked
+bool read_chunk_list(const std::string& hash, std::string& list, uint64_t& size);
+
+// Store a file as chunks plus a chunk list, reading it once with memory bounded by a few
+// chunks; returns the hash of its whole content, or "" if it cannot be read or (with the
+// error printed) an object cannot be written.
+std::string write_chunked_file(const std::string& path);
+
+// Write a chunked object's content to path one chunk at a time
+bool write_chunked_object(const std::string& hash, const std::string& path);
+
+// Store content as a loose object unless it already exists; returns its hash. A per-thread
+// temp name plus rename means readers never see a partially written object. "", with the
+// error printed, if the object cannot be written.
+std::string write_object(const std::string& content);
+
+// Read many objects at once: packed ones from the mapped packs, loose ones in one run_io
+// batch. out[i] receives hashes[i]'s content; the result marks which were found.
+std::vector<bool> read_objects(const std::vector<std::string>& hashes, std::vector<std::string>& out);
+
+// Store many loose objects at once, given their hashes, in one run_io batch; objects that
+// already exist are skipped. False, with the error printed, if any cannot be written.
+bool write_objects(const std::vector<std::string>& hashes, const std::vector<std::string_view>& contents);
+
+// True for a full-width lowercase hex object ID
+bool is_object_id(const std::string& name);
+
+// True for the all-zero ID of an unborn branch (any width, so older repositories still work)
+bool is_null_commit(const std::string& hash);
@@ -0,0 +1,266 @@
+#include "objects.h"
+
+std::string get_current_timestamp() {
+    auto now = std::time(nullptr);
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&now), "%Y-%m-%dT%H:%M:%S");
+    return ss.str();
+}
+
+CommandArena& command_arena() {
+    static CommandArena arena;
+    return arena;
+}
+
+std::string_view intern(std::string_view s) {
+    return StringInterner::instance().intern(s);
+}
+
+const FileEntry* find_file(const FileList& files, std::string_view path) {
+    auto it = std::lower_bound(files.begin(), files.end(), path,
+                               [](const FileEntry& e, std::string_view p) { return e.path < p; });
+    return (it != files.end() && it->path == path) ? &*it : nullptr;
+}
+
+bool same_files(const FileList& a, const FileList& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].path.data() != b[i].path.data() || a[i].hash.data() != b[i].hash.data()) return false;
+    }
+    return true;
+}
+
+FileList make_file_list(const std::map<std::string, std::string>& files) {
+    FileList list(&command_arena());
+    list.reserve(files.size());
+    StringInterner& interner = StringInterner::instance();
+    auto lock = interner.lock();
+    for (const auto& pair : files) {
+        list.push_back({interner.intern_locked(pair.first), interner.intern_locked(pair.second)});
+    }
+    return list;
+}
+
+std::string serialize_commit(const Commit& commit) {
+    std::string out;
+    out.reserve(64 + commit.files.size() * (OBJECT_ID_HEX_LEN + 32));
+    if (!commit.tree.empty()) out.append("tree ").append(commit.tree).append("\n");
+    for (const auto& parent : commit.parents) {
+        out.append("parent ").append(parent).append("\n");
+    }
+    out.append("timestamp ").append(commit.timestamp).append("\n");
+    out.append("message ").append(commit.message).append("\n");
+    for (const FileEntry& file : commit.files) {
+        out.append(file.path).append(":").append(file.hash).append("\n");
+    }
+    return out;
+}
+
+void parse_commit(Commit& commit) {
+    std::string_view data(commit.buffer);
+    commit.files.reserve(std::count(data.begin(), data.end(), '\n'));
+    StringInterner& interner = StringInterner::instance();
+    auto lock = interner.lock();
+    bool sorted = true;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string_view::npos) eol = data.size();
+        std::string_view line = data.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.compare(0, 5, "tree ") == 0) {
+            commit.tree = interner.intern_locked(line.substr(5));
+        } else if (line.compare(0, 7, "parent ") == 0) {
+            commit.parents.push_back(interner.intern_locked(line.substr(7)));
+        } else if (line.compare(0, 10, "timestamp ") == 0) {
+            commit.timestamp = line.substr(10);
+        } else if (line.compare(0, 8, "message ") == 0) {
+            commit.message = line.substr(8);
+        } else {
+            // Hashes never contain ':', so the last one separates path and hash
+            size_t colon = line.rfind(':');
+            if (colon != std::string_view::npos) {
+                std::string_view path = interner.intern_locked(line.substr(0, colon));
+                if (!commit.files.empty() && !(commit.files.back().path < path)) sorted = false;
+                commit.files.push_back({path, interner.intern_locked(line.substr(colon + 1))});
+            }
+        }
+    }
+    if (!sorted) {
+        std::stable_sort(commit.files.begin(), commit.files.end(),
+                         [](const FileEntry& a, const FileEntry& b) { return a.path < b.path; });
+        // Later duplicates win, as they did when commits were parsed into a map
+        FileList unique(&command_arena());
+        for (const FileEntry& file : commit.files) {
+            if (!unique.empty() && unique.back().path == file.path) unique.back() = file;
+            else unique.push_back(file);
+        }
+        commit.files.swap(unique);
+    }
+}
+
+LruCache<Commit>& commit_cache() {
+    static LruCache<Commit> cache(COMMIT_CACHE_ENTRIES);
+    return cache;
+}
+
+std::shared_ptr<const Commit> load_commit(const std::string& commit_hash) {
+    std::shared_ptr<const Commit> cached;
+    if (commit_cache().get(commit_hash, cached)) return cached;
+    auto commit = std::make_shared<Commit>();
+    if (!read_object(commit_hash, commit->buffer)) return commit;
+    TRACE_COUNT(TraceCounter::CommitsParsed);
+    parse_commit(*commit);
+    commit_cache().put(commit_hash, commit, commit->files.size() + 1);
+    return commit;
+}
+
+bool tree_entry_less(const TreeEntry& a, const TreeEntry& b) {
+    size_t n = std::min(a.name.size(), b.name.size());
+    int c = a.name.compare(0, n, b.name.substr(0, n));
+    if (c != 0) return c < 0;
+    char ca = a.name.size() > n ? a.name[n] : a.is_tree ? '/' : '\0';
+    char cb = b.name.size() > n ? b.name[n] : b.is_tree ? '/' : '\0';
+    return static_cast<unsigned char>(ca) < static_cast<unsigned char>(cb);
+}
+
+bool parse_tree(Tree& tree) {
+    std::string_view data(tree.buffer);
+    tree.entries.reserve(std::count(data.begin(), data.end(), '\n'));
+    StringInterner& interner = StringInterner::instance();
+    auto lock = interner.lock();
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string_view::npos) eol = data.size();
+        std::string_view line = data.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.size() < 6 + OBJECT_ID_HEX_LEN + 1 || line[4] != ' ' || line[5 + OBJECT_ID_HEX_LEN] != ' ') return false;
+        std::string_view type = line.substr(0, 4);
+        if (type != "blob" && type != "tree") return false;
+        tree.entries.push_back({line.substr(6 + OBJECT_ID_HEX_LEN),
+                                interner.intern_locked(line.substr(5, OBJECT_ID_HEX_LEN)), type == "tree"});
+    }
+    return true;
+}
+
+LruCache<Tree>& tree_cache() {
+    static LruCache<Tree> cache(COMMIT_CACHE_ENTRIES);
+    return cache;
+}
+
+LruCache<FileList>& tree_files_cache() {
+    static LruCache<FileList> cache(COMMIT_CACHE_ENTRIES);
+    return cache;
+}
+
+std::shared_ptr<const Tree> load_tree(std::string_view tree_hash) {
+    static const auto empty = std::make_shared<const Tree>();
+    if (tree_hash.empty()) return empty;
+    std::string hash(tree_hash);
+    std::shared_ptr<const Tree> cached;
+    if (tree_cache().get(hash, cached)) return cached;
+    auto tree = std::make_shared<Tree>();
+    if (!read_object(hash, tree->buffer) || !parse_tree(*tree)) {
+        std::cerr << "Error: Cannot read tree " << hash << "\n";
+        return empty;
+    }
+    TRACE_COUNT(TraceCounter::TreesParsed);
+    tree_cache().put(hash, tree, tree->entries.size() + 1);
+    return tree;
+}
+
+std::string write_tree_level(const FileList& files, size_t& pos, std::string_view prefix) {
+    std::string content;
+    while (pos < files.size() && files[pos].path.compare(0, prefix.size(), prefix) == 0) {
+        std::string_view rest = files[pos].path.substr(prefix.size());
+        size_t slash = rest.find('/');
+        if (slash == std::string_view::npos) {
+            content.append("blob ").append(files[pos].hash).append(" ").append(rest).append("\n");
+            pos++;
+        } else {
+            std::string_view dir = files[pos].path.substr(0, prefix.size() + slash + 1);
+            std::string subtree = write_tree_level(files, pos, dir);
+            if (subtree.empty()) return "";
+            content.append("tree ").append(subtree).append(" ").append(rest.substr(0, slash)).append("\n");
+        }
+    }
+    return write_object(content);
+}
+
+std::string write_tree(const FileList& files) {
+    TRACE_SCOPE("write tree");
+    size_t pos = 0;
+    return write_tree_level(files, pos, "");
+}
+
+void flatten_tree(std::string_view tree_hash, std::string& prefix, FileList& out) {
+    auto tree = load_tree(tree_hash);
+    for (const TreeEntry& entry : tree->entries) {
+        size_t length = prefix.size();
+        prefix.append(entry.name);
+        if (entry.is_tree) {
+            prefix.push_back('/');
+            flatten_tree(entry.hash, prefix, out);
+        } else {
+            out.push_back({intern(prefix), entry.hash});
+        }
+        prefix.resize(length);
+    }
+}
+
+std::shared_ptr<const FileList> commit_files(const std::shared_ptr<const Commit>& commit) {
+    if (commit->tree.empty()) return std::shared_ptr<const FileList>(commit, &commit->files);
+    std::string hash(commit->tree);
+    std::shared_ptr<const FileList> cached;
+    if (tree_files_cache().get(hash, cached)) return cached;
+    auto files = std::make_shared<FileList>(&command_arena());
+    std::string prefix;
+    flatten_tree(commit->tree, prefix, *files);
+    tree_files_cache().put(hash, files, files->size() + 1);
+    return files;
+}
+
+std::string commit_tree(const Commit& commit) {
+    return commit.tree.empty() ? write_tree(commit.files) : std::string(commit.tree);
+}
+
+void diff_trees(std::string_view old_tree, std::string_view new_tree, std::string& prefix,
+                const std::function<void(std::string_view, std::string_view, std::string_view)>& report) {
+    if (old_tree == new_tree) return;
+    auto a = load_tree(old_tree);
+    auto b = load_tree(new_tree);
+    size_t i = 0, j = 0;
+    while (i < a->entries.size() || j < b->entries.size()) {
+        const TreeEntry* old_entry = nullptr;
+        const TreeEntry* new_entry = nullptr;
+        if (j == b->entries.size() || (i < a->entries.size() && tree_entry_less(a->entries[i], b->entries[j]))) {
+            old_entry = &a->entries[i++];
+        } else if (i == a->entries.size() || tree_entry_less(b->entries[j], a->entries[i])) {
+            new_entry = &b->entries[j++];
+        } else {
+            old_entry = &a->entries[i++];
+            new_entry = &b->entries[j++];
+            if (old_entry->hash.data() == new_entry->hash.data()) continue;
+        }
+        const TreeEntry& entry = old_entry ? *old_entry : *new_entry;
+        size_t length = prefix.size();
+        prefix.append(entry.name);
+        if (entry.is_tree) {
+            prefix.push_back('/');
+            diff_trees(old_entry ? old_entry->hash : "", new_entry ? new_entry->hash : "", prefix, report);
+        } else {
+            report(intern(prefix), old_entry ? old_entry->hash : "", new_entry ? new_entry->hash : "");
+        }
+        prefix.resize(length);
+    }
+}
+
+int64_t parse_timestamp(const std::string& timestamp) {
+    std::tm tm = {};
+    std::istringstream ss(timestamp);
+    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+    if (ss.fail()) return 0;
+    tm.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&tm));
+}
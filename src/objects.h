@@ -0,0 +1,188 @@
+// Commit and tree objects, per-command arena and string interning
+#pragma once
+
+#include "object_store.h"
+
+// Get current timestamp in ISO format
+std::string get_current_timestamp();
+
+// Thread-safe bump allocator for data that lives as long as one command (parsed file
+// lists). Nothing is freed individually; memory goes back when the command ends.
+class CommandArena : public std::pmr::memory_resource {
+public:
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        arena_.release();
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return arena_.allocate(bytes, alignment);
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::mutex mutex_;
+    std::pmr::monotonic_buffer_resource arena_{size_t(1) << 20};
+};
+
+CommandArena& command_arena();
+
+// Process-wide string pool. Paths and object IDs repeat across thousands of commits, so each
+// distinct string is stored once and every user holds a view of the same copy; two interned
+// strings are equal exactly when their data pointers are.
+class StringInterner {
+public:
+    static StringInterner& instance() {
+        static StringInterner interner;
+        return interner;
+    }
+
+    std::string_view intern(std::string_view s) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return intern_locked(s);
+    }
+
+    // For interning many strings under one lock
+    std::unique_lock<std::mutex> lock() { return std::unique_lock<std::mutex>(mutex_); }
+
+    std::string_view intern_locked(std::string_view s) {
+        auto it = strings_.find(s);
+        if (it != strings_.end()) return *it;
+        char* copy = static_cast<char*>(storage_.allocate(s.size() + 1, 1));
+        std::memcpy(copy, s.data(), s.size());
+        copy[s.size()] = '\0';
+        std::string_view stored(copy, s.size());
+        strings_.insert(stored);
+        return stored;
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_set<std::string_view> strings_;
+    std::pmr::monotonic_buffer_resource storage_{size_t(1) << 20};
+};
+
+std::string_view intern(std::string_view s);
+
+// A file recorded in a commit; path and hash are interned
+struct FileEntry {
+    std::string_view path;
+    std::string_view hash;
+};
+
+// A commit's files sorted by path, allocated from the command arena
+using FileList = std::pmr::vector<FileEntry>;
+
+// Structure to represent a commit. Parsed commits keep the raw object in buffer, and
+// timestamp and message are views into it; tree, parents, paths and hashes are interned.
+// Commits point at a root tree; commits made before trees existed list files inline.
+struct Commit {
+    std::string_view tree;                   // Root tree hash ("" for inline file lists)
+    std::vector<std::string_view> parents;   // Parent commit hashes
+    std::string_view timestamp;              // Commit timestamp
+    std::string_view message;                // Commit message
+    FileList files{&command_arena()};        // Inline files sorted by path (tree-less commits)
+    std::string buffer;                      // Raw object (parsed commits only)
+
+    Commit() = default;
+    Commit(const Commit&) = delete;
+    Commit& operator=(const Commit&) = delete;
+};
+
+// Binary search a file list; nullptr if the path is not in it
+const FileEntry* find_file(const FileList& files, std::string_view path);
+
+// Compare two file lists; interned strings compare by pointer
+bool same_files(const FileList& a, const FileList& b);
+
+// Build a file list from a filename to blob hash map
+FileList make_file_list(const std::map<std::string, std::string>& files);
+
+// Serialize a commit object to a string
+std::string serialize_commit(const Commit& commit);
+
+// Parse commit.buffer in place. Lines are scanned without copying; header fields become
+// views into the buffer and file entries are interned into a pre-sized flat vector.
+void parse_commit(Commit& commit);
+
+// Parsed commits shared by every command in the process, bounded by total file entries
+const size_t COMMIT_CACHE_ENTRIES = size_t(1) << 22;
+
+LruCache<Commit>& commit_cache();
+
+// Load a commit from its hash (cached); a missing object yields an empty commit
+std::shared_ptr<const Commit> load_commit(const std::string& commit_hash);
+
+// Tree objects, one per directory: one line per entry, "<type> <hash> <name>\n" with type
+// "blob" or "tree". Entries sort as if directory names ended in '/', so a depth-first walk
+// visits full paths in the same order as a sorted file list.
+struct TreeEntry {
+    std::string_view name;   // View into the tree's buffer
+    std::string_view hash;   // Interned
+    bool is_tree;
+};
+
+struct Tree {
+    std::vector<TreeEntry> entries;
+    std::string buffer;
+
+    Tree() = default;
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+};
+
+// Order of entries within a tree
+bool tree_entry_less(const TreeEntry& a, const TreeEntry& b);
+
+// Parse tree.buffer in place
+bool parse_tree(Tree& tree);
+
+// Parsed trees and flattened file lists, bounded by entry count like the commit cache
+LruCache<Tree>& tree_cache();
+
+LruCache<FileList>& tree_files_cache();
+
+// Load a tree from its hash (cached); a missing or empty hash yields an empty tree
+std::shared_ptr<const Tree> load_tree(std::string_view tree_hash);
+
+// Write the trees for the entries of a sorted file list under prefix, starting at pos, and
+// return the tree's hash. Trees already in the store are not rewritten. "", with the error
+// printed, if a tree cannot be written.
+std::string write_tree_level(const FileList& files, size_t& pos, std::string_view prefix);
+
+// Write the tree objects for a sorted file list and return the root tree's hash, or "" with
+// the error printed
+std::string write_tree(const FileList& files);
+
+// Append every file under a tree to out with its full path
+void flatten_tree(std::string_view tree_hash, std::string& prefix, FileList& out);
+
+// Files of a commit sorted by path, whether it has a tree or an inline list
+std::shared_ptr<const FileList> commit_files(const std::shared_ptr<const Commit>& commit);
+
+// Root tree of a commit; commits with an inline file list get one written for them
+std::string commit_tree(const Commit& commit);
+
+// Walk two trees side by side and report each path whose blob differs, with "" for the
+// side where it is absent. Subtrees with equal hashes are skipped without being read.
+void diff_trees(std::string_view old_tree, std::string_view new_tree, std::string& prefix,
+                const std::function<void(std::string_view, std::string_view, std::string_view)>& report);
+
+// Scope of one top-level command: parsed objects and their arena memory are dropped at
+// the end, so long-running drivers (benchmarks, batch modes) do not accumulate them
+struct CommandScope {
+    CommandScope() = default;
+    CommandScope(const CommandScope&) = delete;
+    CommandScope& operator=(const CommandScope&) = delete;
+    ~CommandScope() {
+        commit_cache().clear();
+        tree_cache().clear();
+        tree_files_cache().clear();
+        command_arena().release();
+    }
+};
+
+// Parse a commit timestamp (local time, ISO format) into seconds since the epoch
+int64_t parse_timestamp(const std::string& timestamp);
@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A completed phase
+struct TraceEvent {
+    const char* name;
+    uint64_t start_us, end_us;
+};
+
+// Events of one thread; only that thread appends to them
+struct TraceThread {
+    uint32_t id;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceState {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string output;   // Chrome trace file, or "" for the summary table
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceThread>> threads;
+    bool reported = false;
+};
+
+// Never destroyed, so threads still running at exit can record safely
+static TraceState& trace_state() {
+    static TraceState* state = new TraceState;
+    return *state;
+}
+
+static const char* const TRACE_COUNTER_NAMES[] = {
+    "objects read", "objects written", "bytes hashed", "commits parsed",
+    "trees parsed", "files written", "files deleted", "fsyncs",
+};
+
+static bool trace_init() {
+#ifdef MINIGIT_NO_TRACE
+    return false;
+#else
+    const char* env = std::getenv("MINIGIT_TRACE");
+    if (!env || !*env || std::strcmp(env, "0") == 0) return false;
+    TraceState& state = trace_state();
+    if (std::strcmp(env, "1") != 0 && std::strcmp(env, "summary") != 0) state.output = env;
+    std::atexit(trace_report);
+    return true;
+#endif
+}
+
+std::atomic<uint64_t> trace_counters[static_cast<int>(TraceCounter::Count)] = {};
+const bool trace_enabled = trace_init();
+
+uint64_t trace_now_us() {
+    auto elapsed = std::chrono::steady_clock::now() - trace_state().start;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+void trace_record(const char* name, uint64_t start_us, uint64_t end_us) {
+    thread_local TraceThread* thread = nullptr;
+    if (!thread) {
+        TraceState& state = trace_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.threads.push_back(std::make_unique<TraceThread>());
+        thread = state.threads.back().get();
+        thread->id = static_cast<uint32_t>(state.threads.size());
+    }
+    thread->events.push_back({name, start_us, end_us});
+}
+
+static std::string json_escape(const char* text) {
+    std::string out;
+    for (const char* p = text; *p; p++) {
+        if (*p == '"' || *p == '\\') out += '\\';
+        if (static_cast<unsigned char>(*p) >= 0x20) out += *p;
+    }
+    return out;
+}
+
+// Per-phase totals on stderr. Phases on worker threads overlap, so totals can exceed wall time.
+static void trace_write_summary(const TraceState& state) {
+    struct Total {
+        uint64_t calls = 0, total_us = 0, max_us = 0;
+    };
+    std::map<std::string, Total> totals;
+    for (const auto& thread : state.threads) {
+        for (const TraceEvent& event : thread->events) {
+            Total& total = totals[event.name];
+            uint64_t us = event.end_us - event.start_us;
+            total.calls++;
+            total.total_us += us;
+            total.max_us = std::max(total.max_us, us);
+        }
+    }
+    std::vector<std::pair<std::string, Total>> rows(totals.begin(), totals.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second.total_us > b.second.total_us; });
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "minigit trace\n" << std::left << std::setw(36) << "phase" << std::right << std::setw(10) << "calls"
+        << std::setw(14) << "total ms" << std::setw(14) << "max ms" << "\n";
+    for (const auto& [name, total] : rows) {
+        out << std::left << std::setw(36) << name << std::right << std::setw(10) << total.calls << std::setw(14)
+            << total.total_us / 1e3 << std::setw(14) << total.max_us / 1e3 << "\n";
+    }
+    out << std::left << std::setw(36) << "counter" << std::right << std::setw(10) << "value" << "\n";
+    for (int c = 0; c < static_cast<int>(TraceCounter::Count); c++) {
+        out << std::left << std::setw(36) << TRACE_COUNTER_NAMES[c] << std::right << std::setw(10)
+            << trace_counters[c].load(std::memory_order_relaxed) << "\n";
+    }
+    std::cerr << out.str();
+}
+
+// Chrome trace-event format: one complete ("X") event per phase, counters as a final "C" event
+static void trace_write_chrome(const TraceState& state, uint64_t end_us) {
+    std::ofstream out(state.output, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error: Cannot write trace file " << state.output << "\n";
+        return;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& thread : state.threads) {
+        for (const TraceEvent& event : thread->events) {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << json_escape(event.name)
+                << "\",\"cat\":\"minigit\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id << ",\"ts\":" << event.start_us
+                << ",\"dur\":" << event.end_us - event.start_us << "}";
+            first = false;
+        }
+    }
+    out << (first ? "" : ",\n") << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << end_us << ",\"args\":{";
+    for (int c = 0; c < static_cast<int>(TraceCounter::Count); c++) {
+        out << (c ? "," : "") << "\"" << TRACE_COUNTER_NAMES[c] << "\":" << trace_counters[c].load(std::memory_order_relaxed);
+    }
+    out << "}}\n]}\n";
+}
+
+void trace_report() {
+    if (!trace_enabled) return;
+    TraceState& state = trace_state();
+    uint64_t end_us = trace_now_us();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.reported) return;
+    state.reported = true;
+    if (state.output.empty()) {
+        trace_write_summary(state);
+    } else {
+        trace_write_chrome(state, end_us);
+    }
+}
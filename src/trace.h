@@ -0,0 +1,66 @@
+// Opt-in tracing: scoped phase timers and counters, enabled by the MINIGIT_TRACE environment
+// variable. MINIGIT_TRACE=1 prints a summary table to stderr when the process exits; any other
+// value is a file that receives Chrome trace-event JSON (chrome://tracing, Perfetto). Unset,
+// every probe costs one predictable branch; building with MINIGIT_NO_TRACE removes them.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Things counted while tracing
+enum class TraceCounter {
+    ObjectsRead,
+    ObjectsWritten,
+    BytesHashed,
+    CommitsParsed,
+    TreesParsed,
+    FilesWritten,
+    FilesDeleted,
+    Fsyncs,
+    Count
+};
+
+// Set once at startup from MINIGIT_TRACE
+extern const bool trace_enabled;
+
+extern std::atomic<uint64_t> trace_counters[static_cast<int>(TraceCounter::Count)];
+
+// Microseconds since tracing started
+uint64_t trace_now_us();
+
+// Record a completed phase on the calling thread
+void trace_record(const char* name, uint64_t start_us, uint64_t end_us);
+
+// Print the summary or write the trace file now (normally done at exit)
+void trace_report();
+
+// Times the enclosing scope as a phase. name must outlive the process (a literal, or argv).
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(trace_enabled ? name : nullptr) {
+        if (name_) start_ = trace_now_us();
+    }
+    ~TraceScope() {
+        if (name_) trace_record(name_, start_, trace_now_us());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_ = 0;
+};
+
+inline void trace_count(TraceCounter counter, uint64_t n = 1) {
+    if (trace_enabled) trace_counters[static_cast<int>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+#define MINIGIT_TRACE_CONCAT_(a, b) a##b
+#define MINIGIT_TRACE_CONCAT(a, b) MINIGIT_TRACE_CONCAT_(a, b)
+#ifndef MINIGIT_NO_TRACE
+#define TRACE_SCOPE(name) TraceScope MINIGIT_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNT(...) trace_count(__VA_ARGS__)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNT(...) ((void)0)
+#endif
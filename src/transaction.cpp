@@ -0,0 +1,276 @@
+#include "transaction.h"
+
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#endif
+
+static FsyncMode fsync_mode_from_env() {
+    const char* env = std::getenv("MINIGIT_FSYNC");
+    if (!env) return FsyncMode::Batch;
+    std::string value = env;
+    if (value == "off" || value == "0" || value == "false") return FsyncMode::Off;
+    if (value == "full") return FsyncMode::Full;
+    return FsyncMode::Batch;
+}
+
+static std::atomic<FsyncMode> current_fsync_mode{fsync_mode_from_env()};
+
+// Set when a file was written out in batch mode and no barrier has committed it yet
+static std::atomic<bool> barrier_pending{false};
+
+FsyncMode fsync_mode() {
+    return current_fsync_mode.load(std::memory_order_relaxed);
+}
+
+void set_fsync_mode(FsyncMode mode) {
+    current_fsync_mode = mode;
+}
+
+static void fsync_fd(int fd) {
+    TRACE_COUNT(TraceCounter::Fsyncs);
+#ifdef _WIN32
+    _commit(fd);
+#elif defined(__APPLE__)
+    // Plain fsync on macOS stops at the drive's cache
+    if (fcntl(fd, F_FULLFSYNC) != 0) fsync(fd);
+#else
+    fsync(fd);
+#endif
+}
+
+void flush_file(int fd) {
+    FsyncMode mode = fsync_mode();
+    if (mode == FsyncMode::Off) return;
+    if (mode == FsyncMode::Batch) barrier_pending = true;
+#ifdef __linux__
+    // Write-out only: the data reaches the disk, and the barrier's fsync flushes its cache
+    if (mode == FsyncMode::Batch &&
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == 0) {
+        return;
+    }
+#endif
+    fsync_fd(fd);
+}
+
+void note_written_out() {
+    barrier_pending = true;
+}
+
+void flush_file(const std::string& path) {
+    if (fsync_mode() == FsyncMode::Off) return;
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+    if (fd < 0) return;
+    flush_file(fd);
+    _close(fd);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    flush_file(fd);
+    ::close(fd);
+#endif
+}
+
+void flush_dir(const std::string& dir) {
+#ifndef _WIN32
+    if (fsync_mode() != FsyncMode::Full) return;
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync_fd(fd);
+    ::close(fd);
+#else
+    (void)dir;
+#endif
+}
+
+void fsync_barrier() {
+    if (fsync_mode() != FsyncMode::Batch || !barrier_pending.exchange(false)) return;
+#ifndef _WIN32
+    // fsync of an unchanged inode may return without waiting on anything (ext4 only waits
+    // for the journal transaction that last touched it), so the barrier syncs a file it has
+    // just created, as Git's bulk-checkin does. That commits the running journal transaction,
+    // with every rename since the last barrier, and flushes the disk cache behind every file
+    // written out meanwhile.
+    std::stringstream name;
+    name << ".minigit/barrier-" << getpid() << "-" << std::this_thread::get_id() << ".tmp";
+    std::string path = name.str();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return;
+    fsync_fd(fd);
+    ::close(fd);
+    ::unlink(path.c_str());
+#endif
+}
+
+bool rename_file(const std::string& tmp, const std::string& path) {
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    flush_dir(fs::path(path).parent_path().string());
+    return true;
+}
+
+#ifndef _WIN32
+bool write_fd(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+#endif
+
+bool write_file_atomic(const std::string& path, const std::string& content) {
+    std::stringstream tmp_name;
+    tmp_name << path << ".tmp" << std::this_thread::get_id();
+    std::string tmp = tmp_name.str();
+#ifndef _WIN32
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return false;
+    bool ok = write_fd(fd, content.data(), content.size());
+    if (ok) flush_file(fd);
+    ok = ::close(fd) == 0 && ok;
+#else
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << content;
+    out.close();
+    bool ok = static_cast<bool>(out);
+    if (ok) flush_file(tmp);
+#endif
+    if (!ok) {
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return rename_file(tmp, path);
+}
+
+Transaction::Lock* Transaction::find(const std::string& path) {
+    for (Lock& lock : locks_) {
+        if (lock.path == path) return &lock;
+    }
+    return nullptr;
+}
+
+bool Transaction::locked(const std::string& path) const {
+    for (const Lock& lock : locks_) {
+        if (lock.path == path) return true;
+    }
+    return false;
+}
+
+bool Transaction::lock(const std::string& path, bool quiet) {
+    if (locked(path)) return true;
+    std::string lock_path = path + LOCK_SUFFIX;
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+#ifdef _WIN32
+    int fd = _open(lock_path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = ::open(lock_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+#endif
+    if (fd < 0) {
+        if (quiet) return false;
+        if (errno == EEXIST) {
+            std::cerr << "Error: Unable to lock " << path << ": another minigit command is running. If it is not, "
+                      << "remove " << lock_path << "\n";
+        } else {
+            std::cerr << "Error: Cannot create " << lock_path << ": " << std::strerror(errno) << "\n";
+        }
+        return false;
+    }
+    Lock lock;
+    lock.path = path;
+    lock.fd = fd;
+    locks_.push_back(std::move(lock));
+    return true;
+}
+
+void Transaction::write(const std::string& path, const std::string& content) {
+    Lock* lock = find(path);
+    if (!lock) return;
+    lock->update = true;
+    lock->remove = false;
+    lock->content = content;
+}
+
+void Transaction::remove(const std::string& path) {
+    Lock* lock = find(path);
+    if (!lock) return;
+    lock->update = false;
+    lock->remove = true;
+    lock->content.clear();
+}
+
+bool Transaction::commit() {
+    TRACE_SCOPE("transaction: commit");
+    // Fill the lock files; nothing is visible until the renames below
+    for (Lock& lock : locks_) {
+        if (!lock.update) continue;
+#ifdef _WIN32
+        bool ok = _write(lock.fd, lock.content.data(), static_cast<unsigned>(lock.content.size())) ==
+                  static_cast<int>(lock.content.size());
+#else
+        bool ok = write_fd(lock.fd, lock.content.data(), lock.content.size());
+#endif
+        if (ok) flush_file(lock.fd);
+        if (!ok) {
+            std::cerr << "Error: Cannot write " << lock.path << LOCK_SUFFIX << "\n";
+            rollback();
+            return false;
+        }
+    }
+    // Objects and lock files reach the disk before anything points at them
+    fsync_barrier();
+    bool ok = true;
+    std::error_code ec;
+    for (Lock& lock : locks_) {
+#ifdef _WIN32
+        _close(lock.fd);
+#else
+        ::close(lock.fd);
+#endif
+        lock.fd = -1;
+        std::string lock_path = lock.path + LOCK_SUFFIX;
+        if (lock.update) {
+            if (!rename_file(lock_path, lock.path)) {
+                std::cerr << "Error: Cannot update " << lock.path << "\n";
+                ok = false;
+            }
+        } else {
+            fs::remove(lock_path, ec);
+            if (lock.remove && fs::remove(lock.path, ec)) flush_dir(fs::path(lock.path).parent_path().string());
+        }
+    }
+    bool changed = std::any_of(locks_.begin(), locks_.end(), [](const Lock& lock) { return lock.update || lock.remove; });
+    locks_.clear();
+    // And the switch-over itself is durable before the command reports success
+    if (changed && fsync_mode() == FsyncMode::Batch) {
+        barrier_pending = true;
+        fsync_barrier();
+    }
+    return ok;
+}
+
+void Transaction::rollback() {
+    std::error_code ec;
+    for (Lock& lock : locks_) {
+#ifdef _WIN32
+        if (lock.fd >= 0) _close(lock.fd);
+#else
+        if (lock.fd >= 0) ::close(lock.fd);
+#endif
+        fs::remove(lock.path + LOCK_SUFFIX, ec);
+    }
+    locks_.clear();
+}
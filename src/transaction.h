@@ -0,0 +1,96 @@
+// Crash-safe repository writes: atomic file replacement, batched fsync and lock files
+#pragma once
+
+#include "common.h"
+
+// How hard new files are pushed to stable storage, chosen by MINIGIT_FSYNC:
+//   off    no syncing; files are still replaced atomically, so readers never see a torn one
+//   batch  the default. Each new file's data is written out to the disk as it is produced,
+//          without a cache flush, and one fsync per transaction commits all of them before
+//          refs and the index switch over to them
+//   full   every file is fsynced before it is renamed, and its directory after
+enum class FsyncMode { Off, Batch, Full };
+
+FsyncMode fsync_mode();
+
+// Override MINIGIT_FSYNC (benchmarks compare the modes in one process)
+void set_fsync_mode(FsyncMode mode);
+
+// Push a new file's data towards the disk before it is renamed into place
+void flush_file(int fd);
+void flush_file(const std::string& path);
+
+// Record a batch-mode write-out issued elsewhere (the io_uring engine), so the next barrier
+// covers it
+void note_written_out();
+
+// In full mode, make renames into dir durable
+void flush_dir(const std::string& dir);
+
+// In batch mode, one fsync that commits every file flushed since the last barrier
+void fsync_barrier();
+
+// Rename tmp over path, then flush path's directory
+bool rename_file(const std::string& tmp, const std::string& path);
+
+#ifndef _WIN32
+// Write all of a buffer to a file descriptor
+bool write_fd(int fd, const char* data, size_t size);
+#endif
+
+// Replace path with content through a per-thread temp file in the same directory, so
+// concurrent writers of the same content do not trip over each other
+bool write_file_atomic(const std::string& path, const std::string& content);
+
+// Lock files sit next to the file they guard; branch names may not end in this
+const std::string LOCK_SUFFIX = ".lock";
+
+inline bool is_lock_file(const std::string& name) {
+    return name.size() >= LOCK_SUFFIX.size() &&
+           name.compare(name.size() - LOCK_SUFFIX.size(), LOCK_SUFFIX.size(), LOCK_SUFFIX) == 0;
+}
+
+// An all-or-nothing update of refs, HEAD and the index. lock() creates <path>.lock
+// exclusively, so a second command touching the same file fails at once instead of losing
+// one side's update; take locks before reading what they guard. write() and remove() stage
+// changes, and commit() writes the lock files, flushes them with everything written so
+// far, then renames each over its target. Locks still held when the transaction is
+// destroyed (an error path) are removed and the targets are left as they were.
+class Transaction {
+public:
+    Transaction() = default;
+    ~Transaction() { rollback(); }
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+    // False if another process holds the lock; the error is printed unless quiet
+    bool lock(const std::string& path, bool quiet = false);
+
+    bool locked(const std::string& path) const;
+
+    // Stage new content for a locked path
+    void write(const std::string& path, const std::string& content);
+
+    // Delete a locked path on commit
+    void remove(const std::string& path);
+
+    // Apply the staged changes and release every lock. False, with the error printed, if a
+    // lock file could not be written (nothing is changed then) or renamed
+    bool commit();
+
+    // Release every lock without applying anything
+    void rollback();
+
+private:
+    struct Lock {
+        std::string path;
+        int fd = -1;
+        bool update = false;
+        bool remove = false;
+        std::string content;
+    };
+
+    Lock* find(const std::string& path);
+
+    std::vector<Lock> locks_;
+};
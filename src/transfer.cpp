@@ -0,0 +1,957 @@
+#include "transfer.h"
+
+// Every path the engine uses is relative to the repository root, so working on another
+// repository means moving into it for a while; packs are re-scanned on the way in and out.
+// Check entered() before touching the repository, and leave() before reporting success: a
+// failed move would have every read and write land in the wrong one.
+class InRepository {
+public:
+    explicit InRepository(const fs::path& root) : previous_(fs::current_path()) { entered_ = enter(root); }
+    ~InRepository() { leave(); }
+    InRepository(const InRepository&) = delete;
+    InRepository& operator=(const InRepository&) = delete;
+
+    bool entered() const { return entered_; }
+
+    // Return to the previous directory; false, with the error printed, if that failed
+    bool leave() {
+        if (!left_) {
+            left_ = true;
+            returned_ = enter(previous_);
+        }
+        return returned_;
+    }
+
+private:
+    static bool enter(const fs::path& root) {
+        std::error_code ec;
+        fs::current_path(root, ec);
+        if (ec) {
+            std::cerr << "Error: Cannot enter " << root.string() << ": " << ec.message() << "\n";
+            return false;
+        }
+        PackStore::instance().reload();
+        return true;
+    }
+
+    fs::path previous_;
+    bool entered_ = false;
+    bool left_ = false;
+    bool returned_ = false;
+};
+
+// A name for this process's temporary transfer files, so concurrent transfers into one
+// repository do not overwrite each other's
+static std::string receive_label() {
+    std::stringstream label;
+    label << "receive-";
+#ifndef _WIN32
+    label << getpid() << "-";
+#endif
+    label << std::chrono::steady_clock::now().time_since_epoch().count();
+    return label.str();
+}
+
+static ObjectId to_object_id(std::string_view hex) {
+    ObjectId id{};
+    std::string raw = hex_to_bytes(std::string(hex));
+    std::memcpy(id.data(), raw.data(), std::min(raw.size(), id.size()));
+    return id;
+}
+
+static std::string short_id(const std::string& hash) {
+    return hash.substr(0, 7);
+}
+
+// Branch names come from another repository or a file, so they must stay under refs/heads
+static bool valid_branch_name(const std::string& name) {
+    if (name.empty() || name.front() == '/' || name.back() == '/' || is_lock_file(name)) return false;
+    for (size_t start = 0; start <= name.size();) {
+        size_t slash = std::min(name.find('/', start), name.size());
+        std::string_view part(name.data() + start, slash - start);
+        if (part.empty() || part == "." || part == "..") return false;
+        start = slash + 1;
+    }
+    return name.find_first_of(" \t\n\\") == std::string::npos;
+}
+
+// What the sending side streams: the commits the receiver lacks and every object they reach
+// that the boundary commits, which the receiver has, do not
+struct TransferPlan {
+    std::vector<std::string> commits;    // Newest generation first
+    std::vector<std::string> boundary;
+    std::vector<std::string> objects;    // Packed ones in pack order, then loose ones
+    std::vector<GraphEntry> graph_entries;   // The commits' commit-graph entries
+    std::unordered_set<ObjectId, ObjectIdHash> sent;
+
+    // New trees and blobs that replaced another at the same path, to be sent as deltas
+    // against it, with the depth of the resulting chain
+    struct DeltaHint {
+        ObjectId base;
+        int depth;
+    };
+    std::unordered_map<ObjectId, DeltaHint, ObjectIdHash> delta_hints;
+
+    // Objects the boundary reaches: bits of the reachability bitmaps when those cover every
+    // boundary commit, otherwise the IDs found walking the boundary commits' trees
+    ReachabilityBitmaps bitmaps;
+    bool bitmap_boundary = false;
+    Bitset had;
+    std::unordered_set<ObjectId, ObjectIdHash> walked;
+
+    bool receiver_has(const ObjectId& id) const {
+        if (!bitmap_boundary) return walked.count(id) != 0;
+        uint32_t pos;
+        return bitmaps.position(id.data(), pos) && had.test(pos);
+    }
+};
+
+// Plan sending tips to a repository that has haves (those this one knows) and, when
+// also_have is set, every commit it accepts. False, with the error printed, if history
+// cannot be read.
+static bool plan_transfer(const std::vector<std::string>& tips, const std::vector<std::string>& haves,
+                          const std::function<bool(const uint8_t*)>& also_have, TransferPlan& plan) {
+    TRACE_SCOPE("transfer: plan");
+    std::vector<std::string> known = tips;
+    known.insert(known.end(), haves.begin(), haves.end());
+    update_commit_graph(known);
+    CommitGraph graph;
+    graph.load();
+    std::vector<uint32_t> want_pos, have_pos, boundary_pos;
+    for (const std::string& tip : tips) {
+        uint32_t pos;
+        if (!graph.find(tip, pos)) {
+            std::cerr << "Error: Cannot read commit " << tip << "\n";
+            return false;
+        }
+        want_pos.push_back(pos);
+    }
+    for (const std::string& have : haves) {
+        uint32_t pos;
+        if (graph.find(have, pos)) have_pos.push_back(pos);
+    }
+    {
+        TRACE_SCOPE("transfer: negotiate");
+        auto had_commit = [&](uint32_t pos) { return also_have && also_have(graph.raw_id(pos)); };
+        for (uint32_t pos : graph_commits_between(graph, want_pos, have_pos, had_commit, boundary_pos)) {
+            plan.commits.push_back(graph.id(pos));
+            plan.graph_entries.push_back(graph.entry(pos));
+        }
+        for (uint32_t pos : boundary_pos) plan.boundary.push_back(graph.id(pos));
+    }
+
+    TRACE_SCOPE("transfer: find objects");
+    const std::string empty_tree = hash_content("");
+    bool ok = true;
+    auto add_chunks = [&](std::string_view hash, const std::function<void(const std::string&)>& add) {
+        std::string list;
+        uint64_t size;
+        std::vector<std::string> chunks;
+        if (read_chunk_list(std::string(hash), list, size) && chunk_list_hashes(list, chunks)) {
+            for (const std::string& chunk : chunks) add(chunk);
+        }
+    };
+    bool listed = false;
+    if (plan.bitmaps.load() && reachable_objects(plan.bitmaps, plan.boundary, plan.had)) {
+        plan.bitmap_boundary = true;
+        Bitset wanted;
+        if (reachable_objects(plan.bitmaps, tips, wanted)) {
+            wanted.subtract(plan.had);
+            plan.objects = bitmap_objects(plan.bitmaps, wanted);
+            listed = true;
+        }
+    } else {
+        // Everything the boundary commits' trees hold; subtrees shared between them are
+        // walked once
+        std::function<void(std::string_view)> walk_tree = [&](std::string_view tree_hash) {
+            if (!plan.walked.insert(to_object_id(tree_hash)).second) return;
+            for (const TreeEntry& entry : load_tree(tree_hash)->entries) {
+                if (entry.is_tree) {
+                    walk_tree(entry.hash);
+                } else if (plan.walked.insert(to_object_id(entry.hash)).second) {
+                    add_chunks(entry.hash, [&](const std::string& chunk) { plan.walked.insert(to_object_id(chunk)); });
+                }
+            }
+        };
+        for (const std::string& hash : plan.boundary) {
+            auto commit = load_commit(hash);
+            plan.walked.insert(to_object_id(hash));
+            if (!commit->tree.empty()) walk_tree(commit->tree);
+            for (const FileEntry& file : commit->files) plan.walked.insert(to_object_id(file.hash));
+        }
+    }
+    if (!listed) {
+        // The new commits' trees, oldest commit first, each beside its first parent's tree: a
+        // subtree the receiver has or that is already going is skipped whole, so only the
+        // directories each commit changed are read, and what replaced an entry of the
+        // parent's tree gets that entry as its delta base
+        auto add = [&](std::string_view hash, std::string_view before) {
+            ObjectId id = to_object_id(hash);
+            if (plan.receiver_has(id) || plan.sent.count(id)) return false;
+            plan.sent.insert(id);
+            if (before.empty()) return true;
+            ObjectId base = to_object_id(before);
+            auto chain = plan.delta_hints.find(base);
+            int depth = chain == plan.delta_hints.end() ? 1 : chain->second.depth + 1;
+            if (depth <= PACK_MAX_DELTA_DEPTH) plan.delta_hints.emplace(id, TransferPlan::DeltaHint{base, depth});
+            return true;
+        };
+        auto add_blob = [&](std::string_view hash, std::string_view before) {
+            if (!add(hash, before)) return;
+            // Chunks go before the chunk list that names them
+            add_chunks(hash, [&](const std::string& chunk) {
+                if (add(chunk, "")) plan.objects.push_back(chunk);
+            });
+            plan.objects.emplace_back(hash);
+        };
+        std::function<void(std::string_view, std::string_view)> add_tree = [&](std::string_view tree_hash,
+                                                                                std::string_view before) {
+            if (tree_hash == empty_tree && !object_exists(empty_tree)) return;
+            if (!add(tree_hash, before)) return;
+            plan.objects.emplace_back(tree_hash);
+            auto tree = load_tree(tree_hash);
+            if (tree->buffer.empty() && tree_hash != empty_tree) {
+                std::cerr << "Error: Cannot read tree " << tree_hash << "\n";
+                ok = false;
+                return;
+            }
+            auto old_tree = load_tree(before);
+            size_t j = 0;
+            for (const TreeEntry& entry : tree->entries) {
+                const auto& old_entries = old_tree->entries;
+                while (j < old_entries.size() && tree_entry_less(old_entries[j], entry)) j++;
+                std::string_view old_hash;
+                if (j < old_entries.size() && old_entries[j].name == entry.name && old_entries[j].is_tree == entry.is_tree) {
+                    old_hash = old_entries[j].hash;
+                }
+                if (entry.is_tree) add_tree(entry.hash, old_hash); else add_blob(entry.hash, old_hash);
+            }
+        };
+        for (auto it = plan.commits.rbegin(); it != plan.commits.rend() && ok; ++it) {
+            auto commit = load_commit(*it);
+            if (commit->buffer.empty()) {
+                std::cerr << "Error: Cannot read commit " << *it << "\n";
+                return false;
+            }
+            add(*it, "");
+            plan.objects.push_back(*it);
+            std::string parent_tree;
+            if (!commit->parents.empty()) parent_tree = load_commit(std::string(commit->parents[0]))->tree;
+            if (!commit->tree.empty()) add_tree(commit->tree, parent_tree);
+            for (const FileEntry& file : commit->files) add_blob(file.hash, "");
+        }
+    } else {
+        for (const std::string& hash : plan.objects) plan.sent.insert(to_object_id(hash));
+    }
+    if (!ok) return false;
+
+    // Packed objects in the order they were packed, so delta bases arrive before their deltas
+    PackStore& store = PackStore::instance();
+    std::map<const PackFile*, size_t> pack_order;
+    for (const auto& pack : store.packs()) pack_order.emplace(pack.get(), pack_order.size());
+    std::vector<std::pair<std::pair<size_t, uint64_t>, size_t>> keys(plan.objects.size());
+    for (size_t i = 0; i < plan.objects.size(); i++) {
+        const PackFile* pack;
+        uint64_t offset;
+        keys[i] = {{SIZE_MAX, i}, i};
+        if (store.find(plan.objects[i], pack, offset)) keys[i].first = {pack_order[pack], offset};
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::string> ordered;
+    ordered.reserve(keys.size());
+    for (const auto& key : keys) ordered.push_back(std::move(plan.objects[key.second]));
+    plan.objects = std::move(ordered);
+    return true;
+}
+
+// A delta record against the hinted base when that is smaller than record
+static void try_delta(const TransferPlan::DeltaHint& hint, const std::string& content, std::string& record) {
+    std::string base;
+    if (!read_object(hash_to_string(hint.base), base)) return;
+    std::unique_ptr<DeltaIndex> index;
+    std::string encoded = delta_record(std::string(reinterpret_cast<const char*>(hint.base.data()), OBJECT_ID_SIZE),
+                                       base, index, content);
+    if (!encoded.empty() && encoded.size() < record.size()) record = std::move(encoded);
+}
+
+// Encode one object for the stream: its packed record as it is when the receiver can
+// resolve it, a delta counting only if its base is sent too or already there, or else a
+// fresh record; either way a delta against the previous version at its path when one was
+// hinted and comes out smaller
+static bool transfer_record(const std::string& hex, const TransferPlan& plan, std::string& record) {
+    auto hint = plan.delta_hints.find(to_object_id(hex));
+    const PackFile* pack;
+    uint64_t offset;
+    uint8_t kind;
+    uint64_t size, stored;
+    const uint8_t* data;
+    if (PackStore::instance().find(hex, pack, offset) && pack_record_at(*pack, offset, kind, size, data, stored)) {
+        bool reusable = kind != PACK_RECORD_DELTA;
+        if (!reusable && stored >= OBJECT_ID_SIZE) {
+            ObjectId base;
+            std::memcpy(base.data(), data, OBJECT_ID_SIZE);
+            reusable = plan.sent.count(base) || plan.receiver_has(base);
+        }
+        if (reusable) {
+            record.push_back(static_cast<char>(kind));
+            append_varint(record, size);
+            append_varint(record, stored);
+            record.append(reinterpret_cast<const char*>(data), static_cast<size_t>(stored));
+            if (hint == plan.delta_hints.end() || kind == PACK_RECORD_CHUNKS) return true;
+        }
+    }
+    std::string list;
+    if (record.empty() && read_chunk_list(hex, list, size)) {
+        record.push_back(static_cast<char>(PACK_RECORD_CHUNKS));
+        append_varint(record, size);
+        append_varint(record, list.size());
+        record += list;
+        return true;
+    }
+    std::string content;
+    if (!read_object(hex, content)) return false;
+    if (record.empty()) record = pack_record(content);
+    if (hint != plan.delta_hints.end()) try_delta(hint->second, content, record);
+    return true;
+}
+
+// Write the plan's objects to out as a pack stream, encoding a batch at a time on the pool
+static bool write_pack_stream(std::ostream& out, const TransferPlan& plan) {
+    TRACE_SCOPE("transfer: write pack");
+    Sha256 checksum;
+    auto emit = [&](const std::string& bytes) {
+        checksum.update(bytes);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    };
+    std::string header(PACK_MAGIC, 4);
+    append_raw<uint32_t>(header, PACK_VERSION);
+    append_raw<uint32_t>(header, static_cast<uint32_t>(plan.objects.size()));
+    emit(header);
+    ThreadPool pool;
+    std::vector<std::string> records;
+    for (size_t start = 0; start < plan.objects.size(); start += TRANSFER_BATCH_OBJECTS) {
+        size_t end = std::min(plan.objects.size(), start + TRANSFER_BATCH_OBJECTS);
+        records.assign(end - start, std::string());
+        for (size_t job = start; job < end; job += TRANSFER_JOB_OBJECTS) {
+            pool.submit([&, start, job] {
+                for (size_t k = job; k < std::min(end, job + TRANSFER_JOB_OBJECTS); k++) {
+                    transfer_record(plan.objects[k], plan, records[k - start]);
+                }
+            });
+        }
+        pool.wait();
+        for (size_t k = start; k < end; k++) {
+            if (records[k - start].empty()) {
+                std::cerr << "Error: Cannot read object " << plan.objects[k] << "\n";
+                return false;
+            }
+            emit(records[k - start]);
+        }
+    }
+    ObjectId sum = checksum.finish();
+    out.write(reinterpret_cast<const char*>(sum.data()), sum.size());
+    return static_cast<bool>(out);
+}
+
+using BranchList = std::vector<std::pair<std::string, std::string>>;   // (commit, branch)
+
+// Write a bundle through a temporary file; bytes receives its size
+static bool write_bundle(const std::string& path, const BranchList& branches, const TransferPlan& plan, uint64_t& bytes) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Error: Cannot create " << tmp << "\n";
+            return false;
+        }
+        out << BUNDLE_SIGNATURE << "\n";
+        for (const std::string& commit : plan.boundary) out << "-" << commit << "\n";
+        for (const auto& [commit, branch] : branches) out << commit << " " << branch << "\n";
+        out << "\n";
+        if (!write_pack_stream(out, plan) || !out.flush()) {
+            out.close();
+            fs::remove(tmp);
+            std::cerr << "Error: Cannot write " << path << "\n";
+            return false;
+        }
+    }
+    flush_file(tmp);
+    if (!rename_file(tmp, path)) {
+        std::cerr << "Error: Cannot write " << path << "\n";
+        return false;
+    }
+    bytes = fs::file_size(path);
+    return true;
+}
+
+struct BundleHeader {
+    std::vector<std::string> prerequisites;
+    BranchList branches;
+};
+
+static bool read_bundle_header(std::istream& in, const std::string& file, BundleHeader& header) {
+    std::string line;
+    bool ok = std::getline(in, line) && line == BUNDLE_SIGNATURE;
+    while (ok && std::getline(in, line) && !line.empty()) {
+        if (line[0] == '-') {
+            header.prerequisites.push_back(line.substr(1));
+            ok = is_object_id(header.prerequisites.back());
+            continue;
+        }
+        size_t space = line.find(' ');
+        std::string commit = line.substr(0, space);
+        std::string branch = space == std::string::npos ? "" : line.substr(space + 1);
+        ok = is_object_id(commit) && valid_branch_name(branch);
+        header.branches.emplace_back(commit, branch);
+    }
+    if (!ok || !in) {
+        std::cerr << "Error: " << file << " is not a MiniGit bundle\n";
+        return false;
+    }
+    return true;
+}
+
+// Pulls a pack stream through its checksum
+class StreamReader {
+public:
+    explicit StreamReader(std::istream& in) : in_(in) {}
+
+    bool read(std::string& out, size_t size) {
+        size_t start = out.size();
+        out.resize(start + size);
+        if (!in_.read(&out[start], static_cast<std::streamsize>(size))) return false;
+        checksum_.update(out.data() + start, size);
+        return true;
+    }
+
+    // A varint, also appended to out as it was stored
+    bool varint(std::string& out, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (!read(out, 1)) return false;
+            uint8_t byte = static_cast<uint8_t>(out.back());
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    ObjectId checksum() { return checksum_.finish(); }
+
+private:
+    std::istream& in_;
+    Sha256 checksum_;
+};
+
+// A received record, with where its stored bytes start
+struct ReceivedRecord {
+    std::string bytes;
+    uint64_t size = 0;
+    size_t data = 0;
+};
+
+// Objects counted while a stream is indexed
+struct ReceiveStats {
+    size_t objects = 0;
+    size_t added = 0;
+    std::string pack;
+};
+
+// Store a pack stream's objects in a new pack. Each record is decoded and hashed, since
+// records do not carry IDs; objects already stored are skipped. Deltas whose base and chunk
+// lists whose chunks come later in the stream are resolved once it ends.
+static bool index_pack_stream(std::istream& in, ReceiveStats& stats) {
+    TRACE_SCOPE("transfer: index pack");
+    StreamReader reader(in);
+    std::string header;
+    if (!reader.read(header, PACK_HEADER_SIZE) || std::memcmp(header.data(), PACK_MAGIC, 4) != 0 ||
+        read_raw<uint32_t>(reinterpret_cast<const uint8_t*>(header.data()) + 4) != PACK_VERSION) {
+        std::cerr << "Error: The pack stream is damaged\n";
+        return false;
+    }
+    uint32_t count = read_raw<uint32_t>(reinterpret_cast<const uint8_t*>(header.data()) + 8);
+    PackWriter writer;
+    if (!writer.open(receive_label())) return false;
+    LruCache<std::string> bases(TRANSFER_BASE_CACHE_BYTES);
+    auto content_of = [&](const ObjectId& id, std::string& out) {
+        std::string hex = hash_to_string(id);
+        std::shared_ptr<const std::string> cached;
+        if (bases.get(hex, cached)) {
+            out = *cached;
+            return true;
+        }
+        return writer.read(id, out) || read_object(hex, out);
+    };
+    enum Outcome { STORED, LATER, CORRUPT };
+    auto store = [&](const ReceivedRecord& record) {
+        uint8_t kind = static_cast<uint8_t>(record.bytes[0]);
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(record.bytes.data()) + record.data;
+        size_t stored = record.bytes.size() - record.data;
+        std::string content;
+        ObjectId id;
+        // A delta against an object stored outside the new pack is stored whole, so chains
+        // never run from one pack into another and cannot grow with every transfer
+        bool thin = false;
+        if (kind == PACK_RECORD_CHUNKS) {
+            std::string_view list(reinterpret_cast<const char*>(data), stored);
+            std::vector<std::string> chunks;
+            if (!chunk_list_hashes(list, chunks)) return CORRUPT;
+            Sha256 hasher;
+            uint64_t total = 0;
+            std::string chunk;
+            for (const std::string& hash : chunks) {
+                if (!content_of(to_object_id(hash), chunk)) return LATER;
+                hasher.update(chunk);
+                total += chunk.size();
+            }
+            if (total != record.size) return CORRUPT;
+            id = hasher.finish();
+        } else {
+            if (kind == PACK_RECORD_DELTA) {
+                if (stored < OBJECT_ID_SIZE) return CORRUPT;
+                ObjectId base_id;
+                std::memcpy(base_id.data(), data, OBJECT_ID_SIZE);
+                std::string base;
+                if (!content_of(base_id, base)) return LATER;
+                if (!delta_apply(base, data + OBJECT_ID_SIZE, stored - OBJECT_ID_SIZE, content)) return CORRUPT;
+                thin = !writer.contains(base_id);
+            } else if (!decode_pack_record(kind, data, stored, record.size, content)) {
+                return CORRUPT;
+            }
+            if (content.size() != record.size) return CORRUPT;
+            Sha256 hasher;
+            hasher.update(content);
+            id = hasher.finish();
+        }
+        std::string hex = hash_to_string(id);
+        if (!writer.contains(id) && !object_exists(hex)) {
+            writer.append(id, thin ? pack_record(content) : record.bytes);
+            stats.added++;
+        }
+        if (kind != PACK_RECORD_CHUNKS) {
+            size_t size = content.size();
+            bases.put(hex, std::make_shared<std::string>(std::move(content)), size);
+        }
+        return STORED;
+    };
+
+    std::vector<ReceivedRecord> later;
+    for (uint32_t i = 0; i < count; i++) {
+        ReceivedRecord record;
+        uint64_t stored;
+        if (!reader.read(record.bytes, 1) || !reader.varint(record.bytes, record.size) ||
+            !reader.varint(record.bytes, stored) || stored > (uint64_t(1) << 40)) {
+            std::cerr << "Error: The pack stream ends early\n";
+            return false;
+        }
+        record.data = record.bytes.size();
+        if (!reader.read(record.bytes, static_cast<size_t>(stored))) {
+            std::cerr << "Error: The pack stream ends early\n";
+            return false;
+        }
+        Outcome outcome = store(record);
+        if (outcome == CORRUPT) {
+            std::cerr << "Error: Object " << i << " of the pack stream is corrupt\n";
+            return false;
+        }
+        if (outcome == LATER) later.push_back(std::move(record));
+    }
+    ObjectId expected = reader.checksum();
+    std::string trailer;
+    reader.read(trailer, OBJECT_ID_SIZE);
+    if (trailer.size() != OBJECT_ID_SIZE || std::memcmp(trailer.data(), expected.data(), OBJECT_ID_SIZE) != 0) {
+        std::cerr << "Error: The pack stream's checksum does not match\n";
+        return false;
+    }
+    for (bool progress = true; progress && !later.empty();) {
+        progress = false;
+        for (auto it = later.begin(); it != later.end();) {
+            Outcome outcome = store(*it);
+            if (outcome == CORRUPT) {
+                std::cerr << "Error: The pack stream holds a corrupt delta or chunk list\n";
+                return false;
+            }
+            if (outcome == STORED) {
+                it = later.erase(it);
+                progress = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (!later.empty()) {
+        std::cerr << "Error: " << later.size() << " objects in the pack stream build on objects that were neither sent nor stored here\n";
+        return false;
+    }
+    stats.objects = count;
+    if (writer.count() == 0) return true;
+    stats.pack = writer.finish();
+    return !stats.pack.empty();
+}
+
+// Print why branch, checked out in the receiving repository (where, "" for this one), was
+// not moved
+static void reject_checked_out(const std::string& branch, const std::string& where) {
+    std::cout << "  " << branch << ": rejected, it is checked out " << (where.empty() ? "here" : "in " + where)
+              << "; check out another branch first\n";
+}
+
+// Check out commit into a repository whose current branch is still unborn and whose index is
+// empty, staging the index in tx. False if the repository is not in that state.
+static bool checkout_unborn(const std::string& old, const std::string& commit, Transaction& tx) {
+    if (!old.empty() || !tx.lock(INDEX_PATH) || !load_index().empty()) return false;
+    auto files = commit_files(load_commit(commit));
+    return update_working_tree(*files, "", tx);
+}
+
+// Move branches to received commits, each only forward, printing one line per branch. The
+// branch HEAD names is refused, as with Git's receive.denyCurrentBranch: its index and working
+// tree would stay at the old commit, and the next commit would revert the new ones. The one
+// exception is an unborn current branch with an empty index (a fresh repository), which is
+// checked out in the same transaction. where names the repository being pushed to ("" for
+// this one). False if a ref could not be written or a branch was refused.
+static bool update_branches(const BranchList& branches, const std::string& where) {
+    std::vector<std::string> tips;
+    for (const auto& branch : branches) tips.push_back(branch.first);
+    update_commit_graph(tips);
+    Transaction tx;
+    // Holding HEAD keeps a checkout from switching to a branch while it moves
+    if (!tx.lock(".minigit/HEAD")) return false;
+    std::string head_ref;
+    read_head(head_ref);
+    bool rejected = false;
+    for (const auto& [commit, branch] : branches) {
+        std::string path = ".minigit/refs/heads/" + branch;
+        std::error_code ec;
+        fs::create_directories(fs::path(path).parent_path(), ec);
+        if (!tx.lock(path)) return false;
+        std::string old = resolve_revision(branch);
+        if (old == commit) {
+            std::cout << "  " << branch << " is up to date\n";
+        } else if (head_ref == "refs/heads/" + branch && !checkout_unborn(old, commit, tx)) {
+            reject_checked_out(branch, where);
+            rejected = true;
+        } else if (!old.empty() && !is_ancestor(old, commit)) {
+            std::cout << "  " << branch << ": rejected, " << short_id(commit) << " does not descend from "
+                      << short_id(old) << "\n";
+            rejected = true;
+        } else {
+            tx.write(path, commit);
+            if (old.empty()) {
+                std::cout << "  " << branch << ": new branch at " << short_id(commit) << "\n";
+            } else {
+                std::cout << "  " << branch << ": " << short_id(old) << ".." << short_id(commit) << "\n";
+            }
+        }
+    }
+    return tx.commit() && !rejected;
+}
+
+// Point the remote-tracking branches <remote>/<branch> at fetched commits, printing one line
+// per branch. They mirror the other repository, so they move wherever its branches did; the
+// local branches are left for merge. False if a ref could not be written.
+static bool update_remote_branches(const BranchList& branches, const std::string& remote) {
+    std::vector<std::string> tips;
+    for (const auto& branch : branches) tips.push_back(branch.first);
+    update_commit_graph(tips);
+    Transaction tx;
+    for (const auto& [commit, branch] : branches) {
+        std::string name = remote + "/" + branch;
+        std::string path = REMOTES_DIR + "/" + name;
+        if (!tx.lock(path)) return false;
+        std::string old = resolve_revision(name);
+        if (old == commit) {
+            std::cout << "  " << name << " is up to date\n";
+            continue;
+        }
+        tx.write(path, commit);
+        std::cout << "  " << branch << " -> " << name << ": ";
+        if (old.empty()) {
+            std::cout << "new at " << short_id(commit) << "\n";
+        } else if (is_ancestor(old, commit)) {
+            std::cout << short_id(old) << ".." << short_id(commit) << "\n";
+        } else {
+            std::cout << "forced update " << short_id(old) << "..." << short_id(commit) << "\n";
+        }
+    }
+    return tx.commit();
+}
+
+// Check a bundle's prerequisites, index its pack and move its branches: the local ones, or
+// with remote set, that repository's remote-tracking ones. graph_entries are the new commits'
+// commit-graph entries when the sending side handed them over, which saves parsing every
+// commit and recomputing its changed-path filter.
+static bool receive_bundle(std::istream& in, const BundleHeader& header, const std::string& where,
+                           const std::string& remote, std::vector<GraphEntry> graph_entries) {
+    for (const std::string& commit : header.prerequisites) {
+        if (!object_exists(commit)) {
+            std::cerr << "Error: The bundle needs commit " << commit << ", which this repository does not have\n";
+            return false;
+        }
+    }
+    ReceiveStats stats;
+    if (!index_pack_stream(in, stats)) return false;
+    for (const auto& [commit, branch] : header.branches) {
+        if (!object_exists(commit)) {
+            std::cerr << "Error: The bundle does not hold commit " << commit << " for " << branch << "\n";
+            return false;
+        }
+    }
+    if (!graph_entries.empty()) {
+        CommitGraph graph;
+        graph.load();
+        graph_entries.erase(std::remove_if(graph_entries.begin(), graph_entries.end(), [&](const GraphEntry& entry) {
+            uint32_t pos;
+            return graph.find(entry.id.data(), pos);
+        }), graph_entries.end());
+        if (!graph_entries.empty()) append_commit_graph(std::move(graph_entries));
+    }
+    std::cout << "Received " << stats.objects << " objects, " << stats.added << " new";
+    if (!stats.pack.empty()) std::cout << " in " << stats.pack << ".pack";
+    std::cout << "\n";
+    if (!remote.empty()) return update_remote_branches(header.branches, remote);
+    return update_branches(header.branches, where);
+}
+
+// Branches named on the command line (HEAD standing for the current one) with their commits
+static bool named_branches(const std::vector<std::string>& names, BranchList& branches) {
+    for (std::string name : names) {
+        if (name == "HEAD") {
+            std::string head_ref;
+            read_head(head_ref);
+            if (head_ref.empty()) {
+                std::cerr << "Error: HEAD is detached; name a branch\n";
+                return false;
+            }
+            name = head_ref.substr(11);
+        }
+        std::string commit = valid_branch_name(name) ? resolve_revision(name) : "";
+        if (commit.empty() || !fs::exists(".minigit/refs/heads/" + name)) {
+            std::cerr << "Error: No branch named " << name << " with commits\n";
+            return false;
+        }
+        branches.emplace_back(commit, name);
+    }
+    return true;
+}
+
+static BranchList all_branches() {
+    BranchList branches;
+    for (const std::string& name : list_branches()) {
+        std::string commit = resolve_revision(name);
+        if (!commit.empty()) branches.emplace_back(commit, name);
+    }
+    return branches;
+}
+
+bool bundle_create(const std::string& file, const std::vector<std::string>& revisions) {
+    TRACE_SCOPE("bundle create");
+    if (!fs::exists(".minigit")) {
+        std::cerr << "Error: Not a MiniGit repository.\n";
+        return false;
+    }
+    std::vector<std::string> names, excluded;
+    for (const std::string& revision : revisions) {
+        if (revision.empty() || revision[0] != '^') {
+            names.push_back(revision);
+            continue;
+        }
+        std::string commit = resolve_revision(revision.substr(1));
+        if (commit.empty()) {
+            std::cerr << "Error: Unknown revision " << revision.substr(1) << "\n";
+            return false;
+        }
+        excluded.push_back(commit);
+    }
+    BranchList branches;
+    if (names.empty()) {
+        branches = all_branches();
+    } else if (!named_branches(names, branches)) {
+        return false;
+    }
+    if (branches.empty()) {
+        std::cerr << "Error: No branches with commits to bundle\n";
+        return false;
+    }
+    std::vector<std::string> tips;
+    for (const auto& branch : branches) tips.push_back(branch.first);
+    TransferPlan plan;
+    uint64_t bytes = 0;
+    if (!plan_transfer(tips, excluded, nullptr, plan) || !write_bundle(file, branches, plan, bytes)) return false;
+    std::cout << "Wrote " << file << ": " << branches.size() << " branches, " << plan.commits.size() << " commits, "
+              << plan.objects.size() << " objects, " << bytes << " bytes\n";
+    return true;
+}
+
+bool bundle_unbundle(const std::string& file) {
+    TRACE_SCOPE("bundle unbundle");
+    if (!fs::exists(".minigit")) {
+        std::cerr << "Error: Not a MiniGit repository.\n";
+        return false;
+    }
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error: Cannot read " << file << "\n";
+        return false;
+    }
+    BundleHeader header;
+    return read_bundle_header(in, file, header) && receive_bundle(in, header, "", "", {});
+}
+
+// Send branches from the repository at source to the one at receiver through a bundle in
+// the receiver's pack directory. Pushing (remote empty) moves the receiver's branches; fetching
+// moves its remote-tracking branches for remote. With no names, pushing sends the current
+// branch and fetching takes every branch.
+static bool transfer(const fs::path& source, const fs::path& receiver, const std::vector<std::string>& names,
+                     const std::string& where, const std::string& remote) {
+    bool pushing = remote.empty();
+    auto start = std::chrono::steady_clock::now();
+    // The receiving side's half of the negotiation: its branch tips, and every commit they
+    // reach as a set of commit-graph positions
+    std::vector<std::string> have_tips;
+    CommitGraph have_graph;
+    Bitset reached;
+    // The branch a push may not move there, and its commit: the checked-out one, unless it
+    // has no commits yet and the index is empty (see update_branches)
+    std::string checked_out, checked_out_commit;
+    {
+        InRepository in(receiver);
+        if (!in.entered()) return false;
+        TRACE_SCOPE("transfer: receiver history");
+        if (pushing) {
+            std::string head_ref;
+            checked_out_commit = read_head(head_ref);
+            if (is_null_commit(checked_out_commit)) checked_out_commit.clear();
+            if (!head_ref.empty() && (!checked_out_commit.empty() || !load_index().empty())) {
+                checked_out = head_ref.substr(11);
+            }
+        }
+        have_tips = ref_tips();
+        update_commit_graph(have_tips);
+        if (have_graph.load()) {
+            std::vector<uint32_t> stack, parents;
+            for (const std::string& tip : have_tips) {
+                uint32_t pos;
+                if (have_graph.find(tip, pos) && !reached.test(pos)) {
+                    reached.set(pos);
+                    stack.push_back(pos);
+                }
+            }
+            while (!stack.empty()) {
+                uint32_t pos = stack.back();
+                stack.pop_back();
+                have_graph.parents(pos, parents);
+                for (uint32_t p : parents) {
+                    if (p == GRAPH_NO_PARENT || reached.test(p)) continue;
+                    reached.set(p);
+                    stack.push_back(p);
+                }
+            }
+        }
+        if (!in.leave()) return false;
+    }
+
+    std::string stream_path = (receiver / PACK_DIR / ("tmp-" + receive_label() + ".bundle")).string();
+    TransferPlan plan;
+    BranchList branches;
+    uint64_t bytes = 0;
+    {
+        InRepository in(source);
+        if (!in.entered()) return false;
+        if (names.empty() && pushing) {
+            if (!named_branches({"HEAD"}, branches)) return false;
+        } else if (names.empty()) {
+            branches = all_branches();
+        } else if (!named_branches(names, branches)) {
+            return false;
+        }
+        if (branches.empty()) {
+            std::cout << "No branches with commits to " << (pushing ? "push" : "fetch") << "\n";
+            return in.leave();
+        }
+        // Refused before anything is sent
+        for (const auto& [commit, branch] : branches) {
+            if (branch == checked_out && commit != checked_out_commit) {
+                reject_checked_out(branch, where);
+                return false;
+            }
+        }
+        std::vector<std::string> tips;
+        for (const auto& branch : branches) tips.push_back(branch.first);
+        auto receiver_has = [&](const uint8_t* id) {
+            uint32_t pos;
+            return have_graph.find(id, pos) && reached.test(pos);
+        };
+        std::error_code ec;
+        fs::create_directories(receiver / PACK_DIR, ec);
+        if (!plan_transfer(tips, have_tips, receiver_has, plan) || !write_bundle(stream_path, branches, plan, bytes)) {
+            return false;
+        }
+        if (!in.leave()) {
+            fs::remove(stream_path, ec);
+            return false;
+        }
+    }
+
+    InRepository in(receiver);
+    if (!in.entered()) {
+        std::error_code ec;
+        fs::remove(stream_path, ec);
+        return false;
+    }
+    bool ok;
+    {
+        std::ifstream stream(stream_path, std::ios::binary);
+        BundleHeader header;
+        ok = read_bundle_header(stream, stream_path, header) &&
+             receive_bundle(stream, header, where, remote, std::move(plan.graph_entries));
+    }
+    std::error_code ec;
+    fs::remove(stream_path, ec);
+    ok = in.leave() && ok;
+    if (!ok) return false;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << (pushing ? "Pushed " : "Fetched ") << plan.commits.size() << " commits as " << plan.objects.size()
+              << " objects in " << bytes << " bytes (" << std::fixed << std::setprecision(3) << elapsed.count()
+              << " s)\n";
+    return true;
+}
+
+// Absolute path of another repository, or "" with the error printed
+static fs::path other_repository(const std::string& path) {
+    std::error_code ec;
+    fs::path root = fs::absolute(path, ec);
+    if (ec || !fs::is_directory(root / ".minigit")) {
+        std::cerr << "Error: " << path << " is not a MiniGit repository.\n";
+        return fs::path();
+    }
+    return root;
+}
+
+bool push(const std::string& path, const std::vector<std::string>& branches) {
+    TRACE_SCOPE("push");
+    if (!fs::exists(".minigit")) {
+        std::cerr << "Error: Not a MiniGit repository.\n";
+        return false;
+    }
+    fs::path remote = other_repository(path);
+    return !remote.empty() && transfer(fs::current_path(), remote, branches, path, "");
+}
+
+bool fetch(const std::string& path, const std::vector<std::string>& branches) {
+    TRACE_SCOPE("fetch");
+    if (!fs::exists(".minigit")) {
+        std::cerr << "Error: Not a MiniGit repository.\n";
+        return false;
+    }
+    fs::path remote = other_repository(path);
+    if (remote.empty()) return false;
+    // Remote-tracking branches are named after the other repository's directory
+    std::string name = remote.lexically_normal().filename().string();
+    if (name.empty()) name = remote.lexically_normal().parent_path().filename().string();
+    if (!valid_branch_name(name) || name.find('/') != std::string::npos) {
+        std::cerr << "Error: Cannot name remote-tracking branches after " << path << "\n";
+        return false;
+    }
+    return transfer(remote, fs::current_path(), branches, path, name);
+}
@@ -0,0 +1,43 @@
+// Moving history between repositories: bundles, and push and fetch over the filesystem
+#pragma once
+
+#include "commands.h"
+
+// A bundle carries branches plus the objects a repository that has the prerequisite commits
+// lacks to reach them, as one pack stream:
+//   "# minigit bundle v1\n", "-<commit>\n" per prerequisite, "<commit> <branch>\n" per
+//   branch, "\n", then a pack as written to .minigit/objects/pack (see object_store.h) whose
+//   deltas may be against objects the prerequisites reach
+const std::string BUNDLE_SIGNATURE = "# minigit bundle v1";
+
+// Packed records are copied into the stream as they are, and loose objects are compressed
+// on the thread pool, in jobs of this many objects with at most this many queued at once
+const size_t TRANSFER_JOB_OBJECTS = 64;
+const size_t TRANSFER_BATCH_OBJECTS = 4096;
+
+// Decoded objects kept while a received stream is indexed, as bases for later deltas
+const size_t TRANSFER_BASE_CACHE_BYTES = size_t(64) << 20;
+
+// Write a bundle of the given branches (every branch when none are named; HEAD names the
+// current one), leaving out the history reachable from the ^<commit> arguments. Commits are
+// found with one walk of the commit-graph, and objects from the reachability bitmaps when
+// they cover those commits, or else by walking only the trees the new commits changed.
+// False, with the error printed, on failure.
+bool bundle_create(const std::string& file, const std::vector<std::string>& revisions);
+
+// Store a bundle's objects in a new pack, each one rehashed on the way in, and move its
+// branches forward: new branches are created, and existing ones are only updated when the
+// bundle's commit descends from theirs. Fails without changing anything if a prerequisite
+// commit is missing.
+bool bundle_unbundle(const std::string& file);
+
+// Send branches (the current one when none are named) to the repository at path, and take
+// the other repository's branches (all of them when none are named) from it. The sending
+// side walks its history until it reaches commits the receiving side's refs already reach,
+// then streams only the objects those new commits introduced as one pack, which the receiver
+// indexes and verifies. push then moves the other repository's branches as bundle_unbundle
+// does; fetch leaves the local branches alone and points the remote-tracking branches
+// refs/remotes/<name>/<branch> at what it took, <name> being the other repository's
+// directory name, so they can be merged.
+bool push(const std::string& path, const std::vector<std::string>& branches);
+bool fetch(const std::string& path, const std::vector<std::string>& branches);
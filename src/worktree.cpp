@@ -0,0 +1,339 @@
+#include "worktree.h"
+
+#include "fsmonitor.h"
+#include "ignore.h"
+
+std::string normalize_path(const std::string& path) {
+    std::string rel = fs::path(path).lexically_normal().generic_string();
+    while (rel.size() >= 2 && rel.compare(0, 2, "./") == 0) rel = rel.substr(2);
+    if (rel == ".") rel.clear();
+    if (!rel.empty() && rel.back() == '/') rel.pop_back();
+    return rel;
+}
+
+void SparseCheckout::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        *this = SparseCheckout();
+        return;
+    }
+    std::vector<std::string> patterns;
+    for (std::string line; std::getline(file, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line[0] != '#') patterns.push_back(line);
+    }
+    set(patterns);
+}
+
+void SparseCheckout::set(const std::vector<std::string>& patterns) {
+    *this = SparseCheckout();
+    enabled_ = true;
+    parents_.insert("");
+    for (const std::string& pattern : patterns) {
+        std::string rel = normalize_path(pattern);
+        if (rel.empty()) continue;
+        patterns_.push_back(rel);
+        if (rel.find_first_of("*?[") != std::string::npos) {
+            globs_.push_back(rel);
+            continue;
+        }
+        dirs_.insert(rel);
+        for (size_t pos = rel.find('/'); pos != std::string::npos; pos = rel.find('/', pos + 1)) {
+            parents_.insert(rel.substr(0, pos));
+        }
+    }
+}
+
+bool SparseCheckout::includes(std::string_view path) const {
+    if (!enabled_) return true;
+    size_t slash = path.rfind('/');
+    if (parents_.count(std::string(slash == std::string_view::npos ? std::string_view() : path.substr(0, slash)))) {
+        return true;
+    }
+    for (size_t pos = path.find('/');; pos = path.find('/', pos + 1)) {
+        std::string prefix(path.substr(0, pos));
+        if (dirs_.count(prefix)) return true;
+        for (const std::string& glob : globs_) {
+            if (glob_match(glob.c_str(), prefix.c_str())) return true;
+        }
+        if (pos == std::string_view::npos) return false;
+    }
+}
+
+bool write_blob_from_file(const std::string& source, const std::string& hash) {
+    std::string blob_path = loose_object_path(hash);
+    if (object_exists(hash)) return true;
+    std::stringstream tmp;
+    tmp << blob_path << ".tmp" << std::this_thread::get_id();
+    std::error_code ec;
+    fs::copy_file(source, tmp.str(), fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+        fs::remove(tmp.str(), ec);
+    } else {
+        flush_file(tmp.str());
+        if (rename_file(tmp.str(), blob_path)) {
+            TRACE_COUNT(TraceCounter::ObjectsWritten);
+            return true;
+        }
+    }
+    std::cerr << "Error: Cannot write object " << hash << "\n";
+    return false;
+}
+
+// Delete files, then the directories they leave empty
+static void remove_files(const std::vector<std::string>& paths) {
+    TRACE_SCOPE("worktree: remove files");
+    std::set<std::string, std::greater<std::string>> emptied;
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        fs::remove(path, ec);
+        if (ec) {
+            std::cerr << "Error removing file " << path << ": " << ec.message() << "\n";
+        } else {
+            TRACE_COUNT(TraceCounter::FilesDeleted);
+        }
+        for (fs::path dir = fs::path(path).parent_path(); !dir.empty(); dir = dir.parent_path()) {
+            emptied.insert(dir.generic_string());
+        }
+    }
+    for (const std::string& dir : emptied) {
+        std::error_code ec;
+        if (fs::is_directory(dir, ec) && fs::is_empty(dir, ec)) fs::remove(dir, ec);
+    }
+}
+
+// Write the files of entries[k] for each k in pending (in path order) and record their stat
+// data. Files are written in batches through the I/O engine: raw pack records straight from
+// the mapped pack, loose objects copied, and compressed or delta records decoded on the pool.
+// Chunked files are set aside and streamed afterwards. False, with the paths printed, if a
+// file could not be written.
+static bool write_files(std::vector<IndexEntry>& entries, const std::vector<size_t>& pending, ThreadPool& pool) {
+    TRACE_SCOPE("worktree: write files");
+    const size_t chunk = 256;
+    std::string last_parent;
+    for (size_t k : pending) {
+        std::string parent = fs::path(entries[k].path).parent_path().generic_string();
+        if (parent.empty() || parent == last_parent) continue;
+        std::error_code ec;
+        fs::create_directories(parent, ec);
+        last_parent = parent;
+    }
+
+    std::vector<size_t> chunked;
+    PackStore& packs = PackStore::instance();
+    std::vector<std::string> errors;
+    size_t next = 0;
+    while (next < pending.size()) {
+        std::vector<IoRequest> requests;
+        std::vector<size_t> owners, decode;
+        uint64_t decoded_bytes = 0;
+        while (next < pending.size() && requests.size() < IO_BATCH_FILES && decoded_bytes < IO_BATCH_BYTES) {
+            size_t k = pending[next++];
+            IoRequest request;
+            request.kind = IoRequest::Write;
+            request.path = entries[k].path;
+            const PackFile* pack;
+            uint64_t offset, size, stored;
+            uint8_t kind;
+            const uint8_t* data;
+            if (packs.find(entries[k].hash, pack, offset) && pack_record_at(*pack, offset, kind, size, data, stored)) {
+                if (kind == PACK_RECORD_CHUNKS) {
+                    chunked.push_back(k);
+                    continue;
+                }
+                if (kind == PACK_RECORD_RAW && stored == size) {
+                    request.data = std::string_view(reinterpret_cast<const char*>(data), stored);
+                } else {
+                    decode.push_back(requests.size());
+                    decoded_bytes += size;
+                }
+            } else {
+                request.kind = IoRequest::Copy;
+                request.source = loose_object_path(entries[k].hash);
+            }
+            requests.push_back(std::move(request));
+            owners.push_back(k);
+        }
+        // A record that cannot be decoded still truncates its file, and is reported below
+        std::vector<char> undecoded(requests.size(), 0);
+        for (size_t start = 0; start < decode.size(); start += chunk) {
+            pool.submit([&, start] {
+                size_t end = std::min(decode.size(), start + chunk);
+                for (size_t d = start; d < end; d++) {
+                    IoRequest& request = requests[decode[d]];
+                    if (read_object(entries[owners[decode[d]]].hash, request.buffer)) {
+                        request.data = request.buffer;
+                    } else {
+                        undecoded[decode[d]] = 1;
+                    }
+                }
+            });
+        }
+        pool.wait();
+        run_io(requests);
+        for (size_t r = 0; r < requests.size(); r++) {
+            if (requests[r].ok && !undecoded[r]) {
+                TRACE_COUNT(TraceCounter::FilesWritten);
+                entries[owners[r]].stat = requests[r].stat;
+            } else if (requests[r].kind == IoRequest::Copy && fs::exists(chunk_list_path(entries[owners[r]].hash))) {
+                chunked.push_back(owners[r]);
+            } else {
+                errors.push_back(entries[owners[r]].path);
+            }
+        }
+    }
+    std::mutex errors_mutex;
+    for (size_t k : chunked) {
+        pool.submit([&, k] {
+            if (write_chunked_object(entries[k].hash, entries[k].path) && stat_file(entries[k].path, entries[k].stat)) {
+                TRACE_COUNT(TraceCounter::FilesWritten);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(errors_mutex);
+            errors.push_back(entries[k].path);
+        });
+    }
+    pool.wait();
+    std::sort(errors.begin(), errors.end());
+    for (const std::string& path : errors) {
+        std::cerr << "Error: Cannot write " << path << "\n";
+    }
+    return errors.empty();
+}
+
+bool update_working_tree(const FileList& target, const std::string& keep_filename, Transaction& tx) {
+    TRACE_SCOPE("worktree: update");
+    IndexView view;
+    int64_t index_mtime_ns = view.open() ? view.mtime_ns() : 0;
+    view.close();
+    std::vector<IndexEntry> current = load_index();
+    SparseCheckout sparse;
+    sparse.load();
+
+    std::vector<IndexEntry> entries(target.size());
+    std::vector<char> rewrite(target.size(), 1);
+    std::vector<const IndexEntry*> unchanged(target.size(), nullptr);
+    std::vector<std::string> removed;
+    size_t i = 0, t = 0;
+    while (i < current.size() || t < target.size()) {
+        if (t == target.size() || (i < current.size() && current[i].path < target[t].path)) {
+            if (current[i].path != keep_filename && sparse.includes(current[i].path)) {
+                removed.push_back(current[i].path);
+            }
+            i++;
+            continue;
+        }
+        entries[t].path = std::string(target[t].path);
+        entries[t].hash = std::string(target[t].hash);
+        rewrite[t] = sparse.includes(target[t].path);
+        if (i < current.size() && current[i].path == target[t].path) {
+            if (current[i].hash == target[t].hash) unchanged[t] = &current[i];
+            i++;
+        }
+        t++;
+    }
+
+    // With fsmonitor, an unchanged file it did not report, and status did not last find
+    // dirty, is known to match its index entry without a stat
+    FsmonitorChanges changes = fsmonitor_changes();
+    const size_t chunk = 256;
+    ThreadPool pool;
+    {
+        TRACE_SCOPE("worktree: check unchanged files");
+        for (size_t start = 0; start < target.size(); start += chunk) {
+            pool.submit([&, start] {
+                size_t end = std::min(target.size(), start + chunk);
+                for (size_t k = start; k < end; k++) {
+                    const IndexEntry* old = unchanged[k];
+                    if (!old || !rewrite[k]) continue;
+                    if (!changes.full && !changes.contains(old->path)) {
+                        entries[k].stat = old->stat;
+                        rewrite[k] = 0;
+                        continue;
+                    }
+                    FileStat fresh;
+                    if (!stat_file(old->path, fresh)) continue;
+                    if (index_entry_clean(*old, fresh, index_mtime_ns) || hash_file(old->path) == old->hash) {
+                        entries[k].stat = fresh;
+                        rewrite[k] = 0;
+                    }
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // Deletions first, so a file can replace a directory that is going away and vice versa
+    remove_files(removed);
+
+    std::vector<size_t> pending;
+    for (size_t k = 0; k < target.size(); k++) {
+        if (rewrite[k]) pending.push_back(k);
+    }
+    bool ok = write_files(entries, pending, pool);
+    save_index(std::move(entries), tx);
+    return ok;
+}
+
+bool apply_sparse_checkout(const SparseCheckout& before, const SparseCheckout& after, Transaction& tx) {
+    TRACE_SCOPE("worktree: sparse checkout");
+    IndexView view;
+    int64_t index_mtime_ns = view.open() ? view.mtime_ns() : 0;
+    view.close();
+    std::vector<IndexEntry> entries = load_index();
+    std::vector<size_t> added, dropped;
+    for (size_t k = 0; k < entries.size(); k++) {
+        bool was = before.includes(entries[k].path), now = after.includes(entries[k].path);
+        if (now && !was) added.push_back(k);
+        if (was && !now) dropped.push_back(k);
+    }
+
+    // A file already there (one kept earlier because it was modified) is not overwritten,
+    // and a dropped file is deleted only if it still matches the index
+    std::vector<char> missing(added.size(), 0), clean(dropped.size(), 0);
+    const size_t chunk = 256;
+    ThreadPool pool;
+    for (size_t start = 0; start < added.size(); start += chunk) {
+        pool.submit([&, start] {
+            for (size_t a = start; a < std::min(added.size(), start + chunk); a++) {
+                IndexEntry& entry = entries[added[a]];
+                FileStat fresh;
+                if (!stat_file(entry.path, fresh)) {
+                    missing[a] = 1;
+                } else if (hash_file(entry.path) == entry.hash) {
+                    entry.stat = fresh;
+                }
+            }
+        });
+    }
+    for (size_t start = 0; start < dropped.size(); start += chunk) {
+        pool.submit([&, start] {
+            for (size_t d = start; d < std::min(dropped.size(), start + chunk); d++) {
+                IndexEntry& entry = entries[dropped[d]];
+                FileStat fresh;
+                clean[d] = stat_file(entry.path, fresh) &&
+                           (index_entry_clean(entry, fresh, index_mtime_ns) || hash_file(entry.path) == entry.hash);
+                entry.stat = FileStat();
+            }
+        });
+    }
+    pool.wait();
+
+    std::vector<std::string> removed;
+    for (size_t d = 0; d < dropped.size(); d++) {
+        const std::string& path = entries[dropped[d]].path;
+        if (clean[d]) {
+            removed.push_back(path);
+        } else if (fs::exists(path)) {
+            std::cerr << "Warning: keeping modified " << path << " outside the sparse checkout\n";
+        }
+    }
+    remove_files(removed);
+    std::vector<size_t> pending;
+    for (size_t a = 0; a < added.size(); a++) {
+        if (missing[a]) pending.push_back(added[a]);
+    }
+    bool ok = write_files(entries, pending, pool);
+    save_index(std::move(entries), tx);
+    return ok;
+}
@@ -0,0 +1,57 @@
+// Writing blobs to the working tree and switching it between file lists
+#pragma once
+
+#include "index.h"
+
+// Normalize a user-supplied path to the repository-relative form stored in the index
+std::string normalize_path(const std::string& path);
+
+// Sparse checkout: the working tree holds only the paths these patterns include, while the
+// index still tracks every path, so commits stay complete. Patterns are kept in
+// SPARSE_CHECKOUT_PATH, one per line. A directory includes everything beneath it and, as in
+// Git's cone mode, the files directly inside each directory above it; files at the top level
+// are always included. A pattern with '*', '?' or '[' is matched with glob_match against a
+// path and each directory above it.
+const std::string SPARSE_CHECKOUT_PATH = ".minigit/sparse-checkout";
+
+class SparseCheckout {
+public:
+    // Read the patterns; without the file sparse checkout is off and every path is included
+    void load(const std::string& path = SPARSE_CHECKOUT_PATH);
+
+    // Use these repository-relative patterns
+    void set(const std::vector<std::string>& patterns);
+
+    bool enabled() const { return enabled_; }
+    const std::vector<std::string>& patterns() const { return patterns_; }
+
+    bool includes(std::string_view path) const;
+
+private:
+    bool enabled_ = false;
+    std::vector<std::string> patterns_;
+    std::unordered_set<std::string> dirs_;      // Literal patterns, included with everything beneath
+    std::unordered_set<std::string> parents_;   // Directories whose own files are included ("" is the top)
+    std::vector<std::string> globs_;
+};
+
+// Copy a file into the object store under its hash; a per-thread temp name plus rename
+// keeps concurrent writers of identical content from tripping over each other. False, with
+// the error printed, if the object cannot be written.
+bool write_blob_from_file(const std::string& source, const std::string& hash);
+
+// Move the working tree from the state recorded in the index to target, then make target
+// the index. Only paths that differ are touched: paths target drops are deleted (with any
+// directories left empty), new and changed paths are written, and paths whose content is
+// unchanged are rewritten only if they were modified or deleted on disk. Untracked files
+// are left alone; with fsmonitor running, only the unchanged paths it reports are checked
+// on disk. Paths outside the sparse checkout are neither written nor deleted, and get no
+// stat data in the index. Checks run on a thread pool and writes go through run_io in
+// batches. The new index is staged in tx, which must hold the index lock.
+bool update_working_tree(const FileList& target, const std::string& keep_filename, Transaction& tx);
+
+// Move the working tree from the sparse-checkout patterns in before to those in after
+// without changing the index's content: files after includes that are missing are written,
+// and files it excludes are deleted if they still match the index (modified ones are kept,
+// with a warning). Their stat data is staged in tx, which must hold the index lock.
+bool apply_sparse_checkout(const SparseCheckout& before, const SparseCheckout& after, Transaction& tx);
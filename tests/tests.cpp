@@ -0,0 +1,287 @@
+// MiniGit unit tests: known answers, round trips and merge properties of the core codecs.
+// Build: cmake -S . -B build && cmake --build build --target minigit-tests
+// Run:   ctest --test-dir build, or ./build/minigit-tests [sha256|lz|delta|pack|gc|merge]
+#include "commands.h"
+
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+            failures++;                                                               \
+        }                                                                             \
+    } while (0)
+
+// Silence command output while a test drives MiniGit commands
+struct QuietStdout {
+    std::ostringstream sink;
+    std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+};
+
+// Run a test inside a fresh scratch repository and remove it afterwards
+template <typename F>
+void in_scratch_repo(const std::string& name, F body) {
+    fs::path previous = fs::current_path();
+    fs::path dir = fs::temp_directory_path() / ("minigit-test-" + name);
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::current_path(dir);
+    {
+        QuietStdout quiet;
+        init();
+    }
+    body();
+    fs::current_path(previous);
+    fs::remove_all(dir);
+}
+
+// Random bytes drawn from a small alphabet, so LZ and delta find matches
+static std::string random_text(std::mt19937& rng, size_t size, int alphabet = 8) {
+    std::uniform_int_distribution<int> pick(0, alphabet - 1);
+    std::string out(size, '\0');
+    for (char& c : out) c = static_cast<char>('a' + pick(rng));
+    return out;
+}
+
+// A copy of text with a few random inserts, deletes and overwrites
+static std::string mutate(std::mt19937& rng, std::string text, int edits) {
+    for (int e = 0; e < edits; e++) {
+        size_t at = std::uniform_int_distribution<size_t>(0, text.size())(rng);
+        size_t len = std::uniform_int_distribution<size_t>(1, 64)(rng);
+        switch (rng() % 3) {
+        case 0:
+            text.insert(at, random_text(rng, len, 256));
+            break;
+        case 1:
+            text.erase(at, len);
+            break;
+        default:
+            text.replace(at, len, random_text(rng, len, 256));
+            break;
+        }
+    }
+    return text;
+}
+
+static ObjectId to_object_id(const std::string& hex) {
+    ObjectId id;
+    std::string bytes = hex_to_bytes(hex);
+    std::memcpy(id.data(), bytes.data(), id.size());
+    return id;
+}
+
+// FIPS 180-4 known answers, fed whole and one byte at a time, for every backend this CPU has
+static void test_sha256() {
+    const std::pair<std::string, const char*> vectors[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+         "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+        {std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+    const HashBackend backends[] = {HashBackend::Scalar, HashBackend::ShaNi, HashBackend::Auto};
+    for (HashBackend backend : backends) {
+        if (!sha256_backend(backend)) {
+            std::cout << "sha256: backend " << int(backend) << " unsupported on this CPU, skipped\n";
+            continue;
+        }
+        for (const auto& vector : vectors) {
+            Sha256 whole(backend);
+            whole.update(vector.first);
+            CHECK(hash_to_string(whole.finish()) == vector.second);
+            if (vector.first.size() > 1000) continue;
+            Sha256 bytewise(backend);
+            for (char c : vector.first) bytewise.update(&c, 1);
+            CHECK(hash_to_string(bytewise.finish()) == vector.second);
+        }
+    }
+    CHECK(hash_content("abc") == vectors[1].second);
+}
+
+// Compressed data decompresses to the input; damaged data is rejected or decoded in bounds
+static void test_lz() {
+    std::mt19937 rng(1);
+    for (int round = 0; round < 500; round++) {
+        size_t size = std::uniform_int_distribution<size_t>(0, round < 400 ? 4096 : 200000)(rng);
+        int alphabet = round % 3 == 0 ? 256 : 2 + round % 16;
+        std::string input = random_text(rng, size, alphabet);
+        if (round % 5 == 0) input = mutate(rng, input + input, 4);
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(input.data());
+        std::string compressed = lz_compress(src, input.size());
+        std::string out;
+        CHECK(lz_decompress(reinterpret_cast<const uint8_t*>(compressed.data()), compressed.size(), out, input.size()));
+        CHECK(out == input);
+        if (compressed.empty()) continue;
+        std::string damaged = compressed;
+        damaged[rng() % damaged.size()] ^= static_cast<char>(1 + rng() % 255);
+        std::string ignored;
+        lz_decompress(reinterpret_cast<const uint8_t*>(damaged.data()), damaged.size(), ignored, input.size());
+        damaged = compressed.substr(0, rng() % compressed.size());
+        CHECK(!lz_decompress(reinterpret_cast<const uint8_t*>(damaged.data()), damaged.size(), ignored, input.size()) ||
+              ignored == input);
+    }
+}
+
+// A delta applied to its base rebuilds the target; a different base is refused
+static void test_delta() {
+    std::mt19937 rng(2);
+    for (int round = 0; round < 500; round++) {
+        size_t size = std::uniform_int_distribution<size_t>(0, round < 400 ? 4096 : 100000)(rng);
+        std::string base = random_text(rng, size, round % 2 == 0 ? 256 : 4);
+        std::string target = round % 7 == 0 ? random_text(rng, size / 2, 256) : mutate(rng, base, 1 + round % 20);
+        DeltaIndex index(base);
+        std::string delta = delta_encode(index, target);
+        std::string out;
+        CHECK(delta_apply(base, reinterpret_cast<const uint8_t*>(delta.data()), delta.size(), out));
+        CHECK(out == target);
+        std::string other = base + "x";
+        CHECK(!delta_apply(other, reinterpret_cast<const uint8_t*>(delta.data()), delta.size(), out));
+    }
+}
+
+// Records written through PackWriter read back before and after the pack is finished,
+// including chains of deltas and stored (uncompressed) records
+static void test_pack() {
+    in_scratch_repo("pack", [] {
+        std::mt19937 rng(3);
+        std::vector<std::string> versions{random_text(rng, 20000, 16)};
+        for (int v = 1; v < 40; v++) versions.push_back(mutate(rng, versions.back(), 5));
+        versions.push_back(random_text(rng, 100, 256));
+        versions.push_back("");
+
+        PackWriter writer;
+        CHECK(writer.open("test"));
+        std::vector<std::string> hashes;
+        for (size_t v = 0; v < versions.size(); v++) {
+            const std::string& content = versions[v];
+            hashes.push_back(hash_content(content));
+            ObjectId id = to_object_id(hashes.back());
+            if (writer.contains(id)) continue;
+            std::string record = pack_record(content, v % 2 == 0);
+            if (v > 0 && v < 40) {
+                std::unique_ptr<DeltaIndex> index;
+                std::string delta = delta_record(hex_to_bytes(hashes[v - 1]), versions[v - 1], index, content);
+                CHECK(!delta.empty());
+                if (delta.size() < record.size()) record = std::move(delta);
+            }
+            writer.append(id, record);
+            std::string out;
+            CHECK(writer.read(id, out) && out == content);
+        }
+        CHECK(writer.count() == versions.size());
+        std::string name = writer.finish();
+        CHECK(!name.empty());
+        CHECK(fs::exists(PACK_DIR + "/" + name + ".pack") && fs::exists(PACK_DIR + "/" + name + ".idx"));
+        PackStore::instance().reload();
+        for (size_t v = 0; v < versions.size(); v++) {
+            std::string out;
+            CHECK(PackStore::instance().contains(hashes[v]));
+            CHECK(read_object(hashes[v], out) && out == versions[v]);
+        }
+        CHECK(!PackStore::instance().contains(hash_content("not stored")));
+        PackStore::instance().reload();
+    });
+}
+
+// gc packs loose objects, delta-compressing similar ones, and every object still reads back
+static void test_gc() {
+    in_scratch_repo("gc", [] {
+        std::mt19937 rng(4);
+        std::vector<std::string> versions{random_text(rng, 50000, 16)};
+        for (int v = 1; v < 30; v++) versions.push_back(mutate(rng, versions.back(), 3));
+        std::vector<std::string> hashes;
+        for (const std::string& content : versions) {
+            hashes.push_back(write_object(content));
+            CHECK(!hashes.back().empty());
+        }
+        {
+            QuietStdout quiet;
+            gc();
+        }
+        uint64_t packed = 0;
+        for (const auto& entry : fs::directory_iterator(PACK_DIR)) {
+            if (entry.path().extension() == ".pack") packed += entry.file_size();
+        }
+        CHECK(packed > 0 && packed < versions[0].size() * versions.size() / 4);
+        for (size_t v = 0; v < versions.size(); v++) {
+            std::string out;
+            CHECK(!fs::exists(loose_object_path(hashes[v])));
+            CHECK(read_object(hashes[v], out) && out == versions[v]);
+        }
+        PackStore::instance().reload();
+    });
+}
+
+// Lines drawn from a small set, so merges see repeated and shifted lines
+static std::string random_lines(std::mt19937& rng, size_t lines) {
+    std::string out;
+    for (size_t i = 0; i < lines; i++) out += "line " + std::to_string(rng() % 12) + "\n";
+    return out;
+}
+
+static std::string edit_lines(std::mt19937& rng, const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line);) lines.push_back(line + "\n");
+    int edits = 1 + static_cast<int>(rng() % 4);
+    for (int e = 0; e < edits; e++) {
+        size_t at = lines.empty() ? 0 : rng() % (lines.size() + 1);
+        if (rng() % 2 == 0 || at == lines.size()) {
+            lines.insert(lines.begin() + static_cast<std::ptrdiff_t>(at), "new " + std::to_string(rng() % 100) + "\n");
+        } else {
+            lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(at));
+        }
+    }
+    std::string out;
+    for (const std::string& line : lines) out += line;
+    return out;
+}
+
+// A side that did not change takes the other side; identical changes merge cleanly
+static void test_merge() {
+    std::mt19937 rng(5);
+    for (int round = 0; round < 1000; round++) {
+        std::string base = random_lines(rng, rng() % 40);
+        std::string changed = edit_lines(rng, base);
+        std::string out;
+        CHECK(merge_texts(base, changed, base, "ours", "theirs", out) == 0);
+        CHECK(out == changed);
+        out.clear();
+        CHECK(merge_texts(base, base, changed, "ours", "theirs", out) == 0);
+        CHECK(out == changed);
+        out.clear();
+        CHECK(merge_texts(base, changed, changed, "ours", "theirs", out) == 0);
+        CHECK(out == changed);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const std::pair<const char*, void (*)()> tests[] = {
+        {"sha256", test_sha256},
+        {"lz", test_lz},
+        {"delta", test_delta},
+        {"pack", test_pack},
+        {"gc", test_gc},
+        {"merge", test_merge},
+    };
+    std::string which = argc > 1 ? argv[1] : "all";
+    bool found = false;
+    for (const auto& test : tests) {
+        if (which != "all" && which != test.first) continue;
+        found = true;
+        int before = failures;
+        test.second();
+        std::cout << test.first << ": " << (failures == before ? "ok" : "FAILED") << "\n";
+    }
+    if (!found) {
+        std::cerr << "Usage: minigit-tests [all|sha256|lz|delta|pack|gc|merge]\n";
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}